@@ -0,0 +1,2696 @@
+//
+//  paintbench.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Command line benchmark for the portable parts of the drawing pipeline. It needs nothing but
+//  a C99 compiler and runs on the Mac as well as on a plain Linux box:
+//
+//      cc -O2 -march=native -std=gnu99 -I "pulsedTouch Demo with Finger/Classes/Model"
+//         Tools/paintbench.c "pulsedTouch Demo with Finger/Classes/Model/"*.c -lm -lpthread -o paintbench
+//      ./paintbench spline
+//      ./paintbench subdivide ["Touch protocol.ptrc"|-] [tolerance] [maxSplinePoints]
+//      ./paintbench predict ["Touch protocol.ptrc"|-] [noise] [lookahead ms …]
+//      ./paintbench recorder
+//      ./paintbench strokefile ["Touch protocol.ptrc"|-] [path]
+//      ./paintbench tiles
+//      ./paintbench touches
+//      ./paintbench lines
+//      ./paintbench index [strokes] [queries]
+//      ./paintbench raster [strokes] [threads]
+//      ./paintbench document [strokes] [path]
+//      ./paintbench tilestore [strokes] [budget kB]
+//      ./paintbench load [lines concurrent sampleRate touches [recording.ptrc]]
+//      ./paintbench pipeline
+//      ./paintbench outline ["Touch protocol.ptrc"|-]
+//      ./paintbench timeline [keyframe interval s] [minutes …]
+//      ./paintbench suite [results.jsonl|-] [baseline.jsonl] [tolerance %]
+//
+//  Every benchmark verifies its results before it measures anything and exits with status 1
+//  if the check fails, so the tool doubles as a unit test of the kernel.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "PaintSplineKernel.h"
+#include "PaintLineTable.h"
+#include "PaintPredictor.h"
+#include "PaintRasterizer.h"
+#include "PaintStrokeFile.h"
+#include "PaintStrokeIndex.h"
+#include "PaintStrokePipeline.h"
+#include "PaintStrokeStore.h"
+#include "PaintStrokeTimeline.h"
+#include "PaintTileGrid.h"
+#include "PaintTileStore.h"
+#include "PaintTouchColumns.h"
+#include "PaintTouchLoad.h"
+#include "PaintTouchRecorder.h"
+
+#pragma mark - Helpers
+
+static double PaintBenchNow(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+// Allocations of the code under test. glibc lets a program replace malloc(), so every call is
+// counted on its way to the one of the C library; elsewhere nothing is counted.
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void  __libc_free(void *pointer);
+
+static uint64_t PaintBenchAllocations;
+
+void *malloc(size_t size) {
+    
+    __atomic_fetch_add(&PaintBenchAllocations, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    
+    __atomic_fetch_add(&PaintBenchAllocations, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    
+    __atomic_fetch_add(&PaintBenchAllocations, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer) {
+    __libc_free(pointer);
+}
+#endif
+
+// Allocations so far, or -1 where they are not counted:
+
+static int64_t PaintBenchAllocationCount(void) {
+
+#ifdef __GLIBC__
+    return (int64_t)__atomic_load_n(&PaintBenchAllocations, __ATOMIC_RELAXED);
+#else
+    return -1;
+#endif
+}
+
+// A synthetic handwriting trace: loops of varying radius, sampled at 240 Hz.
+
+typedef struct PaintBenchTouch {
+    PaintPoint point;
+    PaintPoint velocity;
+    double     timestamp;
+} PaintBenchTouch;
+
+static PaintBenchTouch *PaintBenchTrace(size_t count) {
+    
+    PaintBenchTouch *trace = calloc(count, sizeof(PaintBenchTouch));
+    for (size_t n = 0; n < count; n++) {
+        double t           = n / 240.0;
+        trace[n].timestamp = t;
+        trace[n].point.x   = 100.0 + 40.0 * t + 25.0 * cos(9.0 * t) * (1.0 + 0.3 * sin(1.3 * t));
+        trace[n].point.y   = 300.0 + 30.0 * sin(9.0 * t);
+        if (n > 0) {
+            double dt            = trace[n].timestamp - trace[n-1].timestamp;
+            trace[n].velocity.x  = (trace[n].point.x - trace[n-1].point.x) / dt;
+            trace[n].velocity.y  = (trace[n].point.y - trace[n-1].point.y) / dt;
+        }
+    }
+    return trace;
+}
+
+// Tessellate a trace the way -[PaintSplines splineIncrement:forLine:toPoints:] does.
+// With boxed set, every vertex is copied into its own heap block like the former NSValue array.
+
+static size_t PaintBenchTessellate(const PaintBenchTouch *trace, size_t count, size_t maxSplinePoints,
+                                   int boxed, PaintPoint *out) {
+    
+    size_t written = 0;
+    PaintSplineSegment segment;
+    for (size_t n = 3; n < count; n++) {
+        const PaintBenchTouch *tp1 = &trace[n-2], *tp2 = &trace[n-1];
+        double divisions = (tp2->velocity.x + tp2->velocity.y) / (tp2->timestamp - tp1->timestamp);
+        size_t interpol  = PaintSplineInterpolation(&divisions, maxSplinePoints);
+        PaintSplineSegmentMake(&segment, trace[n-3].point, tp1->point, tp2->point, trace[n].point);
+        out[written++]   = PaintSplineSegmentStart(&segment);
+        written         += PaintSplineSegmentEvaluate(&segment, divisions, interpol, out + written);
+    }
+    if (boxed) {
+        PaintPoint **boxes = malloc(written * sizeof(PaintPoint *));
+        for (size_t i = 0; i < written; i++) {
+            boxes[i]  = malloc(sizeof(PaintPoint));
+            *boxes[i] = out[i];
+        }
+        for (size_t i = 0; i < written; i++) {
+            out[i] = *boxes[i];
+            free(boxes[i]);
+        }
+        free(boxes);
+    }
+    return written;
+}
+
+// Feed a trace through a spline stream in increments of the given size.
+
+static size_t PaintBenchStream(const PaintBenchTouch *trace, size_t count, size_t maxSplinePoints,
+                               size_t increment, PaintPoint *out) {
+    
+    PaintSplineStream stream;
+    PaintSplineStreamInit(&stream);
+    PaintSplineControl control[64];
+    size_t written = 0;
+    for (size_t n = 0; n < count; n += increment) {
+        size_t length = (count - n < increment) ? count - n : increment;
+        for (size_t i = 0; i < length; i++) {
+            control[i].point     = trace[n + i].point;
+            control[i].velocity  = trace[n + i].velocity;
+            control[i].timestamp = trace[n + i].timestamp;
+        }
+        // Each increment repeats the point where the previous one stopped:
+        size_t skip = (written > 0) ? 1 : 0;
+        written    += PaintSplineStreamFeed(&stream, control, length, maxSplinePoints, out + written - skip) - skip;
+    }
+    return written;
+}
+
+#pragma mark - Benchmarks
+
+static int PaintBenchSpline(int argc, char **argv) {
+    
+    size_t touches         = argc > 0 ? strtoul(argv[0], NULL, 10) : 100000;
+    size_t maxSplinePoints = argc > 1 ? strtoul(argv[1], NULL, 10) : 5;
+    PaintBenchTouch *trace = PaintBenchTrace(touches);
+    PaintPoint *reference  = malloc((touches + 1) * (maxSplinePoints + 1) * sizeof(PaintPoint));
+    PaintPoint *out        = malloc((touches + 1) * (maxSplinePoints + 1) * sizeof(PaintPoint));
+    
+    // The stream must not depend on how the line is cut into increments:
+    size_t expected = PaintBenchStream(trace, touches, maxSplinePoints, 1, reference);
+    for (size_t increment = 2; increment <= 16; increment++) {
+        size_t written = PaintBenchStream(trace, touches, maxSplinePoints, increment, out);
+        if (written != expected || memcmp(out, reference, written * sizeof(PaintPoint)) != 0) {
+            fprintf(stderr, "spline: stream output differs for increments of %zu\n", increment);
+            return 1;
+        }
+    }
+    
+    const char *names[2] = { "boxed", "unboxed" };
+    for (int variant = 0; variant < 2; variant++) {
+        size_t vertices = 0;
+        double start    = PaintBenchNow();
+        double elapsed  = 0.0;
+        do {
+            vertices += PaintBenchTessellate(trace, touches, maxSplinePoints, variant == 0, out);
+            elapsed   = PaintBenchNow() - start;
+        } while (elapsed < 0.5);
+        printf("spline %-7s %11.0f vertices/s\n", names[variant], vertices / elapsed);
+    }
+    for (size_t increment = 1; increment <= 16; increment *= 4) {
+        size_t vertices = 0;
+        double start    = PaintBenchNow();
+        double elapsed  = 0.0;
+        do {
+            vertices += PaintBenchStream(trace, touches, maxSplinePoints, increment, out);
+            elapsed   = PaintBenchNow() - start;
+        } while (elapsed < 0.5);
+        printf("spline stream/%-2zu %9.0f vertices/s\n", increment, vertices / elapsed);
+    }
+    
+    free(out);
+    free(reference);
+    free(trace);
+    return 0;
+}
+
+#pragma mark - Touch recorder
+
+// Distance of a point from the polyline out[0 … count-1]:
+
+static double PaintBenchDistance(PaintPoint p, const PaintPoint *out, size_t count) {
+    
+    double best = hypot(p.x - out[0].x, p.y - out[0].y);
+    for (size_t i = 0; i + 1 < count; i++) {
+        double dx = out[i+1].x - out[i].x, dy = out[i+1].y - out[i].y;
+        double length = dx * dx + dy * dy;
+        double u      = length > 0.0 ? ((p.x - out[i].x) * dx + (p.y - out[i].y) * dy) / length : 0.0;
+        u             = u < 0.0 ? 0.0 : (u > 1.0 ? 1.0 : u);
+        best          = fmin(best, hypot(p.x - out[i].x - u * dx, p.y - out[i].y - u * dy));
+    }
+    return best;
+}
+
+// Feed a line one touch at a time, so each output belongs to exactly one segment, and measure
+// how far the segment strays from the points written for it:
+
+static void PaintBenchSubdivideLine(const PaintSplineControl *controls, size_t count, double tolerance,
+                                    size_t maxSplinePoints, size_t *vertices, size_t *segments, double *deviation) {
+    
+    PaintSplineStream stream;
+    PaintSplineStreamInit(&stream);
+    PaintSplineStreamSetTolerance(&stream, tolerance);
+    PaintPoint out[maxSplinePoints + 2];
+    for (size_t n = 0; n < count; n++) {
+        size_t written = PaintSplineStreamFeed(&stream, &controls[n], 1, maxSplinePoints, out);
+        if (stream.count < 2) {
+            *vertices += written;
+            continue;
+        }
+        *vertices += written - 1;
+        (*segments)++;
+        
+        PaintSplineSegment segment;
+        PaintSplineSegmentMake(&segment, stream.control[0].point, stream.control[1].point,
+                               stream.control[2].point, stream.control[3].point);
+        for (int k = 1; k < 64; k++) {
+            double t     = k / 64.0;
+            PaintPoint p = { (PaintFloat)(((segment.c0x * t + segment.c1x) * t + segment.c2x) * t + segment.c3x),
+                             (PaintFloat)(((segment.c0y * t + segment.c1y) * t + segment.c2y) * t + segment.c3y) };
+            *deviation   = fmax(*deviation, PaintBenchDistance(p, out, written));
+        }
+    }
+}
+
+// Compare the vertex count and the deviation of the velocity heuristic with the error-bounded
+// subdivision, over the pen and finger lines of a recording or over the synthetic trace.
+
+typedef struct PaintBenchLineTouch {
+    uint32_t           lineID;
+    size_t             index;               // Order in the recording
+    PaintSplineControl control;
+} PaintBenchLineTouch;
+
+static int PaintBenchCompareLineTouches(const void *a, const void *b) {
+    
+    const PaintBenchLineTouch *x = a, *y = b;
+    if (x->lineID != y->lineID) return x->lineID < y->lineID ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+// Pen and finger touches of a recording, without palm touches and extrapolated points, or of
+// the synthetic trace in lines of one second. The lines of a recording interleave, each one is
+// put in a row. Returns NULL if there are none:
+
+static PaintBenchLineTouch *PaintBenchLineTouches(const char *command, const char *path, size_t *count) {
+    
+    size_t capacity = 0;
+    PaintBenchLineTouch *touches = NULL;
+    *count = 0;
+    if (path) {
+        FILE *file = PaintTouchRecordOpen(path);
+        if (!file) {
+            fprintf(stderr, "%s: %s is no recording\n", command, path);
+            return NULL;
+        }
+        PaintTouchRecord record;
+        while (PaintTouchRecordRead(file, &record, 1) == 1) {
+            if ((record.kind & PaintTouchRecordKindMask) != PaintTouchRecordTouch || record.classification >= 3) continue;
+            if (*count == capacity) {
+                capacity = capacity ? 2 * capacity : 4096;
+                touches  = realloc(touches, capacity * sizeof(PaintBenchLineTouch));
+            }
+            touches[*count] = (PaintBenchLineTouch){ record.lineID, *count,
+                { { record.x, record.y }, { record.vx, record.vy }, record.timestamp } };
+            (*count)++;
+        }
+        fclose(file);
+    } else {
+        *count = 24000;
+        PaintBenchTouch *trace = PaintBenchTrace(*count);
+        touches = malloc(*count * sizeof(PaintBenchLineTouch));
+        for (size_t n = 0; n < *count; n++) {
+            touches[n] = (PaintBenchLineTouch){ (uint32_t)(n / 240), n,
+                                                { trace[n].point, trace[n].velocity, trace[n].timestamp } };
+        }
+        free(trace);
+    }
+    if (*count == 0) {
+        fprintf(stderr, "%s: no touches\n", command);
+        free(touches);
+        return NULL;
+    }
+    qsort(touches, *count, sizeof(PaintBenchLineTouch), PaintBenchCompareLineTouches);
+    return touches;
+}
+
+static int PaintBenchSubdivide(int argc, char **argv) {
+    
+    const char *path       = argc > 0 && strcmp(argv[0], "-") != 0 ? argv[0] : NULL;
+    double tolerance       = argc > 1 ? strtod(argv[1], NULL) : 0.25;
+    size_t maxSplinePoints = argc > 2 ? strtoul(argv[2], NULL, 10) : 5;
+    size_t count;
+    PaintBenchLineTouch *touches = PaintBenchLineTouches("subdivide", path, &count);
+    if (!touches) {
+        return 1;
+    }
+    PaintSplineControl *controls = malloc(count * sizeof(PaintSplineControl));
+    
+    double tolerances[2] = { 0.0, tolerance };
+    for (int mode = 0; mode < 2; mode++) {
+        size_t vertices = 0, segments = 0, lines = 0;
+        double deviation = 0.0;
+        for (size_t first = 0; first < count; lines++) {
+            size_t length = 0;
+            do {
+                controls[length] = touches[first + length].control;
+                length++;
+            } while (first + length < count && touches[first + length].lineID == touches[first].lineID);
+            PaintBenchSubdivideLine(controls, length, tolerances[mode], maxSplinePoints, &vertices, &segments, &deviation);
+            first += length;
+        }
+        printf("subdivide %-9s %6zu lines, %8zu vertices, %5.2f per segment, max deviation %6.3f pt\n",
+               mode ? "tolerance" : "velocity", lines, vertices, segments ? (double)vertices / segments : 0.0, deviation);
+    }
+    
+    free(controls);
+    free(touches);
+    return 0;
+}
+
+#pragma mark - Motion prediction
+
+// Lookaheads compared at most, in ms:
+#define PREDICT_LOOKAHEADS 8
+
+typedef struct PaintBenchPredictionError {
+    double *errors;                         // Distance from the true position, by touch
+    size_t  count;
+    double  overshoot;                      // Sum of the distances ahead of it along the line
+} PaintBenchPredictionError;
+
+// Where the line really was at time t, between the touches j and j + 1, and the direction it
+// went:
+
+static PaintPoint PaintBenchTruth(const PaintSplineControl *controls, size_t j, double t, PaintPoint *direction) {
+    
+    const PaintSplineControl *a = &controls[j], *b = &controls[j + 1];
+    double dt     = b->timestamp - a->timestamp;
+    double u      = dt > 0.0 ? (t - a->timestamp) / dt : 1.0;
+    double dx     = b->point.x - a->point.x, dy = b->point.y - a->point.y;
+    double length = hypot(dx, dy);
+    *direction    = length > 0.0 ? (PaintPoint){ (PaintFloat)(dx / length), (PaintFloat)(dy / length) }
+                                 : (PaintPoint){ 0.0, 0.0 };
+    return (PaintPoint){ (PaintFloat)(a->point.x + u * dx), (PaintFloat)(a->point.y + u * dy) };
+}
+
+// Feed a line touch by touch. After each touch every lookahead is predicted and compared with
+// the position the later touches show, as long as the line lasts that long:
+
+static void PaintBenchPredictLine(const PaintSplineControl *controls, size_t count, const PaintPredictorConfig *config,
+                                  const double *lookaheads, size_t lookaheadCount, PaintBenchPredictionError *errors) {
+    
+    PaintPredictor predictor;
+    PaintPredictorInit(&predictor, config);
+    size_t truth[PREDICT_LOOKAHEADS] = { 0 };
+    for (size_t n = 0; n < count; n++) {
+        PaintPredictorUpdate(&predictor, &controls[n]);
+        for (size_t k = 0; k < lookaheadCount; k++) {
+            double t = controls[n].timestamp + lookaheads[k];
+            if (t > controls[count - 1].timestamp) continue;
+            
+            while (truth[k] + 2 < count && controls[truth[k] + 1].timestamp <= t) truth[k]++;
+            if (truth[k] + 1 >= count) continue;
+            
+            PaintPoint direction, predicted;
+            PaintPoint real = PaintBenchTruth(controls, truth[k], t, &direction);
+            PaintPredictorPredict(&predictor, lookaheads[k], &predicted);
+            double ahead    = (predicted.x - real.x) * direction.x + (predicted.y - real.y) * direction.y;
+            errors[k].errors[errors[k].count++] = hypot(predicted.x - real.x, predicted.y - real.y);
+            errors[k].overshoot += ahead > 0.0 ? ahead : 0.0;
+        }
+    }
+}
+
+static int PaintBenchCompareDoubles(const void *a, const void *b) {
+    
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : (x > y);
+}
+
+// The finite difference predictors must be exact where their model holds: on a straight line
+// at constant speed, and for constant acceleration on a parabola:
+
+static int PaintBenchPredictCheck(void) {
+    
+    PaintSplineControl controls[8];
+    for (int n = 0; n < 8; n++) {
+        double t    = n / 240.0;
+        controls[n] = (PaintSplineControl){ { (PaintFloat)(100.0 + 300.0 * t), (PaintFloat)(200.0 + 800.0 * t * t) },
+                                            { 0.0, 0.0 }, t };
+    }
+    double lookahead = 0.016;
+    double x = 100.0 + 300.0 * (7 / 240.0 + lookahead), y = 200.0 + 800.0 * pow(7 / 240.0 + lookahead, 2.0);
+    PaintPoint velocity, acceleration;
+    PaintPredictorConfig config = PaintPredictorConfigDefault(PaintPredictorConstantVelocity, lookahead);
+    PaintPredictor predictor;
+    PaintPredictorInit(&predictor, &config);
+    for (int n = 0; n < 8; n++) PaintPredictorUpdate(&predictor, &controls[n]);
+    PaintPredictorPredict(&predictor, lookahead, &velocity);
+    config.kind = PaintPredictorConstantAcceleration;
+    PaintPredictorInit(&predictor, &config);
+    for (int n = 0; n < 8; n++) PaintPredictorUpdate(&predictor, &controls[n]);
+    PaintPredictorPredict(&predictor, lookahead, &acceleration);
+    if (fabs(velocity.x - x) > 1e-3 || fabs(acceleration.x - x) > 1e-3 || fabs(acceleration.y - y) > 1e-3) {
+        fprintf(stderr, "predict: (%.3f %.3f) and (%.3f %.3f) instead of (%.3f %.3f)\n",
+                velocity.x, velocity.y, acceleration.x, acceleration.y, x, y);
+        return 1;
+    }
+    return 0;
+}
+
+// Compare the predictors over the lines of a recording or over the synthetic trace, for each
+// lookahead: how far the predicted pen position is from the one the later touches show, and
+// how much of that is ahead of the pen, where the tail overshoots. noise, in points, jitters
+// the touches like a digitizer would.
+
+static int PaintBenchPredict(int argc, char **argv) {
+    
+    if (PaintBenchPredictCheck() != 0) {
+        return 1;
+    }
+    const char *path = argc > 0 && strcmp(argv[0], "-") != 0 ? argv[0] : NULL;
+    double noise     = argc > 1 ? strtod(argv[1], NULL) : 0.0;
+    double lookaheads[PREDICT_LOOKAHEADS] = { 0.008, 0.016, 0.024, 0.032, 0.048 };
+    size_t lookaheadCount = 5;
+    if (argc > 2) {
+        for (lookaheadCount = 0; lookaheadCount < PREDICT_LOOKAHEADS && 2 + lookaheadCount < (size_t)argc; lookaheadCount++) {
+            lookaheads[lookaheadCount] = 1e-3 * strtod(argv[2 + lookaheadCount], NULL);
+        }
+    }
+    size_t count;
+    PaintBenchLineTouch *touches = PaintBenchLineTouches("predict", path, &count);
+    if (!touches) {
+        return 1;
+    }
+    uint32_t random = 12345;
+    PaintSplineControl *controls = malloc(count * sizeof(PaintSplineControl));
+    for (size_t n = 0; n < count; n++) {
+        controls[n] = touches[n].control;
+        for (int axis = 0; axis < 2 && noise > 0.0; axis++) {
+            double jitter = 0.0;
+            for (int i = 0; i < 4; i++) {
+                random  = random * 1664525u + 1013904223u;
+                jitter += random / 4294967296.0 - 0.5;
+            }
+            if (axis == 0) controls[n].point.x += (PaintFloat)(noise * jitter);
+            else           controls[n].point.y += (PaintFloat)(noise * jitter);
+        }
+    }
+    
+    PaintBenchPredictionError errors[PaintPredictorKinds][PREDICT_LOOKAHEADS];
+    for (int kind = 0; kind < PaintPredictorKinds; kind++) {
+        PaintPredictorConfig config = PaintPredictorConfigDefault((PaintPredictorKind)kind, lookaheads[0]);
+        for (size_t k = 0; k < lookaheadCount; k++) {
+            errors[kind][k] = (PaintBenchPredictionError){ malloc(count * sizeof(double)), 0, 0.0 };
+        }
+        for (size_t first = 0, length; first < count; first += length) {
+            for (length = 1; first + length < count && touches[first + length].lineID == touches[first].lineID; length++);
+            PaintBenchPredictLine(controls + first, length, &config, lookaheads, lookaheadCount, errors[kind]);
+        }
+        
+        // What the engine pays for it: one update and one prediction per touch:
+        PaintPredictor predictor;
+        PaintPoint predicted;
+        volatile double sink = 0.0;
+        double start         = PaintBenchNow();
+        for (size_t n = 0; n < count; n++) {
+            if (n == 0 || touches[n].lineID != touches[n - 1].lineID) PaintPredictorInit(&predictor, &config);
+            PaintPredictorUpdate(&predictor, &controls[n]);
+            PaintPredictorPredict(&predictor, config.lookahead, &predicted);
+            sink += predicted.x;
+        }
+        double elapsed = PaintBenchNow() - start;
+        printf("predict %-12s %6.1f ns per touch\n", PaintPredictorName((PaintPredictorKind)kind), 1e9 * elapsed / count);
+    }
+    for (size_t k = 0; k < lookaheadCount; k++) {
+        for (int kind = 0; kind < PaintPredictorKinds; kind++) {
+            PaintBenchPredictionError *error = &errors[kind][k];
+            double sum = 0.0;
+            for (size_t n = 0; n < error->count; n++) sum += error->errors[n];
+            qsort(error->errors, error->count, sizeof(double), PaintBenchCompareDoubles);
+            double count = error->count ? (double)error->count : 1.0;
+            printf("predict %3.0f ms %-12s mean %6.2f  p95 %6.2f  max %7.2f  overshoot %6.2f pt (%zu touches)\n",
+                   1e3 * lookaheads[k], PaintPredictorName((PaintPredictorKind)kind), sum / count,
+                   error->count ? error->errors[(size_t)(0.95 * (error->count - 1))] : 0.0,
+                   error->count ? error->errors[error->count - 1] : 0.0, error->overshoot / count, error->count);
+            free(error->errors);
+        }
+    }
+    free(controls);
+    free(touches);
+    return 0;
+}
+
+// Record a trace in increments of eight touches the way the app does, read it back and compare.
+// The app never waits for the writer; here the producer retries when the ring is full, so the
+// rate is what the writer thread sustains end to end.
+
+static int PaintBenchRecorder(int argc, char **argv) {
+    
+    size_t touches         = argc > 0 ? strtoul(argv[0], NULL, 10) : 1000000;
+    const char *path       = argc > 1 ? argv[1] : "/tmp/paintbench.ptrc";
+    PaintBenchTouch *trace = PaintBenchTrace(touches);
+    PaintTouchRecord *records = calloc(touches, sizeof(PaintTouchRecord));
+    for (size_t n = 0; n < touches; n++) {
+        records[n].timestamp      = trace[n].timestamp;
+        records[n].x              = (float)trace[n].point.x;
+        records[n].y              = (float)trace[n].point.y;
+        records[n].vx             = (float)trace[n].velocity.x;
+        records[n].vy             = (float)trace[n].velocity.y;
+        records[n].lineID         = (uint32_t)(n / 500);
+        records[n].classification = 1;
+        records[n].state          = (n % 500 == 0) ? 1 : 2;
+        records[n].phase          = 2;
+    }
+    
+    PaintTouchRecorder *recorder = PaintTouchRecorderOpen(path, 16384);
+    if (!recorder) {
+        perror(path);
+        return 1;
+    }
+    double start = PaintBenchNow();
+    for (size_t n = 0; n < touches; ) {
+        n += PaintTouchRecorderAppend(recorder, records + n, touches - n < 8 ? touches - n : 8);
+    }
+    size_t dropped = PaintTouchRecorderDropped(recorder);
+    if (PaintTouchRecorderClose(recorder) != 0) {
+        fprintf(stderr, "recorder: writing %s failed\n", path);
+        return 1;
+    }
+    double elapsed = PaintBenchNow() - start;
+    printf("recorder %12.0f records/s (%.1f MB/s), %zu full ring retries\n",
+           touches / elapsed, touches * sizeof(PaintTouchRecord) / elapsed / 1e6, dropped);
+    
+    // Everything must be on disk in the same order:
+    FILE *file = PaintTouchRecordOpen(path);
+    if (!file) {
+        fprintf(stderr, "recorder: %s is no recording\n", path);
+        return 1;
+    }
+    PaintTouchRecord *check = malloc((touches + 1) * sizeof(PaintTouchRecord));
+    size_t read             = PaintTouchRecordRead(file, check, touches + 1);
+    fclose(file);
+    if (read != touches || memcmp(check, records, touches * sizeof(PaintTouchRecord)) != 0) {
+        fprintf(stderr, "recorder: read back %zu records, they differ from the %zu written\n", read, touches);
+        return 1;
+    }
+    
+    free(check);
+    free(records);
+    free(trace);
+    return 0;
+}
+
+// Convert the lines of a recording or the synthetic trace to timed strokes, write them to a
+// stroke file and read them back, each one on its own and in reverse order. Every point must come
+// back within half a grid step and every timestamp within a microsecond; reports the bytes per
+// point against the record of the touch recorder.
+
+static int PaintBenchStrokeFile(int argc, char **argv) {
+    
+    const char *source = argc > 0 && strcmp(argv[0], "-") != 0 ? argv[0] : NULL;
+    const char *path   = argc > 1 ? argv[1] : "/tmp/paintbench.pstk";
+    size_t count;
+    PaintBenchLineTouch *touches = PaintBenchLineTouches("strokefile", source, &count);
+    if (!touches) {
+        return 1;
+    }
+    PaintStoredPoint *points = malloc(count * sizeof(PaintStoredPoint));
+    double *timestamps       = malloc(count * sizeof(double));
+    size_t *starts           = malloc((count + 1) * sizeof(size_t));
+    size_t lines             = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (n == 0 || touches[n].lineID != touches[n - 1].lineID) starts[lines++] = n;
+        points[n]     = (PaintStoredPoint){ (float)touches[n].control.point.x, (float)touches[n].control.point.y };
+        timestamps[n] = touches[n].control.timestamp;
+    }
+    starts[lines] = count;
+    free(touches);
+    
+    PaintLineStyle style = PaintLineStyleDefault();
+    double start = PaintBenchNow();
+    PaintStrokeWriter *writer = PaintStrokeWriterCreate(path, PAINT_STROKE_FILE_GRID);
+    if (!writer) {
+        perror(path);
+        return 1;
+    }
+    for (size_t line = 0; line < lines; line++) {
+        PaintStrokeData data = { style, points + starts[line], timestamps + starts[line], starts[line + 1] - starts[line], NULL };
+        PaintStrokeWriterAppend(writer, &data);
+    }
+    uint64_t bytes = PaintStrokeWriterBytes(writer);
+    if (PaintStrokeWriterClose(writer) != 0) {
+        fprintf(stderr, "strokefile: writing %s failed\n", path);
+        return 1;
+    }
+    double written = PaintBenchNow() - start;
+    
+    PaintStrokeReader *reader = PaintStrokeReaderOpen(path);
+    if (!reader || PaintStrokeReaderCount(reader) != lines) {
+        fprintf(stderr, "strokefile: %s is no stroke file of %zu strokes\n", path, lines);
+        return 1;
+    }
+    PaintStoredPoint *readPoints = malloc(count * sizeof(PaintStoredPoint));
+    double *readTimestamps       = malloc(count * sizeof(double));
+    double deviation = 0.0, skew = 0.0;
+    start = PaintBenchNow();
+    for (size_t line = lines; line-- > 0; ) {
+        size_t length        = starts[line + 1] - starts[line];
+        PaintStrokeData data = { .points = readPoints, .timestamps = readTimestamps };
+        if (PaintStrokeReaderPointCount(reader, line) != length
+            || PaintStrokeReaderRead(reader, line, &data, count) != (long)length || !data.timestamps) {
+            fprintf(stderr, "strokefile: stroke %zu does not read back\n", line);
+            return 1;
+        }
+        for (size_t n = 0; n < length; n++) {
+            deviation = fmax(deviation, fabs(readPoints[n].x - points[starts[line] + n].x));
+            deviation = fmax(deviation, fabs(readPoints[n].y - points[starts[line] + n].y));
+            skew      = fmax(skew, fabs(readTimestamps[n] - timestamps[starts[line] + n]));
+        }
+    }
+    double read = PaintBenchNow() - start;
+    PaintStrokeReaderClose(reader);
+    if (deviation > 0.5 / PAINT_STROKE_FILE_GRID + 1e-4 || skew > 1e-6) {
+        fprintf(stderr, "strokefile: points off by %.4f pt, timestamps by %.2f µs\n", deviation, 1e6 * skew);
+        return 1;
+    }
+    
+    printf("strokefile %6zu strokes, %8zu points, %5.2f bytes per point (record %zu), max deviation %.4f pt\n",
+           lines, count, (double)bytes / count, sizeof(PaintTouchRecord), deviation);
+    printf("strokefile write %6.1f M points/s, read %6.1f M points/s\n", count / written / 1e6, count / read / 1e6);
+    
+    free(readTimestamps);
+    free(readPoints);
+    free(starts);
+    free(timestamps);
+    free(points);
+    return 0;
+}
+
+// Commit strokes of half a second each, written line by line across an iPad canvas, and present
+// the dirty tiles after every commit the way PaintView does. Compares the bytes copied with the
+// full canvas image that drawRect: used to copy for every commit.
+
+static int PaintBenchTiles(int argc, char **argv) {
+    
+    size_t strokes   = argc > 0 ? strtoul(argv[0], NULL, 10) : 10000;
+    double tileSize  = argc > 1 ? strtod(argv[1], NULL) : 128.0;
+    double lineWidth = 5.0;
+    size_t length    = 120;
+    PaintBenchTouch *trace = PaintBenchTrace(length);
+    
+    PaintTileGrid grid;
+    if (tileSize <= 0.0 || PaintTileGridInit(&grid, 1024.0, 768.0, tileSize, 2.0) != 0) {
+        fprintf(stderr, "tiles: no grid with tile size %g\n", tileSize);
+        return 1;
+    }
+    size_t canvasBytes = 4 * 2048 * 1536;
+    
+    // The tiles must cover the canvas exactly, and a small rect inside one tile touches only that:
+    size_t total = 0;
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        total += PaintTileGridTileBytes(&grid, index);
+    }
+    for (size_t index = PaintTileGridNextDirty(&grid, 0); index < PaintTileGridCount(&grid);
+         index = PaintTileGridNextDirty(&grid, index + 1)) {
+        PaintTileGridPresented(&grid, index);
+    }
+    if (total != canvasBytes || grid.bytesPresented != canvasBytes || grid.dirtyCount != 0 ||
+        PaintTileGridMarkRect(&grid, 1.0, 1.0, 2.0, 2.0) != 1 || PaintTileGridNextDirty(&grid, 0) != 0) {
+        fprintf(stderr, "tiles: the grid does not cover the canvas\n");
+        return 1;
+    }
+    PaintTileGridPresented(&grid, 0);
+    grid.tilesPresented = grid.bytesPresented = 0;
+    
+    double start = PaintBenchNow();
+    for (size_t n = 0; n < strokes; n++) {
+        
+        // Ten words per line, twelve lines per page:
+        double dx = 90.0 * (n % 10) - 80.0;
+        double dy = 60.0 * ((n / 10) % 12) - 280.0;
+        double x0 = 1e30, y0 = 1e30, x1 = -1e30, y1 = -1e30;
+        for (size_t k = 0; k < length; k++) {
+            x0 = fmin(x0, trace[k].point.x + dx);
+            y0 = fmin(y0, trace[k].point.y + dy);
+            x1 = fmax(x1, trace[k].point.x + dx);
+            y1 = fmax(y1, trace[k].point.y + dy);
+        }
+        PaintTileGridMarkRect(&grid, x0 - lineWidth, y0 - lineWidth, x1 - x0 + 2 * lineWidth, y1 - y0 + 2 * lineWidth);
+        for (size_t index = PaintTileGridNextDirty(&grid, 0); index < PaintTileGridCount(&grid);
+             index = PaintTileGridNextDirty(&grid, index + 1)) {
+            PaintTileGridPresented(&grid, index);
+        }
+    }
+    double elapsed = PaintBenchNow() - start;
+    
+    printf("tiles    %4.0f pt %zu x %zu, %.2f tiles and %.0f kB per commit instead of %.0f kB (%.1f%%), %.0f commits/s\n",
+           tileSize, grid.columns, grid.rows, (double)grid.tilesPresented / strokes,
+           grid.bytesPresented / 1e3 / strokes, canvasBytes / 1e3,
+           100.0 * grid.bytesPresented / strokes / canvasBytes, strokes / elapsed);
+    
+    PaintTileGridFree(&grid);
+    free(trace);
+    return 0;
+}
+
+// Store a line in increments of eight touches, once in touch columns and once in an array of
+// structs grown with realloc, the way PaintStrokeEngine kept its touches before. Reports the
+// memory and allocations per 10000 touches and checks that the columns give back every touch.
+
+typedef struct PaintBenchStoredTouch {
+    PaintSplineControl control;
+    int                classification;
+    int                state;
+} PaintBenchStoredTouch;
+
+static int PaintBenchTouches(int argc, char **argv) {
+    
+    size_t touches         = argc > 0 ? strtoul(argv[0], NULL, 10) : 10000;
+    size_t runs            = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+    PaintBenchTouch *trace = PaintBenchTrace(touches);
+    PaintSplineControl *controls = malloc(touches * sizeof(PaintSplineControl));
+    for (size_t n = 0; n < touches; n++) {
+        controls[n] = (PaintSplineControl){ trace[n].point, trace[n].velocity, trace[n].timestamp };
+    }
+    size_t increments = (touches + 7) / 8;
+    if (touches == 0 || runs == 0) {
+        fprintf(stderr, "touches: nothing to store\n");
+        return 1;
+    }
+    
+    // Array of structs, doubling like PaintGrow():
+    size_t arrayBytes = 0, arrayAllocations = 0;
+    double start      = PaintBenchNow();
+    for (size_t run = 0; run < runs; run++) {
+        PaintBenchStoredTouch *stored = NULL;
+        size_t count = 0, capacity = 0;
+        arrayAllocations = 0;
+        for (size_t n = 0; n < touches; n++) {
+            if (count == capacity) {
+                capacity = capacity ? 2 * capacity : 16;
+                stored   = realloc(stored, capacity * sizeof(PaintBenchStoredTouch));
+                arrayAllocations++;
+            }
+            stored[count++] = (PaintBenchStoredTouch){ controls[n], 1, 2 };
+        }
+        arrayBytes = capacity * sizeof(PaintBenchStoredTouch);
+        free(stored);
+    }
+    double arrayTime = (PaintBenchNow() - start) / runs;
+    
+    // Touch columns in their arena:
+    PaintTouchColumns columns;
+    size_t columnBytes = 0, columnAllocations = 0;
+    start = PaintBenchNow();
+    for (size_t run = 0; run < runs; run++) {
+        PaintTouchColumnsInit(&columns);
+        for (size_t n = 0; n < touches; n++) {
+            PaintTouchColumnsAppend(&columns, &controls[n], 1);
+        }
+        columnBytes       = columns.arena.bytesReserved;
+        columnAllocations = columns.arena.chunkCount;
+        if (run + 1 < runs) PaintTouchColumnsRelease(&columns);
+    }
+    double columnTime = (PaintBenchNow() - start) / runs;
+    
+    PaintSplineControl *check = malloc(touches * sizeof(PaintSplineControl));
+    if (PaintTouchColumnsSplineControls(&columns, 0, check) != touches ||
+        memcmp(check, controls, touches * sizeof(PaintSplineControl)) != 0) {
+        fprintf(stderr, "touches: the columns do not give back the touches stored\n");
+        return 1;
+    }
+    PaintTouchColumnsRelease(&columns);
+    
+    double per10k = 10000.0 / touches;
+    printf("touches  array   %8.0f bytes %5.1f allocations per 10k touches, %.4f per increment, %.1f ns/touch\n",
+           arrayBytes * per10k, arrayAllocations * per10k, (double)arrayAllocations / increments, 1e9 * arrayTime / touches);
+    printf("touches  columns %8.0f bytes %5.1f allocations per 10k touches, %.4f per increment, %.1f ns/touch\n",
+           columnBytes * per10k, columnAllocations * per10k, (double)columnAllocations / increments, 1e9 * columnTime / touches);
+    
+    free(check);
+    free(controls);
+    free(trace);
+    return 0;
+}
+
+// Look up live lines by ID, with a few and with many lines at the same time: once in the line
+// table, once by scanning an array the way PaintStrokeEngine did before. Lines come and go, so
+// the table also has to survive removals.
+
+static int PaintBenchLines(int argc, char **argv) {
+    
+    size_t lookups    = argc > 0 ? strtoul(argv[0], NULL, 10) : 10000000;
+    size_t sizes[]    = { 2, 16, 128, 1024 };
+    uint32_t *live    = malloc(1024 * sizeof(uint32_t));
+    uint32_t nextID   = 0;
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t count = sizes[s];
+        PaintLineTable table;
+        PaintLineTableInit(&table, 16);
+        for (size_t n = 0; n < count; n++) {
+            live[n] = nextID++;
+            PaintLineTableInsert(&table, live[n])->value = &live[n];
+        }
+        
+        // Every 64th lookup one line ends and a new one starts:
+        size_t found  = 0;
+        double start  = PaintBenchNow();
+        for (size_t n = 0; n < lookups; n++) {
+            size_t index = (n * 7919) % count;
+            PaintLineTableEntry *entry = PaintLineTableFind(&table, live[index]);
+            found += entry && entry->value == &live[index];
+            if (n % 64 == 63) {
+                PaintLineTableRemove(&table, PaintLineTableFind(&table, live[index]));
+                live[index] = nextID++;
+                PaintLineTableInsert(&table, live[index])->value = &live[index];
+            }
+        }
+        double tableTime = PaintBenchNow() - start;
+        if (found != lookups || table.count != count) {
+            fprintf(stderr, "lines: found %zu of %zu lookups, %zu of %zu lines\n", found, lookups, table.count, count);
+            return 1;
+        }
+        
+        size_t scanned = 0;
+        start = PaintBenchNow();
+        for (size_t n = 0; n < lookups; n++) {
+            uint32_t lineID = live[(n * 7919) % count];
+            for (size_t k = 0; k < count; k++) {
+                if (live[k] == lineID) {
+                    scanned++;
+                    break;
+                }
+            }
+        }
+        double scanTime = PaintBenchNow() - start;
+        if (scanned != lookups) {
+            fprintf(stderr, "lines: the scan found %zu of %zu lines\n", scanned, lookups);
+            return 1;
+        }
+        
+        printf("lines    %5zu live: table %6.1f ns, array scan %7.1f ns per lookup\n", count,
+               1e9 * tableTime / lookups, 1e9 * scanTime / lookups);
+        PaintLineTableFree(&table);
+    }
+    free(live);
+    return 0;
+}
+
+// Fill an iPad canvas with short scribbles, each entered into the stroke index point by point as
+// increments would grow a live line. Then ask which strokes intersect rects of three sizes, once
+// through the index and once by testing the bounds of every stroke, and compare the answers.
+// Half of the strokes are erased on the way, the answers have to match after that, too.
+
+#define INDEX_STEPS 24
+
+static int PaintBenchIndexCheck(PaintStrokeIndex *index, const PaintStrokeBounds *bounds, const uint8_t *erased,
+                                size_t strokes, const PaintStrokeBounds *rects, size_t queries, uint32_t *found,
+                                double *indexTime, double *scanTime, size_t *hits) {
+    
+    uint64_t indexSum = 0, scanSum = 0;
+    size_t indexHits  = 0, scanHits = 0;
+    double start      = PaintBenchNow();
+    for (size_t q = 0; q < queries; q++) {
+        size_t count = PaintStrokeIndexQuery(index, rects[q], found, strokes);
+        for (size_t n = 0; n < count; n++) {
+            indexSum += (uint64_t)found[n] * 2654435761u;
+        }
+        indexHits += count;
+    }
+    *indexTime = PaintBenchNow() - start;
+    
+    start = PaintBenchNow();
+    for (size_t q = 0; q < queries; q++) {
+        for (size_t n = 0; n < strokes; n++) {
+            if (!erased[n] && PaintStrokeBoundsIntersect(bounds[n], rects[q])) {
+                scanSum  += (uint64_t)n * 2654435761u;
+                scanHits++;
+            }
+        }
+    }
+    *scanTime = PaintBenchNow() - start;
+    *hits     = indexHits;
+    return indexHits == scanHits && indexSum == scanSum;
+}
+
+static int PaintBenchIndex(int argc, char **argv) {
+    
+    size_t strokes = argc > 0 ? strtoul(argv[0], NULL, 10) : 20000;
+    size_t queries = argc > 1 ? strtoul(argv[1], NULL, 10) : 2000;
+    float sizes[]  = { 10.0f, 100.0f, 400.0f };
+    PaintStrokeBounds *bounds = malloc(strokes * sizeof(PaintStrokeBounds));
+    PaintStrokeBounds *rects  = malloc(queries * sizeof(PaintStrokeBounds));
+    uint8_t *erased           = calloc(strokes, 1);
+    uint32_t *found           = malloc(strokes * sizeof(uint32_t));
+    srand(7);
+    
+    PaintStrokeIndex index;
+    PaintStrokeIndexInit(&index, 64.0f, 1024);
+    double start = PaintBenchNow();
+    for (size_t n = 0; n < strokes; n++) {
+        float x   = 1024.0f * rand() / RAND_MAX, y = 1366.0f * rand() / RAND_MAX;
+        bounds[n] = PaintStrokeBoundsEmpty;
+        for (size_t step = 0; step < INDEX_STEPS; step++) {
+            x += 8.0f * rand() / RAND_MAX - 3.0f;
+            y += 8.0f * rand() / RAND_MAX - 4.0f;
+            PaintStrokeBounds point = { x - 5.0f, y - 5.0f, x + 5.0f, y + 5.0f };
+            bounds[n] = PaintStrokeBoundsUnion(bounds[n], point);
+            PaintStrokeIndexInsert(&index, (uint32_t)n, point);
+        }
+    }
+    double insertTime = PaintBenchNow() - start;
+    printf("index  %6zu strokes: %.0f ns per increment\n", strokes, 1e9 * insertTime / (strokes * INDEX_STEPS));
+    
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            for (size_t q = 0; q < queries; q++) {
+                float x  = 1024.0f * rand() / RAND_MAX, y = 1366.0f * rand() / RAND_MAX;
+                rects[q] = (PaintStrokeBounds){ x, y, x + sizes[s], y + sizes[s] };
+            }
+            double indexTime, scanTime;
+            size_t hits;
+            if (!PaintBenchIndexCheck(&index, bounds, erased, strokes, rects, queries, found, &indexTime, &scanTime, &hits)) {
+                fprintf(stderr, "index: the index and the scan disagree for %.0f pt rects\n", sizes[s]);
+                return 1;
+            }
+            printf("index  %6zu strokes, %3.0f pt rect: index %8.2f µs, scan %8.2f µs per query (%.1f hits)\n",
+                   index.count, sizes[s], 1e6 * indexTime / queries, 1e6 * scanTime / queries, (double)hits / queries);
+        }
+        
+        // Erase every other stroke for the second pass:
+        for (size_t n = 0; n < strokes && pass == 0; n += 2) {
+            PaintStrokeIndexRemove(&index, (uint32_t)n);
+            erased[n] = 1;
+        }
+    }
+    PaintStrokeIndexFree(&index);
+    free(found);
+    free(erased);
+    free(rects);
+    free(bounds);
+    return 0;
+}
+
+// Fill the stroke store with pages of handwriting in all four pen colors, then paint the whole
+// canvas from it at three zoom levels with 1, 2, 4 … threads. Every thread count has to give
+// the same pixels as one thread, and the pixel under a stroke must not stay white.
+
+static uint64_t PaintBenchRasterChecksum(uint32_t *const *tiles, const PaintTileGrid *grid) {
+    
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t index = 0; index < PaintTileGridCount(grid); index++) {
+        size_t pixelsWide, pixelsHigh;
+        PaintTileGridTilePixels(grid, index, &pixelsWide, &pixelsHigh);
+        for (size_t n = 0; n < pixelsWide * pixelsHigh; n++) {
+            hash = (hash ^ tiles[index][n]) * 0x100000001b3ULL;
+        }
+    }
+    return hash;
+}
+
+static int PaintBenchRaster(int argc, char **argv) {
+    
+    size_t strokes    = argc > 0 ? strtoul(argv[0], NULL, 10) : 1200;
+    size_t maxThreads = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+    double scales[]   = { 1.0, 2.0, 4.0 };
+    int    modes[]    = { 20, 10, 9, 3 };
+    size_t length     = 120;
+    PaintBenchTouch *trace = PaintBenchTrace(length);
+    PaintPoint *points     = malloc(length * sizeof(PaintPoint));
+    
+    PaintStrokeStore store;
+    PaintStrokeStoreInit(&store);
+    for (size_t n = 0; n < strokes; n++) {
+        double dx = 90.0 * (n % 10) - 80.0 + 3.0 * (n / 120);
+        double dy = 60.0 * ((n / 10) % 12) - 280.0 + 2.0 * (n / 120);
+        for (size_t k = 0; k < length; k++) {
+            points[k] = (PaintPoint){ trace[k].point.x + dx, trace[k].point.y + dy };
+        }
+        PaintLineStyle style = PaintLineStyleDefault();
+        style.mode  = modes[n % 4];
+        style.color = style.mode > 9 ? style.mode / 10 : style.mode;
+        style.width = style.mode == 3 ? 50.0 : (style.mode == 9 ? 10.0 : 5.0);
+        style.alpha = style.mode == 3 ? 0.33 : 1.0;
+        PaintStrokeStoreAdd(&store, points, length, NULL, 0, style, 0.25);
+    }
+    PaintRasterPool *one = PaintRasterPoolCreate(1);
+    PaintRasterPool *all = PaintRasterPoolCreate(maxThreads);
+    size_t cores         = PaintRasterPoolThreads(all);
+    PaintRasterPoolDestroy(all);
+    printf("raster %5zu strokes, %zu of %zu points kept, up to %zu threads\n",
+           store.count, store.pointCount, store.pointsIn, cores);
+    
+    for (size_t s = 0; s < sizeof(scales) / sizeof(scales[0]); s++) {
+        PaintTileGrid grid;
+        PaintTileGridInit(&grid, 1024.0, 768.0, 128.0, scales[s]);
+        size_t count    = PaintTileGridCount(&grid);
+        uint32_t **tiles = malloc(count * sizeof(uint32_t *));
+        for (size_t index = 0; index < count; index++) {
+            size_t pixelsWide, pixelsHigh;
+            PaintTileGridTilePixels(&grid, index, &pixelsWide, &pixelsHigh);
+            tiles[index] = malloc(pixelsWide * pixelsHigh * sizeof(uint32_t));
+        }
+        PaintRasterizeStrokes(one, &store, &grid, tiles);
+        uint64_t expected = PaintBenchRasterChecksum(tiles, &grid);
+        
+        // The first point of the first stroke, in its tile:
+        const PaintStoredPoint *first = PaintStrokeStorePoints(&store, PaintStrokeStoreStroke(&store, 0));
+        size_t column = (size_t)(first->x / grid.tileSize), row = (size_t)(first->y / grid.tileSize);
+        size_t pixelsWide, pixelsHigh;
+        PaintTileGridTilePixels(&grid, row * grid.columns + column, &pixelsWide, &pixelsHigh);
+        size_t px = (size_t)((first->x - column * grid.tileSize) * grid.scale);
+        size_t py = (size_t)((first->y - row * grid.tileSize) * grid.scale);
+        if (tiles[row * grid.columns + column][py * pixelsWide + px] == 0xffffffffu) {
+            fprintf(stderr, "raster: nothing painted under the first stroke at scale %g\n", scales[s]);
+            return 1;
+        }
+        
+        double single = 0.0;
+        for (size_t threads = 1; threads <= cores; threads = threads * 2 > cores && threads < cores ? cores : threads * 2) {
+            PaintRasterPool *pool = PaintRasterPoolCreate(threads);
+            double best = 1e30;
+            for (int run = 0; run < 5; run++) {
+                double start = PaintBenchNow();
+                PaintRasterizeStrokes(pool, &store, &grid, tiles);
+                best = fmin(best, PaintBenchNow() - start);
+            }
+            PaintRasterPoolDestroy(pool);
+            if (PaintBenchRasterChecksum(tiles, &grid) != expected) {
+                fprintf(stderr, "raster: %zu threads paint other pixels than one\n", threads);
+                return 1;
+            }
+            single = threads == 1 ? best : single;
+            printf("raster %4.0f x %4.0f px, %3zu tiles, %2zu threads: %7.2f ms, %4.1fx\n",
+                   grid.width * grid.scale, grid.height * grid.scale, count, threads, 1e3 * best, single / best);
+        }
+        for (size_t index = 0; index < count; index++) {
+            free(tiles[index]);
+        }
+        free(tiles);
+        PaintTileGridFree(&grid);
+    }
+    PaintRasterPoolDestroy(one);
+    PaintStrokeStoreFree(&store);
+    free(points);
+    free(trace);
+    return 0;
+}
+
+// Open a drawing of many short strokes over a canvas of four screens, in a process of its own
+// each time: eagerly, with every stroke decoded into the store and the whole canvas painted
+// before the first frame, and the way PaintView opens a drawing, with the tiles of the first
+// screen painted from the strokes in them first and the other strokes decoded in chunks after
+// that. Reports the time to the first frame and to the complete canvas, and the memory
+// resident at both. The tiles of the first frame must equal those of the complete canvas.
+
+#define DOCUMENT_WIDTH   2048.0
+#define DOCUMENT_HEIGHT  1536.0
+#define DOCUMENT_SCALE      2.0
+#define DOCUMENT_CHUNK    256
+
+static size_t PaintBenchResidentBytes(void) {
+
+#ifdef __APPLE__
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS) {
+        return 0;
+    }
+    return info.resident_size;
+#else
+    unsigned long size = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file || fscanf(file, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    if (file) fclose(file);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+static size_t PaintBenchPeakResidentBytes(void) {
+    
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (size_t)usage.ru_maxrss;
+#else
+    return (size_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+static uint32_t **PaintBenchTileBuffers(const PaintTileGrid *grid) {
+    
+    uint32_t **tiles = malloc(PaintTileGridCount(grid) * sizeof(uint32_t *));
+    for (size_t index = 0; index < PaintTileGridCount(grid); index++) {
+        tiles[index] = malloc(PaintTileGridTileBytes(grid, index));
+    }
+    return tiles;
+}
+
+static void PaintBenchFreeTileBuffers(uint32_t **tiles, const PaintTileGrid *grid) {
+    
+    for (size_t index = 0; index < PaintTileGridCount(grid); index++) {
+        free(tiles[index]);
+    }
+    free(tiles);
+}
+
+// Strokes first … end-1 of the drawing into the store and the index, as PaintView adds them:
+
+static void PaintBenchDocumentAdd(const PaintStrokeReader *reader, size_t first, size_t end,
+                                  PaintStrokeStore *store, PaintStrokeIndex *index, PaintStoredPoint *points, size_t capacity) {
+    
+    for (size_t n = first; n < end; n++) {
+        PaintStrokeData data = { .points = points };
+        if (PaintStrokeReaderRead(reader, n, &data, capacity) < 0) {
+            data.count = 0;
+        }
+        long added = PaintStrokeStoreAppend(store, points, data.count, data.style);
+        if (added >= 0 && index) {
+            const PaintStoredStroke *stroke = PaintStrokeStoreStroke(store, (size_t)added);
+            PaintStrokeIndexInsert(index, (uint32_t)added, PaintStrokeBoundsInset(stroke->bounds, -stroke->width));
+        }
+    }
+}
+
+static int PaintBenchDocumentOpen(const char *path, int lazy, size_t maxPoints) {
+    
+    PaintRasterPool *pool = PaintRasterPoolCreate(0);
+    PaintStoredPoint *points = malloc(maxPoints * sizeof(PaintStoredPoint));
+    PaintStrokeStore store;
+    PaintStrokeIndex index;
+    PaintStrokeStoreInit(&store);
+    PaintStrokeIndexInit(&index, 64.0f, 1024);
+    PaintTileGrid canvas;
+    PaintTileGridInit(&canvas, DOCUMENT_WIDTH, DOCUMENT_HEIGHT, 128.0, DOCUMENT_SCALE);
+    size_t baseline = PaintBenchResidentBytes();
+    
+    double start = PaintBenchNow();
+    PaintStrokeReader *reader = PaintStrokeReaderOpen(path);
+    if (!reader || !pool || !points) {
+        fprintf(stderr, "document: %s cannot be opened\n", path);
+        return 1;
+    }
+    size_t count = PaintStrokeReaderCount(reader);
+    
+    // The first screen from the strokes which reach into it, in a store of their own:
+    PaintTileGrid screen;
+    PaintTileGridInit(&screen, 1024.0, 768.0, 128.0, DOCUMENT_SCALE);
+    uint32_t **screenTiles = NULL;
+    size_t visible         = count;
+    if (lazy) {
+        PaintStrokeBounds bounds = { 0.0f, 0.0f, 1024.0f, 768.0f };
+        visible                  = PaintStrokeReaderQuery(reader, bounds, NULL, 0);
+        uint32_t *indices        = malloc((visible + 1) * sizeof(uint32_t));
+        PaintStrokeReaderQuery(reader, bounds, indices, visible);
+        PaintStrokeStore first;
+        PaintStrokeStoreInit(&first);
+        for (size_t n = 0; n < visible; n++) {
+            PaintBenchDocumentAdd(reader, indices[n], indices[n] + 1, &first, NULL, points, maxPoints);
+        }
+        screenTiles = PaintBenchTileBuffers(&screen);
+        PaintRasterizeStrokes(pool, &first, &screen, screenTiles);
+        PaintStrokeStoreFree(&first);
+        free(indices);
+    } else {
+        PaintBenchDocumentAdd(reader, 0, count, &store, &index, points, maxPoints);
+    }
+    uint32_t **tiles = PaintBenchTileBuffers(&canvas);
+    if (!lazy) {
+        PaintRasterizeStrokes(pool, &store, &canvas, tiles);
+    }
+    double firstFrame     = PaintBenchNow() - start;
+    size_t firstResident  = PaintBenchResidentBytes();
+    
+    // Then all strokes chunk by chunk, and the canvas from them:
+    if (lazy) {
+        for (size_t chunk = 0; chunk < count; chunk += DOCUMENT_CHUNK) {
+            PaintBenchDocumentAdd(reader, chunk, chunk + DOCUMENT_CHUNK < count ? chunk + DOCUMENT_CHUNK : count,
+                                  &store, &index, points, maxPoints);
+        }
+        PaintRasterizeStrokes(pool, &store, &canvas, tiles);
+    }
+    double complete = PaintBenchNow() - start;
+    printf("document %-6s %6zu strokes, %6zu in first frame: first frame %7.1f ms, %6.1f MB, complete %7.1f ms, peak %6.1f MB\n",
+           lazy ? "lazy" : "eager", count, visible, 1e3 * firstFrame, (firstResident - baseline) / 1e6,
+           1e3 * complete, PaintBenchPeakResidentBytes() / 1e6);
+    
+    int failed = 0;
+    for (size_t n = 0; lazy && n < PaintTileGridCount(&screen); n++) {
+        size_t column = n % screen.columns, row = n / screen.columns;
+        failed |= memcmp(screenTiles[n], tiles[row * canvas.columns + column], PaintTileGridTileBytes(&screen, n)) != 0;
+    }
+    if (failed) {
+        fprintf(stderr, "document: the first frame differs from the complete canvas\n");
+    }
+    if (screenTiles) PaintBenchFreeTileBuffers(screenTiles, &screen);
+    PaintBenchFreeTileBuffers(tiles, &canvas);
+    PaintStrokeReaderClose(reader);
+    PaintTileGridFree(&screen);
+    PaintTileGridFree(&canvas);
+    PaintStrokeIndexFree(&index);
+    PaintStrokeStoreFree(&store);
+    PaintRasterPoolDestroy(pool);
+    free(points);
+    return failed;
+}
+
+static int PaintBenchDocument(int argc, char **argv) {
+    
+    size_t strokes   = argc > 0 ? strtoul(argv[0], NULL, 10) : 100000;
+    const char *path = argc > 1 ? argv[1] : "/tmp/paintbench.pstk";
+    size_t maxPoints = 60;
+    
+    // Short strokes of 10 … 60 points, handwriting size, all over the canvas:
+    PaintStrokeWriter *writer = PaintStrokeWriterCreate(path, PAINT_STROKE_FILE_GRID);
+    if (!writer) {
+        perror(path);
+        return 1;
+    }
+    PaintStoredPoint *points = malloc(maxPoints * sizeof(PaintStoredPoint));
+    uint64_t pointCount      = 0;
+    srand(11);
+    for (size_t n = 0; n < strokes; n++) {
+        PaintStrokeData data = { PaintLineStyleDefault(), points, NULL, 10 + (size_t)rand() % (maxPoints - 9), NULL };
+        data.style.color     = rand() % 5;
+        data.style.width     = 1.0 + rand() % 6;
+        float x = (float)(DOCUMENT_WIDTH * rand() / RAND_MAX), y = (float)(DOCUMENT_HEIGHT * rand() / RAND_MAX);
+        for (size_t k = 0; k < data.count; k++) {
+            x += 6.0f * rand() / RAND_MAX - 3.0f;
+            y += 6.0f * rand() / RAND_MAX - 3.0f;
+            points[k] = (PaintStoredPoint){ x, y };
+        }
+        PaintStrokeWriterAppend(writer, &data);
+        pointCount += data.count;
+    }
+    uint64_t bytes = PaintStrokeWriterBytes(writer);
+    free(points);
+    if (PaintStrokeWriterClose(writer) != 0) {
+        fprintf(stderr, "document: writing %s failed\n", path);
+        return 1;
+    }
+    printf("document %zu strokes, %llu points, %.1f MB on a %.0f x %.0f pt canvas\n", strokes,
+           (unsigned long long)pointCount, bytes / 1e6, DOCUMENT_WIDTH, DOCUMENT_HEIGHT);
+    
+    for (int lazy = 0; lazy < 2; lazy++) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            int failed = PaintBenchDocumentOpen(path, lazy, maxPoints);
+            fflush(stdout);
+            _exit(failed);
+        }
+        int status;
+        if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// A handwritten page on the canvas of the document benchmark, painted the way PaintView paints
+// it: only the tiles which a stroke reaches get pixels. Then the tiles go idle and are packed,
+// and the store is trimmed to a budget. Reports the bytes of the full bitmap and of the store
+// after each step, and what is resident, each in a process of its own. What the tiles show has
+// to stay the same throughout, evicted tiles painted again included, and a tile which no stroke
+// reaches has to be white in the full bitmap, so leaving it out changes nothing.
+
+// Whether the tiles of store show the pixels with checksum expected; pixels has room for a tile:
+
+static int PaintBenchTileStoreShows(const PaintTileStore *store, uint32_t *pixels, uint64_t expected) {
+    
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t index = 0; index < PaintTileGridCount(store->grid); index++) {
+        size_t count = PaintTileGridTileBytes(store->grid, index) / sizeof(uint32_t);
+        if (PaintTileStoreRead(store, index, pixels) != 0) {
+            return 0;
+        }
+        for (size_t n = 0; n < count; n++) {
+            hash = (hash ^ pixels[n]) * 0x100000001b3ULL;
+        }
+    }
+    return hash == expected;
+}
+
+static int PaintBenchTileStoreRun(const PaintStrokeStore *strokes, PaintStrokeIndex *index, int sparse,
+                                  size_t budget, uint64_t expected) {
+    
+    PaintTileGrid grid;
+    PaintTileGridInit(&grid, DOCUMENT_WIDTH, DOCUMENT_HEIGHT, 128.0, DOCUMENT_SCALE);
+    PaintRasterPool *pool = PaintRasterPoolCreate(0);
+    size_t count          = PaintTileGridCount(&grid);
+    size_t full           = 0;
+    for (size_t n = 0; n < count; n++) {
+        full += PaintTileGridTileBytes(&grid, n);
+    }
+    size_t resident = PaintBenchResidentBytes();
+    if (!sparse) {
+        uint32_t **tiles = PaintBenchTileBuffers(&grid);
+        PaintRasterizeStrokes(pool, strokes, &grid, tiles);
+        int failed = PaintBenchRasterChecksum(tiles, &grid) != expected;
+        printf("tilestore full bitmap:  %3zu tiles, %5.2f MB, %5.2f MB more resident\n", count, full / 1e6,
+               ((double)PaintBenchResidentBytes() - resident) / 1e6);
+        PaintBenchFreeTileBuffers(tiles, &grid);
+        PaintRasterPoolDestroy(pool);
+        PaintTileGridFree(&grid);
+        if (failed) fprintf(stderr, "tilestore: the full bitmap differs from the tiles painted one by one\n");
+        return failed;
+    }
+    
+    PaintTileStore store;
+    PaintTileStoreInit(&store, &grid, budget);
+    uint32_t **tiles = calloc(count, sizeof(uint32_t *));
+    for (size_t n = 0; n < count; n++) {
+        double x, y, w, h;
+        PaintTileGridTileRect(&grid, n, &x, &y, &w, &h);
+        PaintStrokeBounds bounds = { x, y, x + w, y + h };
+        if (PaintStrokeIndexQuery(index, bounds, NULL, 0)) {
+            tiles[n] = PaintTileStoreWrite(&store, n, 0.0);
+        }
+    }
+    PaintRasterizeStrokes(pool, strokes, &grid, tiles);
+    uint32_t *pixels = malloc(PaintTileGridTileBytes(&grid, 0));
+    int failed       = 0;
+    failed          |= !PaintBenchTileStoreShows(&store, pixels, expected);
+    printf("tilestore painted:      %3zu tiles with pixels, %5.2f MB, %5.2f MB more resident\n",
+           PaintTileStoreCount(&store, PaintTileLive), PaintTileStoreBytes(&store) / 1e6,
+           ((double)PaintBenchResidentBytes() - resident) / 1e6);
+    
+    // Everything is idle a second later; the packing is timed as the other thread would do it:
+    size_t *idle   = malloc(count * sizeof(size_t));
+    size_t packing = PaintTileStoreIdle(&store, 1.0, 0.5, idle, count);
+    double seconds = 0.0;
+    for (size_t n = 0; n < packing; n++) {
+        uint32_t generation;
+        const uint32_t *live = PaintTileStoreBeginPacking(&store, idle[n], &generation);
+        size_t pixelCount    = PaintTileGridTileBytes(&grid, idle[n]) / sizeof(uint32_t);
+        uint8_t *packed      = malloc(PaintTilePackedMaxBytes(pixelCount));
+        double start         = PaintBenchNow();
+        size_t bytes         = PaintTilePack(live, pixelCount, packed);
+        seconds             += PaintBenchNow() - start;
+        PaintTileStoreFinishPacking(&store, idle[n], generation, live, packed, bytes);
+    }
+    failed |= !PaintBenchTileStoreShows(&store, pixels, expected);
+    printf("tilestore packed:       %3zu tiles packed, %5.2f MB, %5.2f MB more resident, %.0f us per tile\n",
+           PaintTileStoreCount(&store, PaintTilePacked), PaintTileStoreBytes(&store) / 1e6,
+           ((double)PaintBenchResidentBytes() - resident) / 1e6, packing ? 1e6 * seconds / packing : 0.0);
+    
+    // Over budget the tiles go; the evicted ones are painted from the strokes again:
+    size_t evicted = PaintTileStoreTrim(&store, budget);
+    printf("tilestore trimmed:      %3zu tiles evicted for %.2f MB, %5.2f MB, %5.2f MB more resident\n", evicted,
+           budget / 1e6, PaintTileStoreBytes(&store) / 1e6, ((double)PaintBenchResidentBytes() - resident) / 1e6);
+    for (size_t n = 0; n < count; n++) {
+        int restore = PaintTileStoreState(&store, n) == PaintTileEvicted;
+        tiles[n]    = restore ? PaintTileStoreWrite(&store, n, 2.0) : NULL;
+    }
+    PaintRasterizeStrokes(pool, strokes, &grid, tiles);
+    failed |= !PaintBenchTileStoreShows(&store, pixels, expected);
+    if (failed) {
+        fprintf(stderr, "tilestore: the tiles do not show the page any more\n");
+    }
+    free(idle);
+    free(pixels);
+    free(tiles);
+    PaintTileStoreFree(&store);
+    PaintRasterPoolDestroy(pool);
+    PaintTileGridFree(&grid);
+    return failed;
+}
+
+static int PaintBenchTileStore(int argc, char **argv) {
+    
+    size_t strokes = argc > 0 ? strtoul(argv[0], NULL, 10) : 600;
+    size_t budget  = argc > 1 ? strtoul(argv[1], NULL, 10) << 10 : 1u << 20;
+    size_t length  = 30;
+#ifdef __GLIBC__
+    
+    // Tiles which are freed go back to the system right away, as on Darwin; glibc would keep
+    // them once a large block has been freed:
+    mallopt(M_MMAP_THRESHOLD, 128 << 10);
+#endif
+    
+    // Words of a few letters, 28 to a line, on a page with margins:
+    PaintStrokeStore store;
+    PaintStrokeIndex index;
+    PaintStrokeStoreInit(&store);
+    PaintStrokeIndexInit(&index, 64.0f, 1024);
+    PaintPoint *points = malloc(length * sizeof(PaintPoint));
+    srand(22);
+    for (size_t n = 0; n < strokes; n++) {
+        double x0 = 100.0 + 50.0 * (n % 28), y0 = 120.0 + 48.0 * (n / 28);
+        for (size_t k = 0; k < length; k++) {
+            points[k] = (PaintPoint){ x0 + 40.0 * k / length + 2.0 * rand() / RAND_MAX,
+                                      y0 + 12.0 * sin(0.9 * k) + 2.0 * rand() / RAND_MAX };
+        }
+        PaintLineStyle style = PaintLineStyleDefault();
+        style.width          = 2.0 + rand() % 4;
+        long added           = PaintStrokeStoreAdd(&store, points, length, NULL, 0, style, 0.25);
+        if (added >= 0) {
+            const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&store, (size_t)added);
+            PaintStrokeIndexInsert(&index, (uint32_t)added, PaintStrokeBoundsInset(stroke->bounds, -stroke->width));
+        }
+    }
+    free(points);
+    
+    // The page tile by tile, with one buffer; a tile no stroke reaches has to be white:
+    PaintTileGrid grid;
+    PaintTileGridInit(&grid, DOCUMENT_WIDTH, DOCUMENT_HEIGHT, 128.0, DOCUMENT_SCALE);
+    size_t count          = PaintTileGridCount(&grid);
+    uint32_t **tiles      = calloc(count, sizeof(uint32_t *));
+    uint32_t *pixels      = malloc(PaintTileGridTileBytes(&grid, 0));
+    PaintRasterPool *pool = PaintRasterPoolCreate(1);
+    uint64_t expected     = 0xcbf29ce484222325ULL;
+    size_t reached        = 0;
+    for (size_t n = 0; n < count; n++) {
+        double x, y, w, h;
+        PaintTileGridTileRect(&grid, n, &x, &y, &w, &h);
+        PaintStrokeBounds bounds = { x, y, x + w, y + h };
+        int white                = PaintStrokeIndexQuery(&index, bounds, NULL, 0) == 0;
+        size_t pixelCount        = PaintTileGridTileBytes(&grid, n) / sizeof(uint32_t);
+        tiles[n]                 = pixels;
+        PaintRasterizeStrokes(pool, &store, &grid, tiles);
+        tiles[n]                 = NULL;
+        reached                 += !white;
+        for (size_t k = 0; k < pixelCount; k++) {
+            if (white && pixels[k] != PAINT_TILE_WHITE) {
+                fprintf(stderr, "tilestore: tile %zu is reached by no stroke, but not white\n", n);
+                return 1;
+            }
+            expected = (expected ^ pixels[k]) * 0x100000001b3ULL;
+        }
+    }
+    PaintRasterPoolDestroy(pool);
+    PaintTileGridFree(&grid);
+    printf("tilestore %zu strokes, %zu points on a %.0f x %.0f pt page, %zu of %zu tiles reached\n",
+           store.count, store.pointCount, DOCUMENT_WIDTH, DOCUMENT_HEIGHT, reached, count);
+    
+    int failed = 0;
+    for (int sparse = 0; sparse < 2 && !failed; sparse++) {
+        fflush(stdout);
+        pid_t child = fork();
+        if (child == 0) {
+            int result = PaintBenchTileStoreRun(&store, &index, sparse, budget, expected);
+            fflush(stdout);
+            _exit(result);
+        }
+        int status;
+        failed = child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+    }
+    free(pixels);
+    free(tiles);
+    PaintStrokeIndexFree(&index);
+    PaintStrokeStoreFree(&store);
+    return failed;
+}
+
+// Drive the stroke engine with generated touch streams at full speed, the committed lines going
+// into a stroke store like in the view. The memory of the live lines is summed up in the
+// callbacks, so the peak is known exactly and the same on every machine.
+
+typedef struct PaintBenchLoadRun {
+    PaintStrokeStore store;
+    size_t          *lineBytes;         // By slot
+    size_t           slotCapacity;
+    size_t           maxSplinePoints;
+    size_t           liveBytes;
+    size_t           peakBytes;
+} PaintBenchLoadRun;
+
+static void PaintBenchLoadMeasure(PaintBenchLoadRun *run, const PaintStrokeLine *line, int live) {
+    
+    if (line->slot >= run->slotCapacity) {
+        size_t capacity = 2 * line->slot + 16;
+        run->lineBytes  = realloc(run->lineBytes, capacity * sizeof(size_t));
+        memset(run->lineBytes + run->slotCapacity, 0, (capacity - run->slotCapacity) * sizeof(size_t));
+        run->slotCapacity = capacity;
+    }
+    size_t bytes = !live ? 0 : sizeof(PaintStrokeLine) + line->touches.arena.bytesReserved
+                 + line->touches.blockCapacity * sizeof(PaintTouchBlock *)
+                 + (line->pointCapacity + run->maxSplinePoints + 1) * sizeof(PaintPoint);
+    run->liveBytes = run->liveBytes - run->lineBytes[line->slot] + bytes;
+    run->lineBytes[line->slot] = bytes;
+    run->peakBytes = run->liveBytes > run->peakBytes ? run->liveBytes : run->peakBytes;
+}
+
+static void PaintBenchLoadOpened(void *context, const PaintStrokeLine *line) {
+    PaintBenchLoadMeasure(context, line, 1);
+}
+
+static void PaintBenchLoadExtended(void *context, const PaintStrokeLine *line, size_t firstPoint) {
+    PaintBenchLoadMeasure(context, line, 1);
+}
+
+static void PaintBenchLoadCommitted(void *context, const PaintStrokeLine *line) {
+    
+    PaintBenchLoadRun *run = context;
+    PaintStrokeStoreAdd(&run->store, line->points, line->pointCount,
+                        line->tail, line->pointCount ? line->tailCount : 0, line->style, 0.25);
+    PaintBenchLoadMeasure(run, line, 0);
+}
+
+static void PaintBenchLoadRemoved(void *context, const PaintStrokeLine *line) {
+    PaintBenchLoadMeasure(context, line, 0);
+}
+
+static int PaintBenchLoadScenario(const char *name, const PaintTouchLoad *load, const char *path) {
+    
+    double start              = PaintBenchNow();
+    size_t count;
+    PaintTouchRecord *records = PaintTouchLoadGenerate(load, &count);
+    double generated          = PaintBenchNow() - start;
+    if (!records) {
+        fprintf(stderr, "load: %s: no stream generated\n", name);
+        return 1;
+    }
+    if (path) {
+        PaintTouchRecorder *recorder = PaintTouchRecorderOpen(path, 16384);
+        for (size_t n = 0; recorder && n < count; ) {
+            n += PaintTouchRecorderAppend(recorder, records + n, count - n);
+        }
+        if (!recorder || PaintTouchRecorderClose(recorder) != 0) {
+            fprintf(stderr, "load: cannot write %s\n", path);
+            return 1;
+        }
+    }
+    
+    PaintBenchLoadRun run          = { .maxSplinePoints = 5 };
+    PaintStrokeCallbacks callbacks = { .context = &run, .lineOpened = PaintBenchLoadOpened,
+                                       .lineExtended = PaintBenchLoadExtended, .lineCommitted = PaintBenchLoadCommitted,
+                                       .lineRemoved = PaintBenchLoadRemoved };
+    PaintStrokeStoreInit(&run.store);
+    PaintStrokeEngine *engine = PaintStrokeEngineCreate(run.maxSplinePoints, &callbacks);
+    PaintStrokeEngineSetTolerance(engine, 0.25);
+    start          = PaintBenchNow();
+    size_t groups  = PaintTouchLoadFeed(engine, records, count);
+    double elapsed = PaintBenchNow() - start;
+    PaintStrokeStatistics statistics = PaintStrokeEngineGetStatistics(engine);
+    size_t open    = PaintStrokeEngineLineCount(engine);
+    PaintStrokeEngineDestroy(engine);
+    
+    // Every generated line ends, by its last touch, a line ended message or a palm touch:
+    if (open != 0 || statistics.linesOpened != statistics.linesCommitted + statistics.linesRemoved
+        || statistics.linesOpened < load->lines) {
+        fprintf(stderr, "load: %s: %zu lines opened, %zu committed, %zu removed, %zu still open\n", name,
+                statistics.linesOpened, statistics.linesCommitted, statistics.linesRemoved, open);
+        return 1;
+    }
+    printf("%-26s %7zu touches %6zu groups %6zu lines: %8.0f touches/s %8.0f increments/s, %5.1f ms to generate, "
+           "%7.1f kB peak in live lines, %7.1f kB stored (%zu opened, %zu committed, %zu removed, %zu mode checks)\n",
+           name, statistics.touches, groups, load->lines, statistics.touches / elapsed,
+           statistics.increments / elapsed, 1e3 * generated, run.peakBytes / 1e3,
+           PaintStrokeStoreBytes(&run.store) / 1e3, statistics.linesOpened, statistics.linesCommitted,
+           statistics.linesRemoved, statistics.modeChecks);
+    
+    PaintStrokeStoreFree(&run.store);
+    free(run.lineBytes);
+    free(records);
+    return 0;
+}
+
+static int PaintBenchLoad(int argc, char **argv) {
+    
+    PaintTouchLoad load = PaintTouchLoadDefault();
+    if (argc >= 4) {
+        load.lines        = strtoul(argv[0], NULL, 10);
+        load.concurrent   = strtoul(argv[1], NULL, 10);
+        load.sampleRate   = strtod(argv[2], NULL);
+        load.lineTouches  = strtoul(argv[3], NULL, 10);
+        load.lengthSpread = 0.25;
+        load.fingerShare  = 0.2;
+        load.palmShare    = 0.2;
+        return PaintBenchLoadScenario("custom", &load, argc > 4 ? argv[4] : NULL);
+    }
+    
+    // Two seconds of writing per line at each sample rate:
+    static const double rates[3] = { 60.0, 120.0, 240.0 };
+    int failed = 0;
+    for (int r = 0; r < 3; r++) {
+        char name[32];
+        load             = PaintTouchLoadDefault();
+        load.lines       = 500;
+        load.sampleRate  = rates[r];
+        load.lineTouches = (size_t)(2.0 * rates[r]);
+        snprintf(name, sizeof(name), "pen lines at %.0f Hz", rates[r]);
+        failed |= PaintBenchLoadScenario(name, &load, NULL);
+    }
+    
+    load              = PaintTouchLoadDefault();
+    load.lines        = 400;
+    load.concurrent   = 20;
+    load.lineTouches  = 480;
+    load.lengthSpread = 0.5;
+    load.fingerShare  = 0.5;
+    failed |= PaintBenchLoadScenario("20 simultaneous lines", &load, NULL);
+    
+    load              = PaintTouchLoadDefault();
+    load.lineTouches  = 50000;
+    failed |= PaintBenchLoadScenario("one 50k-point stroke", &load, NULL);
+    
+    load              = PaintTouchLoadDefault();
+    load.lines        = 20000;
+    load.concurrent   = 10;
+    load.lineTouches  = 60;
+    load.palmShare    = 0.9;
+    load.palmTouches  = 4;
+    failed |= PaintBenchLoadScenario("rapid palm rejection churn", &load, NULL);
+    
+    load              = PaintTouchLoadDefault();
+    load.lines        = 2000;
+    load.concurrent   = 4;
+    load.sampleRate   = 120.0;
+    load.lineTouches  = 240;
+    load.lengthSpread = 0.5;
+    load.fingerShare  = 0.25;
+    load.palmShare    = 0.25;
+    failed |= PaintBenchLoadScenario("mixed, 4 at a time", &load, NULL);
+    return failed;
+}
+
+#pragma mark - Pipeline
+
+// The same streams through the worker of PaintStrokePipeline. The committed lines must come back
+// exactly as from the engine itself, in the same order. What counts for the app is the time the
+// calling thread spends queueing, the main thread in the app; the drain is timed on its own,
+// it runs once per display frame there.
+
+// Records queued between two drains, about what four fingers deliver per frame at 240 Hz:
+#define PIPELINE_FRAME_RECORDS 64
+
+typedef struct PaintBenchPipelineRun {
+    uint64_t checksum;
+    size_t   committed;
+    size_t   removed;
+} PaintBenchPipelineRun;
+
+static void PaintBenchPipelineCommitted(void *context, const PaintStrokeLine *line) {
+    
+    PaintBenchPipelineRun *run = context;
+    const unsigned char *bytes = (const unsigned char *)line->points;
+    for (size_t n = 0; n < line->pointCount * sizeof(PaintPoint); n++) {
+        run->checksum = (run->checksum ^ bytes[n]) * 0x100000001b3ULL;
+    }
+    bytes = (const unsigned char *)line->tail;
+    for (size_t n = 0; n < line->tailCount * sizeof(PaintPoint); n++) {
+        run->checksum = (run->checksum ^ bytes[n]) * 0x100000001b3ULL;
+    }
+    run->checksum = (run->checksum ^ (uint64_t)(line->style.color + 16 * line->style.mode)) * 0x100000001b3ULL;
+    run->committed++;
+}
+
+static void PaintBenchPipelineRemoved(void *context, const PaintStrokeLine *line) {
+    ((PaintBenchPipelineRun *)context)->removed++;
+}
+
+static int PaintBenchPipelineScenario(const char *name, const PaintTouchLoad *load) {
+    
+    size_t count;
+    PaintTouchRecord *records = PaintTouchLoadGenerate(load, &count);
+    if (!records) {
+        fprintf(stderr, "pipeline: %s: no stream generated\n", name);
+        return 1;
+    }
+    PaintBenchPipelineRun direct   = { .checksum = 0xcbf29ce484222325ULL };
+    PaintBenchPipelineRun piped    = { .checksum = 0xcbf29ce484222325ULL };
+    PaintStrokeCallbacks callbacks = { .context = &direct, .lineCommitted = PaintBenchPipelineCommitted,
+                                       .lineRemoved = PaintBenchPipelineRemoved };
+    PaintStrokeEngine *engine      = PaintStrokeEngineCreate(5, &callbacks);
+    PaintStrokeEngineSetTolerance(engine, 0.25);
+    double start       = PaintBenchNow();
+    PaintTouchLoadFeed(engine, records, count);
+    double inlined     = PaintBenchNow() - start;
+    size_t touches     = PaintStrokeEngineGetStatistics(engine).touches;
+    PaintStrokeEngineDestroy(engine);
+    
+    callbacks.context             = &piped;
+    PaintStrokePipeline *pipeline = PaintStrokePipelineCreate(5, &callbacks, NULL, NULL);
+    PaintStrokePipelineSetTolerance(pipeline, 0.25);
+    
+    // A frame's worth of events at a time, cut at the end of a group:
+    double queued = 0.0, flushed = 0.0;
+    for (size_t first = 0, end; first < count; first = end) {
+        end = first + PIPELINE_FRAME_RECORDS < count ? first + PIPELINE_FRAME_RECORDS : count;
+        while (end < count && !(records[end - 1].kind & PaintTouchRecordEndOfGroup)) {
+            end++;
+        }
+        start    = PaintBenchNow();
+        PaintTouchLoadFeedPipeline(pipeline, records + first, end - first);
+        queued  += PaintBenchNow() - start;
+        start    = PaintBenchNow();
+        PaintStrokePipelineFlush(pipeline);
+        flushed += PaintBenchNow() - start;
+    }
+    PaintStrokePipelineStatistics statistics = PaintStrokePipelineGetStatistics(pipeline);
+    size_t open        = PaintStrokePipelineLineCount(pipeline);
+    PaintStrokePipelineDestroy(pipeline);
+    free(records);
+    
+    if (piped.checksum != direct.checksum || piped.committed != direct.committed || piped.removed != direct.removed
+        || open != 0) {
+        fprintf(stderr, "pipeline: %s: %zu committed, %zu removed, %zu open, checksum %016llx instead of "
+                "%zu committed, %zu removed, %016llx\n", name, piped.committed, piped.removed, open,
+                (unsigned long long)piped.checksum, direct.committed, direct.removed,
+                (unsigned long long)direct.checksum);
+        return 1;
+    }
+    printf("%-26s %7zu touches: %6.3f µs per touch in the engine, %6.3f µs to queue, %6.3f µs to flush, "
+           "%zu events, %zu results, %zu producer waits, %zu worker waits\n",
+           name, touches, 1e6 * inlined / touches, 1e6 * queued / touches, 1e6 * flushed / touches,
+           statistics.commands, statistics.results, statistics.producerWaits, statistics.workerWaits);
+    return 0;
+}
+
+static int PaintBenchPipeline(int argc, char **argv) {
+    
+    int failed          = 0;
+    PaintTouchLoad load = PaintTouchLoadDefault();
+    load.lines          = 500;
+    load.sampleRate     = 240.0;
+    load.lineTouches    = 480;
+    failed |= PaintBenchPipelineScenario("pen lines at 240 Hz", &load);
+    
+    load              = PaintTouchLoadDefault();
+    load.lines        = 400;
+    load.concurrent   = 20;
+    load.lineTouches  = 480;
+    load.lengthSpread = 0.5;
+    load.fingerShare  = 0.5;
+    failed |= PaintBenchPipelineScenario("20 simultaneous lines", &load);
+    
+    load              = PaintTouchLoadDefault();
+    load.lineTouches  = 50000;
+    failed |= PaintBenchPipelineScenario("one 50k-point stroke", &load);
+    
+    load              = PaintTouchLoadDefault();
+    load.lines        = 20000;
+    load.concurrent   = 10;
+    load.lineTouches  = 60;
+    load.palmShare    = 0.9;
+    load.palmTouches  = 4;
+    failed |= PaintBenchPipelineScenario("rapid palm rejection churn", &load);
+    
+    load              = PaintTouchLoadDefault();
+    load.lines        = 2000;
+    load.concurrent   = 4;
+    load.sampleRate   = 120.0;
+    load.lineTouches  = 240;
+    load.lengthSpread = 0.5;
+    load.fingerShare  = 0.25;
+    load.palmShare    = 0.25;
+    failed |= PaintBenchPipelineScenario("mixed, 4 at a time", &load);
+    return failed;
+}
+
+#pragma mark - Outline
+
+// Live lines whose width follows the speed, outlined the way PaintStrokeLayer does it: in
+// segments of OUTLINE_SEGMENT points, the open one grown by the new points of each increment
+// and closed over the tail. Each increment is timed against a constant width outline of the
+// whole open segment made from scratch, which is what the layer had Core Animation stroke again
+// every frame; the budget is one frame at 240 Hz. The grown outline must be the one made in one
+// go from the same points.
+
+#define OUTLINE_SEGMENT 128
+#define OUTLINE_BUDGET  (1.0 / 240.0)
+
+typedef struct PaintBenchOutlineLine {
+    PaintStrokeOutline outline;
+    size_t             openStart;
+    size_t             outlined;
+    PaintFloat         width;           // The outline has, the style may change while the line is live
+} PaintBenchOutlineLine;
+
+typedef struct PaintBenchOutlineRun {
+    PaintBenchOutlineLine *lines;       // By slot
+    size_t                 slotCapacity;
+    PaintStrokeOutline     whole;       // For the outlines made from scratch
+    PaintPoint            *points;
+    PaintFloat            *radii;
+    size_t                 capacity;
+    double                *grown;       // Seconds per increment, both ways
+    double                *redone;
+    size_t                 increments;
+    size_t                 incrementCapacity;
+    size_t                 ringPoints;
+    size_t                 mismatches;
+    size_t                 varying;     // Lines with width factors
+} PaintBenchOutlineRun;
+
+// Points first … first+count-1 of the line and then its tail, with their radii:
+
+static size_t PaintBenchOutlineGather(PaintBenchOutlineRun *run, const PaintStrokeLine *line, size_t first,
+                                      size_t count, int constant) {
+    
+    size_t tailCount = line->pointCount ? line->tailCount : 0;
+    size_t total     = count + tailCount;
+    if (total > run->capacity) {
+        run->capacity = 2 * total;
+        run->points   = realloc(run->points, run->capacity * sizeof(PaintPoint));
+        run->radii    = realloc(run->radii, run->capacity * sizeof(PaintFloat));
+    }
+    PaintFloat radius = 0.25 * line->style.width;
+    for (size_t n = 0; n < total; n++) {
+        int fromTail   = n >= count;
+        run->points[n] = fromTail ? line->tail[n - count] : line->points[first + n];
+        run->radii[n]  = radius;
+        if (!constant && line->widths) {
+            run->radii[n] *= fromTail ? line->tailWidths[n - count] : line->widths[first + n];
+        }
+    }
+    return total;
+}
+
+static const PaintFloat *PaintBenchOutlineRadii(PaintBenchOutlineRun *run, const PaintFloat *widths,
+                                                size_t count, PaintFloat width) {
+    
+    if (count > run->capacity) {
+        run->capacity = 2 * count;
+        run->points   = realloc(run->points, run->capacity * sizeof(PaintPoint));
+        run->radii    = realloc(run->radii, run->capacity * sizeof(PaintFloat));
+    }
+    for (size_t n = 0; n < count; n++) {
+        run->radii[n] = 0.25 * width * (widths ? widths[n] : 1.0);
+    }
+    return run->radii;
+}
+
+static PaintBenchOutlineLine *PaintBenchOutlineSlot(PaintBenchOutlineRun *run, uint32_t slot) {
+    
+    if (slot >= run->slotCapacity) {
+        size_t capacity = 2 * slot + 16;
+        run->lines      = realloc(run->lines, capacity * sizeof(PaintBenchOutlineLine));
+        for (size_t n = run->slotCapacity; n < capacity; n++) {
+            run->lines[n] = (PaintBenchOutlineLine){ .openStart = 0 };
+            PaintStrokeOutlineInit(&run->lines[n].outline, 0.25 / 3.0);
+        }
+        run->slotCapacity = capacity;
+    }
+    return &run->lines[slot];
+}
+
+static void PaintBenchOutlineOpened(void *context, const PaintStrokeLine *line) {
+    
+    PaintBenchOutlineLine *open = PaintBenchOutlineSlot(context, line->slot);
+    PaintStrokeOutlineReset(&open->outline);
+    open->openStart = 0;
+    open->outlined  = 0;
+    open->width     = line->style.width;
+}
+
+static void PaintBenchOutlineExtended(void *context, const PaintStrokeLine *line, size_t firstPoint) {
+    
+    PaintBenchOutlineRun *run   = context;
+    PaintBenchOutlineLine *open = PaintBenchOutlineSlot(run, line->slot);
+    PaintFloat width            = line->style.width;
+    size_t ringCount, wholeCount;
+    
+    // What the layer did: the whole open segment from scratch, with one width:
+    size_t openCount = line->pointCount - open->openStart;
+    if (openCount > OUTLINE_SEGMENT) openCount = OUTLINE_SEGMENT;
+    size_t count     = PaintBenchOutlineGather(run, line, open->openStart, openCount, 1);
+    double start     = PaintBenchNow();
+    PaintStrokeOutlineOfPoints(&run->whole, run->points, run->radii, count, line->buttCap, &wholeCount);
+    double redone    = PaintBenchNow() - start;
+    
+    // What it does now: freeze full segments, grow the open one by the new points, close it. A
+    // new width outlines the open segment again:
+    start = PaintBenchNow();
+    if (width != open->width) {
+        PaintStrokeOutlineReset(&open->outline);
+        open->outlined = open->openStart;
+        open->width    = width;
+    }
+    while (line->pointCount - open->openStart > OUTLINE_SEGMENT) {
+        const PaintFloat *widths = line->widths ? line->widths + open->openStart : NULL;
+        PaintStrokeOutlineOfPoints(&open->outline, line->points + open->openStart,
+                                   PaintBenchOutlineRadii(run, widths, OUTLINE_SEGMENT, width),
+                                   OUTLINE_SEGMENT, line->buttCap, &ringCount);
+        open->openStart += OUTLINE_SEGMENT - 2;
+        open->outlined   = open->openStart;
+        PaintStrokeOutlineReset(&open->outline);
+    }
+    const PaintFloat *widths = line->widths ? line->widths + open->outlined : NULL;
+    PaintStrokeOutlineAppend(&open->outline, line->points + open->outlined,
+                             PaintBenchOutlineRadii(run, widths, line->pointCount - open->outlined, width),
+                             line->pointCount - open->outlined);
+    open->outlined  = line->pointCount;
+    size_t tailCount = line->pointCount ? line->tailCount : 0;
+    const PaintPoint *ring = PaintStrokeOutlineClose(&open->outline, line->tail,
+                                                     PaintBenchOutlineRadii(run, line->tailWidths, tailCount, width),
+                                                     tailCount, line->buttCap, &ringCount);
+    double grown = PaintBenchNow() - start;
+    
+    // The same ring in one go:
+    count = PaintBenchOutlineGather(run, line, open->openStart, line->pointCount - open->openStart, 0);
+    const PaintPoint *whole = PaintStrokeOutlineOfPoints(&run->whole, run->points, run->radii, count,
+                                                         line->buttCap, &wholeCount);
+    if ((ring == NULL) != (whole == NULL) || (ring && (ringCount != wholeCount
+                                                       || memcmp(ring, whole, ringCount * sizeof(PaintPoint)) != 0))) {
+        run->mismatches++;
+    }
+    
+    if (run->increments == run->incrementCapacity) {
+        run->incrementCapacity = run->incrementCapacity ? 2 * run->incrementCapacity : 4096;
+        run->grown  = realloc(run->grown, run->incrementCapacity * sizeof(double));
+        run->redone = realloc(run->redone, run->incrementCapacity * sizeof(double));
+    }
+    run->grown[run->increments]  = grown;
+    run->redone[run->increments] = redone;
+    run->increments++;
+    run->ringPoints += ring ? ringCount : 0;
+}
+
+static void PaintBenchOutlineEnded(void *context, const PaintStrokeLine *line) {
+    
+    PaintBenchOutlineRun *run = context;
+    run->varying += line->widths != NULL;
+}
+
+static void PaintBenchOutlineReport(const char *name, double *seconds, size_t count) {
+    
+    double sum = 0.0;
+    for (size_t n = 0; n < count; n++) {
+        sum += seconds[n];
+    }
+    qsort(seconds, count, sizeof(double), PaintBenchCompareDoubles);
+    printf("%-34s %8.2f µs mean %8.2f µs p99 %8.2f µs max, %5.2f%% of the 240 Hz frame at p99\n", name,
+           1e6 * sum / count, 1e6 * seconds[(size_t)(0.99 * (count - 1))], 1e6 * seconds[count - 1],
+           100.0 * seconds[(size_t)(0.99 * (count - 1))] / OUTLINE_BUDGET);
+}
+
+static int PaintBenchOutline(int argc, char **argv) {
+    
+    const char *source        = argc > 0 && strcmp(argv[0], "-") != 0 ? argv[0] : NULL;
+    PaintTouchRecord *records = NULL;
+    size_t count              = 0;
+    if (source) {
+        FILE *file = PaintTouchRecordOpen(source);
+        if (!file) {
+            fprintf(stderr, "outline: %s is no recording\n", source);
+            return 1;
+        }
+        size_t capacity = 0, read;
+        do {
+            if (count == capacity) {
+                capacity = capacity ? 2 * capacity : 16384;
+                records  = realloc(records, capacity * sizeof(PaintTouchRecord));
+            }
+            read   = PaintTouchRecordRead(file, records + count, capacity - count);
+            count += read;
+        } while (read > 0);
+        fclose(file);
+    } else {
+        PaintTouchLoad load = PaintTouchLoadDefault();
+        load.lines          = 200;
+        load.sampleRate     = 240.0;
+        load.lineTouches    = 960;
+        load.lengthSpread   = 0.5;
+        records             = PaintTouchLoadGenerate(&load, &count);
+    }
+    if (!records || count == 0) {
+        fprintf(stderr, "outline: no touches\n");
+        free(records);
+        return 1;
+    }
+    
+    PaintBenchOutlineRun run       = { .slotCapacity = 0 };
+    PaintStrokeCallbacks callbacks = { .context = &run, .lineOpened = PaintBenchOutlineOpened,
+                                       .lineExtended = PaintBenchOutlineExtended,
+                                       .lineCommitted = PaintBenchOutlineEnded, .lineRemoved = PaintBenchOutlineEnded };
+    PaintStrokeOutlineInit(&run.whole, 0.25 / 3.0);
+    PaintStrokeWidthRange range = PaintStrokeWidthRangeDefault(0.5, 2.0);
+    PaintStrokeEngine *engine   = PaintStrokeEngineCreate(5, &callbacks);
+    PaintStrokeEngineSetTolerance(engine, 0.25);
+    PaintStrokeEngineSetWidthRange(engine, &range);
+    PaintTouchLoadFeed(engine, records, count);
+    PaintStrokeEngineDestroy(engine);
+    free(records);
+    
+    int failed = 0;
+    if (run.increments == 0 || run.varying == 0 || run.mismatches > 0) {
+        fprintf(stderr, "outline: %zu increments, %zu lines with widths, %zu grown outlines differ from the whole one\n",
+                run.increments, run.varying, run.mismatches);
+        failed = 1;
+    } else {
+        printf("%zu increments of %zu lines with widths, %.0f outline points each\n", run.increments, run.varying,
+               (double)run.ringPoints / run.increments);
+        PaintBenchOutlineReport("constant width, from scratch", run.redone, run.increments);
+        PaintBenchOutlineReport("variable width, grown", run.grown, run.increments);
+    }
+    for (size_t n = 0; n < run.slotCapacity; n++) {
+        PaintStrokeOutlineFree(&run.lines[n].outline);
+    }
+    PaintStrokeOutlineFree(&run.whole);
+    free(run.lines);
+    free(run.points);
+    free(run.radii);
+    free(run.grown);
+    free(run.redone);
+    return failed;
+}
+
+#pragma mark - Timeline
+
+// Sessions of handwriting one, ten and sixty minutes long on the canvas of the document
+// benchmark, a stroke every half second with the pages written over each other, a few strokes
+// erased now and then and the whole canvas every twenty minutes. The canvas at a time is
+// painted again from the start, the way it had to be without the timeline, and by seeking the
+// timeline, first with the keyframes made and then at random times. Every seek has to give the
+// pixels of the strokes on the canvas then, painted from a store of their own.
+
+#define TIMELINE_STROKE_EVERY 0.5
+#define TIMELINE_ERASE_EVERY  20
+#define TIMELINE_CLEAR_EVERY  1200.0
+#define TIMELINE_SEEKS        40
+
+static void PaintBenchTimelineSession(PaintStrokeTimeline *timeline, double minutes) {
+    
+    size_t length          = 96;
+    PaintBenchTouch *trace = PaintBenchTrace(length);
+    PaintStoredPoint *points = malloc(length * sizeof(PaintStoredPoint));
+    int modes[]            = { 20, 10, 9, 3 };
+    double nextClear       = TIMELINE_CLEAR_EVERY;
+    size_t strokes         = (size_t)(60.0 * minutes / TIMELINE_STROKE_EVERY);
+    for (size_t n = 0; n < strokes; n++) {
+        double start = n * TIMELINE_STROKE_EVERY;
+        double dx    = 90.0 * (n % 20) + 40.0 + 3.0 * ((n / 480) % 16);
+        double dy    = 60.0 * ((n / 20) % 24) - 260.0 + 2.0 * ((n / 480) % 16);
+        for (size_t k = 0; k < length; k++) {
+            points[k] = (PaintStoredPoint){ (float)(trace[k].point.x + dx), (float)(trace[k].point.y + dy) };
+        }
+        PaintLineStyle style = PaintLineStyleDefault();
+        style.mode  = modes[n % 4];
+        style.color = style.mode > 9 ? style.mode / 10 : style.mode;
+        style.width = style.mode == 3 ? 50.0 : (style.mode == 9 ? 10.0 : 5.0);
+        style.alpha = style.mode == 3 ? 0.33 : 1.0;
+        PaintStrokeTimelineAdd(timeline, points, NULL, length, style, start, start + trace[length - 1].timestamp);
+        
+        if (n % TIMELINE_ERASE_EVERY == TIMELINE_ERASE_EVERY - 1) {
+            uint32_t erased[3] = { (uint32_t)n - 3, (uint32_t)n - 2, (uint32_t)n - 1 };
+            PaintStrokeTimelineErase(timeline, erased, 3, start + 0.45);
+        }
+        if (start + 0.45 >= nextClear) {
+            PaintStrokeTimelineClear(timeline, start + 0.48);
+            nextClear += TIMELINE_CLEAR_EVERY;
+        }
+    }
+    free(points);
+    free(trace);
+}
+
+// Paint the strokes on the canvas at time from a store of their own, all of them:
+
+static double PaintBenchTimelineRepaint(const PaintStrokeTimeline *timeline, PaintRasterPool *pool, double time,
+                                        uint32_t **tiles, uint64_t *checksum) {
+    
+    PaintStrokeStore visible;
+    PaintStrokeStoreInit(&visible);
+    double start = PaintBenchNow();
+    for (size_t index = 0; index < PaintStrokeTimelineCommitted(timeline, time); index++) {
+        if (!PaintStrokeTimelineVisible(timeline, index, time)) continue;
+        
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&timeline->store, index);
+        PaintStrokeStoreAppendWidths(&visible, PaintStrokeStorePoints(&timeline->store, stroke),
+                                     PaintStrokeStoreWidths(&timeline->store, stroke), stroke->pointCount,
+                                     PaintStrokeStoreStyle(stroke));
+    }
+    PaintRasterizeStrokes(pool, &visible, &timeline->grid, tiles);
+    double seconds = PaintBenchNow() - start;
+    *checksum      = PaintBenchRasterChecksum(tiles, &timeline->grid);
+    PaintStrokeStoreFree(&visible);
+    return seconds;
+}
+
+static int PaintBenchTimeline(int argc, char **argv) {
+    
+    double interval      = 10.0;
+    double sessions[8]   = { 1.0, 10.0, 60.0 };
+    size_t sessionCount  = 3;
+    if (argc > 0) {
+        interval = atof(argv[0]);
+    }
+    if (argc > 1) {
+        sessionCount = 0;
+        for (int n = 1; n < argc && sessionCount < 8; n++) {
+            sessions[sessionCount++] = atof(argv[n]);
+        }
+    }
+    PaintRasterPool *pool = PaintRasterPoolCreate(0);
+    uint32_t random       = 12345;
+    printf("timeline keyframe every %g s, %.0f x %.0f px, %zu threads\n", interval,
+           DOCUMENT_WIDTH * DOCUMENT_SCALE, DOCUMENT_HEIGHT * DOCUMENT_SCALE, PaintRasterPoolThreads(pool));
+    
+    for (size_t s = 0; s < sessionCount; s++) {
+        PaintStrokeTimeline timeline;
+        if (PaintStrokeTimelineInit(&timeline, DOCUMENT_WIDTH, DOCUMENT_HEIGHT, 128.0, DOCUMENT_SCALE, interval) != 0) {
+            fprintf(stderr, "timeline: no memory\n");
+            return 1;
+        }
+        PaintBenchTimelineSession(&timeline, sessions[s]);
+        uint32_t **tiles  = PaintBenchTileBuffers(&timeline.grid);
+        uint32_t **expect = PaintBenchTileBuffers(&timeline.grid);
+        double end        = timeline.latest;
+        
+        // Painting the last moment again from the start, then seeking there, which makes all
+        // keyframes:
+        uint64_t expected, checksum;
+        double repaint = PaintBenchTimelineRepaint(&timeline, pool, end, expect, &expected);
+        double start   = PaintBenchNow();
+        int failed     = PaintStrokeTimelineSeek(&timeline, pool, end, tiles) != 0;
+        double build   = PaintBenchNow() - start;
+        failed        |= PaintBenchRasterChecksum(tiles, &timeline.grid) != expected;
+        
+        double latencies[TIMELINE_SEEKS];
+        for (size_t n = 0; n < TIMELINE_SEEKS && !failed; n++) {
+            random      = random * 1664525u + 1013904223u;
+            double time = timeline.origin + (end - timeline.origin) * (random / 4294967296.0);
+            start       = PaintBenchNow();
+            failed     |= PaintStrokeTimelineSeek(&timeline, pool, time, tiles) != 0;
+            latencies[n] = PaintBenchNow() - start;
+            
+            // Every fourth one is checked, that leaves the timing of the others alone:
+            if (n % 4 == 0) {
+                PaintBenchTimelineRepaint(&timeline, pool, time, expect, &expected);
+                checksum = PaintBenchRasterChecksum(tiles, &timeline.grid);
+                if (checksum != expected) {
+                    fprintf(stderr, "timeline: the seek to %.1f s differs from the strokes on the canvas then\n",
+                            time - timeline.origin);
+                    failed = 1;
+                }
+            }
+        }
+        if (failed) {
+            fprintf(stderr, "timeline: seeking in %g minutes went wrong\n", sessions[s]);
+            return 1;
+        }
+        qsort(latencies, TIMELINE_SEEKS, sizeof(double), PaintBenchCompareDoubles);
+        printf("timeline %5.0f min, %6zu strokes, %4zu erases, %4zu keyframes %6.2f MB: "
+               "repaint %7.2f ms, keyframes %8.1f ms, seek median %6.2f ms, max %6.2f ms\n",
+               sessions[s], timeline.store.count, timeline.eraseCount, timeline.keyframeCount,
+               PaintStrokeTimelineBytes(&timeline) / 1e6, 1e3 * repaint, 1e3 * build,
+               1e3 * latencies[TIMELINE_SEEKS / 2], 1e3 * latencies[TIMELINE_SEEKS - 1]);
+        PaintBenchFreeTileBuffers(tiles, &timeline.grid);
+        PaintBenchFreeTileBuffers(expect, &timeline.grid);
+        PaintStrokeTimelineFree(&timeline);
+    }
+    PaintRasterPoolDestroy(pool);
+    return 0;
+}
+
+#pragma mark - Suite
+
+// The drawing path with fixed input, to compare one build with another: the spline stream in
+// increments of 1 … 16 touches, as -[PaintSplines splineIncrement:forLine:] gets them; the
+// stroke engine extending lines of 120 … 12000 touches, which shows what the live path costs
+// as a line grows; the rasterizer painting the committed strokes, as addPath:with: does; and
+// the touch recorder taking the increments the way writeLines: hands them over. The input is
+// the recording checked in with the tests; the long lines come from PaintTouchLoad with its
+// fixed seed. Every result is a line of JSON. Against the results of an earlier run, a metric
+// which got worse by more than the tolerance is a regression and the exit status is 1.
+// Allocations are counted where the allocator can be replaced (glibc).
+
+#define SUITE_TRACE     "pulsedTouch Demo with FingerTests/Handwriting.ptrc"
+#define SUITE_RECORDING "/tmp/paintbench-suite.ptrc"
+#define SUITE_TOLERANCE 10.0
+
+typedef struct PaintBenchResult {
+    char   benchmark[48];
+    char   metric[32];
+    double value;
+} PaintBenchResult;
+
+typedef struct PaintBenchResults {
+    PaintBenchResult *results;
+    size_t            count;
+    size_t            capacity;
+} PaintBenchResults;
+
+// One pass over the input, adding the increments (or strokes) and the vertices it handled:
+typedef void (*PaintBenchSuitePass)(void *context, size_t *increments, size_t *vertices);
+
+static void PaintBenchResultsAdd(PaintBenchResults *results, const char *benchmark, const char *metric, double value) {
+    
+    if (results->count == results->capacity) {
+        results->capacity = results->capacity ? 2 * results->capacity : 32;
+        results->results  = realloc(results->results, results->capacity * sizeof(PaintBenchResult));
+    }
+    PaintBenchResult *result = &results->results[results->count++];
+    snprintf(result->benchmark, sizeof(result->benchmark), "%s", benchmark);
+    snprintf(result->metric, sizeof(result->metric), "%s", metric);
+    result->value = value;
+}
+
+// One pass to warm up, one to count the allocations, then the best of five rounds of 50 ms at
+// least. unit names what an increment is. Returns the vertices of one pass:
+
+static size_t PaintBenchSuiteMeasure(PaintBenchResults *results, const char *benchmark, const char *unit,
+                                     PaintBenchSuitePass pass, void *context) {
+    
+    size_t increments = 0, vertices = 0;
+    pass(context, &increments, &vertices);
+    increments = vertices = 0;
+    int64_t allocations = PaintBenchAllocationCount();
+    pass(context, &increments, &vertices);
+    allocations = allocations >= 0 ? PaintBenchAllocationCount() - allocations : -1;
+    
+    double best = 1e30;
+    for (int round = 0; round < 5; round++) {
+        size_t passes = 0, ignored[2] = { 0, 0 };
+        double start  = PaintBenchNow(), elapsed;
+        do {
+            pass(context, &ignored[0], &ignored[1]);
+            passes++;
+            elapsed = PaintBenchNow() - start;
+        } while (elapsed < 0.05);
+        best = fmin(best, elapsed / passes);
+    }
+    
+    char metric[32];
+    snprintf(metric, sizeof(metric), "ns_per_%s", unit);
+    PaintBenchResultsAdd(results, benchmark, metric, 1e9 * best / increments);
+    printf("suite %-20s %10.0f ns per %-9s", benchmark, 1e9 * best / increments, unit);
+    if (vertices) {
+        PaintBenchResultsAdd(results, benchmark, "vertices_per_s", vertices / best);
+        printf(" %12.0f vertices/s", vertices / best);
+    }
+    if (allocations >= 0) {
+        snprintf(metric, sizeof(metric), "allocs_per_%s", unit);
+        PaintBenchResultsAdd(results, benchmark, metric, (double)allocations / increments);
+        printf(" %8.3f allocations per %s", (double)allocations / increments, unit);
+    }
+    printf("\n");
+    return vertices;
+}
+
+#pragma mark Spline increments
+
+typedef struct PaintBenchSuiteLines {
+    PaintSplineControl *controls;       // All lines one after the other
+    size_t             *starts;         // Of each line, and the end of the last
+    size_t              lineCount;
+    size_t              increment;
+    size_t              maxSplinePoints;
+    PaintPoint         *out;
+} PaintBenchSuiteLines;
+
+// Counts each vertex once, without the one an increment repeats:
+
+static void PaintBenchSuiteSpline(void *context, size_t *increments, size_t *vertices) {
+    
+    PaintBenchSuiteLines *lines = context;
+    for (size_t line = 0; line < lines->lineCount; line++) {
+        PaintSplineStream stream;
+        PaintSplineStreamInit(&stream);
+        size_t lineVertices = 0, end = lines->starts[line + 1];
+        for (size_t n = lines->starts[line]; n < end; n += lines->increment) {
+            size_t length  = end - n < lines->increment ? end - n : lines->increment;
+            size_t written = PaintSplineStreamFeed(&stream, lines->controls + n, length, lines->maxSplinePoints, lines->out);
+            size_t skip    = lineVertices > 0 ? 1 : 0;
+            lineVertices  += written > skip ? written - skip : 0;
+            (*increments)++;
+        }
+        *vertices += lineVertices;
+    }
+}
+
+#pragma mark Live lines
+
+typedef struct PaintBenchSuiteEngine {
+    PaintStrokeEngine      *engine;
+    const PaintTouchRecord *records;
+    size_t                  count;
+} PaintBenchSuiteEngine;
+
+static void PaintBenchSuiteExtend(void *context, size_t *increments, size_t *vertices) {
+    
+    PaintBenchSuiteEngine *run        = context;
+    PaintStrokeStatistics before      = PaintStrokeEngineGetStatistics(run->engine);
+    PaintTouchLoadFeed(run->engine, run->records, run->count);
+    PaintStrokeStatistics statistics  = PaintStrokeEngineGetStatistics(run->engine);
+    *increments += statistics.increments - before.increments;
+    *vertices   += statistics.points - before.points;
+}
+
+static void PaintBenchSuiteCommitted(void *context, const PaintStrokeLine *line) {
+    
+    PaintStrokeStoreAdd(context, line->points, line->pointCount,
+                        line->tail, line->pointCount ? line->tailCount : 0, line->style, 0.25);
+}
+
+#pragma mark Rasterizer
+
+typedef struct PaintBenchSuiteRaster {
+    PaintRasterPool        *pool;
+    const PaintStrokeStore *store;
+    const PaintTileGrid    *grid;
+    uint32_t              **tiles;
+} PaintBenchSuiteRaster;
+
+static void PaintBenchSuiteRasterize(void *context, size_t *increments, size_t *vertices) {
+    
+    PaintBenchSuiteRaster *run = context;
+    PaintRasterizeStrokes(run->pool, run->store, run->grid, run->tiles);
+    *increments += run->store->count;
+    *vertices   += run->store->pointCount;
+}
+
+#pragma mark Recorder
+
+typedef struct PaintBenchSuiteRecorder {
+    PaintTouchRecorder     *recorder;
+    const PaintTouchRecord *records;
+    size_t                  count;
+    size_t                  appended;
+} PaintBenchSuiteRecorder;
+
+// One group at a time, as they arrive:
+
+static void PaintBenchSuiteRecord(void *context, size_t *increments, size_t *vertices) {
+    
+    PaintBenchSuiteRecorder *run = context;
+    for (size_t n = 0; n < run->count; ) {
+        size_t end = n;
+        while (end + 1 < run->count && !(run->records[end].kind & PaintTouchRecordEndOfGroup)) {
+            end++;
+        }
+        for (end++; n < end; ) {
+            n += PaintTouchRecorderAppend(run->recorder, run->records + n, end - n);
+        }
+        (*increments)++;
+    }
+    run->appended += run->count;
+}
+
+#pragma mark Results
+
+static int PaintBenchResultsWrite(const PaintBenchResults *results, const char *path) {
+    
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    for (size_t n = 0; n < results->count; n++) {
+        fprintf(file, "{\"benchmark\": \"%s\", \"metric\": \"%s\", \"value\": %.6g}\n",
+                results->results[n].benchmark, results->results[n].metric, results->results[n].value);
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Rates are better when they rise, times and allocations when they fall. An allocation where
+// there was none is always a regression. Returns the number of regressions, or -1:
+
+static int PaintBenchResultsCompare(const PaintBenchResults *results, const char *path, double tolerance) {
+    
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return -1;
+    }
+    PaintBenchResults baseline = { NULL, 0, 0 };
+    PaintBenchResult result;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        if (sscanf(line, " {\"benchmark\": \"%47[^\"]\", \"metric\": \"%31[^\"]\", \"value\": %lf",
+                   result.benchmark, result.metric, &result.value) == 3) {
+            PaintBenchResultsAdd(&baseline, result.benchmark, result.metric, result.value);
+        }
+    }
+    fclose(file);
+    
+    int regressions = 0;
+    printf("suite against %s, %.0f %% tolerance:\n", path, tolerance);
+    for (size_t n = 0; n < results->count; n++) {
+        const PaintBenchResult *now = &results->results[n], *then = NULL;
+        for (size_t k = 0; k < baseline.count && !then; k++) {
+            if (strcmp(baseline.results[k].benchmark, now->benchmark) == 0
+                && strcmp(baseline.results[k].metric, now->metric) == 0) {
+                then = &baseline.results[k];
+            }
+        }
+        if (!then) {
+            printf("  %-20s %-20s %12.4g  new\n", now->benchmark, now->metric, now->value);
+            continue;
+        }
+        size_t length = strlen(now->metric);
+        int higher    = length > 6 && strcmp(now->metric + length - 6, "_per_s") == 0;
+        double change = then->value != 0.0 ? 100.0 * (now->value - then->value) / then->value
+                                           : (now->value > 0.0 ? 1e30 : 0.0);
+        int worse     = higher ? change < -tolerance : change > tolerance;
+        regressions  += worse;
+        if (then->value == 0.0) {
+            printf("  %-20s %-20s %12.4g -> %12.4g           %s\n", now->benchmark, now->metric,
+                   then->value, now->value, worse ? "  REGRESSION" : "");
+        } else {
+            printf("  %-20s %-20s %12.4g -> %12.4g %+8.1f %%%s\n", now->benchmark, now->metric,
+                   then->value, now->value, change, worse ? "  REGRESSION" : "");
+        }
+    }
+    printf("suite: %d regressions\n", regressions);
+    free(baseline.results);
+    return regressions;
+}
+
+static int PaintBenchSuite(int argc, char **argv) {
+    
+    const char *resultsPath  = argc > 0 && strcmp(argv[0], "-") != 0 ? argv[0] : NULL;
+    const char *baselinePath = argc > 1 ? argv[1] : NULL;
+    double tolerance         = argc > 2 ? strtod(argv[2], NULL) : SUITE_TOLERANCE;
+    PaintBenchResults results = { NULL, 0, 0 };
+    char name[48];
+    
+    // The recording, as it is and as lines of touches:
+    FILE *file = PaintTouchRecordOpen(SUITE_TRACE);
+    if (!file) {
+        fprintf(stderr, "suite: %s is no recording\n", SUITE_TRACE);
+        return 1;
+    }
+    size_t recordCount = 0, recordCapacity = 4096;
+    PaintTouchRecord *records = malloc(recordCapacity * sizeof(PaintTouchRecord));
+    for (size_t read; (read = PaintTouchRecordRead(file, records + recordCount, recordCapacity - recordCount)) > 0; ) {
+        recordCount += read;
+        if (recordCount == recordCapacity) {
+            recordCapacity *= 2;
+            records         = realloc(records, recordCapacity * sizeof(PaintTouchRecord));
+        }
+    }
+    fclose(file);
+    size_t touchCount;
+    PaintBenchLineTouch *touches = PaintBenchLineTouches("suite", SUITE_TRACE, &touchCount);
+    if (!touches) {
+        return 1;
+    }
+    
+    // Spline increments: the same vertices whatever the increment:
+    PaintBenchSuiteLines lines = { .increment = 1, .maxSplinePoints = 5 };
+    lines.controls = malloc(touchCount * sizeof(PaintSplineControl));
+    lines.starts   = malloc((touchCount + 1) * sizeof(size_t));
+    lines.out      = malloc(PaintSplineStreamMaxPoints(16, lines.maxSplinePoints) * sizeof(PaintPoint));
+    for (size_t n = 0; n < touchCount; n++) {
+        if (n == 0 || touches[n].lineID != touches[n - 1].lineID) {
+            lines.starts[lines.lineCount++] = n;
+        }
+        lines.controls[n] = touches[n].control;
+    }
+    lines.starts[lines.lineCount] = touchCount;
+    size_t expected = 0;
+    for (size_t increment = 1; increment <= 16; increment *= 2) {
+        lines.increment = increment;
+        snprintf(name, sizeof(name), "spline/increment-%zu", increment);
+        size_t vertices = PaintBenchSuiteMeasure(&results, name, "increment", PaintBenchSuiteSpline, &lines);
+        if (increment > 1 && vertices != expected) {
+            fprintf(stderr, "suite: %zu vertices in increments of %zu, %zu in single touches\n",
+                    vertices, increment, expected);
+            return 1;
+        }
+        expected = vertices;
+    }
+    
+    // Live lines of growing length, the same number of touches in all:
+    static const size_t lengths[3] = { 120, 1200, 12000 };
+    for (int l = 0; l < 3; l++) {
+        PaintTouchLoad load    = PaintTouchLoadDefault();
+        load.lineTouches       = lengths[l];
+        load.lines             = 24000 / lengths[l];
+        size_t count;
+        PaintTouchRecord *feed = PaintTouchLoadGenerate(&load, &count);
+        PaintBenchSuiteEngine run = { PaintStrokeEngineCreate(5, &(PaintStrokeCallbacks){ 0 }), feed, count };
+        PaintStrokeEngineSetTolerance(run.engine, 0.25);
+        snprintf(name, sizeof(name), "extend/touches-%zu", lengths[l]);
+        PaintBenchSuiteMeasure(&results, name, "increment", PaintBenchSuiteExtend, &run);
+        PaintStrokeStatistics statistics = PaintStrokeEngineGetStatistics(run.engine);
+        if (PaintStrokeEngineLineCount(run.engine) != 0 || statistics.linesCommitted == 0) {
+            fprintf(stderr, "suite: %zu lines of %zu touches left open, %zu committed\n",
+                    PaintStrokeEngineLineCount(run.engine), lengths[l], statistics.linesCommitted);
+            return 1;
+        }
+        PaintStrokeEngineDestroy(run.engine);
+        free(feed);
+    }
+    
+    // The committed lines of the recording, as many times as they fit on a page:
+    PaintStrokeStore page, store;
+    PaintStrokeStoreInit(&page);
+    PaintStrokeStoreInit(&store);
+    PaintStrokeEngine *engine = PaintStrokeEngineCreate(5, &(PaintStrokeCallbacks){
+        .context = &page, .lineCommitted = PaintBenchSuiteCommitted });
+    PaintStrokeEngineSetTolerance(engine, 0.25);
+    PaintTouchLoadFeed(engine, records, recordCount);
+    PaintStrokeEngineDestroy(engine);
+    PaintStrokeBounds bounds = PaintStrokeBoundsEmpty;
+    size_t pointCapacity     = 0;
+    for (size_t n = 0; n < page.count; n++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&page, n);
+        bounds.minX   = fminf(bounds.minX, stroke->bounds.minX);
+        bounds.minY   = fminf(bounds.minY, stroke->bounds.minY);
+        bounds.maxX   = fmaxf(bounds.maxX, stroke->bounds.maxX);
+        bounds.maxY   = fmaxf(bounds.maxY, stroke->bounds.maxY);
+        pointCapacity = stroke->pointCount > pointCapacity ? stroke->pointCount : pointCapacity;
+    }
+    if (page.count == 0) {
+        fprintf(stderr, "suite: no line of %s committed\n", SUITE_TRACE);
+        return 1;
+    }
+    PaintPoint *points = malloc(pointCapacity * sizeof(PaintPoint));
+    double width       = fmin(bounds.maxX - bounds.minX + 20.0, 1000.0);
+    double height      = fmin(bounds.maxY - bounds.minY + 20.0, 740.0);
+    for (double y = 20.0; y + height <= 768.0; y += height) {
+        for (double x = 20.0; x + width <= 1024.0; x += width) {
+            for (size_t n = 0; n < page.count; n++) {
+                const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&page, n);
+                const PaintStoredPoint *stored  = PaintStrokeStorePoints(&page, stroke);
+                for (size_t k = 0; k < stroke->pointCount; k++) {
+                    points[k] = (PaintPoint){ stored[k].x - bounds.minX + x, stored[k].y - bounds.minY + y };
+                }
+                PaintLineStyle style = PaintLineStyleDefault();
+                style.mode   = stroke->mode;
+                style.color  = stroke->color;
+                style.width  = stroke->width;
+                style.alpha  = stroke->alpha;
+                style.bright = stroke->bright;
+                PaintStrokeStoreAdd(&store, points, stroke->pointCount, NULL, 0, style, 0.0);
+            }
+        }
+    }
+    PaintTileGrid grid;
+    PaintTileGridInit(&grid, 1024.0, 768.0, 128.0, 2.0);
+    PaintBenchSuiteRaster raster = { PaintRasterPoolCreate(1), &store, &grid, PaintBenchTileBuffers(&grid) };
+    PaintBenchSuiteMeasure(&results, "raster/page", "stroke", PaintBenchSuiteRasterize, &raster);
+    const PaintStoredPoint *first = PaintStrokeStorePoints(&store, PaintStrokeStoreStroke(&store, 0));
+    size_t column = (size_t)(first->x / grid.tileSize), row = (size_t)(first->y / grid.tileSize);
+    size_t pixelsWide, pixelsHigh;
+    PaintTileGridTilePixels(&grid, row * grid.columns + column, &pixelsWide, &pixelsHigh);
+    size_t px = (size_t)((first->x - column * grid.tileSize) * grid.scale);
+    size_t py = (size_t)((first->y - row * grid.tileSize) * grid.scale);
+    if (raster.tiles[row * grid.columns + column][py * pixelsWide + px] == 0xffffffffu) {
+        fprintf(stderr, "suite: nothing painted under the first stroke\n");
+        return 1;
+    }
+    PaintRasterPoolDestroy(raster.pool);
+    PaintBenchFreeTileBuffers(raster.tiles, &grid);
+    PaintTileGridFree(&grid);
+    PaintStrokeStoreFree(&store);
+    PaintStrokeStoreFree(&page);
+    free(points);
+    
+    // The recorder, with everything it took back from the file:
+    PaintBenchSuiteRecorder recorder = { PaintTouchRecorderOpen(SUITE_RECORDING, 16384), records, recordCount, 0 };
+    if (!recorder.recorder) {
+        fprintf(stderr, "suite: cannot write %s\n", SUITE_RECORDING);
+        return 1;
+    }
+    PaintBenchSuiteMeasure(&results, "record/groups", "increment", PaintBenchSuiteRecord, &recorder);
+    size_t readBack = 0;
+    if (PaintTouchRecorderClose(recorder.recorder) != 0 || !(file = PaintTouchRecordOpen(SUITE_RECORDING))) {
+        fprintf(stderr, "suite: cannot write %s\n", SUITE_RECORDING);
+        return 1;
+    }
+    for (size_t read; (read = PaintTouchRecordRead(file, records, recordCount)) > 0; ) {
+        readBack += read;
+    }
+    fclose(file);
+    unlink(SUITE_RECORDING);
+    if (readBack != recorder.appended) {
+        fprintf(stderr, "suite: %zu records appended, %zu in the file\n", recorder.appended, readBack);
+        return 1;
+    }
+    
+    int failed = 0;
+    if (resultsPath && PaintBenchResultsWrite(&results, resultsPath) != 0) {
+        fprintf(stderr, "suite: cannot write %s\n", resultsPath);
+        failed = 1;
+    }
+    if (baselinePath) {
+        failed |= PaintBenchResultsCompare(&results, baselinePath, tolerance) != 0;
+    }
+    free(results.results);
+    free(lines.controls);
+    free(lines.starts);
+    free(lines.out);
+    free(touches);
+    free(records);
+    return failed;
+}
+
+#pragma mark - Main
+
+typedef struct PaintBenchCommand {
+    const char *name;
+    int (*run)(int argc, char **argv);
+    const char *usage;
+} PaintBenchCommand;
+
+static const PaintBenchCommand commands[] = {
+    { "spline",   PaintBenchSpline,   "spline [touches] [maxSplinePoints]" },
+    { "subdivide", PaintBenchSubdivide, "subdivide [recording.ptrc|-] [tolerance] [maxSplinePoints]" },
+    { "predict",  PaintBenchPredict,  "predict [recording.ptrc|-] [noise] [lookahead ms ...]" },
+    { "recorder", PaintBenchRecorder, "recorder [touches] [path]" },
+    { "strokefile", PaintBenchStrokeFile, "strokefile [recording.ptrc|-] [path]" },
+    { "tiles",    PaintBenchTiles,    "tiles [strokes] [tileSize]" },
+    { "touches",  PaintBenchTouches,  "touches [touches] [runs]" },
+    { "lines",    PaintBenchLines,    "lines [lookups]" },
+    { "index",    PaintBenchIndex,    "index [strokes] [queries]" },
+    { "raster",   PaintBenchRaster,   "raster [strokes] [threads]" },
+    { "document", PaintBenchDocument, "document [strokes] [path]" },
+    { "tilestore", PaintBenchTileStore, "tilestore [strokes] [budget kB]" },
+    { "load",     PaintBenchLoad,     "load [lines concurrent sampleRate touches [recording.ptrc]]" },
+    { "pipeline", PaintBenchPipeline, "pipeline" },
+    { "outline",  PaintBenchOutline,  "outline [recording.ptrc|-]" },
+    { "timeline", PaintBenchTimeline, "timeline [keyframe interval s] [minutes ...]" },
+    { "suite",    PaintBenchSuite,    "suite [results.jsonl|-] [baseline.jsonl] [tolerance %]" },
+};
+
+int main(int argc, char **argv) {
+    
+    size_t numberOfCommands = sizeof(commands) / sizeof(commands[0]);
+    for (size_t n = 0; n < numberOfCommands; n++) {
+        if (argc > 1 && strcmp(argv[1], commands[n].name) == 0) {
+            return commands[n].run(argc - 2, argv + 2);
+        }
+    }
+    fprintf(stderr, "usage:\n");
+    for (size_t n = 0; n < numberOfCommands; n++) {
+        fprintf(stderr, "  %s %s\n", argv[0], commands[n].usage);
+    }
+    return 2;
+}
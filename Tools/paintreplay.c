@@ -0,0 +1,260 @@
+//
+//  paintreplay.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Replays a touch recording (Touch protocol.ptrc) through PaintStrokeEngine, the line assembly
+//  DetailViewController runs on the device, without any UI and as fast as the machine allows:
+//
+//      cc -O2 -march=native -std=gnu99 -I "pulsedTouch Demo with Finger/Classes/Model"
+//         Tools/paintreplay.c "pulsedTouch Demo with Finger/Classes/Model/"*.c -lm -lpthread -o paintreplay
+//      ./paintreplay [-m maxSplinePoints] [-t tolerance] [-s tolerance] [-n runs] [-p] [-q] "Touch protocol.ptrc"
+//
+//  It reports increments/s and vertices/s and lists the final stroke set: every line that went
+//  into the bitmap, every line still open at the end, and a checksum over all their points.
+//  The replay is deterministic, so the checksum changes only if the drawing pipeline does.
+//  Without -t the splines are subdivided by speed, with -t they stay within tolerance points.
+//  The committed lines also go into a PaintStrokeStore, simplified within the -s tolerance
+//  (0.25 points, the default of the app on a Retina screen), which reports what it keeps.
+//  With -p the engine runs on the worker of PaintStrokePipeline, like in the app, and the
+//  strokes come from its mirror lines; the checksum must be the same.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "PaintStrokeEngine.h"
+#include "PaintStrokePipeline.h"
+#include "PaintStrokeStore.h"
+#include "PaintTouchLoad.h"
+#include "PaintTouchRecorder.h"
+
+#pragma mark - Final stroke set
+
+typedef struct PaintReplayStroke {
+    uint32_t       lineID;
+    PaintLineStyle style;
+    size_t         pointCount;
+    PaintPoint     min, max;
+    uint64_t       checksum;
+    int            committed;
+} PaintReplayStroke;
+
+typedef struct PaintReplay {
+    int                collect;         // Keep the strokes, only for the first run
+    PaintReplayStroke *strokes;
+    size_t             strokeCount;
+    size_t             strokeCapacity;
+    size_t             vertices;        // stable and tail points handed to the display
+    PaintStrokeStore   store;           // The committed lines as the view keeps them
+    double             storeTolerance;
+} PaintReplay;
+
+// FNV-1a over the coordinates, so two stroke sets can be compared at a glance:
+
+static uint64_t PaintReplayHash(uint64_t hash, const PaintPoint *points, size_t count) {
+    
+    const unsigned char *bytes = (const unsigned char *)points;
+    for (size_t n = 0; n < count * sizeof(PaintPoint); n++) {
+        hash = (hash ^ bytes[n]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void PaintReplayKeep(PaintReplay *replay, const PaintStrokeLine *line, int committed) {
+    
+    if (!replay->collect) {
+        return;
+    }
+    if (replay->strokeCount == replay->strokeCapacity) {
+        replay->strokeCapacity = replay->strokeCapacity ? 2 * replay->strokeCapacity : 64;
+        replay->strokes        = realloc(replay->strokes, replay->strokeCapacity * sizeof(PaintReplayStroke));
+    }
+    PaintReplayStroke *stroke = &replay->strokes[replay->strokeCount++];
+    stroke->lineID     = line->lineID;
+    stroke->style      = line->style;
+    stroke->pointCount = line->pointCount + line->tailCount;
+    stroke->committed  = committed;
+    stroke->checksum   = PaintReplayHash(PaintReplayHash(0xcbf29ce484222325ULL, line->points, line->pointCount),
+                                         line->tail, line->tailCount);
+    stroke->min.x = stroke->min.y =  1e30;
+    stroke->max.x = stroke->max.y = -1e30;
+    for (size_t n = 0; n < stroke->pointCount; n++) {
+        PaintPoint p  = n < line->pointCount ? line->points[n] : line->tail[n - line->pointCount];
+        stroke->min.x = p.x < stroke->min.x ? p.x : stroke->min.x;
+        stroke->min.y = p.y < stroke->min.y ? p.y : stroke->min.y;
+        stroke->max.x = p.x > stroke->max.x ? p.x : stroke->max.x;
+        stroke->max.y = p.y > stroke->max.y ? p.y : stroke->max.y;
+    }
+}
+
+static void PaintReplayExtended(void *context, const PaintStrokeLine *line, size_t firstPoint) {
+    
+    PaintReplay *replay = context;
+    replay->vertices   += line->pointCount - firstPoint + line->tailCount;
+}
+
+static void PaintReplayOpened(void *context, const PaintStrokeLine *line) {
+    
+    PaintReplayExtended(context, line, 0);
+}
+
+static void PaintReplayCommitted(void *context, const PaintStrokeLine *line) {
+    
+    PaintReplay *replay = context;
+    PaintReplayKeep(replay, line, 1);
+    if (replay->collect) {
+        PaintStrokeStoreAdd(&replay->store, line->points, line->pointCount,
+                            line->tail, line->pointCount ? line->tailCount : 0, line->style, replay->storeTolerance);
+    }
+}
+
+#pragma mark - Replay
+
+static PaintStrokeStatistics PaintReplayRun(const PaintTouchRecord *records, size_t count,
+                                            size_t maxSplinePoints, double tolerance, int pipelined,
+                                            PaintReplay *replay) {
+    
+    PaintStrokeCallbacks callbacks = {
+        .context       = replay,
+        .lineOpened    = PaintReplayOpened,
+        .lineExtended  = PaintReplayExtended,
+        .lineCommitted = PaintReplayCommitted,
+    };
+    if (pipelined) {
+        PaintStrokePipeline *pipeline = PaintStrokePipelineCreate(maxSplinePoints, &callbacks, NULL, NULL);
+        PaintStrokePipelineSetTolerance(pipeline, tolerance);
+        PaintTouchLoadFeedPipeline(pipeline, records, count);
+        PaintStrokePipelineFlush(pipeline);
+        for (size_t n = 0; n < PaintStrokePipelineLineCount(pipeline); n++) {
+            PaintReplayKeep(replay, PaintStrokePipelineLineAtIndex(pipeline, n), 0);
+        }
+        PaintStrokeStatistics statistics = PaintStrokePipelineEngineStatistics(pipeline);
+        PaintStrokePipelineDestroy(pipeline);
+        return statistics;
+    }
+    PaintStrokeEngine *engine = PaintStrokeEngineCreate(maxSplinePoints, &callbacks);
+    PaintStrokeEngineSetTolerance(engine, tolerance);
+    PaintTouchLoadFeed(engine, records, count);
+    
+    // Lines which are still open at the end are part of the result, too:
+    for (size_t n = 0; n < PaintStrokeEngineLineCount(engine); n++) {
+        PaintReplayKeep(replay, PaintStrokeEngineLineAtIndex(engine, n), 0);
+    }
+    PaintStrokeStatistics statistics = PaintStrokeEngineGetStatistics(engine);
+    PaintStrokeEngineDestroy(engine);
+    return statistics;
+}
+
+#pragma mark - Main
+
+static double PaintReplayNow(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static PaintTouchRecord *PaintReplayLoad(const char *path, size_t *count) {
+    
+    FILE *file = PaintTouchRecordOpen(path);
+    if (!file) {
+        return NULL;
+    }
+    size_t capacity           = 4096;
+    PaintTouchRecord *records = malloc(capacity * sizeof(PaintTouchRecord));
+    size_t read;
+    *count = 0;
+    while ((read = PaintTouchRecordRead(file, records + *count, capacity - *count)) > 0) {
+        *count += read;
+        if (*count == capacity) {
+            capacity *= 2;
+            records   = realloc(records, capacity * sizeof(PaintTouchRecord));
+        }
+    }
+    fclose(file);
+    return records;
+}
+
+int main(int argc, char **argv) {
+    
+    size_t maxSplinePoints = 5;
+    size_t runs            = 1;
+    double tolerance       = 0.0;
+    double storeTolerance  = 0.25;
+    int quiet              = 0;
+    int pipelined          = 0;
+    int arg                = 1;
+    for (; arg < argc - 1 && argv[arg][0] == '-'; arg++) {
+        if (strcmp(argv[arg], "-m") == 0 && arg + 1 < argc - 1) {
+            maxSplinePoints = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-t") == 0 && arg + 1 < argc - 1) {
+            tolerance = strtod(argv[++arg], NULL);
+        } else if (strcmp(argv[arg], "-s") == 0 && arg + 1 < argc - 1) {
+            storeTolerance = strtod(argv[++arg], NULL);
+        } else if (strcmp(argv[arg], "-n") == 0 && arg + 1 < argc - 1) {
+            runs = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-q") == 0) {
+            quiet = 1;
+        } else if (strcmp(argv[arg], "-p") == 0) {
+            pipelined = 1;
+        } else {
+            break;
+        }
+    }
+    if (arg != argc - 1 || runs == 0) {
+        fprintf(stderr, "usage: %s [-m maxSplinePoints] [-t tolerance] [-s tolerance] [-n runs] [-p] [-q] recording.ptrc\n", argv[0]);
+        return 2;
+    }
+    
+    size_t count;
+    PaintTouchRecord *records = PaintReplayLoad(argv[arg], &count);
+    if (!records) {
+        fprintf(stderr, "%s: no touch recording\n", argv[arg]);
+        return 1;
+    }
+    
+    PaintReplay replay = { .collect = 1, .storeTolerance = storeTolerance };
+    PaintStrokeStoreInit(&replay.store);
+    PaintStrokeStatistics statistics;
+    double start = PaintReplayNow();
+    for (size_t run = 0; run < runs; run++) {
+        statistics     = PaintReplayRun(records, count, maxSplinePoints, tolerance, pipelined, &replay);
+        replay.collect = 0;
+    }
+    double elapsed = (PaintReplayNow() - start) / runs;
+    
+    printf("%zu records, %zu increments, %zu touches, %zu vertices in %.3f ms per run\n",
+           count, statistics.increments, statistics.touches, replay.vertices / runs, 1e3 * elapsed);
+    printf("%.0f increments/s, %.0f vertices/s\n",
+           statistics.increments / elapsed, replay.vertices / runs / elapsed);
+    printf("%zu lines opened, %zu committed, %zu removed, %zu still open\n",
+           statistics.linesOpened, statistics.linesCommitted, statistics.linesRemoved,
+           statistics.linesOpened - statistics.linesCommitted - statistics.linesRemoved);
+    
+    uint64_t checksum = 0xcbf29ce484222325ULL;
+    for (size_t n = 0; n < replay.strokeCount; n++) {
+        const PaintReplayStroke *stroke = &replay.strokes[n];
+        checksum = (checksum ^ stroke->checksum) * 0x100000001b3ULL;
+        if (quiet) continue;
+        
+        printf("%s line %5u mode %3d color %d width %5.1f alpha %4.2f %6zu points (%7.1f %7.1f) … (%7.1f %7.1f) %016llx\n",
+               stroke->committed ? "committed" : "open     ", stroke->lineID, stroke->style.mode, stroke->style.color,
+               stroke->style.width, stroke->style.alpha, stroke->pointCount,
+               stroke->min.x, stroke->min.y, stroke->max.x, stroke->max.y, (unsigned long long)stroke->checksum);
+    }
+    printf("stroke set checksum %016llx\n", (unsigned long long)checksum);
+    if (replay.store.count) {
+        printf("stroke store: %zu strokes, %zu of %zu points kept (%.1f %%), %.0f bytes per stroke\n",
+               replay.store.count, replay.store.pointCount, replay.store.pointsIn,
+               100.0 * replay.store.pointCount / replay.store.pointsIn,
+               (double)PaintStrokeStoreBytes(&replay.store) / replay.store.count);
+    }
+    
+    PaintStrokeStoreFree(&replay.store);
+    free(replay.strokes);
+    free(records);
+    return 0;
+}
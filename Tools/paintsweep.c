@@ -0,0 +1,628 @@
+//
+//  paintsweep.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Sweeps the rendering parameters of the lines over a corpus of touch recordings, offline and
+//  on all cores:
+//
+//      cc -O2 -march=native -std=gnu99 -I "pulsedTouch Demo with Finger/Classes/Model"
+//         Tools/paintsweep.c "pulsedTouch Demo with Finger/Classes/Model/"*.c -lm -lpthread -o paintsweep
+//      ./paintsweep [-j threads] [-n rows] [-o results.csv] [-m 3,5,8] [-t 0,0.25] [-g 0,0.5,1] [-s 0,0.5,1]
+//                   recording.ptrc …
+//
+//  The parameters are the cap of spline points per segment (-m, maxSplinePoints of
+//  PaintViewData), the tolerance of the subdivision (-t, 0 for the division count from the
+//  speed), how far the tail reaches beyond the newest touch (-g, the gain of
+//  PaintSplineStreamTailWithGain(); 1 is the extrapolation of addLastPointToPath:fromPoints:)
+//  and where an increment which ends with an extrapolated point leads the tail (-s: 0 ignores
+//  the point like the stroke engine, 0.5 goes half the way to it like paintIncrement used to,
+//  1 all the way).
+//
+//  Every combination replays the pen and finger lines of all recordings in the increments they
+//  were recorded in and gets four scores: the stable vertices per touch, the CPU time per touch
+//  of the spline stream and its tails, the deviation of the vertices from the curve, which is
+//  sampled to 1/100 point, and the overshoot of the tails, how far they stray from where the
+//  line really went. The table is ranked by Pareto fronts over vertices, deviation and
+//  overshoot (time depends on the machine), within a front by deviation plus overshoot. After
+//  it come the mean scores of all combinations with a parameter at each of its values, the
+//  sensitivity of the scores to that parameter. The combinations run on a pool of threads which
+//  share nothing but the corpus, so the sweep scales with the cores.
+//
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "PaintSplineKernel.h"
+#include "PaintTouchRecorder.h"
+
+#define SWEEP_MAX_VALUES          32
+#define SWEEP_REFERENCE_TOLERANCE 0.01
+#define SWEEP_REFERENCE_POINTS    256
+#define SWEEP_TAIL_WINDOW         3     // Segments beyond the newest touch a tail is compared with
+#define SWEEP_RUNS                5
+
+static double PaintSweepNow(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+static double PaintSweepThreadTime(void) {
+    
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+#pragma mark - Corpus
+
+// The touches of one increment of a line, as the recognizer handed them over:
+typedef struct PaintSweepIncrement {
+    size_t     end;                     // Touches of the line up to here
+    int        extrapolated;            // Ends with an extrapolated point …
+    PaintPoint target;                  // … at target
+} PaintSweepIncrement;
+
+typedef struct PaintSweepLine {
+    size_t firstTouch;
+    size_t touchCount;
+    size_t firstIncrement;
+    size_t incrementCount;
+    size_t firstEnd;                    // touchCount + 2 entries of referenceEnds
+} PaintSweepLine;
+
+// Pen and finger lines of all recordings. The reference of a line is its curve through all
+// touches, sampled densely, with two more segments to the last touch; referenceEnds tells where
+// the segment ending at each touch stops:
+
+typedef struct PaintSweepCorpus {
+    PaintSplineControl  *touches;
+    size_t               touchCount, touchCapacity;
+    PaintSweepIncrement *increments;
+    size_t               incrementCount, incrementCapacity;
+    PaintSweepLine      *lines;
+    size_t               lineCount, lineCapacity;
+    PaintPoint          *reference;
+    size_t               referenceCount, referenceCapacity;
+    size_t              *referenceEnds;
+    size_t               endCount, endCapacity;
+    size_t               maxIncrement;  // Touches
+} PaintSweepCorpus;
+
+// Room for one more element in an array of count:
+
+static void *PaintSweepReserve(void *array, size_t count, size_t *capacity, size_t size) {
+    
+    if (count < *capacity) {
+        return array;
+    }
+    *capacity = *capacity ? 2 * *capacity : 1024;
+    array     = realloc(array, *capacity * size);
+    if (!array) {
+        fprintf(stderr, "paintsweep: out of memory\n");
+        exit(1);
+    }
+    return array;
+}
+
+typedef struct PaintSweepRecord {
+    PaintTouchRecord record;
+    size_t           group;
+    size_t           index;
+} PaintSweepRecord;
+
+static int PaintSweepCompareRecords(const void *a, const void *b) {
+    
+    const PaintSweepRecord *x = a, *y = b;
+    if (x->record.lineID != y->record.lineID) return x->record.lineID < y->record.lineID ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+static void PaintSweepAddReference(PaintSweepCorpus *corpus, const PaintSweepLine *line) {
+    
+    PaintSplineStream stream;
+    PaintSplineStreamInit(&stream);
+    PaintSplineStreamSetTolerance(&stream, SWEEP_REFERENCE_TOLERANCE);
+    PaintPoint out[SWEEP_REFERENCE_POINTS + 2];
+    const PaintSplineControl *touches = corpus->touches + line->firstTouch;
+    for (size_t k = 0; k < line->touchCount + 2; k++) {
+        const PaintSplineControl *touch = &touches[k < line->touchCount ? k : line->touchCount - 1];
+        size_t written = PaintSplineStreamFeed(&stream, touch, 1, SWEEP_REFERENCE_POINTS, out);
+        
+        // Each segment after the first one starts with the end of the one before:
+        for (size_t i = k > 0 ? 1 : 0; i < written; i++) {
+            corpus->reference = PaintSweepReserve(corpus->reference, corpus->referenceCount,
+                                                  &corpus->referenceCapacity, sizeof(PaintPoint));
+            corpus->reference[corpus->referenceCount++] = out[i];
+        }
+        corpus->referenceEnds = PaintSweepReserve(corpus->referenceEnds, corpus->endCount,
+                                                  &corpus->endCapacity, sizeof(size_t));
+        corpus->referenceEnds[corpus->endCount++] = corpus->referenceCount;
+    }
+}
+
+// Add the pen and finger lines of a recording. A line with a palm touch is rejected in the app
+// and left out; so are lines of fewer than three touches, which get no spline.
+
+static int PaintSweepLoad(PaintSweepCorpus *corpus, const char *path) {
+    
+    FILE *file = PaintTouchRecordOpen(path);
+    if (!file) {
+        return -1;
+    }
+    PaintSweepRecord *records = NULL;
+    size_t count = 0, capacity = 0, group = 0;
+    PaintTouchRecord record;
+    while (PaintTouchRecordRead(file, &record, 1) == 1) {
+        if ((record.kind & PaintTouchRecordKindMask) == PaintTouchRecordTouch) {
+            records = PaintSweepReserve(records, count, &capacity, sizeof(PaintSweepRecord));
+            records[count] = (PaintSweepRecord){ record, group, count };
+            count++;
+        }
+        group += (record.kind & PaintTouchRecordEndOfGroup) != 0;
+    }
+    fclose(file);
+    qsort(records, count, sizeof(PaintSweepRecord), PaintSweepCompareRecords);
+    
+    for (size_t first = 0, end; first < count; first = end) {
+        int palm = 0;
+        for (end = first; end < count && records[end].record.lineID == records[first].record.lineID; end++) {
+            palm |= records[end].record.classification == 3;
+        }
+        if (palm) continue;
+        
+        PaintSweepLine line = { corpus->touchCount, 0, corpus->incrementCount, 0, corpus->endCount };
+        for (size_t n = first; n < end; n++) {
+            const PaintTouchRecord *touch = &records[n].record;
+            if (touch->classification < 3) {
+                corpus->touches = PaintSweepReserve(corpus->touches, corpus->touchCount,
+                                                    &corpus->touchCapacity, sizeof(PaintSplineControl));
+                corpus->touches[corpus->touchCount++] = (PaintSplineControl){ { touch->x, touch->y },
+                                                                              { touch->vx, touch->vy }, touch->timestamp };
+                line.touchCount++;
+            }
+            
+            // The increment ends with the last touch of the line in a group:
+            if (n + 1 == end || records[n + 1].group != records[n].group) {
+                corpus->increments = PaintSweepReserve(corpus->increments, corpus->incrementCount,
+                                                       &corpus->incrementCapacity, sizeof(PaintSweepIncrement));
+                PaintSweepIncrement *increment = &corpus->increments[corpus->incrementCount++];
+                *increment = (PaintSweepIncrement){ line.touchCount, touch->classification > 3, { touch->x, touch->y } };
+                line.incrementCount++;
+            }
+        }
+        if (line.touchCount < 3) {
+            corpus->touchCount     = line.firstTouch;
+            corpus->incrementCount = line.firstIncrement;
+            continue;
+        }
+        for (size_t n = 0, start = 0; n < line.incrementCount; n++) {
+            size_t length        = corpus->increments[line.firstIncrement + n].end - start;
+            corpus->maxIncrement = length > corpus->maxIncrement ? length : corpus->maxIncrement;
+            start               += length;
+        }
+        PaintSweepAddReference(corpus, &line);
+        corpus->lines = PaintSweepReserve(corpus->lines, corpus->lineCount, &corpus->lineCapacity, sizeof(PaintSweepLine));
+        corpus->lines[corpus->lineCount++] = line;
+    }
+    free(records);
+    return 0;
+}
+
+#pragma mark - Scores
+
+typedef struct PaintSweepCombination {
+    size_t maxSplinePoints;
+    double tolerance;
+    double gain;
+    double share;
+    
+    // Scores:
+    double verticesPerTouch;
+    double nsPerTouch;
+    double deviationMean, deviationMax;
+    double overshootMean, overshootMax;
+    int    front;
+} PaintSweepCombination;
+
+// Distance of p from a polyline of count points, count > 0:
+
+static double PaintSweepDistance(PaintPoint p, const PaintPoint *polyline, size_t count) {
+    
+    double best = hypot(polyline[0].x - p.x, polyline[0].y - p.y);
+    for (size_t n = 0; n + 1 < count; n++) {
+        double ax = polyline[n].x, ay = polyline[n].y;
+        double dx = polyline[n + 1].x - ax, dy = polyline[n + 1].y - ay;
+        double length2 = dx * dx + dy * dy;
+        double t       = length2 > 0.0 ? ((p.x - ax) * dx + (p.y - ay) * dy) / length2 : 0.0;
+        t              = t < 0.0 ? 0.0 : (t > 1.0 ? 1.0 : t);
+        best           = fmin(best, hypot(ax + t * dx - p.x, ay + t * dy - p.y));
+    }
+    return best;
+}
+
+// The tail shown after an increment: towards the extrapolated point if there is one and the
+// combination uses it, otherwise beyond the newest touch by the gain. The last increment always
+// gets the extrapolated tail, the engine adds it when the line ends:
+
+static size_t PaintSweepTail(const PaintSweepCombination *combination, const PaintSplineStream *stream,
+                             const PaintSweepIncrement *increment, int last, PaintPoint *out) {
+    
+    if (!last && !increment->extrapolated) {
+        return 0;
+    }
+    if (!last && combination->share > 0.0 && stream->count >= 2) {
+        PaintPoint newest = stream->control[3].point;
+        PaintPoint target = { (PaintFloat)(newest.x + combination->share * (increment->target.x - newest.x)),
+                              (PaintFloat)(newest.y + combination->share * (increment->target.y - newest.y)) };
+        return PaintSplineStreamTailTo(stream, target, combination->maxSplinePoints, out);
+    }
+    return PaintSplineStreamTailWithGain(stream, combination->gain, combination->maxSplinePoints, out);
+}
+
+// Replay all lines as the app would, in their increments, for the time:
+
+static void PaintSweepReplay(const PaintSweepCorpus *corpus, const PaintSweepCombination *combination,
+                             PaintPoint *out) {
+    
+    for (size_t l = 0; l < corpus->lineCount; l++) {
+        const PaintSweepLine *line = &corpus->lines[l];
+        PaintSplineStream stream;
+        PaintSplineStreamInit(&stream);
+        PaintSplineStreamSetTolerance(&stream, combination->tolerance);
+        for (size_t n = 0, start = 0; n < line->incrementCount; n++) {
+            const PaintSweepIncrement *increment = &corpus->increments[line->firstIncrement + n];
+            PaintSplineStreamFeed(&stream, corpus->touches + line->firstTouch + start, increment->end - start,
+                                  combination->maxSplinePoints, out);
+            PaintSweepTail(combination, &stream, increment, n + 1 == line->incrementCount, out);
+            start = increment->end;
+        }
+    }
+}
+
+static void PaintSweepScore(const PaintSweepCorpus *corpus, PaintSweepCombination *combination, PaintPoint *out) {
+    
+    size_t vertices = 0, segments = 0, tails = 0;
+    double deviation = 0.0, overshoot = 0.0;
+    combination->deviationMax = combination->overshootMax = 0.0;
+    
+    for (size_t l = 0; l < corpus->lineCount; l++) {
+        const PaintSweepLine *line = &corpus->lines[l];
+        const size_t *ends         = corpus->referenceEnds + line->firstEnd;
+        PaintSplineStream stream;
+        PaintSplineStreamInit(&stream);
+        PaintSplineStreamSetTolerance(&stream, combination->tolerance);
+        size_t k = 0;
+        for (size_t n = 0; n < line->incrementCount; n++) {
+            const PaintSweepIncrement *increment = &corpus->increments[line->firstIncrement + n];
+            
+            // One touch at a time gives the same points, and each segment on its own:
+            for (; k < increment->end; k++) {
+                size_t written = PaintSplineStreamFeed(&stream, corpus->touches + line->firstTouch + k, 1,
+                                                       combination->maxSplinePoints, out);
+                vertices      += k > 0 ? written - 1 : written;
+                if (k == 0) continue;
+                
+                double worst = 0.0;
+                for (size_t r = ends[k - 1] - 1; r < ends[k]; r++) {
+                    worst = fmax(worst, PaintSweepDistance(corpus->reference[r], out, written));
+                }
+                deviation += worst;
+                segments++;
+                combination->deviationMax = fmax(combination->deviationMax, worst);
+            }
+            
+            // How far the tail strays from the line that followed, from the newest segment on:
+            size_t written = PaintSweepTail(combination, &stream, increment, n + 1 == line->incrementCount, out);
+            if (written == 0) continue;
+            
+            size_t from = ends[k >= 2 ? k - 2 : 0] - 1;
+            size_t to   = ends[k - 1 + SWEEP_TAIL_WINDOW < line->touchCount + 1 ? k - 1 + SWEEP_TAIL_WINDOW
+                                                                               : line->touchCount + 1];
+            double worst = 0.0;
+            for (size_t i = 0; i < written; i++) {
+                worst = fmax(worst, PaintSweepDistance(out[i], corpus->reference + from, to - from));
+            }
+            overshoot += worst;
+            tails++;
+            combination->overshootMax = fmax(combination->overshootMax, worst);
+        }
+    }
+    combination->verticesPerTouch = (double)vertices / corpus->touchCount;
+    combination->deviationMean    = segments ? deviation / segments : 0.0;
+    combination->overshootMean    = tails ? overshoot / tails : 0.0;
+}
+
+#pragma mark - Threads
+
+typedef struct PaintSweepWork {
+    const PaintSweepCorpus *corpus;
+    PaintSweepCombination  *combinations;
+    size_t                  count;
+    size_t                  next;       // Taken with an atomic increment
+    double                  cpuTime;
+    pthread_mutex_t         lock;
+} PaintSweepWork;
+
+static void *PaintSweepWorker(void *context) {
+    
+    PaintSweepWork *work = context;
+    double start         = PaintSweepThreadTime();
+    PaintPoint *out      = NULL;
+    size_t capacity      = 0;
+    for (size_t n; (n = __atomic_fetch_add(&work->next, 1, __ATOMIC_RELAXED)) < work->count; ) {
+        PaintSweepCombination *combination = &work->combinations[n];
+        size_t needed = PaintSplineStreamMaxPoints(work->corpus->maxIncrement, combination->maxSplinePoints)
+                      + combination->maxSplinePoints + 2;
+        if (needed > capacity) {
+            capacity = needed;
+            out      = realloc(out, capacity * sizeof(PaintPoint));
+        }
+        double best = INFINITY;
+        for (int run = 0; run < SWEEP_RUNS; run++) {
+            double runStart = PaintSweepThreadTime();
+            PaintSweepReplay(work->corpus, combination, out);
+            best = fmin(best, PaintSweepThreadTime() - runStart);
+        }
+        combination->nsPerTouch = 1e9 * best / work->corpus->touchCount;
+        PaintSweepScore(work->corpus, combination, out);
+    }
+    free(out);
+    pthread_mutex_lock(&work->lock);
+    work->cpuTime += PaintSweepThreadTime() - start;
+    pthread_mutex_unlock(&work->lock);
+    return NULL;
+}
+
+#pragma mark - Ranking
+
+static int PaintSweepDominates(const PaintSweepCombination *a, const PaintSweepCombination *b) {
+    
+    return a->verticesPerTouch <= b->verticesPerTouch && a->deviationMean <= b->deviationMean
+        && a->overshootMean <= b->overshootMean
+        && (a->verticesPerTouch < b->verticesPerTouch || a->deviationMean < b->deviationMean
+            || a->overshootMean < b->overshootMean);
+}
+
+static void PaintSweepAssignFronts(PaintSweepCombination *combinations, size_t count) {
+    
+    for (size_t n = 0; n < count; n++) {
+        combinations[n].front = 0;
+    }
+    size_t assigned = 0;
+    for (int front = 1; assigned < count; front++) {
+        for (size_t n = 0; n < count; n++) {
+            if (combinations[n].front) continue;
+            
+            // Dominated by none of those still without a front, including the ones just put in this one:
+            int dominated = 0;
+            for (size_t k = 0; k < count && !dominated; k++) {
+                dominated = combinations[k].front <= 0 && PaintSweepDominates(&combinations[k], &combinations[n]);
+            }
+            if (!dominated) {
+                combinations[n].front = -front;
+            }
+        }
+        for (size_t n = 0; n < count; n++) {
+            if (combinations[n].front < 0) {
+                combinations[n].front = front;
+                assigned++;
+            }
+        }
+    }
+}
+
+static int PaintSweepCompareCombinations(const void *a, const void *b) {
+    
+    const PaintSweepCombination *x = a, *y = b;
+    if (x->front != y->front) return x->front < y->front ? -1 : 1;
+    double ex = x->deviationMean + x->overshootMean, ey = y->deviationMean + y->overshootMean;
+    if (ex != ey) return ex < ey ? -1 : 1;
+    return x->verticesPerTouch < y->verticesPerTouch ? -1 : (x->verticesPerTouch > y->verticesPerTouch);
+}
+
+static void PaintSweepPrintHeader(const char *first) {
+    
+    printf("%-22s %9s %9s %9s %9s %9s %9s\n", first, "vertices", "ns", "deviation", "max", "overshoot", "max");
+}
+
+static void PaintSweepPrintScores(const PaintSweepCombination *c) {
+    
+    printf(" %9.3f %9.1f %9.4f %9.4f %9.3f %9.3f\n", c->verticesPerTouch, c->nsPerTouch,
+           c->deviationMean, c->deviationMax, c->overshootMean, c->overshootMax);
+}
+
+// Mean scores of the combinations with parameter p at each of its values:
+
+static double PaintSweepParameter(const PaintSweepCombination *combination, int p) {
+    
+    switch (p) {
+        case 0:  return (double)combination->maxSplinePoints;
+        case 1:  return combination->tolerance;
+        case 2:  return combination->gain;
+        default: return combination->share;
+    }
+}
+
+static void PaintSweepSensitivity(const PaintSweepCombination *combinations, size_t count, int p,
+                                  const char *name, const double *values, size_t valueCount) {
+    
+    printf("\n");
+    PaintSweepPrintHeader(name);
+    for (size_t v = 0; v < valueCount; v++) {
+        PaintSweepCombination mean = { 0 };
+        size_t matching = 0;
+        for (size_t n = 0; n < count; n++) {
+            const PaintSweepCombination *c = &combinations[n];
+            if (PaintSweepParameter(c, p) != values[v]) continue;
+            
+            mean.verticesPerTouch += c->verticesPerTouch;
+            mean.nsPerTouch       += c->nsPerTouch;
+            mean.deviationMean    += c->deviationMean;
+            mean.deviationMax      = fmax(mean.deviationMax, c->deviationMax);
+            mean.overshootMean    += c->overshootMean;
+            mean.overshootMax      = fmax(mean.overshootMax, c->overshootMax);
+            matching++;
+        }
+        mean.verticesPerTouch /= matching;
+        mean.nsPerTouch       /= matching;
+        mean.deviationMean    /= matching;
+        mean.overshootMean    /= matching;
+        printf("  %-20g", values[v]);
+        PaintSweepPrintScores(&mean);
+    }
+}
+
+#pragma mark - Main
+
+static size_t PaintSweepParseValues(const char *list, double *values) {
+    
+    size_t count = 0;
+    for (const char *p = list; *p && count < SWEEP_MAX_VALUES; ) {
+        char *end;
+        values[count] = strtod(p, &end);
+        if (end == p) {
+            return 0;
+        }
+        count++;
+        p = *end == ',' ? end + 1 : end;
+    }
+    return count;
+}
+
+int main(int argc, char **argv) {
+    
+    double grid[4][SWEEP_MAX_VALUES] = {
+        { 2, 3, 4, 5, 6, 8, 12 }, { 0.0, 0.1, 0.25, 0.5 }, { 0.0, 0.5, 1.0, 1.5 }, { 0.0, 0.5, 1.0 } };
+    size_t gridCount[4]   = { 7, 4, 4, 3 };
+    static const char *names[4] = { "maxSplinePoints", "tolerance", "gain", "share" };
+    static const char *flags    = "mtgs";
+    long threads          = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t rows           = 20;
+    const char *csv       = NULL;
+    int arg               = 1;
+    for (; arg < argc - 1 && argv[arg][0] == '-'; arg++) {
+        const char *flag = argv[arg][1] && !argv[arg][2] ? strchr(flags, argv[arg][1]) : NULL;
+        if (flag && *flag) {
+            size_t p     = (size_t)(flag - flags);
+            gridCount[p] = PaintSweepParseValues(argv[++arg], grid[p]);
+            if (gridCount[p] == 0) break;
+        } else if (strcmp(argv[arg], "-j") == 0) {
+            threads = strtol(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-n") == 0) {
+            rows = strtoul(argv[++arg], NULL, 10);
+        } else if (strcmp(argv[arg], "-o") == 0) {
+            csv = argv[++arg];
+        } else {
+            break;
+        }
+    }
+    int valid = arg < argc && threads > 0 && gridCount[0] && gridCount[1] && gridCount[2] && gridCount[3];
+    for (size_t v = 0; valid && v < gridCount[0]; v++) {
+        grid[0][v] = floor(grid[0][v]);
+        valid      = grid[0][v] >= 1.0 && grid[0][v] <= 256.0;
+    }
+    if (!valid) {
+        fprintf(stderr, "usage: %s [-j threads] [-n rows] [-o results.csv] [-m maxSplinePoints,…] [-t tolerance,…]\n"
+                        "       [-g gain,…] [-s share,…] recording.ptrc …\n", argv[0]);
+        return 2;
+    }
+    
+    PaintSweepCorpus corpus = { 0 };
+    for (; arg < argc; arg++) {
+        if (PaintSweepLoad(&corpus, argv[arg]) != 0) {
+            fprintf(stderr, "%s: no touch recording\n", argv[arg]);
+            return 1;
+        }
+    }
+    if (corpus.lineCount == 0) {
+        fprintf(stderr, "paintsweep: no pen or finger lines\n");
+        return 1;
+    }
+    
+    size_t count = gridCount[0] * gridCount[1] * gridCount[2] * gridCount[3], n = 0;
+    PaintSweepCombination *combinations = calloc(count, sizeof(PaintSweepCombination));
+    for (size_t m = 0; m < gridCount[0]; m++)
+        for (size_t t = 0; t < gridCount[1]; t++)
+            for (size_t g = 0; g < gridCount[2]; g++)
+                for (size_t s = 0; s < gridCount[3]; s++) {
+                    combinations[n++] = (PaintSweepCombination){ .maxSplinePoints = (size_t)grid[0][m],
+                        .tolerance = grid[1][t], .gain = grid[2][g], .share = grid[3][s] };
+                }
+    printf("%zu lines, %zu touches, %zu increments; %zu combinations on %ld threads\n",
+           corpus.lineCount, corpus.touchCount, corpus.incrementCount, count, threads);
+    
+    PaintSweepWork work = { &corpus, combinations, count, 0, 0.0, PTHREAD_MUTEX_INITIALIZER };
+    pthread_t *pool     = malloc(threads * sizeof(pthread_t));
+    double start        = PaintSweepNow();
+    for (long k = 0; k < threads; k++) {
+        pthread_create(&pool[k], NULL, PaintSweepWorker, &work);
+    }
+    for (long k = 0; k < threads; k++) {
+        pthread_join(pool[k], NULL);
+    }
+    double elapsed = PaintSweepNow() - start;
+    free(pool);
+    printf("%.2f s, %.1f combinations/s, %.1f s of CPU time (%.1fx)\n",
+           elapsed, count / elapsed, work.cpuTime, work.cpuTime / elapsed);
+    
+    // The subdivision keeps its promise, or the scores mean nothing:
+    for (n = 0; n < count; n++) {
+        const PaintSweepCombination *c = &combinations[n];
+        if (c->tolerance > 0.0 && c->deviationMax > c->tolerance + 1e-3) {
+            fprintf(stderr, "paintsweep: %g points off the curve at tolerance %g\n", c->deviationMax, c->tolerance);
+            return 1;
+        }
+    }
+    
+    PaintSweepAssignFronts(combinations, count);
+    qsort(combinations, count, sizeof(PaintSweepCombination), PaintSweepCompareCombinations);
+    printf("\nper touch: vertices, ns; points: deviation from the curve, overshoot of the tails\n\n");
+    printf("rank front ");
+    PaintSweepPrintHeader("  m   tolerance  gain share");
+    for (n = 0; n < count && n < rows; n++) {
+        const PaintSweepCombination *c = &combinations[n];
+        printf("%4zu %5d %3zu %11g %5g %5g", n + 1, c->front, c->maxSplinePoints, c->tolerance, c->gain, c->share);
+        PaintSweepPrintScores(c);
+    }
+    for (int p = 0; p < 4; p++) {
+        if (gridCount[p] > 1) {
+            PaintSweepSensitivity(combinations, count, p, names[p], grid[p], gridCount[p]);
+        }
+    }
+    
+    if (csv) {
+        FILE *file = fopen(csv, "w");
+        if (!file) {
+            perror(csv);
+            return 1;
+        }
+        fprintf(file, "rank,front,maxSplinePoints,tolerance,gain,share,vertices_per_touch,ns_per_touch,"
+                      "deviation_mean,deviation_max,overshoot_mean,overshoot_max\n");
+        for (n = 0; n < count; n++) {
+            const PaintSweepCombination *c = &combinations[n];
+            fprintf(file, "%zu,%d,%zu,%g,%g,%g,%.6g,%.6g,%.6g,%.6g,%.6g,%.6g\n", n + 1, c->front,
+                    c->maxSplinePoints, c->tolerance, c->gain, c->share, c->verticesPerTouch, c->nsPerTouch,
+                    c->deviationMean, c->deviationMax, c->overshootMean, c->overshootMax);
+        }
+        if (fclose(file) != 0) {
+            perror(csv);
+            return 1;
+        }
+    }
+    
+    free(combinations);
+    free(corpus.touches);
+    free(corpus.increments);
+    free(corpus.lines);
+    free(corpus.reference);
+    free(corpus.referenceEnds);
+    return 0;
+}
@@ -0,0 +1,88 @@
+//
+//  touchlog2txt.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Turns a binary touch recording (Touch protocol.ptrc from the Documents folder of the app)
+//  into the text protocol the app used to write:
+//
+//      cc -O2 -std=gnu99 -I "pulsedTouch Demo with Finger/Classes/Model"
+//         Tools/touchlog2txt.c "pulsedTouch Demo with Finger/Classes/Model/"*.c -lm -lpthread -o touchlog2txt
+//      ./touchlog2txt "Touch protocol.ptrc" > "Touch protocol.txt"
+//
+//  With -plist the lines are wrapped into the property list NSArray used to write, so old
+//  scripts that read the file with NSArray arrayWithContentsOfFile: keep working. Pen mode and
+//  line ended records have no counterpart in the text protocol and are skipped.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "PaintTouchRecorder.h"
+
+// Phases of UIGestureRecognizerState as recorded by the app:
+enum { PhaseBegan = 1, PhaseChanged = 2, PhaseEnded = 3 };
+
+static void PaintPrintRecord(const PaintTouchRecord *record, int plist) {
+    
+    char line[128];
+    switch (record->phase) {
+        case PhaseBegan:
+            snprintf(line, sizeof(line), "Linie %u beginnt zur Zeit %15.6f an %5.1f %5.1f",
+                     record->lineID, record->timestamp, record->x, record->y);
+            break;
+        
+        case PhaseChanged:
+            snprintf(line, sizeof(line), "Linie %u weiter  zur Zeit %15.6f an %5.1f %5.1f",
+                     record->lineID, record->timestamp, record->x, record->y);
+            break;
+        
+        case PhaseEnded:
+            snprintf(line, sizeof(line), "Linie %u endet   zur Zeit %15.6f an %5.1f %5.1f",
+                     record->lineID, record->timestamp, record->x, record->y);
+            break;
+        
+        default:
+            snprintf(line, sizeof(line), "Linie %u in Phase %d zur Zeit %15.6f an %5.1f %5.1f",
+                     record->lineID, record->phase, record->timestamp, record->x, record->y);
+    }
+    if (plist) {
+        printf("\t<string>%s</string>\n", line);
+    } else {
+        printf("%s\n", line);
+    }
+}
+
+int main(int argc, char **argv) {
+    
+    int plist = (argc > 1 && strcmp(argv[1], "-plist") == 0);
+    if (argc != 2 + plist) {
+        fprintf(stderr, "usage: %s [-plist] recording.ptrc\n", argv[0]);
+        return 2;
+    }
+    FILE *file = PaintTouchRecordOpen(argv[1 + plist]);
+    if (!file) {
+        fprintf(stderr, "%s: no touch recording\n", argv[1 + plist]);
+        return 1;
+    }
+    
+    if (plist) {
+        printf("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+               "<!DOCTYPE plist PUBLIC \"-//Apple//DTD PLIST 1.0//EN\" \"http://www.apple.com/DTDs/PropertyList-1.0.dtd\">\n"
+               "<plist version=\"1.0\">\n<array>\n");
+    }
+    PaintTouchRecord records[256];
+    size_t count;
+    while ((count = PaintTouchRecordRead(file, records, 256)) > 0) {
+        for (size_t n = 0; n < count; n++) {
+            if ((records[n].kind & PaintTouchRecordKindMask) == PaintTouchRecordTouch) {
+                PaintPrintRecord(&records[n], plist);
+            }
+        }
+    }
+    if (plist) {
+        printf("</array>\n</plist>\n");
+    }
+    fclose(file);
+    return 0;
+}
@@ -22,10 +22,16 @@
 @property (strong, nonatomic) PaintViewLine *linePresets;
 @property (assign, nonatomic) CGFloat       lineSpeed;
 
-- (CGFloat) calculateFrameRate;
 - (void)    handleTouchEnded:(SID_PulsedTouchRecognizer *)tRec;
 - (void)    eraseButton;
+- (void)    eraseRect:(CGRect)rect;
+- (BOOL)    reviewSessionAt:(double)fraction;
+- (void)    endReview;
 - (void)    switchMode;
 - (void)    startRecording;
+- (NSString *) incrementCostReport;
+- (NSString *) latencySummary;
+- (NSString *) latencyReport;
+- (NSString *) frameReport;
 
 @end
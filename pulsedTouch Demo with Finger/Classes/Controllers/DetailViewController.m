@@ -9,29 +9,76 @@
 //
 
 #import <stdio.h>
+#import <QuartzCore/QuartzCore.h>
 #import "DetailViewController.h"
+#import "PaintLatency.h"
 #import "PaintView.h"
-#import "PaintSplines.h"
+#import "PaintStrokeFile.h"
+#import "PaintStrokePipeline.h"
+#import "PaintStrokeLayer.h"
+#import "PaintTouchRecorder.h"
 #import "SID_PulsedTouchRecognizer/SID_Touch.h"
 
+// Bucket size (in stroke points) and number of buckets for the increment cost curve:
+#define COST_BUCKET_POINTS 250
+#define COST_BUCKETS        40
+
+// Records in the ring buffer of the touch recorder (32 bytes each), and records collected on the stack:
+#define RECORDER_CAPACITY 16384
+#define RECORD_BATCH         64
+
+// Line ID strings remembered by identity:
+#define LINE_NUMBER_CACHE   256
+
+// What changed for the layer of a line since the last display frame:
+enum {
+    PaintLayerExtended = 1 << 0,        // New points or a new tail
+    PaintLayerStyled   = 1 << 1,        // New color or width
+};
+
 @interface DetailViewController () <SID_PulsedTouchAnalyzerProtocol> {
-    CGRect         layerFrame;
-    double         lastTime;
-    CGFloat        frameRate;
-    NSUInteger     frameRateCounter;
-    NSMutableSet  *setOfKeys;
-    PaintViewLine *lastLine;
+    CGRect               layerFrame;
+    PaintStrokePipeline *pipeline;          // Line assembly on a worker, this controller turns its callbacks into layers
+    PaintStrokeTouch    *touchBuffer;       // Increment converted for the engine
+    NSUInteger           touchCapacity;
+    NSMutableDictionary *lineNumbers;       // Numeric line IDs for the engine and the recording
+    NSMapTable          *lineNumberCache;   // The same by string identity, without hashing the string
+    uint32_t             nextLineNumber;    // Numbers are not given out twice, not even after the tables are cleared
+    NSMutableArray      *layerSlots;        // Layer of each live line, indexed by the slot of the line
+    double               incrementCost[COST_BUCKETS];   // Time per increment, by line length
+    NSUInteger           incrementCount[COST_BUCKETS];
+    PaintTouchRecorder  *recorder;          // Binary touch protocol, written by a background thread
+    PaintLatency        *latency;           // Time from the touch to each stage of the drawing
+    CFTimeInterval       incrementTouched;  // Timestamp of the oldest touch behind the callback, 0 if none
+    CADisplayLink       *frameLink;         // Applies the queued layer updates once per display frame
+    NSMutableIndexSet   *dirtySlots;        // Slots of the lines whose layer has updates queued
+    uint8_t             *slotUpdates;       // The updates by slot
+    CFTimeInterval      *slotTouched;       // The oldest touch behind them, for the latency
+    NSUInteger           slotUpdateCapacity;
+    unsigned long long   updatesQueued;     // Callbacks which changed a layer
+    unsigned long long   updatesApplied;    // Layer updates done, one per layer and frame
+    unsigned long long   framesUpdated;
+    double               queueSeconds;      // Time the touch handling spent handing increments to the worker
+    unsigned long long   queuedTouches;
+    BOOL                 drawingOpened;     // The drawing of the last session has been opened
+    NSMutableArray      *retiredLayers;     // Layers of committed lines, until the tiles show them
+    NSMutableArray      *retiredCommits;    // and the commit of the view each one waits for
+    double               commitSeconds;     // Time the main thread spent committing lines
+    unsigned long long   commitTouches;
 }
 @property (strong, nonatomic) UIPopoverController *masterPopoverController;
 @property (strong, nonatomic) NSString            *filePath;
-@property (strong, nonatomic) NSMutableArray      *fileData;
-@property (strong, nonatomic) NSMutableDictionary *layersDict;
 
 - (void)configureView;
 
 @end
 
-#define DAMPING 0.7
+// Callbacks of the stroke engine, see Engine Callbacks below:
+static void PaintLineOpened(void *context, const PaintStrokeLine *line);
+static void PaintLineStyled(void *context, const PaintStrokeLine *line);
+static void PaintLineExtended(void *context, const PaintStrokeLine *line, size_t firstPoint);
+static void PaintLineCommitted(void *context, const PaintStrokeLine *line);
+static void PaintLineRemoved(void *context, const PaintStrokeLine *line);
 
 @implementation DetailViewController
 
@@ -77,17 +124,37 @@
         self.tRec.enabled = YES;
     }
     
-    lastTime         = [[NSDate date] timeIntervalSince1970];
-    frameRate        =  0.0;
-    frameRateCounter =  0;
-    setOfKeys        = [[NSMutableSet alloc] init];
-    lastLine         = [[PaintViewLine alloc] init];
+    latency          = PaintLatencyCreate();
+    lineNumbers      = [[NSMutableDictionary alloc] init];
+    lineNumberCache  = [NSMapTable mapTableWithKeyOptions:NSPointerFunctionsObjectPointerPersonality
+                                             valueOptions:NSPointerFunctionsStrongMemory];
+    layerSlots       = [[NSMutableArray alloc] init];
+    dirtySlots       = [[NSMutableIndexSet alloc] init];
+    retiredLayers    = [[NSMutableArray alloc] init];
+    retiredCommits   = [[NSMutableArray alloc] init];
     
     self.linePresets = [[PaintViewLine alloc] init];
-    self.fileData    = [[NSMutableArray alloc] init];
-    self.layersDict  = [[NSMutableDictionary alloc] init];
     self.lineSpeed   = 0.0;
     
+    // The engine runs on a worker and reports back through plain C callbacks, once per frame:
+    PaintStrokeCallbacks callbacks = {
+        .context        = (__bridge void *)self,
+        .lineOpened     = PaintLineOpened,
+        .lineStyled     = PaintLineStyled,
+        .lineExtended   = PaintLineExtended,
+        .lineCommitted  = PaintLineCommitted,
+        .lineRemoved    = PaintLineRemoved,
+        .linesCommitted = PaintLinesCommitted,
+    };
+    pipeline = PaintStrokePipelineCreate(self.pvData.maxSplinePoints, &callbacks, latency, CACurrentMediaTime);
+    PaintStrokePipelineSetTolerance(pipeline, self.pvData.splineTolerance / [[UIScreen mainScreen] scale]);
+    PaintStrokePipelineSetPredictor(pipeline, PaintPredictorConfigDefault((PaintPredictorKind)self.pvData.predictor,
+                                                                          self.pvData.predictionLead / 1000.0));
+    
+    // Lines get thinner with speed between the minimum and maximum width, if they differ:
+    PaintStrokeWidthRange widthRange = PaintStrokeWidthRangeDefault(self.pvData.minLineWidth, self.pvData.maxLineWidth);
+    PaintStrokePipelineSetWidthRange(pipeline, self.pvData.maxLineWidth > self.pvData.minLineWidth ? &widthRange : NULL);
+    
     // One observer for setting the penMode:
     [[NSNotificationCenter defaultCenter] addObserver:self
                                              selector:@selector(applyPenMode:)
@@ -103,6 +170,11 @@
                                              selector:@selector(processedRects:)
                                                  name:@"SID_RectNotification"
                                                object:nil];
+    // The drawing is saved when the app goes to the background:
+    [[NSNotificationCenter defaultCenter] addObserver:self
+                                             selector:@selector(saveCurrentDrawing:)
+                                                 name:UIApplicationDidEnterBackgroundNotification
+                                               object:nil];
 }
 
 # pragma Mark - Touch processor configuration.
@@ -124,32 +196,61 @@
     }
 }
 
-// Get the screen refresh rate from the PaintView:
+// The display link runs while the view is on screen and is paused in frames without updates.
+// It retains its target, so it is not kept beyond that:
 
-- (CGFloat)calculateFrameRate {
+- (void) viewWillAppear:(BOOL)animated {
     
-    NSTimeInterval elapsed = [[NSDate date] timeIntervalSince1970] - lastTime;
-    lastTime              += elapsed;
-    CGFloat newRate        = frameRateCounter / elapsed;
-    frameRateCounter       = 0;
+    [super viewWillAppear:animated];
+    if (!frameLink) {
+        frameLink        = [CADisplayLink displayLinkWithTarget:self selector:@selector(updateLayers:)];
+        frameLink.paused = ([dirtySlots count] == 0 && [retiredLayers count] == 0 && PaintStrokePipelineIdle(pipeline));
+        [frameLink addToRunLoop:[NSRunLoop mainRunLoop] forMode:NSRunLoopCommonModes];
+    }
+}
+
+// The drawing of the last session is opened once the view is in its window, so the part of it
+// which is visible can go first:
+
+- (void) viewDidAppear:(BOOL)animated {
     
-    // Apply some simple damping:
-    if (frameRate > 0.1) {
-        frameRate = DAMPING * newRate + (1.0 - DAMPING) * frameRate;
-    } else {
-        frameRate = newRate;
+    [super viewDidAppear:animated];
+    if (!drawingOpened) {
+        drawingOpened  = YES;
+        NSString *path = [self drawingPath:@"Drawing.pstk"];
+        if (path && [[NSFileManager defaultManager] fileExistsAtPath:path]) {
+            [self.paint openDrawing:path];
+        }
     }
+}
+
+- (void) viewDidDisappear:(BOOL)animated {
     
-    return frameRate;
+    [super viewDidDisappear:animated];
+    PaintStrokePipelineDrain(pipeline);
+    [self.paint finishCommits];
+    [self retireLayersUpTo:[self.paint commitsQueued]];
+    [self applyLayerUpdates];
+    [frameLink invalidate];
+    frameLink = nil;
 }
 
-// What to do when the orientation changes.
+// What to do when the orientation changes. The canvas grows to cover the new size, the strokes
+// stay where they are; its tiles are made again and painted from the strokes once the
+// transition is over.
 
 - (void) viewWillTransitionToSize:(CGSize)size
         withTransitionCoordinator:(id<UIViewControllerTransitionCoordinator>)coordinator {
     
     [super viewWillTransitionToSize:size withTransitionCoordinator:coordinator];
     [self.tRec SID_cleanUp];
+    
+    [coordinator animateAlongsideTransition:nil completion:^(id<UIViewControllerTransitionCoordinatorContext> context) {
+        CGRect frame     = self.paint.frame;
+        frame.size       = CGSizeMake(MAX(frame.size.width, size.width), MAX(frame.size.height, size.height));
+        self.paint.frame = frame;
+        [self.paint resizeTiles];
+    }];
 }
 
 // Override to allow orientations other than the default portrait orientation for iPad.
@@ -163,14 +264,76 @@
 
 - (void) eraseButton {
     
-    for (CAShapeLayer *layer in [self.layersDict allValues]) {
-        [layer removeFromSuperlayer];
+    // Everything queued before the erase is drawn and goes with it:
+    PaintStrokePipelineErase(pipeline);
+    PaintStrokePipelineFlush(pipeline);
+    [layerSlots removeAllObjects];
+    [retiredLayers removeAllObjects];
+    [retiredCommits removeAllObjects];
+    
+    // With diagnostics on, report how the increments performed with the lines drawn since the
+    // last erase:
+    NSString *report = self.pvData.diagnostics ? [self incrementCostReport] : nil;
+    if ([report length]) {
+        NSLog(@"Increment cost by line length:\n%@", report);
+        NSLog(@"Touch latency:\n%@", [self latencyReport]);
+        NSLog(@"%@", [self frameReport]);
+        [self writeLatency];
+        NSLog(@"Bitmap tiles presented: %llu, %.1f MB", self.paint.tilesPresented, self.paint.bytesPresented / 1e6);
+        NSLog(@"%@", [self.paint tileReport]);
+        const PaintStrokeTimeline *timeline = [self.paint strokeTimeline];
+        NSLog(@"Stroke timeline: %lu strokes, %lu erases, %lu keyframes, %.1f MB", (unsigned long)timeline->store.count,
+              (unsigned long)timeline->eraseCount, (unsigned long)timeline->keyframeCount,
+              PaintStrokeTimelineBytes(timeline) / 1e6);
+        
+        const PaintStrokeStore *store = [self.paint strokeStore];
+        if (store->count) {
+            NSLog(@"Stroke store: %lu strokes, %lu of %lu points kept, %.0f bytes per stroke",
+                  (unsigned long)store->count, (unsigned long)store->pointCount, (unsigned long)store->pointsIn,
+                  (double)PaintStrokeStoreBytes(store) / store->count);
+        }
     }
-    [self.layersDict removeAllObjects];
+    memset(incrementCost,  0, sizeof(incrementCost));
+    memset(incrementCount, 0, sizeof(incrementCount));
+    queueSeconds  = 0.0;
+    queuedTouches = 0;
+    commitSeconds = 0.0;
+    commitTouches = 0;
+    if (latency) PaintLatencyReset(latency);
     
     [self.tRec SID_cleanUp];
+    [self forgetLineNumbers];
     [self.paint clearScreen];
-    frameRate = 0.0;
+}
+
+// Erase a region: the live lines in it go like palm lines, the committed strokes in it are taken
+// out of the stroke store and the area they covered is painted again.
+
+- (void) eraseRect:(CGRect)rect {
+    
+    PaintStrokeBounds bounds = { CGRectGetMinX(rect), CGRectGetMinY(rect), CGRectGetMaxX(rect), CGRectGetMaxY(rect) };
+    PaintStrokePipelineEraseRect(pipeline, bounds);
+    PaintStrokePipelineFlush(pipeline);
+    [self.paint eraseStrokesInRect:rect];
+    frameLink.paused = NO;
+}
+
+// Review the session: fraction 0 is the start of the first stroke, 1 the newest time the
+// timeline has seen. The canvas then covers the drawing until endReview or the next touch.
+
+- (BOOL) reviewSessionAt:(double)fraction {
+    
+    const PaintStrokeTimeline *timeline = [self.paint strokeTimeline];
+    if (isnan(timeline->origin)) {
+        return NO;
+    }
+    fraction = fmin(fmax(fraction, 0.0), 1.0);
+    return [self.paint reviewTimelineAt:timeline->origin + fraction * (timeline->latest - timeline->origin)];
+}
+
+- (void) endReview {
+    
+    [self.paint endTimelineReview];
 }
 
 - (BOOL) gestureRecognizer:(UIGestureRecognizer *)gestureRecognizer shouldRecognizeSimultaneouslyWithGestureRecognizer:(UIGestureRecognizer *)otherGestureRecognizer {
@@ -194,6 +357,7 @@
 
 - (void) touchesBegan:(NSSet *)touches withEvent:(UIEvent *)event {
     
+    [self endReview];
     if (self.pvData.touchAnalyzer) {
         [self.tAn SID_touchesBegan:touches withEvent:(UIEvent *)event];
     }
@@ -224,53 +388,15 @@
 
 - (void) SID_linesChangedClass:(NSDictionary *)touchesDict {
     
-    // Loop over the NSArray entries
+    // Loop over the NSArray entries. The engine selects the touch handling according to type:
     for (NSString *key in touchesDict) {
         NSArray *touchArray   = touchesDict[key];
         SID_Touch *firstTouch = [touchArray firstObject];
-        
-        // Select the touch handling according to type:
-        switch (firstTouch.classification) {
-                
-                // First a finger touch
-            case 2:
-            case 6:
-                switch (firstTouch.state) {
-                    case 1:
-                        [self openNewPathWithIncrement:touchArray forKey:firstTouch.lineID];
-                        break;
-                        
-                    case 2:
-                        [self paintIncrement:touchArray forKey:firstTouch.lineID withEnd:NO];
-                        break;
-                        
-                    default:
-                        [self paintIncrement:touchArray forKey:firstTouch.lineID withEnd:YES];
-                }
-                break;
-                
-                // Next a palm touch to ignore
-            case 3:
-                break;
-                
-                // Now what counts: Pen line points!
-            default:
-                
-                // If the key is not yet in the set, initialize a new array and add the key to the key set.
-                // No plotting so far:
-                if (![setOfKeys containsObject:firstTouch.lineID]) {
-                    [setOfKeys addObject:firstTouch.lineID];
-                    [self openNewPathWithIncrement:touchArray forKey:firstTouch.lineID];
-                    
-                    // If we get consecutive points, we start plotting them:
-                } else {
-                    [self paintIncrement:touchArray forKey:firstTouch.lineID withEnd:NO];
-                }
-        }
+        [self feedIncrement:touchArray forKey:firstTouch.lineID from:PaintStrokeFromAnalyzer];
     }
     
     // Process the events properly for file and screen output:
-    if (self.paint.pvData.recording) [self writeLines:touchesDict];
+    if (self.paint.pvData.recording) [self writeLines:touchesDict from:PaintStrokeFromAnalyzer];
 }
 
 // Target method for tRec:
@@ -282,355 +408,397 @@
     
     // Loop over the NSDictionary entries
     for (NSString *key in newIncrements) {
-        NSArray *lineIncr = newIncrements[key];
-            
-        // If the key is not yet in the set, initialize a new array and add the key to the key set.
-        // No plotting so far:
-        if (![setOfKeys containsObject:key]) {
-            [setOfKeys addObject:key];
-            [self openNewPathWithIncrement:lineIncr forKey:key];
-            
-            // If we get consecutive points, we start plotting them:
-        } else {
-            [self paintIncrement:lineIncr forKey:key withEnd:NO];
-        }
+        [self feedIncrement:newIncrements[key] forKey:key from:PaintStrokeFromRecognizer];
     }
-
+    
     // Process the events properly for file and screen output:
-    if (self.paint.pvData.recording) [self writeLines:newIncrements];
+    if (self.paint.pvData.recording) [self writeLines:newIncrements from:PaintStrokeFromRecognizer];
 }
 
 #pragma mark - Touch Processing
 
+// Line IDs are strings in the recognizer. The engine and the recording number them in the
+// order they appear. The increments of a line usually come with the same string object, so the
+// number is looked up by identity first; only a string object not seen before gets hashed.
+// Whenever no line is live the tables are cleared, so they only hold the lines of the moment.
+
+- (uint32_t) lineNumberFor:(NSString *)key {
+    
+    NSNumber *lineNumber = [lineNumberCache objectForKey:key];
+    if (lineNumber) {
+        return [lineNumber unsignedIntValue];
+    }
+    lineNumber = lineNumbers[key];
+    if (!lineNumber) {
+        lineNumber       = @(nextLineNumber++);
+        lineNumbers[key] = lineNumber;
+    }
+    
+    // The cache keeps its strings alive, so it is kept short:
+    if ([lineNumberCache count] >= LINE_NUMBER_CACHE) {
+        [lineNumberCache removeAllObjects];
+    }
+    [lineNumberCache setObject:lineNumber forKey:key];
+    return [lineNumber unsignedIntValue];
+}
+
+// A message for a line which has ended meanwhile gets a new number, which the engine does not
+// know either:
+
+- (void) forgetLineNumbers {
+    
+    if ([lineNumbers count] && PaintStrokePipelineIdle(pipeline) && PaintStrokePipelineLineCount(pipeline) == 0) {
+        [lineNumbers removeAllObjects];
+        [lineNumberCache removeAllObjects];
+    }
+}
+
+// Hand an increment to the engine, which opens, extends, ends or deletes the line. It only goes
+// into the queue of the worker here, the layers learn about it with the next frame:
+
+- (void) feedIncrement:(NSArray *)lineIncr forKey:(NSString *)key from:(PaintStrokeSource)source {
+    
+    CFTimeInterval delivered = CACurrentMediaTime();
+    NSUInteger count         = [lineIncr count];
+    if (count > touchCapacity) {
+        touchBuffer   = reallocf(touchBuffer, count * sizeof(PaintStrokeTouch));
+        touchCapacity = touchBuffer ? count : 0;
+    }
+    
+    // The latency of an increment is that of its oldest touch:
+    CFTimeInterval touched = 0.0;
+    for (NSUInteger n = 0; n < count && touchBuffer; n++) {
+        SID_Touch *touch = lineIncr[n];
+        if (touch.timestamp > 0.0 && (touched == 0.0 || touch.timestamp < touched)) {
+            touched = touch.timestamp;
+        }
+        touchBuffer[n]   = (PaintStrokeTouch){
+            .control        = { .point     = { touch.point.x, touch.point.y },
+                                .velocity  = { touch.velocity.x, touch.velocity.y },
+                                .timestamp = touch.timestamp },
+            .classification = (int)touch.classification,
+            .state          = (int)touch.state };
+    }
+    
+    if (touched > 0.0) {
+        PaintLatencyRecord(latency, PaintLatencyDelivered, delivered - touched);
+    }
+    
+    // The presets may have changed in the controls:
+    PaintStrokePipelineSetPresets(pipeline, [self.linePresets style]);
+    PaintStrokePipelineIncrement(pipeline, [self lineNumberFor:key], touchBuffer, touchBuffer ? count : 0, source);
+    queueSeconds    += CACurrentMediaTime() - delivered;
+    queuedTouches   += count;
+    frameLink.paused = NO;
+    
+    // The speed of the last increment the worker has done:
+    self.lineSpeed = PaintStrokePipelineLineSpeed(pipeline);
+}
+
+// Pen mode and line ended notifications carry a mode per line:
+
+- (NSUInteger) modeChanges:(PaintStrokeModeChange *)changes from:(NSDictionary *)userInfo {
+    
+    NSUInteger count = 0;
+    for (NSString *key in userInfo) {
+        changes[count++] = (PaintStrokeModeChange){ [self lineNumberFor:key], (int)[userInfo[key] longValue] };
+    }
+    return count;
+}
+
+- (void) applyPenMode:(NSNotification *)notification {
+    
+    PaintStrokeModeChange changes[MAX([notification.userInfo count], 1)];
+    NSUInteger count = [self modeChanges:changes from:notification.userInfo];
+    if (self.paint.pvData.recording) [self writeModeChanges:changes count:count kind:PaintTouchRecordPenMode];
+    
+    // The engine applies the modes and the newly found penMode retrospectively:
+    PaintStrokePipelineSetPresets(pipeline, [self.linePresets style]);
+    PaintStrokePipelineApplyPenModes(pipeline, changes, count);
+    frameLink.paused = NO;
+}
+
+// Merge good lines into the bitmap. Finish or erase the identified paths and finish drawing the lines:
+
+- (void) endLine:(NSNotification *)notification {
+    
+    PaintStrokeModeChange changes[MAX([notification.userInfo count], 1)];
+    NSUInteger count = [self modeChanges:changes from:notification.userInfo];
+    if (self.paint.pvData.recording) [self writeModeChanges:changes count:count kind:PaintTouchRecordLineEnded];
+    
+    // Committed lines mark the tiles they were painted into, only those are presented again:
+    PaintStrokePipelineEndLines(pipeline, changes, count);
+    frameLink.paused = NO;
+}
+
+#pragma mark - Engine Callbacks
+
+static void PaintLineOpened(void *context, const PaintStrokeLine *line) {
+    
+    [(__bridge DetailViewController *)context openLayerForLine:line];
+}
+
+static void PaintLineStyled(void *context, const PaintStrokeLine *line) {
+    
+    [(__bridge DetailViewController *)context styleLayerForLine:line];
+}
+
+static void PaintLineExtended(void *context, const PaintStrokeLine *line, size_t firstPoint) {
+    
+    [(__bridge DetailViewController *)context extendLayerForLine:line from:firstPoint];
+}
+
+static void PaintLineCommitted(void *context, const PaintStrokeLine *line) {
+    
+    [(__bridge DetailViewController *)context commitLayerForLine:line];
+}
+
+static void PaintLineRemoved(void *context, const PaintStrokeLine *line) {
+    
+    [(__bridge DetailViewController *)context removeLayerForLine:line];
+}
+
+static void PaintLinesCommitted(void *context, const PaintStrokeLine *const *lines, size_t count) {
+    
+    [(__bridge DetailViewController *)context commitLayersForLines:lines count:count];
+}
+
+// The layers of the live lines sit in a flat array, at the slot the engine gave the line:
+
+- (PaintStrokeLayer *) layerForLine:(const PaintStrokeLine *)line {
+    
+    id layer = line->slot < [layerSlots count] ? layerSlots[line->slot] : nil;
+    return (layer == [NSNull null]) ? nil : layer;
+}
+
+- (void) setLayer:(id)layer forLine:(const PaintStrokeLine *)line {
+    
+    while ([layerSlots count] <= line->slot) {
+        [layerSlots addObject:[NSNull null]];
+    }
+    layerSlots[line->slot] = layer ? layer : [NSNull null];
+}
+
+// The view draws with PaintViewLines:
+
+- (PaintViewLine *) viewLineFor:(const PaintStrokeLine *)line {
+    
+    PaintViewLine *viewLine = [[PaintViewLine alloc] init];
+    [viewLine setStyle:line->style];
+    return viewLine;
+}
+
 // Open a new layer if a new line start is detected:
 
-- (void) openNewPathWithIncrement:(NSArray *)lineIncr forKey:(NSString *)key {
+- (void) openLayerForLine:(const PaintStrokeLine *)line {
+    
+    incrementTouched = PaintStrokePipelineTiming(pipeline).touched;
     
     // Define the layer for drawing the new line:
-    CAShapeLayer *pathLayer = [CAShapeLayer layer];
+    PaintStrokeLayer *pathLayer = [PaintStrokeLayer layer];
     
     if (pathLayer) {
         [self.paint.layer addSublayer:pathLayer];
         pathLayer.delegate = self;
         pathLayer.frame    = layerFrame;
         
-        // Pen lines will get a preliminary color, ideally inherited from the line before:
-        SID_Touch *firstTouch  = [lineIncr lastObject];
-        SID_Touch *lastTouch   = [lineIncr lastObject];
-        PaintViewLine *newLine = [[PaintViewLine alloc] initWithIncrement:lineIncr andLine:lastLine];
-        
-        [pathLayer setValue:key     forKey:@"Key"];
-        [pathLayer setValue:newLine forKey:@"Line"];
-        [self setLine:newLine inLayer:pathLayer toMode:newLine.mode];
-        
-        // Add an extra path to store the un-extrapolated path (this one does not get displayed, but appended each time)
-        UIBezierPath *shortPath = [[UIBezierPath alloc] init];
-        [shortPath moveToPoint:firstTouch.point];
-        [pathLayer setValue:shortPath forKey:@"shortPath"];
-        
-        // Start drawing if we have enough points:
-        CGMutablePathRef path = CGPathCreateMutable();
-        CGPathMoveToPoint(path, nil, firstTouch.point.x, firstTouch.point.y);
-        if ([lineIncr count] > 2) {
-            NSMutableArray *points = [self.paint.splinefunc splineIncrement:lineIncr forLine:lineIncr];
-            for (NSUInteger n = 1; n < [lineIncr count]; n++) {
-                CGPoint nextPoint = [points[n] CGPointValue];
-                CGPathAddLineToPoint(path, nil, nextPoint.x, nextPoint.y);
-            }
-        }
-        
         // Depending on the line type, we choose a square or round line start:
-        if (lastTouch.classification == 1) {
-            if (newLine.mode == 3) {
-                [pathLayer setLineCap:kCALineCapButt];
-            } else {
-                [pathLayer setLineCap:kCALineCapRound];
-            }
-        } else {
-            
-            // Undecided touches get the default mode:
-            [pathLayer setLineCap:kCALineCapRound];
-        }
+        [pathLayer setLineCap:line->buttCap ? kCALineCapButt : kCALineCapRound];
         
         // Set the rest of the layer accordingly:
-        pathLayer.path        = path;
         pathLayer.opaque      = NO;
-        pathLayer.strokeColor = [self.paint lineColorFor:newLine].CGColor;
-        pathLayer.fillColor   = [UIColor clearColor].CGColor;
-        pathLayer.lineWidth   = 0.5 * newLine.width;
+        pathLayer.strokeColor = [self.paint lineColorFor:[self viewLineFor:line]].CGColor;
+        pathLayer.lineWidth   = 0.5 * line->style.width;
         pathLayer.lineJoin    = kCALineJoinRound;
-        [self.layersDict setObject:pathLayer forKey:key];
+        [self setLayer:pathLayer forLine:line];
+        [self queueUpdate:PaintLayerExtended forLine:line];
     }
-    CGPathRelease(pathLayer.path);
 }
 
-// Add the most recent Increment to the line of an existing layer:
+// The new color shows with the next frame:
 
-- (void) paintIncrement:(NSArray *)lineIncr forKey:(NSString *)key withEnd:(BOOL)end {
+- (void) styleLayerForLine:(const PaintStrokeLine *)line {
     
-    CAShapeLayer *layer = self.layersDict[key];
+    [self queueUpdate:PaintLayerStyled forLine:line];
+}
+
+// The new points and the tail, too:
+
+- (void) extendLayerForLine:(const PaintStrokeLine *)line from:(size_t)firstPoint {
     
-    if (layer) {
-        PaintViewLine *line = [layer valueForKey:@"Line"];
-        SID_Touch *lastTouch = [lineIncr lastObject];
-        
-        // If palm touches are reported, delete the line and layer:
-        if (lastTouch.classification == 3 || line.mode < 0) {
-            
-            // Pen mode is -1: We need to delete the line! Get the oldPath from the layer:
-            CGMutablePathRef oldPath = CGPathCreateMutableCopy(layer.path);
-            CGRect dirtyRect    = CGRectInset(CGPathGetBoundingBox(oldPath), -line.width, -line.width);
-            self.paint.clipRect = CGRectUnion(self.paint.clipRect, dirtyRect);
-            
-            // In any case: Delete the layer of this path:
-            [layer removeFromSuperlayer];
-            [self.layersDict removeObjectForKey:key];
-            [setOfKeys       removeObject:key];
-            CGPathRelease(oldPath);
-        } else {
-            
-            [line setLength:[line.touches count]];
-            NSUInteger length = [lineIncr count];
-
-            // Finger touches get mode 9:
-            if (lastTouch.classification == 2 || lastTouch.classification == 6) {
-                [self setLine:line inLayer:layer toMode:9L];
-
-            // Only use half the extrapolation to get better results:
-            } else if (lastTouch.classification > 3 && length > 1) {
-                SID_Touch *lastTrueTouch = lineIncr[length-2];
-                lastTouch.point = CGPointMake(0.5*(lastTrueTouch.point.x + lastTouch.point.x),
-                                              0.5*(lastTrueTouch.point.y + lastTouch.point.y));
-                line.length--;
-            }
-            
-            if (length > 0) {
-
-                // Extend the line by all non-extrapolated points:
-                for (NSUInteger j = 0; j < length; j++) {
-                    SID_Touch *touch = [lineIncr objectAtIndex:j];
-                    
-                    // Update the parameters for the stored path:
-                    if (touch.classification < 3) {
-                        [line.touches addObject:touch];
-                        self.lineSpeed = DAMPING * self.lineSpeed + (1.0 - DAMPING) * (touch.velocity.x + touch.velocity.y);
-                    }
-                }
-
-                // Update the parameters for the UI:
-                NSMutableArray *points = [self.paint.splinefunc splineIncrement:lineIncr forLine:line.touches];
-                
-                // Get the oldPath from the layer and append the new points minus the last one to it
-                UIBezierPath *shortPath  = [layer valueForKey:@"shortPath"];
-                
-                // Open newPath to draw the new increment into:
-                CGMutablePathRef newPath = CGPathCreateMutable();
-                if ([points count]) {
-                    CGPoint nextPoint = [points[0] CGPointValue];
-                    [shortPath addLineToPoint:nextPoint];
-                    CGPathMoveToPoint(newPath, nil, nextPoint.x, nextPoint.y);
-                    
-                    for (NSUInteger n = 1; n < [points count]; n++) {
-                        nextPoint = [points[n] CGPointValue];
-                        [shortPath addLineToPoint:nextPoint];
-                        CGPathAddLineToPoint(newPath, nil, nextPoint.x, nextPoint.y);
-                    }
-
-// Extra points if there is an extrapolated point:
-                    if (lastTouch.classification > 3) {
-                        [self.paint.splinefunc addLastPointToPath:newPath fromPoints:line.touches];
-                    }
-                }
-                
-                // End detected: Close the line and transfer it to the bitmap:
-                if (end) {
-                    
-                    // Paint this path to the bitmap.
-                    [self.paint addPath:layer.path with:line];
-                    [layer removeFromSuperlayer];
-                    [self.layersDict removeObjectForKey:lastTouch.lineID];
-                    [setOfKeys       removeObject:lastTouch.lineID];
-                }
-                
-                // Put the extended shortPath back and place the extrapolated path into the layer:
-                CGMutablePathRef oldPath = CGPathCreateMutableCopy(shortPath.CGPath);
-                CGPathAddPath(oldPath, nil, newPath);
-                layer.path = oldPath;
-                CGPathRelease(oldPath);
-                
-                // Update the display where something new happened:
-                CGRect dirtyRect    = CGRectInset(CGPathGetBoundingBox(newPath), -line.width, -line.width);
-                self.paint.clipRect = CGRectUnion(self.paint.clipRect, dirtyRect);
-                CGPathRelease(newPath);
-            }               // lineIncr count > 0
-        }                   // touch.classification != 3
-        
-        // Draw inside the clipping rect:
-        [layer setNeedsDisplayInRect:self.paint.clipRect];
-        
-        // Count the number of screen redraws.
-        frameRateCounter++;
-    }                       // layer exists
+    // The worker has timed the splines, and its share of the increment:
+    PaintStrokeTiming timing = PaintStrokePipelineTiming(pipeline);
+    incrementTouched         = timing.touched;
+    [self addIncrementCost:timing.seconds forLength:line->pointCount];
+    [self queueUpdate:PaintLayerExtended forLine:line];
 }
 
-- (void) applyPenMode:(NSNotification *)notification {
+// Hand the line to the stroke store of the view, which paints it to the bitmap, and retire its layer:
+
+- (void) commitLayerForLine:(const PaintStrokeLine *)line {
     
-    // Transfer the parameters from the message dictionary to their properties:
-    for (NSString *key in notification.userInfo) {
-        CAShapeLayer *layer = self.layersDict[key];
-        PaintViewLine *line = [layer valueForKey:@"Line"];
-        
-        // Extract the information from the dictionary item:
-        line.mode = [notification.userInfo[key] longValue];
+    [self commitLayersForLines:&line count:1];
+}
+
+// Lines a pen mode decided on all at once are painted in one pass over the tiles. That happens
+// on the commit queue of the view, so the layers of the lines stay until the tiles show them:
+
+- (void) commitLayersForLines:(const PaintStrokeLine *const *)lines count:(size_t)count {
+    
+    CFTimeInterval started = CACurrentMediaTime();
+    [self.paint commitLines:lines count:count];
+    NSNumber *commit       = @([self.paint commitsQueued]);
+    for (size_t n = 0; n < count; n++) {
+        const PaintStrokeLine *line = lines[n];
+        [self dropUpdatesForLine:line];
+        if (line->touches.count > 0) {
+            double touched = PaintTouchColumnsControl(&line->touches, line->touches.count - 1).timestamp;
+            if (touched > 0.0) PaintLatencyRecord(latency, PaintLatencyCommitted, CACurrentMediaTime() - touched);
+        }
         
-        if (line.mode > 9) {
-            [self setLine:line inLayer:layer toMode:line.mode];
-            
-            // Realistically, there can only be one good line. Save its properties,
-            // so the line can serve as a template for future lines.
-            [line copyToLine:lastLine];
-            
-            // A negative penMode means we should erase the line and remove it from memory:
-        } else if (line.mode < 0) {
-            CAShapeLayer *layer = self.layersDict[key];
-            [layer removeFromSuperlayer];
-            [self.layersDict removeObjectForKey:key];
-            [setOfKeys       removeObject:key];
+        PaintStrokeLayer *layer = [self layerForLine:line];
+        if (layer) {
+            [retiredLayers addObject:layer];
+            [retiredCommits addObject:commit];
         }
+        [self setLayer:nil forLine:line];
+        commitTouches += line->touches.count;
+    }
+    commitSeconds += CACurrentMediaTime() - started;
+}
+
+// The layers of the lines whose commits the tiles show go, in the order they were retired:
+
+- (void) retireLayersUpTo:(unsigned long long)commit {
+    
+    NSUInteger count = 0;
+    while (count < [retiredLayers count] && [retiredCommits[count] unsignedLongLongValue] <= commit) {
+        [retiredLayers[count++] removeFromSuperlayer];
     }
+    [retiredLayers removeObjectsInRange:NSMakeRange(0, count)];
+    [retiredCommits removeObjectsInRange:NSMakeRange(0, count)];
+}
+
+// Delete the layer. The layer knows where it has drawn:
+
+- (void) removeLayerForLine:(const PaintStrokeLine *)line {
     
-    // Now clean the setOfKeys and apply the newly found penMode retrospectively:
-    if (lastLine.mode > 9 && [setOfKeys count] > 1) {
-        
-        for (NSString *key in [setOfKeys copy]) {
-            if ([notification.userInfo objectForKey:key]) continue;
-            
-            CAShapeLayer *layer = self.layersDict[key];
-            if (layer) {
-                PaintViewLine *line = [layer valueForKey:@"Line"];
-                if (line.mode == lastLine.mode) continue;
-                
-                [self setLine:line inLayer:layer toMode:lastLine.mode];
-                
-                // Paint this path to the bitmap. What is left here has the mode 0, so no check needed:
-                [self.paint addPath:layer.path with:line];
-                [layer removeFromSuperlayer];
-                [self.layersDict removeObjectForKey:key];
-                [setOfKeys       removeObject:key];
-            }
+    [self dropUpdatesForLine:line];
+    PaintStrokeLayer *layer = [self layerForLine:line];
+    if (layer) {
+        CGRect dirtyRect    = CGRectInset(layer.strokeBounds, -line->style.width, -line->style.width);
+        self.paint.clipRect = CGRectUnion(self.paint.clipRect, dirtyRect);
+        [layer removeFromSuperlayer];
+        [self setLayer:nil forLine:line];
+    }
+}
+
+#pragma mark - Frame Updates
+
+// Increments and messages go to the engine on the worker as they arrive, so palm rejection and
+// the pen modes see every touch in order. Once per display frame the worker's results are
+// drained, and the layers learn which lines changed. Each of those gets all its changes at once:
+// one path with the new points and the latest tail, the latest style, and one dirty rect for the
+// view.
+
+- (void) queueUpdate:(uint8_t)update forLine:(const PaintStrokeLine *)line {
+    
+    uint32_t slot = line->slot;
+    if (slot >= slotUpdateCapacity) {
+        NSUInteger capacity = MAX(2 * slotUpdateCapacity, slot + 16);
+        slotUpdates         = reallocf(slotUpdates, capacity * sizeof(uint8_t));
+        slotTouched         = reallocf(slotTouched, capacity * sizeof(CFTimeInterval));
+        if (!slotUpdates || !slotTouched) {
+            slotUpdateCapacity = 0;
+            return;
         }
+        memset(slotUpdates + slotUpdateCapacity, 0, (capacity - slotUpdateCapacity) * sizeof(uint8_t));
+        memset(slotTouched + slotUpdateCapacity, 0, (capacity - slotUpdateCapacity) * sizeof(CFTimeInterval));
+        slotUpdateCapacity = capacity;
+    }
+    if (!slotUpdates[slot]) {
+        [dirtySlots addIndex:slot];
     }
+    slotUpdates[slot] |= update;
+    if (incrementTouched > 0.0 && (slotTouched[slot] == 0.0 || incrementTouched < slotTouched[slot])) {
+        slotTouched[slot] = incrementTouched;
+    }
+    updatesQueued++;
+}
+
+// A line which ends takes its queued updates with it, the slot may get a new line right away:
+
+- (void) dropUpdatesForLine:(const PaintStrokeLine *)line {
     
-    // Paint into bitmap, now using the full screen to erase unwanted lines!
-    [self.paint setNeedsDisplay];
-}
-
-// Apply all changes to a line when the mode changes:
-
-- (void) setLine:(PaintViewLine *)line inLayer:(CAShapeLayer *)layer toMode:(NSInteger)mode {
-    
-    line.mode = mode;
-    switch (mode) {
-        case  1:
-        case 10:
-            line.color      = 1;
-            line.width      = self.linePresets.width;
-            line.bright     = self.linePresets.bright;
-            line.alphaValue = self.linePresets.alphaValue;
-            break;
-            
-        case  2:
-        case 20:
-            line.color      = 2;
-            line.width      = self.linePresets.width;
-            line.bright     = self.linePresets.bright;
-            line.alphaValue = self.linePresets.alphaValue;
-            break;
-            
-        case  3:
-        case 30:
-            line.color      =  3;
-            line.width      = 50.0;
-            line.bright     =  1.0;
-            line.alphaValue =  0.33;
-            break;
-            
-        case  9:
-            line.color      = 9;
-            line.width      = 2 * self.linePresets.width;
-            line.bright     = self.linePresets.bright;
-            line.alphaValue = self.linePresets.alphaValue;
-            break;
-            
-        default:
-            line.color      = 0;
-            line.width      = self.linePresets.width;
-            line.bright     = self.linePresets.bright;
-            line.alphaValue = self.linePresets.alphaValue;
-            break;
-    }
-    
-    // Set the new color immediately
-    [layer setStrokeColor:[self.paint lineColorFor:line].CGColor];
-    [layer setLineWidth:0.5 * line.width];
+    if (line->slot < slotUpdateCapacity && slotUpdates[line->slot]) {
+        slotUpdates[line->slot] = 0;
+        slotTouched[line->slot] = 0.0;
+        [dirtySlots removeIndex:line->slot];
+    }
 }
 
-// Merge good lines into the bitmap. Finish or erase the identified paths and finish drawing the lines:
+- (void) updateLayers:(CADisplayLink *)link {
+    
+    PaintStrokePipelineDrain(pipeline);
+    [self retireLayersUpTo:[self.paint presentCommits]];
+    [self applyLayerUpdates];
+    [self forgetLineNumbers];
+    link.paused = PaintStrokePipelineIdle(pipeline) && [retiredLayers count] == 0;
+}
 
-- (void) endLine:(NSNotification *)notification {
+- (void) applyLayerUpdates {
     
-    for (NSString *key in notification.userInfo) {
-        
-        // Dump and recreate the pathLayer:
-        CAShapeLayer *layer = self.layersDict[key];
-        PaintViewLine *line = [layer valueForKey:@"Line"];
+    if ([dirtySlots count] == 0) {
+        return;
+    }
+    CGRect dirtyRect = CGRectNull;
+    for (NSUInteger slot = [dirtySlots firstIndex]; slot != NSNotFound; slot = [dirtySlots indexGreaterThanIndex:slot]) {
+        const PaintStrokeLine *line = PaintStrokePipelineLineInSlot(pipeline, (uint32_t)slot);
+        PaintStrokeLayer *layer     = line ? [self layerForLine:line] : nil;
+        if (layer && (slotUpdates[slot] & PaintLayerStyled)) {
+            [layer setStrokeColor:[self.paint lineColorFor:[self viewLineFor:line]].CGColor];
+            [layer setLineWidth:0.5 * line->style.width];
+        }
         
-        if (line) {
-            
-            // The notification value is one of the possible pen modes. If we have set line.mode to 9
-            // (finger) before, we must not overwrite this here! The notification value for finger
-            // lines is 0, and this would make our pretty finger line a line of undefined penMode.
-            if (line.mode != 9) {
-                line.mode = [notification.userInfo[key] longValue];
+        // The layer has all points up to its pointCount, the engine only ever adds to them:
+        if (layer && (slotUpdates[slot] & PaintLayerExtended)) {
+            CGRect changedRect = [layer appendPoints:(const CGPoint *)line->points + layer.pointCount
+                                              widths:line->widths ? (const CGFloat *)line->widths + layer.pointCount : NULL
+                                               count:line->pointCount - layer.pointCount
+                                            withTail:(const CGPoint *)line->tail
+                                              widths:(const CGFloat *)line->tailWidths
+                                               count:line->tailCount];
+            if (!CGRectIsNull(changedRect)) {
+                dirtyRect = CGRectUnion(dirtyRect, CGRectInset(changedRect, -line->style.width, -line->style.width));
             }
-            
-            // … but only when we are sure about the line!
-            if (line.mode > 0) {
-                if (line.mode > 9) {
-                    line.color = line.mode / 10;
-                } else {
-                    line.color = line.mode;
-                }
-                
-                // Add a little extrapolation at the end of the lines to catch the last point:
-                CGMutablePathRef path = CGPathCreateMutableCopy(layer.path);
-                [self.paint.splinefunc addLastPointToPath:path fromPoints:line.touches];
-                
-                // Paint this path to the bitmap:
-                if (!CGPathIsEmpty(path)) {
-                    [self.paint addPath:path with:line];
-                }
-                CGPathRelease(path);
-                
-                [layer removeFromSuperlayer];
-                [self.layersDict removeObjectForKey:key];
-                [setOfKeys       removeObject:key];
-                
-            } else if (line.mode < 0) {
-                
-                // Finger smudge: Delete the layer of this path:
-                [layer removeFromSuperlayer];
-                [self.layersDict removeObjectForKey:key];
-                [setOfKeys       removeObject:key];
+        }
+        if (layer) {
+            updatesApplied++;
+            if (slotTouched[slot] > 0.0) {
+                PaintLatencyRecord(latency, PaintLatencyLayered, CACurrentMediaTime() - slotTouched[slot]);
             }
         }
+        slotUpdates[slot] = 0;
+        slotTouched[slot] = 0.0;
     }
-    
-    // Paint into bitmap, now using the full screen to erase unwanted lines!
-    [self.paint setNeedsDisplay];
+    [dirtySlots removeAllIndexes];
+    self.paint.clipRect = CGRectUnion(self.paint.clipRect, dirtyRect);
+    framesUpdated++;
 }
 
-// Start the rect drawing:
+- (NSString *) frameReport {
+    
+    PaintStrokePipelineStatistics statistics = PaintStrokePipelineGetStatistics(pipeline);
+    return [NSString stringWithFormat:@"Layer updates: %llu queued, %llu applied in %llu frames, %.1f per layer update\n"
+            "Worker: %lu events, %lu results, %lu + %lu waits, %.2f µs per touch on the main thread, "
+            "%.2f µs per touch of committed lines",
+            updatesQueued, updatesApplied, framesUpdated,
+            updatesApplied ? (double)updatesQueued / updatesApplied : 0.0,
+            (unsigned long)statistics.commands, (unsigned long)statistics.results,
+            (unsigned long)statistics.producerWaits, (unsigned long)statistics.workerWaits,
+            queuedTouches ? 1e6 * queueSeconds / queuedTouches : 0.0,
+            commitTouches ? 1e6 * commitSeconds / commitTouches : 0.0];
+}
 
 - (void) processedRects:(NSNotification *)notification {
     
@@ -638,6 +806,13 @@
     CGRect enclosingRect = [notification.userInfo[@"greenRect"] CGRectValue];
     CGRect palmRect      = [notification.userInfo[@"redRect"] CGRectValue];
     
+    // The live lines under the palm go. The committed strokes stay, the hand rests on them
+    // while writing, so only eraseRect: takes those:
+    if (!CGRectIsEmpty(palmRect)) {
+        PaintStrokeBounds bounds = { CGRectGetMinX(palmRect), CGRectGetMinY(palmRect),
+                                     CGRectGetMaxX(palmRect), CGRectGetMaxY(palmRect) };
+        PaintStrokePipelineErasePalm(pipeline, bounds);
+    }
     if (self.pvData.rectDisplay) {
         [self.paint drawGreenRect:enclosingRect andRedRect:palmRect];
     }
@@ -671,48 +846,176 @@
     if (self.paint.pvData.recording) {
         NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
         if (paths.count > 0) {
-            NSString *filename = [NSString stringWithFormat:@"Touch protocol.txt"];
+            NSString *filename = [NSString stringWithFormat:@"Touch protocol.ptrc"];
             self.filePath      = [[paths objectAtIndex:0] stringByAppendingPathComponent:filename];
+            recorder           = PaintTouchRecorderOpen([self.filePath fileSystemRepresentation], RECORDER_CAPACITY);
+        }
+        if (!recorder) {
+            NSLog(@"Cannot record to %@: %s", self.filePath, strerror(errno));
+            self.paint.pvData.recording = NO;
         }
     } else {
-        [self.fileData writeToFile:self.filePath atomically:NO];
+        size_t dropped = PaintTouchRecorderDropped(recorder);
+        if (PaintTouchRecorderClose(recorder) != 0) {
+            NSLog(@"Writing %@ failed", self.filePath);
+        } else if (dropped > 0) {
+            NSLog(@"%lu touches could not be recorded", (unsigned long)dropped);
+        }
+        recorder = NULL;
     }
 }
 
-- (void) writeLines:(NSDictionary *)newIncrements {
+// Hand the touches to the recorder. All it gets are fixed size records, the writer thread
+// takes care of the file. The last record of each increment is marked:
+
+- (void) writeLines:(NSDictionary *)newIncrements from:(PaintStrokeSource)source {
     
-    // Put the content of the NSSet in a text file.
+    int8_t phase = (int8_t)self.tRec.state;
+    uint8_t kind = PaintTouchRecordTouch | ((source == PaintStrokeFromAnalyzer) ? PaintTouchRecordFromAnalyzer : 0);
     for (NSString *key in newIncrements) {
         NSArray *touches = newIncrements[key];
         
+        // The analyzer path goes by the line ID of the touches, like the engine:
+        NSString *lineKey = (source == PaintStrokeFromAnalyzer) ? [[touches firstObject] lineID] : key;
+        uint32_t lineID   = [self lineNumberFor:lineKey];
+        
+        PaintTouchRecord records[RECORD_BATCH];
+        size_t count = 0;
         for (SID_Touch *touch in touches) {
-            NSTimeInterval now = touch.timestamp;
-            switch (self.tRec.state) {
-                case UIGestureRecognizerStateBegan:
-                {
-                    [self.fileData addObject:[NSString stringWithFormat:@"Linie %@ beginnt zur Zeit %15.6f an %5.1f %5.1f", key, now, touch.point.x, touch.point.y]];
-                    break;
-                }
-                    
-                case UIGestureRecognizerStateChanged:
-                {
-                    [self.fileData addObject:[NSString stringWithFormat:@"Linie %@ weiter  zur Zeit %15.6f an %5.1f %5.1f", key, now, touch.point.x, touch.point.y]];
-                    break;
-                }
-                    
-                case UIGestureRecognizerStateRecognized:
-                {
-                    [self.fileData addObject:[NSString stringWithFormat:@"Linie %@ endet   zur Zeit %15.6f an %5.1f %5.1f", key, now, touch.point.x, touch.point.y]];
-                    break;
-                }
-                    
-                default:
-                {
-                    [self.fileData addObject:[NSString stringWithFormat:@"Linie %@ in Phase %ld zur Zeit %15.6f an %5.1f %5.1f", key, (long)self.tRec.state, touch.timestamp, touch.point.x, touch.point.y]];
-                }
+            records[count++] = (PaintTouchRecord){
+                .timestamp      = touch.timestamp,
+                .x              = touch.point.x,
+                .y              = touch.point.y,
+                .vx             = touch.velocity.x,
+                .vy             = touch.velocity.y,
+                .lineID         = lineID,
+                .classification = (int8_t)touch.classification,
+                .state          = (int8_t)touch.state,
+                .phase          = phase,
+                .kind           = kind };
+            if (count == RECORD_BATCH) {
+                PaintTouchRecorderAppend(recorder, records, count);
+                count = 0;
             }
         }
+        if (count > 0) {
+            records[count - 1].kind |= PaintTouchRecordEndOfGroup;
+            PaintTouchRecorderAppend(recorder, records, count);
+        }
+    }
+}
+
+- (void) writeModeChanges:(const PaintStrokeModeChange *)changes count:(NSUInteger)count kind:(PaintTouchRecordKind)kind {
+    
+    NSTimeInterval now = [[NSProcessInfo processInfo] systemUptime];
+    for (NSUInteger n = 0; n < count; n++) {
+        PaintTouchRecord record = {
+            .timestamp      = now,
+            .lineID         = changes[n].lineID,
+            .classification = (int8_t)changes[n].mode,
+            .phase          = (int8_t)self.tRec.state,
+            .kind           = kind | ((n + 1 == count) ? PaintTouchRecordEndOfGroup : 0) };
+        PaintTouchRecorderAppend(recorder, &record, 1);
+    }
+}
+
+#pragma mark - Increment Cost
+
+// Collect the time the worker spent on each increment over the length of the line.
+// A flat curve means the cost of an increment does not depend on how long the line is:
+
+- (void) addIncrementCost:(CFTimeInterval)cost forLength:(NSUInteger)length {
+    
+    NSUInteger bucket = MIN(length / COST_BUCKET_POINTS, COST_BUCKETS - 1);
+    incrementCost[bucket] += cost;
+    incrementCount[bucket]++;
+}
+
+- (NSString *) incrementCostReport {
+    
+    NSMutableString *report = [NSMutableString string];
+    for (NSUInteger bucket = 0; bucket < COST_BUCKETS; bucket++) {
+        if (incrementCount[bucket] == 0) continue;
+        
+        [report appendFormat:@"%5lu … %5lu points: %8.1f µs (%lu increments)\n",
+         (unsigned long)(bucket * COST_BUCKET_POINTS), (unsigned long)((bucket + 1) * COST_BUCKET_POINTS - 1),
+         1e6 * incrementCost[bucket] / incrementCount[bucket], (unsigned long)incrementCount[bucket]];
+    }
+    return report;
+}
+
+#pragma mark - Touch Latency
+
+// Median, 99th and 99.9th percentile from the touch to the layer of its line, in ms:
+
+- (NSString *) latencySummary {
+    
+    if (!latency || PaintLatencyCount(latency, PaintLatencyLayered) == 0) {
+        return nil;
+    }
+    return [NSString stringWithFormat:@"%.0f/%.0f/%.0f",
+            1e3 * PaintLatencyPercentile(latency, PaintLatencyLayered, 50.0),
+            1e3 * PaintLatencyPercentile(latency, PaintLatencyLayered, 99.0),
+            1e3 * PaintLatencyPercentile(latency, PaintLatencyLayered, 99.9)];
+}
+
+- (NSString *) latencyReport {
+    
+    NSMutableString *report = [NSMutableString string];
+    for (int stage = 0; stage < PaintLatencyStages && latency; stage++) {
+        if (PaintLatencyCount(latency, stage) == 0) continue;
+        
+        [report appendFormat:@"%-10s p50 %6.1f ms, p99 %6.1f ms, p99.9 %6.1f ms, max %6.1f ms (%llu touches)\n",
+         PaintLatencyStageName(stage), 1e3 * PaintLatencyPercentile(latency, stage, 50.0),
+         1e3 * PaintLatencyPercentile(latency, stage, 99.0), 1e3 * PaintLatencyPercentile(latency, stage, 99.9),
+         1e3 * PaintLatencyPercentile(latency, stage, 100.0), (unsigned long long)PaintLatencyCount(latency, stage)];
+    }
+    return report;
+}
+
+// The histograms go to the documents next to the touch protocol, in the HdrHistogram format:
+
+- (void) writeLatency {
+    
+    NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
+    if (!latency || paths.count == 0) {
+        return;
+    }
+    NSString *path = [[paths objectAtIndex:0] stringByAppendingPathComponent:@"Touch latency.hgrm"];
+    FILE *file     = fopen([path fileSystemRepresentation], "w");
+    if (!file || PaintLatencyWrite(latency, file) != 0) {
+        NSLog(@"Cannot write %@: %s", path, strerror(errno));
+    }
+    if (file) fclose(file);
+}
+
+// The drawing on screen goes to the documents as a stroke file whenever the app goes to the
+// background, to be opened again at the next start:
+
+- (NSString *) drawingPath:(NSString *)name {
+    
+    NSArray *paths = NSSearchPathForDirectoriesInDomains(NSDocumentDirectory, NSUserDomainMask, YES);
+    return paths.count ? [[paths objectAtIndex:0] stringByAppendingPathComponent:name] : nil;
+}
+
+- (void) saveCurrentDrawing:(NSNotification *)notification {
+    
+    [self saveDrawing:[self.paint strokeStore] as:@"Drawing.pstk"];
+}
+
+- (void) saveDrawing:(const PaintStrokeStore *)store as:(NSString *)name {
+    
+    NSString *path = [self drawingPath:name];
+    if (!path) {
+        return;
+    }
+    if (PaintStrokeStoreWrite(store, [path fileSystemRepresentation], PAINT_STROKE_FILE_GRID) != 0) {
+        NSLog(@"Cannot write %@: %s", path, strerror(errno));
+        return;
     }
+    NSNumber *size = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL] objectForKey:NSFileSize];
+    NSLog(@"%@: %.1f kB, %.2f bytes per point", name, [size doubleValue] / 1e3,
+          store->pointCount ? [size doubleValue] / store->pointCount : 0.0);
 }
 
 #pragma mark - Default ViewController stuff
@@ -721,10 +1024,19 @@
     
     [super didReceiveMemoryWarning];
     
-    // Dispose of any resources that can be recreated.
-    [self.fileData   removeAllObjects];
-    [self.layersDict removeAllObjects];
-    [setOfKeys       removeAllObjects];
+    // Dispose of any resources that can be recreated: the bitmap tiles are painted again from the
+    // strokes when they are needed. The lines being drawn stay.
+    [self.paint shrinkTiles];
+}
+
+- (void) dealloc {
+    
+    PaintStrokePipelineDestroy(pipeline);
+    free(touchBuffer);
+    PaintTouchRecorderClose(recorder);
+    PaintLatencyDestroy(latency);
+    free(slotUpdates);
+    free(slotTouched);
 }
 
 @end
@@ -14,7 +14,7 @@
 @property (strong, nonatomic) IBOutlet UILabel *alphaValueLabel;
 @property (strong, nonatomic) IBOutlet UILabel *lineBrightLabel;
 @property (strong, nonatomic) IBOutlet UILabel *speedLabel;
-@property (strong, nonatomic) IBOutlet UILabel *frameRateLabel;
+@property (strong, nonatomic) IBOutlet UILabel *latencyLabel;
 @property (strong, nonatomic) IBOutlet UIButton *filterSwitchButton;
 @property (strong, nonatomic) IBOutlet UIButton *analyzerSwitchButton;
 @property (strong, nonatomic) IBOutlet UIButton *tRecSelectButton;
@@ -44,7 +44,7 @@
     [super viewDidLoad];
     self.detailViewController = (DetailViewController *)[[self.splitViewController.viewControllers lastObject] topViewController];
     
-    // Launch a timer for frameRate updates. Since viewDidLoad is called twice, we need to check
+    // Launch a timer for latency updates. Since viewDidLoad is called twice, we need to check
     // whether the timer runs already.
     if (!self.displayTimer) {
         NSTimer *timer = [NSTimer scheduledTimerWithTimeInterval:0.5 target:self selector:@selector(updateDisplayValues:) userInfo:nil repeats:YES];
@@ -407,18 +407,18 @@
 
 - (IBAction)eraseButtonTapped:(UIButton *)sender {
     [self.detailViewController eraseButton];
-    self.speedLabel.text     = [NSString stringWithFormat:@"%.2f", self.detailViewController.lineSpeed];
-    self.frameRateLabel.text = [NSString stringWithFormat:@"%.2f", 0.0];
+    self.speedLabel.text   = [NSString stringWithFormat:@"%.2f", self.detailViewController.lineSpeed];
+    self.latencyLabel.text = @"0";
 }
 
-// Recalculate frame rate, called by timer every 500 ms.
+// Show the touch latency percentiles, called by timer every 500 ms.
 
 - (void)updateDisplayValues:(NSNotification *)notification {
     
     self.speedLabel.text = [NSString stringWithFormat:@"%.2f", self.detailViewController.lineSpeed];
-    CGFloat frameRate    = [self.detailViewController calculateFrameRate];
-    if (frameRate > 0.01) {
-        self.frameRateLabel.text = [NSString stringWithFormat:@"%.2f", frameRate];
+    NSString *latency    = [self.detailViewController latencySummary];
+    if (latency) {
+        self.latencyLabel.text = latency;
     }
 }
 
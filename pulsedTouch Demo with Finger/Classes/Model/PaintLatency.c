@@ -0,0 +1,184 @@
+//
+//  PaintLatency.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include "PaintLatency.h"
+
+#define PAINT_LATENCY_HALF (1u << (PAINT_LATENCY_SUB_BITS - 1))
+
+// Below 128 µs a bucket is one µs wide. A value with its highest bit at m >= 7 is shifted right
+// by m - 6, which leaves 64 … 127, and goes to one of the 64 buckets of its power of two:
+static inline size_t PaintLatencyIndex(uint64_t value) {
+    
+    if (value < 2 * PAINT_LATENCY_HALF) {
+        return (size_t)value;
+    }
+    unsigned shift = (unsigned)(63 - __builtin_clzll(value)) - (PAINT_LATENCY_SUB_BITS - 1);
+    return (size_t)shift * PAINT_LATENCY_HALF + (size_t)(value >> shift);
+}
+
+// The smallest and largest value of a bucket:
+static inline uint64_t PaintLatencyLowest(size_t index) {
+    
+    if (index < 2 * PAINT_LATENCY_HALF) {
+        return index;
+    }
+    unsigned shift = (unsigned)(index / PAINT_LATENCY_HALF) - 1;
+    return (uint64_t)(index % PAINT_LATENCY_HALF + PAINT_LATENCY_HALF) << shift;
+}
+
+static inline uint64_t PaintLatencyHighest(size_t index) {
+    
+    return PaintLatencyLowest(index + 1) - 1;
+}
+
+PaintLatency *PaintLatencyCreate(void) {
+    
+    return calloc(1, sizeof(PaintLatency));
+}
+
+void PaintLatencyDestroy(PaintLatency *latency) {
+    
+    free(latency);
+}
+
+void PaintLatencyReset(PaintLatency *latency) {
+    
+    for (size_t stage = 0; stage < PaintLatencyStages; stage++) {
+        PaintLatencyHistogram *histogram = &latency->stages[stage];
+        for (size_t n = 0; n < PAINT_LATENCY_COUNTS; n++) {
+            __atomic_store_n(&histogram->counts[n], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&histogram->total, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->sum, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&histogram->max, 0, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&latency->negative, 0, __ATOMIC_RELAXED);
+}
+
+void PaintLatencyRecord(PaintLatency *latency, PaintLatencyStage stage, double seconds) {
+    
+    if (!latency || stage >= PaintLatencyStages) {
+        return;
+    }
+    if (!(seconds >= 0.0)) {
+        __atomic_fetch_add(&latency->negative, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint64_t value = seconds < 6e4 ? (uint64_t)(seconds * 1e6 + 0.5) : (1ULL << PAINT_LATENCY_MAX_BITS) - 1;
+    PaintLatencyHistogram *histogram = &latency->stages[stage];
+    __atomic_fetch_add(&histogram->counts[PaintLatencyIndex(value)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->total, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&histogram->sum, value, __ATOMIC_RELAXED);
+    
+    uint64_t max = __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    while (value > max && !__atomic_compare_exchange_n(&histogram->max, &max, value, 1,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+const char *PaintLatencyStageName(PaintLatencyStage stage) {
+    
+    switch (stage) {
+        case PaintLatencyDelivered: return "delivered";
+        case PaintLatencySplined:   return "splined";
+        case PaintLatencyLayered:   return "layered";
+        case PaintLatencyCommitted: return "committed";
+        default:                    return "unknown";
+    }
+}
+
+uint64_t PaintLatencyCount(const PaintLatency *latency, PaintLatencyStage stage) {
+    
+    return __atomic_load_n(&latency->stages[stage].total, __ATOMIC_RELAXED);
+}
+
+// The bucket with the touch of rank ceil(percent/100 · total), counted in a snapshot of the
+// buckets. Touches recorded meanwhile may or may not be in it:
+double PaintLatencyPercentile(const PaintLatency *latency, PaintLatencyStage stage, double percent) {
+    
+    const PaintLatencyHistogram *histogram = &latency->stages[stage];
+    uint64_t counts[PAINT_LATENCY_COUNTS], total = 0;
+    for (size_t n = 0; n < PAINT_LATENCY_COUNTS; n++) {
+        counts[n] = __atomic_load_n(&histogram->counts[n], __ATOMIC_RELAXED);
+        total    += counts[n];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    if (percent >= 100.0) {
+        return 1e-6 * __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+    }
+    
+    uint64_t rank = (uint64_t)ceil(fmax(percent, 0.0) / 100.0 * total);
+    rank          = rank ? rank : 1;
+    uint64_t seen = 0;
+    for (size_t n = 0; n < PAINT_LATENCY_COUNTS; n++) {
+        seen += counts[n];
+        if (seen >= rank) {
+            return 1e-6 * PaintLatencyHighest(n);
+        }
+    }
+    return 1e-6 * __atomic_load_n(&histogram->max, __ATOMIC_RELAXED);
+}
+
+double PaintLatencyMean(const PaintLatency *latency, PaintLatencyStage stage) {
+    
+    const PaintLatencyHistogram *histogram = &latency->stages[stage];
+    uint64_t total = __atomic_load_n(&histogram->total, __ATOMIC_RELAXED);
+    return total ? 1e-6 * __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED) / total : 0.0;
+}
+
+// One line per bucket which holds touches, with the share of touches up to its upper end:
+static int PaintLatencyWriteStage(const PaintLatency *latency, PaintLatencyStage stage, FILE *file) {
+    
+    const PaintLatencyHistogram *histogram = &latency->stages[stage];
+    uint64_t counts[PAINT_LATENCY_COUNTS], total = 0;
+    double   sum = 0.0, squares = 0.0;
+    for (size_t n = 0; n < PAINT_LATENCY_COUNTS; n++) {
+        counts[n]     = __atomic_load_n(&histogram->counts[n], __ATOMIC_RELAXED);
+        total        += counts[n];
+        double middle = 0.5e-3 * (PaintLatencyLowest(n) + PaintLatencyHighest(n));
+        sum          += counts[n] * middle;
+        squares      += counts[n] * middle * middle;
+    }
+    fprintf(file, "# %s\n", PaintLatencyStageName(stage));
+    fprintf(file, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    
+    uint64_t seen = 0;
+    for (size_t n = 0; n < PAINT_LATENCY_COUNTS; n++) {
+        if (counts[n] == 0) continue;
+        
+        seen             += counts[n];
+        double percentile = (double)seen / total;
+        if (seen < total) {
+            fprintf(file, "%12.3f %14.12f %10llu %14.2f\n", 1e-3 * PaintLatencyHighest(n), percentile,
+                    (unsigned long long)seen, 1.0 / (1.0 - percentile));
+        } else {
+            fprintf(file, "%12.3f %14.12f %10llu\n", 1e-3 * PaintLatencyHighest(n), percentile, (unsigned long long)seen);
+        }
+    }
+    double mean = total ? sum / total : 0.0;
+    fprintf(file, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean,
+            total ? sqrt(fmax(squares / total - mean * mean, 0.0)) : 0.0);
+    fprintf(file, "#[Max     = %12.3f, Total count    = %12llu]\n",
+            1e-3 * __atomic_load_n(&histogram->max, __ATOMIC_RELAXED), (unsigned long long)total);
+    fprintf(file, "#[Buckets = %12d, SubBuckets     = %12d]\n\n",
+            PAINT_LATENCY_MAX_BITS - PAINT_LATENCY_SUB_BITS + 1, 2 * PAINT_LATENCY_HALF);
+    return ferror(file) ? -1 : 0;
+}
+
+int PaintLatencyWrite(const PaintLatency *latency, FILE *file) {
+    
+    for (size_t stage = 0; stage < PaintLatencyStages; stage++) {
+        if (PaintLatencyWriteStage(latency, (PaintLatencyStage)stage, file) != 0) {
+            return -1;
+        }
+    }
+    return fflush(file) == 0 ? 0 : -1;
+}
@@ -0,0 +1,88 @@
+//
+//  PaintLatency.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  How long a touch takes to reach the screen. Every stage a touch passes is timed from the
+//  timestamp of the touch, on the same monotonic clock (CACurrentMediaTime() and the touch
+//  timestamps both count seconds since boot). The times go into one histogram per stage with
+//  log-linear buckets, like HdrHistogram: each power of two is split into 64 buckets, so every
+//  percentile is good to 1.6 % from a microsecond to hours, and recording is one atomic add.
+//
+
+#ifndef PaintLatency_h
+#define PaintLatency_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  The stages of a touch. The first three are timed from the oldest touch of each increment,
+ *  the last one from the last touch of the line.
+ */
+typedef enum PaintLatencyStage {
+    PaintLatencyDelivered = 0,          // The recognizer or the analyzer hands the increment over
+    PaintLatencySplined   = 1,          // The spline points of the increment are there
+    PaintLatencyLayered   = 2,          // The layer of the line shows them
+    PaintLatencyCommitted = 3,          // The line is in the stroke store and the bitmap
+    PaintLatencyStages    = 4,
+} PaintLatencyStage;
+
+// Values below 2^PAINT_LATENCY_SUB_BITS µs are counted exactly; above, each power of two has
+// half as many buckets. The largest value is 2^PAINT_LATENCY_MAX_BITS - 1 µs, about 19 hours:
+#define PAINT_LATENCY_SUB_BITS   7
+#define PAINT_LATENCY_MAX_BITS  36
+#define PAINT_LATENCY_COUNTS   ((PAINT_LATENCY_MAX_BITS - PAINT_LATENCY_SUB_BITS + 2) << (PAINT_LATENCY_SUB_BITS - 1))
+
+typedef struct PaintLatencyHistogram {
+    uint64_t counts[PAINT_LATENCY_COUNTS];
+    uint64_t total;
+    uint64_t sum;                       // µs
+    uint64_t max;                       // µs
+} PaintLatencyHistogram;
+
+typedef struct PaintLatency {
+    PaintLatencyHistogram stages[PaintLatencyStages];
+    uint64_t              negative;     // Times from a touch in the future, not recorded
+} PaintLatency;
+
+/**
+ *  A zeroed set of histograms, or NULL.
+ */
+PaintLatency *PaintLatencyCreate(void);
+void PaintLatencyDestroy(PaintLatency *latency);
+void PaintLatencyReset(PaintLatency *latency);
+
+/**
+ *  Count one touch which reached stage after seconds. Can be called from any thread.
+ */
+void PaintLatencyRecord(PaintLatency *latency, PaintLatencyStage stage, double seconds);
+
+const char *PaintLatencyStageName(PaintLatencyStage stage);
+uint64_t    PaintLatencyCount(const PaintLatency *latency, PaintLatencyStage stage);
+
+/**
+ *  The time in seconds which percent of the touches of stage did not exceed, the upper end of
+ *  its bucket. 0 if nothing was recorded; 100 is the maximum.
+ */
+double PaintLatencyPercentile(const PaintLatency *latency, PaintLatencyStage stage, double percent);
+double PaintLatencyMean(const PaintLatency *latency, PaintLatencyStage stage);
+
+/**
+ *  Write all stages as percentile distributions in the text format of HdrHistogram, values in
+ *  milliseconds, one after the other, each after a comment line with its name. Returns 0, or
+ *  -1 on a write error.
+ */
+int PaintLatencyWrite(const PaintLatency *latency, FILE *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintLatency_h */
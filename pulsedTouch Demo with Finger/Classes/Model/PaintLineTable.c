@@ -0,0 +1,103 @@
+//
+//  PaintLineTable.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "PaintLineTable.h"
+
+// Line IDs are counted up from 0, the multiplication spreads them over the table:
+
+static inline size_t PaintLineTableHome(const PaintLineTable *table, uint32_t lineID) {
+    
+    return (size_t)((lineID * 2654435761u) & (table->capacity - 1));
+}
+
+int PaintLineTableInit(PaintLineTable *table, size_t capacity) {
+    
+    size_t size = 16;
+    while (size < capacity) {
+        size *= 2;
+    }
+    table->entries  = calloc(size, sizeof(PaintLineTableEntry));
+    table->capacity = table->entries ? size : 0;
+    table->count    = 0;
+    return table->entries ? 0 : -1;
+}
+
+void PaintLineTableFree(PaintLineTable *table) {
+    
+    free(table->entries);
+    memset(table, 0, sizeof(PaintLineTable));
+}
+
+PaintLineTableEntry *PaintLineTableFind(const PaintLineTable *table, uint32_t lineID) {
+    
+    if (table->capacity == 0) {
+        return NULL;
+    }
+    for (size_t index = PaintLineTableHome(table, lineID); ; index = (index + 1) & (table->capacity - 1)) {
+        PaintLineTableEntry *entry = &table->entries[index];
+        if (!(entry->flags & PaintLineTableUsed)) return NULL;
+        if (entry->lineID == lineID) return entry;
+    }
+}
+
+static int PaintLineTableGrow(PaintLineTable *table) {
+    
+    PaintLineTable grown;
+    if (PaintLineTableInit(&grown, table->capacity ? 2 * table->capacity : 16) != 0) {
+        return -1;
+    }
+    for (size_t n = 0; n < table->capacity; n++) {
+        const PaintLineTableEntry *entry = &table->entries[n];
+        if (entry->flags & PaintLineTableUsed) {
+            *PaintLineTableInsert(&grown, entry->lineID) = *entry;
+        }
+    }
+    free(table->entries);
+    *table = grown;
+    return 0;
+}
+
+PaintLineTableEntry *PaintLineTableInsert(PaintLineTable *table, uint32_t lineID) {
+    
+    PaintLineTableEntry *entry = PaintLineTableFind(table, lineID);
+    if (entry) {
+        return entry;
+    }
+    if (2 * (table->count + 1) > table->capacity && PaintLineTableGrow(table) != 0) {
+        return NULL;
+    }
+    size_t index = PaintLineTableHome(table, lineID);
+    while (table->entries[index].flags & PaintLineTableUsed) {
+        index = (index + 1) & (table->capacity - 1);
+    }
+    entry         = &table->entries[index];
+    entry->lineID = lineID;
+    entry->flags  = PaintLineTableUsed;
+    entry->value  = NULL;
+    table->count++;
+    return entry;
+}
+
+void PaintLineTableRemove(PaintLineTable *table, PaintLineTableEntry *entry) {
+    
+    size_t mask = table->capacity - 1;
+    size_t hole = (size_t)(entry - table->entries);
+    
+    // Move every entry of the cluster behind the hole up, unless its home lies between the hole
+    // and the entry itself, cyclically:
+    for (size_t index = (hole + 1) & mask; table->entries[index].flags & PaintLineTableUsed; index = (index + 1) & mask) {
+        size_t home = PaintLineTableHome(table, table->entries[index].lineID);
+        if (((index - home) & mask) >= ((index - hole) & mask)) {
+            table->entries[hole] = table->entries[index];
+            hole                 = index;
+        }
+    }
+    memset(&table->entries[hole], 0, sizeof(PaintLineTableEntry));
+    table->count--;
+}
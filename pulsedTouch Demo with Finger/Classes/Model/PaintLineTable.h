@@ -0,0 +1,68 @@
+//
+//  PaintLineTable.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Flat open-addressing table from numeric line IDs to the state of a live line. Lookups cost
+//  the same with one line and with hundreds, there is no string hashing and no boxing.
+//
+
+#ifndef PaintLineTable_h
+#define PaintLineTable_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  One line. flags belong to the owner of the table; the table only keeps entries with used
+ *  set. value is whatever the owner keeps per line.
+ */
+typedef struct PaintLineTableEntry {
+    uint32_t  lineID;
+    uint32_t  flags;
+    void     *value;
+} PaintLineTableEntry;
+
+#define PaintLineTableUsed 0x1u
+
+typedef struct PaintLineTable {
+    PaintLineTableEntry *entries;
+    size_t               capacity;          // a power of two
+    size_t               count;
+} PaintLineTable;
+
+/**
+ *  Returns 0 on success and -1 if the entries cannot be allocated. capacity is rounded up
+ *  to a power of two.
+ */
+int  PaintLineTableInit(PaintLineTable *table, size_t capacity);
+void PaintLineTableFree(PaintLineTable *table);
+
+/**
+ *  The entry of a line, or NULL if the line is not in the table.
+ */
+PaintLineTableEntry *PaintLineTableFind(const PaintLineTable *table, uint32_t lineID);
+
+/**
+ *  The entry of a line, created with flags PaintLineTableUsed and no value if it is new.
+ *  The table grows at half load, which moves the entries: pointers to entries are only valid
+ *  until the next insert. Returns NULL if the table cannot grow.
+ */
+PaintLineTableEntry *PaintLineTableInsert(PaintLineTable *table, uint32_t lineID);
+
+/**
+ *  Take an entry out of the table. The entries behind it move up, so the probe sequences stay
+ *  intact without tombstones.
+ */
+void PaintLineTableRemove(PaintLineTable *table, PaintLineTableEntry *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintLineTable_h */
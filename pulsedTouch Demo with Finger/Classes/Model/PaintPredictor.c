@@ -0,0 +1,143 @@
+//
+//  PaintPredictor.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <string.h>
+#include "PaintPredictor.h"
+
+// Kalman filter defaults: a touch position is good to about half a point, the velocity of the
+// pen may change by a few hundred points/s within a sample:
+#define MEASUREMENT_NOISE   0.25
+#define PROCESS_NOISE       2.0e5
+
+// Uncertainty of the velocity before the second touch, (1000 points/s)²:
+#define INITIAL_VELOCITY    1.0e6
+
+PaintPredictorConfig PaintPredictorConfigDefault(PaintPredictorKind kind, double lookahead) {
+    
+    PaintPredictorConfig config = { .kind             = kind,
+                                    .lookahead        = lookahead,
+                                    .processNoise     = PROCESS_NOISE,
+                                    .measurementNoise = MEASUREMENT_NOISE };
+    return config;
+}
+
+void PaintPredictorInit(PaintPredictor *predictor, const PaintPredictorConfig *config) {
+    
+    memset(predictor, 0, sizeof(PaintPredictor));
+    predictor->config = *config;
+}
+
+// Constant velocity model by axis, the velocity is driven by white noise. One step of dt moves
+// the estimate and widens the covariance, the touch then pulls both towards what it measured:
+
+static void PaintPredictorFilter(PaintPredictor *predictor, const PaintSplineControl *control) {
+    
+    double measured[2] = { control->point.x, control->point.y };
+    double q           = predictor->config.processNoise;
+    double r           = predictor->config.measurementNoise;
+    if (predictor->count == 0) {
+        for (int axis = 0; axis < 2; axis++) {
+            predictor->position[axis]      = measured[axis];
+            predictor->velocity[axis]      = 0.0;
+            predictor->covariance[axis][0] = r;
+            predictor->covariance[axis][1] = 0.0;
+            predictor->covariance[axis][2] = INITIAL_VELOCITY;
+        }
+        predictor->timestamp = control->timestamp;
+        return;
+    }
+    double dt = control->timestamp - predictor->timestamp;
+    for (int axis = 0; axis < 2; axis++) {
+        double *p = predictor->covariance[axis];
+        predictor->position[axis] += dt * predictor->velocity[axis];
+        p[0] += dt * (2.0 * p[1] + dt * p[2]) + q * dt * dt * dt / 3.0;
+        p[1] += dt * p[2] + q * dt * dt / 2.0;
+        p[2] += q * dt;
+        
+        double gain0 = p[0] / (p[0] + r);
+        double gain1 = p[1] / (p[0] + r);
+        double error = measured[axis] - predictor->position[axis];
+        predictor->position[axis] += gain0 * error;
+        predictor->velocity[axis] += gain1 * error;
+        p[2] -= gain1 * p[1];
+        p[1] -= gain0 * p[1];
+        p[0] -= gain0 * p[0];
+    }
+    predictor->timestamp = control->timestamp;
+}
+
+void PaintPredictorUpdate(PaintPredictor *predictor, const PaintSplineControl *control) {
+    
+    // A repeated timestamp carries no motion, the newer position replaces the older one:
+    if (predictor->count > 0 && control->timestamp <= predictor->history[predictor->count - 1].timestamp) {
+        predictor->history[predictor->count - 1] = *control;
+        if (predictor->count == 1) {
+            predictor->position[0] = control->point.x;
+            predictor->position[1] = control->point.y;
+        }
+        return;
+    }
+    if (predictor->config.kind == PaintPredictorKalman) {
+        PaintPredictorFilter(predictor, control);
+    }
+    if (predictor->count == 3) {
+        predictor->history[0] = predictor->history[1];
+        predictor->history[1] = predictor->history[2];
+        predictor->count      = 2;
+    }
+    predictor->history[predictor->count++] = *control;
+}
+
+int PaintPredictorPredict(const PaintPredictor *predictor, double lookahead, PaintPoint *out) {
+    
+    if (predictor->count == 0) {
+        return 0;
+    }
+    const PaintSplineControl *newest = &predictor->history[predictor->count - 1];
+    *out = newest->point;
+    if (lookahead <= 0.0 || predictor->config.kind == PaintPredictorOff || predictor->count < 2) {
+        return 1;
+    }
+    
+    // The Kalman estimate lags the newest touch by nothing, it was filtered at its timestamp:
+    if (predictor->config.kind == PaintPredictorKalman) {
+        out->x = (PaintFloat)(predictor->position[0] + lookahead * predictor->velocity[0]);
+        out->y = (PaintFloat)(predictor->position[1] + lookahead * predictor->velocity[1]);
+        return 1;
+    }
+    
+    // Finite differences. The velocity between two touches is that of the time between them,
+    // the acceleration shifts it to the newest touch:
+    const PaintSplineControl *previous = &predictor->history[predictor->count - 2];
+    double dt = newest->timestamp - previous->timestamp;
+    double vx = (newest->point.x - previous->point.x) / dt;
+    double vy = (newest->point.y - previous->point.y) / dt;
+    double ax = 0.0, ay = 0.0;
+    if (predictor->config.kind == PaintPredictorConstantAcceleration && predictor->count == 3) {
+        const PaintSplineControl *oldest = &predictor->history[0];
+        double dt0  = previous->timestamp - oldest->timestamp;
+        double span = 0.5 * (dt + dt0);
+        ax  = (vx - (previous->point.x - oldest->point.x) / dt0) / span;
+        ay  = (vy - (previous->point.y - oldest->point.y) / dt0) / span;
+        vx += 0.5 * dt * ax;
+        vy += 0.5 * dt * ay;
+    }
+    out->x = (PaintFloat)(newest->point.x + lookahead * vx + 0.5 * lookahead * lookahead * ax);
+    out->y = (PaintFloat)(newest->point.y + lookahead * vy + 0.5 * lookahead * lookahead * ay);
+    return 1;
+}
+
+const char *PaintPredictorName(PaintPredictorKind kind) {
+    
+    switch (kind) {
+        case PaintPredictorOff:                  return "off";
+        case PaintPredictorConstantVelocity:     return "velocity";
+        case PaintPredictorConstantAcceleration: return "acceleration";
+        case PaintPredictorKalman:               return "kalman";
+        default:                                 return "?";
+    }
+}
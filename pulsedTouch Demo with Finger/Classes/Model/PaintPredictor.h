@@ -0,0 +1,79 @@
+//
+//  PaintPredictor.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Motion prediction for the tail of a live line: from the timestamps and positions of the
+//  touches so far it projects where the pen tip will be a given time after the newest touch,
+//  so the line reaches the pen although the display lags behind it. Each line has its own
+//  predictor; the state is a fixed-size struct, updating and predicting never allocate.
+//  paintbench predict measures the prediction error against recorded lines.
+//
+
+#ifndef PaintPredictor_h
+#define PaintPredictor_h
+
+#include <stddef.h>
+#include "PaintSplineKernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum PaintPredictorKind {
+    PaintPredictorOff                  = 0,     // No prediction, the tail follows the recognizer's extrapolated points
+    PaintPredictorConstantVelocity     = 1,     // From the last two touches
+    PaintPredictorConstantAcceleration = 2,     // From the last three touches
+    PaintPredictorKalman               = 3,     // Position and velocity filtered over all touches
+    PaintPredictorKinds
+} PaintPredictorKind;
+
+typedef struct PaintPredictorConfig {
+    PaintPredictorKind kind;
+    double             lookahead;           // Seconds ahead of the newest touch
+    double             processNoise;        // Kalman: how much the velocity may change, points²/s³
+    double             measurementNoise;    // Kalman: variance of a touch position, points²
+} PaintPredictorConfig;
+
+typedef struct PaintPredictor {
+    PaintPredictorConfig config;
+    PaintSplineControl   history[3];        // The newest touches, history[count - 1] is the newest
+    size_t               count;             // Up to 3
+    double               position[2];       // Kalman estimate by axis
+    double               velocity[2];
+    double               covariance[2][3];  // By axis: position², position × velocity, velocity²
+    double               timestamp;         // Of the estimate
+} PaintPredictor;
+
+/**
+ *  The configuration the app uses for kind and lookahead, with noise figures for a touch
+ *  screen sampled at 120 … 240 Hz.
+ */
+PaintPredictorConfig PaintPredictorConfigDefault(PaintPredictorKind kind, double lookahead);
+
+/**
+ *  Start without any touches.
+ */
+void PaintPredictorInit(PaintPredictor *predictor, const PaintPredictorConfig *config);
+
+/**
+ *  Take the next touch of the line. A touch with the timestamp of the previous one replaces
+ *  it, the recognizer sometimes reports a position twice.
+ */
+void PaintPredictorUpdate(PaintPredictor *predictor, const PaintSplineControl *control);
+
+/**
+ *  Where the pen will be lookahead seconds after the newest touch. With too few touches for
+ *  the model the next simpler one is used; PaintPredictorOff and lookahead 0 give the newest
+ *  touch. Returns 0 if there has been no touch yet.
+ */
+int PaintPredictorPredict(const PaintPredictor *predictor, double lookahead, PaintPoint *out);
+
+const char *PaintPredictorName(PaintPredictorKind kind);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintPredictor_h */
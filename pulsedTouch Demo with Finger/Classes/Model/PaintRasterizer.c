@@ -0,0 +1,399 @@
+//
+//  PaintRasterizer.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "PaintRasterizer.h"
+
+#pragma mark - Thread pool
+
+// The share of jobs of one thread. Owner and thieves both take jobs with an atomic increment of
+// next, so a job is never done twice. Each share sits on its own cache line:
+typedef struct PaintRasterShare {
+    size_t next;
+    size_t end;
+    char   padding[64 - 2 * sizeof(size_t)];
+} PaintRasterShare;
+
+typedef struct PaintRasterWorker {
+    PaintRasterPool *pool;
+    size_t           index;
+} PaintRasterWorker;
+
+struct PaintRasterPool {
+    size_t             threads;         // Including the calling thread
+    pthread_t         *handles;
+    PaintRasterWorker *workers;
+    PaintRasterShare  *shares;
+    pthread_mutex_t    mutex;
+    pthread_cond_t     wake;
+    pthread_cond_t     done;
+    unsigned long      generation;      // Counts the runs, a new one wakes the threads
+    size_t             busy;            // Threads still working on this run
+    int                quit;
+    PaintRasterJob     job;
+    void              *context;
+};
+
+static void PaintRasterPoolWork(PaintRasterPool *pool, size_t worker) {
+    
+    for (size_t k = 0; k < pool->threads; k++) {
+        PaintRasterShare *share = &pool->shares[(worker + k) % pool->threads];
+        for (;;) {
+            size_t job = __atomic_fetch_add(&share->next, 1, __ATOMIC_RELAXED);
+            if (job >= share->end) break;
+            
+            pool->job(pool->context, job, worker);
+        }
+    }
+}
+
+static void *PaintRasterPoolThread(void *argument) {
+    
+    PaintRasterWorker *worker = argument;
+    PaintRasterPool   *pool   = worker->pool;
+    unsigned long seen        = 0;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->quit && pool->generation == seen) {
+            pthread_cond_wait(&pool->wake, &pool->mutex);
+        }
+        if (pool->quit) break;
+        
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+        PaintRasterPoolWork(pool, worker->index);
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+PaintRasterPool *PaintRasterPoolCreate(size_t threads) {
+    
+    if (threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads    = cores > 0 ? (size_t)cores : 1;
+    }
+    PaintRasterPool *pool = calloc(1, sizeof(PaintRasterPool));
+    if (!pool) {
+        return NULL;
+    }
+    pool->threads = threads;
+    pool->handles = calloc(threads, sizeof(pthread_t));
+    pool->workers = calloc(threads, sizeof(PaintRasterWorker));
+    if (posix_memalign((void **)&pool->shares, 64, threads * sizeof(PaintRasterShare)) != 0) {
+        pool->shares = NULL;
+    }
+    if (!pool->handles || !pool->workers || !pool->shares) {
+        free(pool->handles);
+        free(pool->workers);
+        free(pool->shares);
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    
+    // Thread 0 is whoever calls PaintRasterPoolRun():
+    for (size_t n = 1; n < threads; n++) {
+        pool->workers[n] = (PaintRasterWorker){ pool, n };
+        if (pthread_create(&pool->handles[n], NULL, PaintRasterPoolThread, &pool->workers[n]) != 0) {
+            pool->threads = n;
+            PaintRasterPoolDestroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void PaintRasterPoolDestroy(PaintRasterPool *pool) {
+    
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+    for (size_t n = 1; n < pool->threads; n++) {
+        pthread_join(pool->handles[n], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool->handles);
+    free(pool->workers);
+    free(pool->shares);
+    free(pool);
+}
+
+size_t PaintRasterPoolThreads(const PaintRasterPool *pool) {
+    
+    return pool->threads;
+}
+
+void PaintRasterPoolRun(PaintRasterPool *pool, size_t count, PaintRasterJob job, void *context) {
+    
+    for (size_t n = 0; n < pool->threads; n++) {
+        pool->shares[n].next = count * n / pool->threads;
+        pool->shares[n].end  = count * (n + 1) / pool->threads;
+    }
+    pthread_mutex_lock(&pool->mutex);
+    pool->job     = job;
+    pool->context = context;
+    pool->busy    = pool->threads - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->mutex);
+    
+    PaintRasterPoolWork(pool, 0);
+    
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+#pragma mark - Colors
+
+// The same five colors as -[PaintView lineColorFor:]:
+
+void PaintRasterStyleColor(PaintLineStyle style, double rgba[4]) {
+    
+    double red, green, blue, alpha = style.alpha;
+    switch (style.color) {
+        case  9: red = 0.000; green = 0.800; blue = 0.300;               break;
+        case  3: red = 1.000; green = 1.000; blue = 0.000; alpha = 0.33; break;
+        case  2: red = 1.000; green = 0.166; blue = 0.000;               break;
+        case  1: red = 0.000; green = 0.300; blue = 0.800;               break;
+        default: red = 1.000; green = 1.000; blue = 1.000; alpha = 1.0;  break;
+    }
+    rgba[0] = red   * style.bright;
+    rgba[1] = green * style.bright;
+    rgba[2] = blue  * style.bright;
+    rgba[3] = alpha;
+}
+
+#pragma mark - Rasterization
+
+typedef struct PaintRasterTiles {
+    const PaintStrokeStore *store;
+    const PaintTileGrid    *grid;
+    uint32_t *const        *tiles;
+    int                     fill;       // Fill the tiles white first
+    size_t                 *offsets;    // Strokes of tile n: strokes[offsets[n] … offsets[n+1]-1]
+    uint32_t               *strokes;
+    float                  *coverage;   // One tile of scratch per thread
+    size_t                  tilePixels;
+} PaintRasterTiles;
+
+// The pixels a stroke can reach around its points: half the line width, which is half of the
+// style width like in PaintView, and half a pixel of antialiasing. A stroke whose width follows
+// the speed reaches as far as its widest point:
+
+static inline float PaintRasterReach(const PaintStoredStroke *stroke, double scale) {
+    
+    return (float)(0.25 * stroke->width * stroke->widest * scale + 0.5);
+}
+
+PaintStrokeBounds PaintRasterStrokeReach(const PaintStoredStroke *stroke, double scale) {
+    
+    float reach = (float)(PaintRasterReach(stroke, scale) / scale);
+    PaintStrokeBounds bounds = { stroke->bounds.minX - reach, stroke->bounds.minY - reach,
+                                 stroke->bounds.maxX + reach, stroke->bounds.maxY + reach };
+    return bounds;
+}
+
+// Coverage of the pixels by one stroke, the largest of all its segments. The stroke covers
+// everything closer than half its width to its polygon; round caps and joins come with that.
+// Butt caps cut the first and the last segment off at their ends. With width factors, half the
+// width goes linearly from one point to the next, radius at factor 1, and reach is where the
+// widest point ends.
+
+static void PaintRasterCover(const PaintStoredPoint *points, const float *widths, size_t count,
+                             float reach, float radius, int buttCap, float originX, float originY, float scale,
+                             float *coverage, size_t pixelsWide, size_t x0, size_t y0, size_t x1, size_t y1) {
+    
+    for (size_t segment = 0; segment + 1 < count; segment++) {
+        float ax = (points[segment].x - originX) * scale, ay = (points[segment].y - originY) * scale;
+        float bx = (points[segment + 1].x - originX) * scale, by = (points[segment + 1].y - originY) * scale;
+        float dx = bx - ax, dy = by - ay;
+        float length2 = dx * dx + dy * dy;
+        float inverse = length2 > 0.0f ? 1.0f / length2 : 0.0f;
+        int cutStart  = buttCap && segment == 0;
+        int cutEnd    = buttCap && segment + 2 == count;
+        float reachA  = widths ? radius * widths[segment] + 0.5f : reach;
+        float reachB  = widths ? radius * widths[segment + 1] + 0.5f : reach;
+        float change  = reachB - reachA;
+        float around  = fmaxf(reachA, reachB);
+        
+        // The pixels around this segment only:
+        float left   = fminf(ax, bx) - around, right  = fmaxf(ax, bx) + around;
+        float top    = fminf(ay, by) - around, bottom = fmaxf(ay, by) + around;
+        if (right < (float)x0 || bottom < (float)y0) continue;
+        
+        size_t px0   = left   > (float)x0 ? (size_t)left : x0;
+        size_t py0   = top    > (float)y0 ? (size_t)top  : y0;
+        size_t px1   = right  < (float)x1 ? (size_t)right  + 1 : x1;
+        size_t py1   = bottom < (float)y1 ? (size_t)bottom + 1 : y1;
+        
+        for (size_t py = py0; py < py1; py++) {
+            float *row = coverage + py * pixelsWide;
+            float  cy  = py + 0.5f - ay;
+            for (size_t px = px0; px < px1; px++) {
+                float cx = px + 0.5f - ax;
+                float t  = (cx * dx + cy * dy) * inverse;
+                if ((cutStart && t < 0.0f) || (cutEnd && t > 1.0f)) continue;
+                
+                t          = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+                float ex   = cx - t * dx, ey = cy - t * dy;
+                float edge = reachA + t * change - sqrtf(ex * ex + ey * ey);
+                if (edge > row[px]) {
+                    row[px] = edge > 1.0f ? 1.0f : edge;
+                }
+            }
+        }
+    }
+}
+
+static void PaintRasterTile(void *context, size_t index, size_t worker) {
+    
+    PaintRasterTiles    *raster = context;
+    const PaintTileGrid *grid   = raster->grid;
+    double x, y, w, h;
+    size_t pixelsWide, pixelsHigh;
+    PaintTileGridTileRect(grid, index, &x, &y, &w, &h);
+    PaintTileGridTilePixels(grid, index, &pixelsWide, &pixelsHigh);
+    uint32_t *pixels = raster->tiles[index];
+    float *coverage  = raster->coverage + worker * raster->tilePixels;
+    float scale      = (float)grid->scale;
+    if (!pixels) {
+        return;
+    }
+    for (size_t n = 0; raster->fill && n < pixelsWide * pixelsHigh; n++) {
+        pixels[n] = 0xffffffffu;
+    }
+    
+    for (size_t k = raster->offsets[index]; k < raster->offsets[index + 1]; k++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(raster->store, raster->strokes[k]);
+        float reach  = PaintRasterReach(stroke, scale);
+        float left   = (stroke->bounds.minX - (float)x) * scale - reach;
+        float top    = (stroke->bounds.minY - (float)y) * scale - reach;
+        float right  = (stroke->bounds.maxX - (float)x) * scale + reach + 1.0f;
+        float bottom = (stroke->bounds.maxY - (float)y) * scale + reach + 1.0f;
+        size_t x0 = left  > 0.0f ? (size_t)left : 0, x1 = right  < (float)pixelsWide ? (size_t)right  : pixelsWide;
+        size_t y0 = top   > 0.0f ? (size_t)top  : 0, y1 = bottom < (float)pixelsHigh ? (size_t)bottom : pixelsHigh;
+        if (x0 >= x1 || y0 >= y1) continue;
+        
+        for (size_t py = y0; py < y1; py++) {
+            memset(coverage + py * pixelsWide + x0, 0, (x1 - x0) * sizeof(float));
+        }
+        PaintRasterCover(PaintStrokeStorePoints(raster->store, stroke), PaintStrokeStoreWidths(raster->store, stroke),
+                         stroke->pointCount, reach, 0.25f * stroke->width * scale, stroke->mode == 3,
+                         (float)x, (float)y, scale, coverage, pixelsWide, x0, y0, x1, y1);
+        
+        // Blend the color over the tile, premultiplied:
+        double rgba[4];
+        PaintRasterStyleColor(PaintStrokeStoreStyle(stroke), rgba);
+        float red = (float)(255.0 * rgba[0] * rgba[3]), green = (float)(255.0 * rgba[1] * rgba[3]);
+        float blue = (float)(255.0 * rgba[2] * rgba[3]), alpha = (float)(255.0 * rgba[3]);
+        for (size_t py = y0; py < y1; py++) {
+            const float *row = coverage + py * pixelsWide;
+            uint32_t    *out = pixels + py * pixelsWide;
+            for (size_t px = x0; px < x1; px++) {
+                float c = row[px];
+                if (c <= 0.0f) continue;
+                
+                float keep = 1.0f - c * alpha / 255.0f;
+                uint32_t p = out[px];
+                uint32_t a = (uint32_t)(c * alpha + keep * (float)(p >> 24)         + 0.5f);
+                uint32_t r = (uint32_t)(c * red   + keep * (float)((p >> 16) & 255) + 0.5f);
+                uint32_t g = (uint32_t)(c * green + keep * (float)((p >> 8) & 255)  + 0.5f);
+                uint32_t b = (uint32_t)(c * blue  + keep * (float)(p & 255)         + 0.5f);
+                out[px]    = (a << 24) | (r << 16) | (g << 8) | b;
+            }
+        }
+    }
+}
+
+static int PaintRasterize(PaintRasterPool *pool, const PaintStrokeStore *store, size_t first, size_t end,
+                          const PaintTileGrid *grid, uint32_t *const *tiles, int fill) {
+    
+    size_t tileCount  = PaintTileGridCount(grid);
+    size_t tilePixels = (size_t)ceil(grid->tileSize * grid->scale);
+    PaintRasterTiles raster = { store, grid, tiles, fill, calloc(tileCount + 1, sizeof(size_t)), NULL,
+                                malloc(pool->threads * tilePixels * tilePixels * sizeof(float)), tilePixels * tilePixels };
+    
+    // Sort the strokes into the tiles they reach, in the order they were committed. First count
+    // them, then give each tile its place in one array. Tiles without a buffer get none:
+    for (int pass = 0; pass < 2 && raster.offsets && raster.coverage; pass++) {
+        for (size_t index = first; index < end; index++) {
+            const PaintStoredStroke *stroke = PaintStrokeStoreStroke(store, index);
+            if (stroke->erased || stroke->pointCount < 2) continue;
+            
+            double reach = PaintRasterReach(stroke, grid->scale) / grid->scale;
+            size_t c0, r0, c1, r1;
+            if (!PaintTileGridRange(grid, stroke->bounds.minX - reach, stroke->bounds.minY - reach,
+                                    stroke->bounds.maxX - stroke->bounds.minX + 2 * reach,
+                                    stroke->bounds.maxY - stroke->bounds.minY + 2 * reach, &c0, &r0, &c1, &r1)) continue;
+            
+            for (size_t row = r0; row < r1; row++) {
+                for (size_t column = c0; column < c1; column++) {
+                    size_t tile = row * grid->columns + column;
+                    if (!tiles[tile]) continue;
+                    
+                    if (pass == 0) {
+                        raster.offsets[tile + 1]++;
+                    } else {
+                        raster.strokes[raster.offsets[tile]++] = (uint32_t)index;
+                    }
+                }
+            }
+        }
+        if (pass == 0) {
+            for (size_t tile = 0; tile < tileCount; tile++) {
+                raster.offsets[tile + 1] += raster.offsets[tile];
+            }
+            raster.strokes = malloc((raster.offsets[tileCount] + 1) * sizeof(uint32_t));
+            if (!raster.strokes) break;
+        } else {
+            
+            // Filling moved every offset to the start of the next tile:
+            memmove(raster.offsets + 1, raster.offsets, tileCount * sizeof(size_t));
+            raster.offsets[0] = 0;
+        }
+    }
+    int result = (raster.offsets && raster.coverage && raster.strokes) ? 0 : -1;
+    if (result == 0) {
+        PaintRasterPoolRun(pool, tileCount, PaintRasterTile, &raster);
+    }
+    free(raster.offsets);
+    free(raster.strokes);
+    free(raster.coverage);
+    return result;
+}
+
+int PaintRasterizeStrokes(PaintRasterPool *pool, const PaintStrokeStore *store,
+                          const PaintTileGrid *grid, uint32_t *const *tiles) {
+    
+    return PaintRasterize(pool, store, 0, store->count, grid, tiles, 1);
+}
+
+int PaintRasterizeStrokeRange(PaintRasterPool *pool, const PaintStrokeStore *store, size_t first, size_t end,
+                              const PaintTileGrid *grid, uint32_t *const *tiles) {
+    
+    return PaintRasterize(pool, store, first, end < store->count ? end : store->count, grid, tiles, 0);
+}
@@ -0,0 +1,84 @@
+//
+//  PaintRasterizer.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Paints the tiles of the bitmap from the stroke store on the CPU, on all cores. The strokes
+//  are sorted into the tiles they reach first, then every tile is painted on its own by a pool
+//  of threads. Widths, caps and colors are the ones PaintView strokes its paths with, so a
+//  canvas can be rebuilt at any scale without Core Graphics (see paintbench raster).
+//
+
+#ifndef PaintRasterizer_h
+#define PaintRasterizer_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintStrokeStore.h"
+#include "PaintTileGrid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#pragma mark - Thread pool
+
+/**
+ *  Runs count jobs on a fixed set of threads, the calling thread being one of them. Each thread
+ *  starts on its own share of the jobs; a thread which is done takes jobs from the shares of
+ *  the others, so tiles full of strokes do not keep the other cores waiting.
+ */
+typedef struct PaintRasterPool PaintRasterPool;
+
+typedef void (*PaintRasterJob)(void *context, size_t job, size_t worker);
+
+/**
+ *  threads counts the calling thread, 0 means one per core. Returns NULL if the threads
+ *  cannot be started.
+ */
+PaintRasterPool *PaintRasterPoolCreate(size_t threads);
+void   PaintRasterPoolDestroy(PaintRasterPool *pool);
+size_t PaintRasterPoolThreads(const PaintRasterPool *pool);
+
+/**
+ *  Run job for 0 … count-1 and return when all are done. worker is 0 … threads-1.
+ */
+void PaintRasterPoolRun(PaintRasterPool *pool, size_t count, PaintRasterJob job, void *context);
+
+#pragma mark - Rasterization
+
+/**
+ *  The color PaintView gives a line of this style, as red, green, blue and alpha from 0 to 1.
+ */
+void PaintRasterStyleColor(PaintLineStyle style, double rgba[4]);
+
+/**
+ *  Paint all strokes of the store which are not erased into the tiles of grid. tiles holds one
+ *  pixel buffer per tile, PaintTileGridTilePixels() wide and high, with 4 bytes per pixel and
+ *  no padding: premultiplied alpha first in host byte order, like the bitmap contexts of
+ *  PaintView, top row first. Every tile is filled white before the strokes go in; a tile
+ *  whose buffer is NULL is left out.
+ *  Returns 0, or -1 if there is no memory for the bookkeeping.
+ */
+int PaintRasterizeStrokes(PaintRasterPool *pool, const PaintStrokeStore *store,
+                          const PaintTileGrid *grid, uint32_t *const *tiles);
+
+/**
+ *  Paint strokes first … end-1 which are not erased over what the tiles show, as if they had
+ *  been painted right after the ones before. Painting the strokes in two ranges one after the
+ *  other gives the same pixels as painting them all at once.
+ */
+int PaintRasterizeStrokeRange(PaintRasterPool *pool, const PaintStrokeStore *store, size_t first, size_t end,
+                              const PaintTileGrid *grid, uint32_t *const *tiles);
+
+/**
+ *  What a stroke can paint at scale: its points, half its widest line and the antialiasing.
+ */
+PaintStrokeBounds PaintRasterStrokeReach(const PaintStoredStroke *stroke, double scale);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintRasterizer_h */
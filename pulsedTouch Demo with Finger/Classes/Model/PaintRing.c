@@ -0,0 +1,87 @@
+//
+//  PaintRing.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "PaintRing.h"
+
+int PaintRingInit(PaintRing *ring, size_t itemSize, size_t capacity) {
+    
+    memset(ring, 0, sizeof(PaintRing));
+    size_t size = 16;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    ring->items    = malloc(size * itemSize);
+    ring->itemSize = itemSize;
+    ring->mask     = size - 1;
+    return ring->items ? 0 : -1;
+}
+
+void PaintRingFree(PaintRing *ring) {
+    
+    free(ring->items);
+    ring->items = NULL;
+}
+
+size_t PaintRingCapacity(const PaintRing *ring) {
+    
+    return ring->mask + 1;
+}
+
+// Copy count items between the ring at index and a flat buffer. The range can wrap around the
+// end of the ring:
+
+static void PaintRingCopy(const PaintRing *ring, size_t index, void *buffer, size_t count, int into) {
+    
+    size_t start = index & ring->mask;
+    size_t chunk = count < ring->mask + 1 - start ? count : ring->mask + 1 - start;
+    unsigned char *flat = buffer;
+    if (into) {
+        memcpy(ring->items + start * ring->itemSize, flat, chunk * ring->itemSize);
+        memcpy(ring->items, flat + chunk * ring->itemSize, (count - chunk) * ring->itemSize);
+    } else {
+        memcpy(flat, ring->items + start * ring->itemSize, chunk * ring->itemSize);
+        memcpy(flat + chunk * ring->itemSize, ring->items, (count - chunk) * ring->itemSize);
+    }
+}
+
+// The index of the other side is read with acquire, our own is published with release, so the
+// items are complete before the other side sees them. The producer publishes sequentially
+// consistent, a consumer about to sleep must not miss it (see PaintStrokePipeline.c).
+
+int PaintRingPush(PaintRing *ring, const void *items, size_t count) {
+    
+    size_t head = ring->head;
+    size_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (count > ring->mask + 1 - (head - tail)) {
+        return 0;
+    }
+    if (count == 0) {
+        return 1;
+    }
+    PaintRingCopy(ring, head, (void *)items, count, 1);
+    __atomic_store_n(&ring->head, head + count, __ATOMIC_SEQ_CST);
+    return 1;
+}
+
+size_t PaintRingPop(PaintRing *ring, void *items, size_t max) {
+    
+    size_t tail  = ring->tail;
+    size_t head  = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    size_t count = head - tail < max ? head - tail : max;
+    if (count > 0) {
+        PaintRingCopy(ring, tail, items, count, 0);
+        __atomic_store_n(&ring->tail, tail + count, __ATOMIC_RELEASE);
+    }
+    return count;
+}
+
+size_t PaintRingCount(const PaintRing *ring) {
+    
+    return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
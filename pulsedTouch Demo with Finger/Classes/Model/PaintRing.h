@@ -0,0 +1,60 @@
+//
+//  PaintRing.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Lock-free queue between exactly one producer thread and one consumer thread, like the ring
+//  of the touch recorder, for items of any fixed size. Each side writes only its own index, so
+//  pushing and popping are a few loads and stores and never wait for each other.
+//
+
+#ifndef PaintRing_h
+#define PaintRing_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PaintRing {
+    unsigned char *items;
+    size_t         itemSize;
+    size_t         mask;                // capacity - 1, the capacity is a power of two
+    size_t         head;                // next item to fill, written by the producer only
+    char           padding[64];         // keeps the two indices on their own cache lines
+    size_t         tail;                // next item to take, written by the consumer only
+} PaintRing;
+
+/**
+ *  Room for capacity items of itemSize bytes, rounded up to a power of two. Returns 0, or -1
+ *  if there is no memory.
+ */
+int  PaintRingInit(PaintRing *ring, size_t itemSize, size_t capacity);
+void PaintRingFree(PaintRing *ring);
+
+size_t PaintRingCapacity(const PaintRing *ring);
+
+/**
+ *  Producer side: append count items, all of them or none. Returns 1 if they went in, 0 if
+ *  there is not enough room yet.
+ */
+int PaintRingPush(PaintRing *ring, const void *items, size_t count);
+
+/**
+ *  Consumer side: take up to max items. Returns how many were taken.
+ */
+size_t PaintRingPop(PaintRing *ring, void *items, size_t max);
+
+/**
+ *  Items waiting, as seen from either side.
+ */
+size_t PaintRingCount(const PaintRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintRing_h */
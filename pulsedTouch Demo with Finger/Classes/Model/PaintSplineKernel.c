@@ -0,0 +1,225 @@
+//
+//  PaintSplineKernel.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <string.h>
+#include "PaintSplineKernel.h"
+
+#pragma mark - Segment setup
+
+void PaintSplineSegmentMake(PaintSplineSegment *segment,
+                            PaintPoint p0, PaintPoint p1, PaintPoint p2, PaintPoint p3) {
+    
+    segment->c0x = (-p0.x + 3 * p1.x - 3 * p2.x + p3.x) / 6.0;
+    segment->c1x = ( p0.x - 2 * p1.x +     p2.x       ) / 2.0;
+    segment->c2x = (-p0.x            +     p2.x       ) / 2.0;
+    segment->c3x = ( p0.x + 4 * p1.x +     p2.x       ) / 6.0;
+    segment->c0y = (-p0.y + 3 * p1.y - 3 * p2.y + p3.y) / 6.0;
+    segment->c1y = ( p0.y - 2 * p1.y +     p2.y       ) / 2.0;
+    segment->c2y = (-p0.y            +     p2.y       ) / 2.0;
+    segment->c3y = ( p0.y + 4 * p1.y +     p2.y       ) / 6.0;
+}
+
+PaintPoint PaintSplineSegmentStart(const PaintSplineSegment *segment) {
+    
+    PaintPoint point = { (PaintFloat)segment->c3x, (PaintFloat)segment->c3y };
+    return point;
+}
+
+PaintPoint PaintSplineSegmentEnd(const PaintSplineSegment *segment) {
+    
+    PaintPoint point = { (PaintFloat)(segment->c0x + segment->c1x + segment->c2x + segment->c3x),
+                         (PaintFloat)(segment->c0y + segment->c1y + segment->c2y + segment->c3y) };
+    return point;
+}
+
+size_t PaintSplineInterpolation(double *divisions, size_t maxSplinePoints) {
+    
+    // The negated comparison also catches NaN from identical timestamps:
+    if (!(*divisions >= 1.0)) {
+        return 0;
+    }
+    if (*divisions >= (double)(maxSplinePoints + 1)) {
+        double interpol = floor(*divisions);
+        *divisions      = isinf(interpol) ? maxSplinePoints : *divisions * maxSplinePoints / interpol;
+        return maxSplinePoints;
+    }
+    return (size_t)*divisions;
+}
+
+size_t PaintSplineSegmentSteps(const PaintSplineSegment *segment, double tolerance, size_t maxSplinePoints) {
+    
+    // p''(t) = 6 c0 t + 2 c1 is linear, so its length is largest at t = 0 or t = 1:
+    double ax = 2 * segment->c1x, ay = 2 * segment->c1y;
+    double bx = ax + 6 * segment->c0x, by = ay + 6 * segment->c0y;
+    double curvature = fmax(ax * ax + ay * ay, bx * bx + by * by);
+    
+    // steps^2 >= |p''| / (8 * tolerance). The negated comparison also catches NaN:
+    double steps = ceil(sqrt(sqrt(curvature) / (8.0 * tolerance)));
+    if (!(steps > 1.0) || maxSplinePoints < 1) {
+        return 1;
+    }
+    return steps < (double)maxSplinePoints ? (size_t)steps : maxSplinePoints;
+}
+
+#pragma mark - Evaluation
+
+// Each segment gives a handful of points, fewer than maxSplinePoints, so the loop stays plain:
+
+size_t PaintSplineSegmentEvaluate(const PaintSplineSegment *segment,
+                                  double divisions, size_t interpol, PaintPoint *out) {
+    
+    size_t count = 0;
+    for (size_t i = 1; i < interpol; i++) {
+        double t     = (double)i / divisions;
+        out[count].x = (PaintFloat)((segment->c2x + t*(segment->c1x + t*segment->c0x))*t + segment->c3x);
+        out[count].y = (PaintFloat)((segment->c2y + t*(segment->c1y + t*segment->c0y))*t + segment->c3y);
+        count++;
+    }
+    return count;
+}
+
+#pragma mark - Streaming evaluation
+
+static double PaintSplineControlDivisions(const PaintSplineControl *previous, const PaintSplineControl *control) {
+    
+    return (control->velocity.x + control->velocity.y) / (control->timestamp - previous->timestamp);
+}
+
+void PaintSplineStreamInit(PaintSplineStream *stream) {
+    
+    memset(stream, 0, sizeof(PaintSplineStream));
+}
+
+void PaintSplineStreamSetTolerance(PaintSplineStream *stream, double tolerance) {
+    
+    stream->tolerance = tolerance > 0.0 ? tolerance : 0.0;
+}
+
+// Number of t steps and the step length for a segment, by the mode of the stream. divisions is
+// the division count the heuristic derived from the end point of the segment:
+
+static size_t PaintSplineStreamSteps(const PaintSplineStream *stream, const PaintSplineSegment *segment,
+                                     double *divisions, size_t maxSplinePoints) {
+    
+    if (stream->tolerance > 0.0) {
+        size_t steps = PaintSplineSegmentSteps(segment, stream->tolerance, maxSplinePoints);
+        *divisions   = steps;
+        return steps;
+    }
+    return PaintSplineInterpolation(divisions, maxSplinePoints);
+}
+
+void PaintSplineStreamPrime(PaintSplineStream *stream, const PaintSplineControl control[3]) {
+    
+    stream->control[0] = control[0];
+    stream->control[1] = control[0];
+    stream->control[2] = control[1];
+    stream->control[3] = control[2];
+    stream->count      = 3;
+    stream->divisions  = PaintSplineControlDivisions(&control[1], &control[2]);
+    stream->end.x      = (PaintFloat)((control[0].point.x + 4 * control[1].point.x + control[2].point.x) / 6.0);
+    stream->end.y      = (PaintFloat)((control[0].point.y + 4 * control[1].point.y + control[2].point.y) / 6.0);
+}
+
+size_t PaintSplineStreamMaxPoints(size_t count, size_t maxSplinePoints) {
+    
+    return count * (maxSplinePoints + 1) + 1;
+}
+
+size_t PaintSplineStreamFeed(PaintSplineStream *stream, const PaintSplineControl *control,
+                             size_t count, size_t maxSplinePoints, PaintPoint *out) {
+    
+    size_t written = 0;
+    PaintSplineSegment segment;
+    
+    for (size_t n = 0; n < count; n++) {
+        
+        // The first point of a line fills all four slots:
+        if (stream->count == 0) {
+            stream->control[0] = stream->control[1] = stream->control[2] = stream->control[3] = control[n];
+            stream->divisions  = 0.0;
+            stream->end        = control[n].point;
+            stream->count      = 1;
+            out[written++]     = stream->end;
+            continue;
+        }
+        
+        // Start where the previous increment stopped:
+        if (written == 0) {
+            out[written++] = stream->end;
+        }
+        stream->control[0] = stream->control[1];
+        stream->control[1] = stream->control[2];
+        stream->control[2] = stream->control[3];
+        stream->control[3] = control[n];
+        stream->count++;
+        
+        PaintSplineSegmentMake(&segment, stream->control[0].point, stream->control[1].point,
+                               stream->control[2].point, stream->control[3].point);
+        double divisions   = stream->divisions;
+        size_t interpol    = PaintSplineStreamSteps(stream, &segment, &divisions, maxSplinePoints);
+        stream->divisions  = PaintSplineControlDivisions(&stream->control[2], &stream->control[3]);
+        written           += PaintSplineSegmentEvaluate(&segment, divisions, interpol, out + written);
+        stream->end        = PaintSplineSegmentEnd(&segment);
+        out[written++]     = stream->end;
+    }
+    return written;
+}
+
+// The segment from the last emitted point towards the newest control point, with p3 as the
+// control point after it:
+
+static size_t PaintSplineStreamTailSegment(const PaintSplineStream *stream, PaintPoint p3,
+                                           size_t maxSplinePoints, PaintPoint *out) {
+    
+    PaintSplineSegment segment;
+    PaintSplineSegmentMake(&segment, stream->control[1].point, stream->control[2].point, stream->control[3].point, p3);
+    double divisions = stream->divisions;
+    size_t interpol  = PaintSplineStreamSteps(stream, &segment, &divisions, maxSplinePoints);
+    size_t written   = PaintSplineSegmentEvaluate(&segment, divisions, interpol, out);
+    out[written++]   = PaintSplineSegmentEnd(&segment);
+    return written;
+}
+
+size_t PaintSplineStreamTail(const PaintSplineStream *stream, size_t maxSplinePoints, PaintPoint *out) {
+    
+    if (stream->count < 2) {
+        return 0;
+    }
+    PaintPoint p0 = stream->control[1].point;
+    PaintPoint p1 = stream->control[2].point;
+    PaintPoint p2 = stream->control[3].point;
+    PaintPoint p3 = { (PaintFloat)(1.5*p2.x - 0.75*p1.x + 0.25*p0.x),
+                      (PaintFloat)(1.5*p2.y - 0.75*p1.y + 0.25*p0.y) };
+    return PaintSplineStreamTailSegment(stream, p3, maxSplinePoints, out);
+}
+
+size_t PaintSplineStreamTailWithGain(const PaintSplineStream *stream, double gain,
+                                     size_t maxSplinePoints, PaintPoint *out) {
+    
+    if (stream->count < 2) {
+        return 0;
+    }
+    PaintPoint p0 = stream->control[1].point;
+    PaintPoint p1 = stream->control[2].point;
+    PaintPoint p2 = stream->control[3].point;
+    PaintPoint p3 = { (PaintFloat)(p2.x + gain * (0.5*p2.x - 0.75*p1.x + 0.25*p0.x)),
+                      (PaintFloat)(p2.y + gain * (0.5*p2.y - 0.75*p1.y + 0.25*p0.y)) };
+    return PaintSplineStreamTailSegment(stream, p3, maxSplinePoints, out);
+}
+
+size_t PaintSplineStreamTailTo(const PaintSplineStream *stream, PaintPoint target,
+                               size_t maxSplinePoints, PaintPoint *out) {
+    
+    if (stream->count < 2) {
+        return 0;
+    }
+    size_t written = PaintSplineStreamTailSegment(stream, target, maxSplinePoints, out);
+    out[written++] = target;
+    return written;
+}
@@ -0,0 +1,160 @@
+//
+//  PaintSplineKernel.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Portable C core of the B-spline tessellation. It has no Foundation or UIKit dependencies,
+//  so it builds with any C99 compiler (see Tools/paintbench.c for the Linux benchmark).
+//
+
+#ifndef PaintSplineKernel_h
+#define PaintSplineKernel_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// PaintFloat follows the definition of CGFloat, so a PaintPoint buffer can be handed to
+// CGPathAddLines() as a CGPoint buffer without any conversion:
+#if defined(__LP64__) && __LP64__
+typedef double PaintFloat;
+#define PAINT_FLOAT_IS_DOUBLE 1
+#else
+typedef float  PaintFloat;
+#define PAINT_FLOAT_IS_DOUBLE 0
+#endif
+
+typedef struct PaintPoint {
+    PaintFloat x;
+    PaintFloat y;
+} PaintPoint;
+
+/**
+ *  Polynomial coefficients of one uniform cubic B-spline segment:
+ *  p(t) = ((c0 * t + c1) * t + c2) * t + c3 for t in [0, 1].
+ */
+typedef struct PaintSplineSegment {
+    double c0x, c1x, c2x, c3x;
+    double c0y, c1y, c2y, c3y;
+} PaintSplineSegment;
+
+/**
+ *  Derive the segment coefficients from the four control points p0 … p3.
+ */
+void PaintSplineSegmentMake(PaintSplineSegment *segment,
+                            PaintPoint p0, PaintPoint p1, PaintPoint p2, PaintPoint p3);
+
+/**
+ *  The points at t = 0 (roughly p1) and t = 1 (roughly p2) of a segment.
+ */
+PaintPoint PaintSplineSegmentStart(const PaintSplineSegment *segment);
+PaintPoint PaintSplineSegmentEnd(const PaintSplineSegment *segment);
+
+/**
+ *  Clamp the number of divisions of a segment to maxSplinePoints. Returns the number of
+ *  interpolation steps and rescales *divisions, so the steps still cover the same t range.
+ *  Negative, zero and undefined division counts yield no steps at all.
+ */
+size_t PaintSplineInterpolation(double *divisions, size_t maxSplinePoints);
+
+/**
+ *  Error-bounded alternative to the division count: the smallest number of equal t steps for
+ *  which the polygon through the steps deviates from the segment by at most tolerance, capped
+ *  at maxSplinePoints. The chord error of a step is at most |p''|max / (8 * steps^2), and
+ *  |p''| is largest at one of the ends of a cubic. Returns at least 1.
+ */
+size_t PaintSplineSegmentSteps(const PaintSplineSegment *segment, double tolerance, size_t maxSplinePoints);
+
+/**
+ *  Write the inner points of a segment at t = i / divisions for i = 1 … interpol-1 into out,
+ *  which must have room for interpol-1 points. Returns the number of points written.
+ */
+size_t PaintSplineSegmentEvaluate(const PaintSplineSegment *segment,
+                                  double divisions, size_t interpol, PaintPoint *out);
+
+#pragma mark - Streaming evaluation
+
+/**
+ *  A touch point as far as the spline is concerned.
+ */
+typedef struct PaintSplineControl {
+    PaintPoint point;
+    PaintPoint velocity;
+    double     timestamp;
+} PaintSplineControl;
+
+/**
+ *  Incremental evaluator for one line. It keeps the last four control points, the pending
+ *  division count of the newest point and the end point it has emitted last, so feeding an
+ *  increment costs O(increment) no matter how long the line already is.
+ *
+ *  The first control point is replicated, which makes the curve start exactly at the first
+ *  touch and needs no extrapolated starting point.
+ */
+typedef struct PaintSplineStream {
+    PaintSplineControl control[4];      // control[3] is the newest point
+    size_t             count;           // control points fed so far
+    double             divisions;       // division count of the segment ending at control[3]
+    PaintPoint         end;             // the point emitted last
+    double             tolerance;       // 0: divisions from velocity and timestamps, see below
+} PaintSplineStream;
+
+void PaintSplineStreamInit(PaintSplineStream *stream);
+
+/**
+ *  By default a segment gets (vx + vy) / dt divisions, from the velocity and the time step of
+ *  its end point. With a tolerance > 0 (in points) it gets PaintSplineSegmentSteps() instead,
+ *  just enough steps to stay within the tolerance. The cap of maxSplinePoints holds for both,
+ *  so PaintSplineStreamMaxPoints() is still the bound.
+ */
+void PaintSplineStreamSetTolerance(PaintSplineStream *stream, double tolerance);
+
+/**
+ *  Set the stream up as if the three control points had been fed already, without emitting
+ *  anything. The next point fed evaluates the segment control[0] … control[2] plus that point.
+ */
+void PaintSplineStreamPrime(PaintSplineStream *stream, const PaintSplineControl control[3]);
+
+/**
+ *  Upper bound for the number of points PaintSplineStreamFeed() writes for count controls.
+ */
+size_t PaintSplineStreamMaxPoints(size_t count, size_t maxSplinePoints);
+
+/**
+ *  Feed count control points. Writes the point emitted last (where the caller's path ends),
+ *  followed by the new spline points, and returns the number of points written. The very
+ *  first point of a line is emitted as it is.
+ */
+size_t PaintSplineStreamFeed(PaintSplineStream *stream, const PaintSplineControl *control,
+                             size_t count, size_t maxSplinePoints, PaintPoint *out);
+
+/**
+ *  Speculative continuation beyond the last emitted point towards the newest control point,
+ *  using one extrapolated control point. Writes up to maxSplinePoints + 1 points, which
+ *  continue from stream->end, and returns their number. The stream is not modified.
+ */
+size_t PaintSplineStreamTail(const PaintSplineStream *stream, size_t maxSplinePoints, PaintPoint *out);
+
+/**
+ *  The same with the extrapolated control point moved: gain 1 puts it where
+ *  PaintSplineStreamTail() does, 0 onto the newest control point, 2 twice as far beyond it.
+ */
+size_t PaintSplineStreamTailWithGain(const PaintSplineStream *stream, double gain,
+                                     size_t maxSplinePoints, PaintPoint *out);
+
+/**
+ *  The same towards a predicted position of the pen instead of the extrapolated control point:
+ *  the segment curves from the last emitted point past the newest control point, a straight
+ *  piece leads on to target. Writes up to maxSplinePoints + 1 points as well.
+ */
+size_t PaintSplineStreamTailTo(const PaintSplineStream *stream, PaintPoint target,
+                               size_t maxSplinePoints, PaintPoint *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintSplineKernel_h */
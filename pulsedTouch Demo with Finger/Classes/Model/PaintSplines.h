@@ -8,6 +8,11 @@
 
 #import "PaintViewData.h"
 #import "PaintViewLine.h"
+#import "PaintSplineKernel.h"
+
+// Splines for lines given as SID_Touch objects, a thin layer over PaintSplineKernel. The app
+// draws through PaintStrokeEngine, which runs the same kernel on its own touch columns; the
+// tests hold the engine against these methods.
 
 #pragma mark - Getter methods
 
@@ -17,7 +22,13 @@
 
 - (NSMutableArray *) splineIncrement:(NSArray *)lineIncr
                              forLine:(NSArray *)touches;
-- (void) addLastPointToPath:(CGMutablePathRef)path
-                 fromPoints:(NSArray *)points;
+- (NSUInteger) splineIncrement:(NSArray *)lineIncr
+                       forLine:(NSArray *)touches
+                      toPoints:(CGPoint *)points;
+- (NSUInteger) splineIncrement:(NSArray *)lineIncr
+                        ofLine:(PaintViewLine *)line
+                      toPoints:(CGPoint *)points;
+- (NSUInteger) maxPointsForIncrement:(NSUInteger)incrLength;
+- (double) tolerance;
 
 @end
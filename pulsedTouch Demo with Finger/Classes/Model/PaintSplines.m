@@ -6,6 +6,7 @@
 //  Copyright (c) 2014 STABILO digital. All rights reserved.
 //
 
+#import <UIKit/UIKit.h>
 #import "PaintSplines.h"
 
 @interface PaintSplines ()
@@ -23,180 +24,157 @@
     return self;
 }
 
+static inline PaintSplineControl PaintSplineControlMake(SID_Touch *touch) {
+    
+    return (PaintSplineControl){ { touch.point.x,    touch.point.y    },
+                                 { touch.velocity.x, touch.velocity.y },
+                                 touch.timestamp };
+}
+
 #pragma mark - Spline drawing
 
+// Boxed variant of splineIncrement:forLine:toPoints:, kept for callers which want an NSArray:
+
 - (NSMutableArray *) splineIncrement:(NSArray *)lineIncr
                              forLine:(NSArray *)touches {
     
-    // Get the points from the newLine and the lineIncr:
-    NSUInteger length      = [touches count];
-    NSUInteger incrLength  = [lineIncr count];
-    NSUInteger startIndex  = length - incrLength;
-    SID_Touch *lastTouch   = [lineIncr lastObject];
-    if (lastTouch.classification > 3) {
-        startIndex++;
+    NSUInteger maxData = [self maxPointsForIncrement:[lineIncr count]];
+    CGPoint *buffer    = malloc(maxData * sizeof(CGPoint));
+    NSUInteger count   = [self splineIncrement:lineIncr forLine:touches toPoints:buffer];
+    
+    NSMutableArray *points = nil;
+    if (count > 0) {
+        points = [[NSMutableArray alloc] initWithCapacity:count];
+        for (NSUInteger n = 0; n < count; n++) {
+            [points addObject:[NSValue valueWithCGPoint:buffer[n]]];
+        }
     }
-    NSUInteger maxData     = incrLength * self.pvData.maxSplinePoints;
-    NSMutableArray *points = [[NSMutableArray alloc] initWithCapacity:maxData];
+    free(buffer);
+    return points;
+}
+
+// Upper bound for the number of points the spline methods write for an increment. Three more
+// touches are allowed for, because the array variant replays the start of short lines:
+
+- (NSUInteger) maxPointsForIncrement:(NSUInteger)incrLength {
+    
+    return PaintSplineStreamMaxPoints(incrLength + 3, self.pvData.maxSplinePoints);
+}
+
+// The spline tolerance of the settings in points, for PaintSplineStreamSetTolerance():
+
+- (double) tolerance {
     
-    if (length == 0) {
-        return nil;
-        
-        // The first point must serve as a starting point.
-    } else if (length < 3) {
-        if (startIndex == 0) {
-            SID_Touch *tp = [touches firstObject];
-            if (tp.classification < 3) {
-                [points addObject:[NSValue valueWithCGPoint:tp.point]];
-            }
+    return self.pvData.splineTolerance / [[UIScreen mainScreen] scale];
+}
+
+// Feed the touches in range into the stream. Palm touches and extrapolated points are skipped.
+
+- (NSUInteger) feedTouches:(NSArray *)touches
+                     range:(NSRange)range
+                    stream:(PaintSplineStream *)stream
+                  toPoints:(CGPoint *)points {
+    
+    PaintSplineControl control[64];
+    NSUInteger written = 0;
+    NSUInteger length  = 0;
+    PaintSplineStreamSetTolerance(stream, [self tolerance]);
+    
+    for (NSUInteger n = range.location; n < NSMaxRange(range); n++) {
+        SID_Touch *touch = touches[n];
+        if (touch.classification < 3) {
+            control[length++] = PaintSplineControlMake(touch);
         }
-        return nil;
-        
-        // Only with four points or more we can really plot a B-spline.
-    } else {
-        SID_Touch *tp0, *tp1, *tp2, *tp3;
-        CGPoint   pi3, pi4;
-        
-        if (startIndex < 3) {
-            // Step one with extrapolated starting point, so that the first segment can be splined:
-            tp1       = [touches firstObject];
-            tp2       = [touches objectAtIndex:1L];
-            tp3       = [touches objectAtIndex:2L];
-            tp0       = [[SID_Touch alloc] init];
-            tp0.point = CGPointMake(1.5*tp1.point.x - 0.75*tp2.point.x + 0.25*tp3.point.x,
-                                    1.5*tp1.point.y - 0.75*tp2.point.y + 0.25*tp3.point.y);
+        if (length == 64 || (length > 0 && n + 1 == NSMaxRange(range))) {
             
-        } else {
-            tp0 = [touches objectAtIndex:startIndex-3];
-            tp1 = [touches objectAtIndex:startIndex-2];
-            tp2 = [touches objectAtIndex:startIndex-1];
-            tp3 = [touches objectAtIndex:startIndex];
+            // Chunks after the first repeat the point where the previous one stopped; drop it:
+            NSUInteger skip = (written > 0) ? 1 : 0;
+            written += PaintSplineStreamFeed(stream, control, length, self.pvData.maxSplinePoints,
+                                             (PaintPoint *)points + written - skip) - skip;
+            length   = 0;
         }
-        
-        CGFloat divisions   = (tp2.velocity.x + tp2.velocity.y) / (tp2.timestamp - tp1.timestamp);
-        NSUInteger interpol = (NSUInteger)divisions;
-        if (interpol > self.pvData.maxSplinePoints) {
-            divisions = divisions * self.pvData.maxSplinePoints / interpol;
-            interpol  = self.pvData.maxSplinePoints;
-        }
-        
-        // Now prepare the splining part of the segment:
-        CGFloat pi0x = (-tp0.point.x + 3 * tp1.point.x - 3 * tp2.point.x + tp3.point.x) / 6.0;
-        CGFloat pi1x = ( tp0.point.x - 2 * tp1.point.x +     tp2.point.x              ) / 2.0;
-        CGFloat pi2x = (-tp0.point.x                   +     tp2.point.x              ) / 2.0;
-        CGFloat pi3x = ( tp0.point.x + 4 * tp1.point.x +     tp2.point.x              ) / 6.0;
-        CGFloat pi0y = (-tp0.point.y + 3 * tp1.point.y - 3 * tp2.point.y + tp3.point.y) / 6.0;
-        CGFloat pi1y = ( tp0.point.y - 2 * tp1.point.y +     tp2.point.y              ) / 2.0;
-        CGFloat pi2y = (-tp0.point.y                   +     tp2.point.y              ) / 2.0;
-        CGFloat pi3y = ( tp0.point.y + 4 * tp1.point.y +     tp2.point.y              ) / 6.0;
-        
-        // Add the first point to the array. It should be the point which was last in the previous loop
-        // and is roughly pt1, i.e. the point with the index line.length - incrLength - 2
-        pi3  = CGPointMake(pi3x, pi3y);
-        [points addObject:[NSValue valueWithCGPoint:pi3]];
-        for (NSUInteger i = 1; i < interpol; i++) {
-            double t = (double)i / divisions;
-            pi4.x    = (pi2x + t*(pi1x + t*pi0x))*t + pi3x;
-            pi4.y    = (pi2y + t*(pi1y + t*pi0y))*t + pi3y;
-            [points addObject:[NSValue valueWithCGPoint:pi4]];
+    }
+    return written;
+}
+
+// The same for touches kept in columns, from index first on:
+
+- (NSUInteger) feedColumns:(const PaintTouchColumns *)columns
+                      from:(NSUInteger)first
+                    stream:(PaintSplineStream *)stream
+                  toPoints:(CGPoint *)points {
+    
+    PaintSplineControl control[64];
+    NSUInteger written = 0;
+    NSUInteger length  = 0;
+    PaintSplineStreamSetTolerance(stream, [self tolerance]);
+    
+    for (NSUInteger n = first; n < columns->count; n++) {
+        if (PaintTouchColumnsClassification(columns, n) < 3) {
+            control[length++] = PaintTouchColumnsControl(columns, n);
         }
-        divisions = (tp3.velocity.x + tp3.velocity.y) / (tp3.timestamp - tp2.timestamp);
-        
-        // Now loop over the known points. No guessing needed here!
-        for (NSUInteger n = startIndex+1; n < length; n++) {
-            
-            // prepare for next run of the loop. If the last point is an extrapolation, stop the loop:
-            SID_Touch *touch = touches[n];
-            tp0      = tp1;
-            tp1      = tp2;
-            tp2      = tp3;
-            tp3      = touch;
-            interpol = (NSUInteger)divisions;
-            if (interpol > self.pvData.maxSplinePoints) {
-                divisions = divisions * self.pvData.maxSplinePoints / interpol;
-                interpol  = self.pvData.maxSplinePoints;
-            }
-            
-            pi0x = (-tp0.point.x + 3 * tp1.point.x - 3 * tp2.point.x + tp3.point.x) / 6.0;
-            pi1x = ( tp0.point.x - 2 * tp1.point.x +     tp2.point.x              ) / 2.0;
-            pi2x = (-tp0.point.x                   +     tp2.point.x              ) / 2.0;
-            pi3x = ( tp0.point.x + 4 * tp1.point.x +     tp2.point.x              ) / 6.0;
-            pi0y = (-tp0.point.y + 3 * tp1.point.y - 3 * tp2.point.y + tp3.point.y) / 6.0;
-            pi1y = ( tp0.point.y - 2 * tp1.point.y +     tp2.point.y              ) / 2.0;
-            pi2y = (-tp0.point.y                   +     tp2.point.y              ) / 2.0;
-            pi3y = ( tp0.point.y + 4 * tp1.point.y +     tp2.point.y              ) / 6.0;
-            pi3  = CGPointMake(pi3x, pi3y);
-            
-            [points addObject:[NSValue valueWithCGPoint:pi3]];
-            for (NSUInteger i = 1; i < interpol; i++) {
-                double t = (double)i / divisions;
-                pi4.x    = (pi2x + t*(pi1x + t*pi0x))*t + pi3x;
-                pi4.y    = (pi2y + t*(pi1y + t*pi0y))*t + pi3y;
-                [points addObject:[NSValue valueWithCGPoint:pi4]];
-            }
-            divisions = (tp3.velocity.x + tp3.velocity.y) / (tp3.timestamp - tp2.timestamp);
+        if (length == 64 || (length > 0 && n + 1 == columns->count)) {
+            NSUInteger skip = (written > 0) ? 1 : 0;
+            written += PaintSplineStreamFeed(stream, control, length, self.pvData.maxSplinePoints,
+                                             (PaintPoint *)points + written - skip) - skip;
+            length   = 0;
         }
-        
-        // The last point must be close to pt2, so we can continue at the same point next time:
-        pi3x = ( tp1.point.x + 4 * tp2.point.x + tp3.point.x) / 6.0;
-        pi3y = ( tp1.point.y + 4 * tp2.point.y + tp3.point.y) / 6.0;
-        [points addObject:[NSValue valueWithCGPoint:CGPointMake(pi3x, pi3y)]];
     }
-    return points;
+    return written;
 }
 
-// Add one extrapolated point. This really helps (sometimes)!
+// Add the increment to the line and feed it into the spline stream of the line. Only the new
+// touches are read, the older ones are represented by the state of the stream.
 
-- (void) addLastPointToPath:(CGMutablePathRef)path fromPoints:(NSArray *)points {
+- (NSUInteger) splineIncrement:(NSArray *)lineIncr
+                        ofLine:(PaintViewLine *)line
+                      toPoints:(CGPoint *)points {
     
-    NSUInteger length = [points count];
-    if (length < 2) {
-        return;
-        
-        // If the line never had more than two points, it needs to be painted completely.
-    } else if (length < 3) {
-        SID_Touch *tp1 = [points objectAtIndex:length-2];
-        CGPathMoveToPoint(path, NULL, tp1.point.x, tp1.point.y);
-        SID_Touch *tp2 = [points objectAtIndex:length-1];
-        CGPathMoveToPoint(path, NULL, tp2.point.x, tp2.point.y);
-        CGPoint pt3 = CGPointMake(2*tp2.point.x - tp1.point.x, 2*tp2.point.y - tp1.point.y);
-        CGPathAddLineToPoint(path, NULL, pt3.x, pt3.y);
-        
-        // Set up the splining for the last gap, and then some more.
+    NSUInteger first = [line touchColumns]->count;
+    [line addIncrement:lineIncr];
+    return [self feedColumns:[line touchColumns]
+                        from:first
+                      stream:[line splineStream]
+                    toPoints:points];
+}
+
+// Stateless variant for a line given as an array of touches. The increment is the tail of touches,
+// the three touches before it set up a temporary stream.
+
+- (NSUInteger) splineIncrement:(NSArray *)lineIncr
+                       forLine:(NSArray *)touches
+                      toPoints:(CGPoint *)points {
+    
+    // Get the points from the newLine and the lineIncr:
+    NSUInteger length      = [touches count];
+    NSUInteger incrLength  = [lineIncr count];
+    NSUInteger startIndex  = length - incrLength;
+    SID_Touch *lastTouch   = [lineIncr lastObject];
+    if (lastTouch.classification > 3) {
+        startIndex++;
+    }
+    
+    // Only with four points or more we can really plot a B-spline. An increment with nothing
+    // but an extrapolated point brings no new segment either.
+    if (length < 3 || startIndex >= length) {
+        return 0;
+    }
+    
+    PaintSplineStream stream;
+    PaintSplineStreamInit(&stream);
+    if (startIndex < 3) {
+        startIndex = 0;
     } else {
-        SID_Touch *tp0 = [points objectAtIndex:length-3];
-        SID_Touch *tp1 = [points objectAtIndex:length-2];
-        SID_Touch *tp2 = [points objectAtIndex:length-1];
-        CGPoint pt3    = CGPointMake(1.5*tp2.point.x - 0.75*tp1.point.x + 0.25*tp0.point.x,
-                                     1.5*tp2.point.y - 0.75*tp1.point.y + 0.25*tp0.point.y);
-        
-        CGFloat divisions   = (tp2.velocity.x + tp2.velocity.y) / (tp2.timestamp - tp1.timestamp);
-        NSUInteger interpol = (NSUInteger)divisions;
-        if (interpol > self.pvData.maxSplinePoints) {
-            divisions = divisions * self.pvData.maxSplinePoints / interpol;
-            interpol  = self.pvData.maxSplinePoints;
-        }
-        
-        CGFloat pi0x = (-tp0.point.x + 3 * tp1.point.x - 3 * tp2.point.x + pt3.x) / 6.0;
-        CGFloat pi1x = ( tp0.point.x - 2 * tp1.point.x +     tp2.point.x        ) / 2.0;
-        CGFloat pi2x = (-tp0.point.x                   +     tp2.point.x        ) / 2.0;
-        CGFloat pi3x = ( tp0.point.x + 4 * tp1.point.x +     tp2.point.x        ) / 6.0;
-        CGFloat pi0y = (-tp0.point.y + 3 * tp1.point.y - 3 * tp2.point.y + pt3.y) / 6.0;
-        CGFloat pi1y = ( tp0.point.y - 2 * tp1.point.y +     tp2.point.y        ) / 2.0;
-        CGFloat pi2y = (-tp0.point.y                   +     tp2.point.y        ) / 2.0;
-        CGFloat pi3y = ( tp0.point.y + 4 * tp1.point.y +     tp2.point.y        ) / 6.0;
-        
-        CGPoint pi4;
-        for (NSUInteger i = 1; i < interpol; i++) {
-            double t = (double)i / divisions;
-            pi4.x    = (pi2x + t*(pi1x + t*pi0x))*t + pi3x;
-            pi4.y    = (pi2y + t*(pi1y + t*pi0y))*t + pi3y;
-            CGPathAddLineToPoint(path, NULL, pi4.x, pi4.y);
+        PaintSplineControl control[3];
+        for (NSUInteger n = 0; n < 3; n++) {
+            control[n] = PaintSplineControlMake(touches[startIndex - 3 + n]);
         }
-        pi4 = CGPointMake(( tp1.point.x + 4 * tp2.point.x + pt3.x) / 6.0,
-                          ( tp1.point.y + 4 * tp2.point.y + pt3.y) / 6.0);
-        CGPathAddLineToPoint(path, NULL, pi4.x, pi4.y);
+        PaintSplineStreamPrime(&stream, control);
     }
+    return [self feedTouches:touches
+                       range:NSMakeRange(startIndex, length - startIndex)
+                      stream:&stream
+                    toPoints:points];
 }
 
 @end
@@ -0,0 +1,846 @@
+//
+//  PaintStrokeEngine.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintStrokeEngine.h"
+
+#define DAMPING 0.7
+
+// Flag of the line table: a pen line with this ID has been seen and is not decided yet.
+#define LINE_KEY 0x2u
+
+// Cell size in points and bucket count of the index of live lines:
+#define INDEX_CELL     64.0f
+#define INDEX_BUCKETS  1024
+
+// Lists of undecided pen lines: one for each confirmed pen mode and one for all other modes:
+#define MODE_LISTS     4
+
+struct PaintStrokeEngine {
+    size_t                maxSplinePoints;
+    double                tolerance;        // Spline subdivision, 0 for the velocity heuristic
+    PaintPredictorConfig  predictor;        // For the tails of new lines
+    PaintStrokeWidthRange widthRange;       // For the widths of new lines
+    int                   widthByRange;
+    PaintStrokeCallbacks  callbacks;
+    PaintLineStyle        presets;          // From the controls
+    PaintLineStyle        lastLine;         // Template for new lines, set by the last confirmed pen line
+    PaintStrokeLine     **lines;            // Lines still being drawn, in the order they were opened
+    size_t                lineCount;
+    size_t                lineCapacity;
+    PaintLineTable        table;            // Line ID -> line being drawn, and the key flag
+    size_t                keyCount;         // Pen lines seen so far, as long as they are undecided
+    PaintStrokeLine      *modeLists[MODE_LISTS];    // The lines of the keys, by mode
+    PaintStrokeLine     **decided;          // Scratch buffer for applying a pen mode to them
+    size_t                decidedCapacity;
+    uint64_t              lineOrder;
+    uint32_t             *freeSlots;        // Slots of finished lines, to be handed out again
+    size_t                freeSlotCount;
+    size_t                freeSlotCapacity;
+    uint32_t              slotCount;
+    PaintStrokeLine     **slotLines;        // Line by slot, NULL for free slots
+    size_t                slotCapacity;
+    PaintStrokeIndex      index;            // Bounds of the live lines by slot
+    uint32_t             *foundSlots;       // Result of the last query of the index
+    size_t                foundCapacity;
+    PaintSplineControl   *controls;         // Scratch buffer for feeding the spline stream
+    size_t                controlCapacity;
+    double                lineSpeed;
+    PaintStrokeStatistics statistics;
+};
+
+PaintLineStyle PaintLineStyleDefault(void) {
+    
+    PaintLineStyle style = { .mode = 2, .color = 1, .width = 5.0, .alpha = 1.0, .bright = 0.8 };
+    return style;
+}
+
+#pragma mark - Bookkeeping
+
+// Returns the buffer with room for needed items, or NULL if there is no memory; the old buffer
+// and capacity stay as they were then:
+
+static void *PaintGrow(void *buffer, size_t *capacity, size_t needed, size_t size) {
+    
+    if (needed <= *capacity) {
+        return buffer;
+    }
+    size_t grown = *capacity ? 2 * *capacity : 16;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *resized = realloc(buffer, grown * size);
+    if (resized) {
+        *capacity = grown;
+    }
+    return resized;
+}
+
+static PaintStrokeLine *PaintStrokeEngineFindLine(const PaintStrokeEngine *engine, uint32_t lineID) {
+    
+    PaintLineTableEntry *entry = PaintLineTableFind(&engine->table, lineID);
+    return entry ? entry->value : NULL;
+}
+
+static int PaintStrokeEngineHasKey(const PaintStrokeEngine *engine, uint32_t lineID) {
+    
+    PaintLineTableEntry *entry = PaintLineTableFind(&engine->table, lineID);
+    return entry && (entry->flags & LINE_KEY);
+}
+
+// A pen mode found for one line goes to the lines which have a key and stand for it. They are
+// kept in lists by mode, so the lines which already have the mode are not even looked at:
+
+static int PaintStrokeModeList(int mode) {
+    
+    switch (mode) {
+        case 10: return 1;
+        case 20: return 2;
+        case 30: return 3;
+        default: return 0;
+    }
+}
+
+static void PaintStrokeEngineUnlistLine(PaintStrokeEngine *engine, PaintStrokeLine *line) {
+    
+    if (line->modeList < 0) {
+        return;
+    }
+    if (line->modePrevious) {
+        line->modePrevious->modeNext = line->modeNext;
+    } else {
+        engine->modeLists[line->modeList] = line->modeNext;
+    }
+    if (line->modeNext) {
+        line->modeNext->modePrevious = line->modePrevious;
+    }
+    line->modePrevious = line->modeNext = NULL;
+    line->modeList     = -1;
+}
+
+// Put the line into the list it belongs to now. Called whenever its mode, its key or the line
+// the ID stands for may have changed:
+
+static void PaintStrokeEngineListLine(PaintStrokeEngine *engine, PaintStrokeLine *line) {
+    
+    PaintLineTableEntry *entry = PaintLineTableFind(&engine->table, line->lineID);
+    int list = (entry && entry->value == line && (entry->flags & LINE_KEY)) ? PaintStrokeModeList(line->style.mode) : -1;
+    if (list == line->modeList) {
+        return;
+    }
+    PaintStrokeEngineUnlistLine(engine, line);
+    if (list >= 0) {
+        line->modeList     = list;
+        line->modeNext     = engine->modeLists[list];
+        if (line->modeNext) line->modeNext->modePrevious = line;
+        engine->modeLists[list] = line;
+    }
+}
+
+static void PaintStrokeEngineAddKey(PaintStrokeEngine *engine, uint32_t lineID) {
+    
+    PaintLineTableEntry *entry = PaintLineTableInsert(&engine->table, lineID);
+    if (entry && !(entry->flags & LINE_KEY)) {
+        entry->flags |= LINE_KEY;
+        engine->keyCount++;
+        if (entry->value) PaintStrokeEngineListLine(engine, entry->value);
+    }
+}
+
+// The entry goes when neither the key nor a line is left:
+
+static void PaintStrokeEngineRemoveKey(PaintStrokeEngine *engine, uint32_t lineID) {
+    
+    PaintLineTableEntry *entry = PaintLineTableFind(&engine->table, lineID);
+    if (entry && (entry->flags & LINE_KEY)) {
+        entry->flags &= ~LINE_KEY;
+        engine->keyCount--;
+        if (!entry->value) {
+            PaintLineTableRemove(&engine->table, entry);
+        } else {
+            PaintStrokeEngineListLine(engine, entry->value);
+        }
+    }
+}
+
+static void PaintStrokeLineFree(PaintStrokeLine *line) {
+    
+    PaintTouchColumnsRelease(&line->touches);
+    free(line->points);
+    free(line->tail);
+    free(line->widths);
+    free(line->tailWidths);
+    free(line);
+}
+
+// Take a line out of the engine, after its owner has been told:
+
+static void PaintStrokeEngineDetachLine(PaintStrokeEngine *engine, PaintStrokeLine *line) {
+    
+    // Once a line ends, a younger line with the same ID (if any) is the one the ID stands for:
+    size_t index              = engine->lineCount;
+    PaintStrokeLine *namesake = NULL;
+    for (size_t n = 0; n < engine->lineCount; n++) {
+        if (engine->lines[n] == line) {
+            index = n;
+        } else if (!namesake && engine->lines[n]->lineID == line->lineID) {
+            namesake = engine->lines[n];
+        }
+    }
+    if (index == engine->lineCount) {
+        return;
+    }
+    memmove(engine->lines + index, engine->lines + index + 1, (engine->lineCount - index - 1) * sizeof(PaintStrokeLine *));
+    engine->lineCount--;
+    PaintStrokeEngineUnlistLine(engine, line);
+    
+    PaintLineTableEntry *entry = PaintLineTableFind(&engine->table, line->lineID);
+    if (entry && entry->value == line) {
+        entry->value = namesake;
+        if (namesake) {
+            PaintStrokeEngineListLine(engine, namesake);
+        } else if (!(entry->flags & LINE_KEY)) {
+            PaintLineTableRemove(&engine->table, entry);
+        }
+    }
+    
+    // Without room in the free list the slot is not used again, which only costs a slot:
+    uint32_t *freeSlots = PaintGrow(engine->freeSlots, &engine->freeSlotCapacity, engine->freeSlotCount + 1, sizeof(uint32_t));
+    if (freeSlots) {
+        engine->freeSlots = freeSlots;
+        engine->freeSlots[engine->freeSlotCount++] = line->slot;
+    }
+    engine->slotLines[line->slot] = NULL;
+    PaintStrokeIndexRemove(&engine->index, line->slot);
+    PaintStrokeLineFree(line);
+}
+
+// The tail keeps the width where the stable points end:
+
+static void PaintStrokeEngineWidenTail(PaintStrokeLine *line) {
+    
+    if (!line->widths || line->pointCount == 0) {
+        return;
+    }
+    for (size_t n = 0; n < line->tailCount; n++) {
+        line->tailWidths[n] = line->widths[line->pointCount - 1];
+    }
+}
+
+// A predicted tail leads the pen while it moves. A line which goes into the bitmap gets the
+// extrapolated tail of its spline instead, which ends at the last touch, not past it:
+
+static void PaintStrokeEngineSettleTail(PaintStrokeEngine *engine, PaintStrokeLine *line) {
+    
+    if (line->predictor.config.kind == PaintPredictorOff) {
+        return;
+    }
+    line->tailCount = PaintSplineStreamTail(&line->stream, engine->maxSplinePoints, line->tail);
+    PaintStrokeEngineWidenTail(line);
+}
+
+// The line is committed to the bitmap or dropped, depending on commit:
+
+static void PaintStrokeEngineFinishLine(PaintStrokeEngine *engine, PaintStrokeLine *line, int commit) {
+    
+    if (commit) {
+        PaintStrokeEngineSettleTail(engine, line);
+        engine->statistics.linesCommitted++;
+        if (engine->callbacks.lineCommitted) engine->callbacks.lineCommitted(engine->callbacks.context, line);
+    } else {
+        engine->statistics.linesRemoved++;
+        if (engine->callbacks.lineRemoved) engine->callbacks.lineRemoved(engine->callbacks.context, line);
+    }
+    PaintStrokeEngineDetachLine(engine, line);
+}
+
+// Commit several lines at once, one call if the owner takes them that way:
+
+static void PaintStrokeEngineCommitLines(PaintStrokeEngine *engine, PaintStrokeLine **lines, size_t count) {
+    
+    if (count == 0) {
+        return;
+    }
+    if (!engine->callbacks.linesCommitted) {
+        for (size_t n = 0; n < count; n++) {
+            PaintStrokeEngineFinishLine(engine, lines[n], 1);
+        }
+        return;
+    }
+    for (size_t n = 0; n < count; n++) {
+        PaintStrokeEngineSettleTail(engine, lines[n]);
+    }
+    engine->statistics.linesCommitted += count;
+    engine->callbacks.linesCommitted(engine->callbacks.context, (const PaintStrokeLine *const *)lines, count);
+    for (size_t n = 0; n < count; n++) {
+        PaintStrokeEngineDetachLine(engine, lines[n]);
+    }
+}
+
+#pragma mark - Lines
+
+// Grow the bounds of the line by its points from firstPoint on and by its tail, and keep them in
+// the index together with the line width:
+
+static void PaintStrokeEngineIndexLine(PaintStrokeEngine *engine, PaintStrokeLine *line, size_t firstPoint) {
+    
+    for (size_t n = firstPoint; n < line->pointCount + line->tailCount; n++) {
+        PaintPoint p            = n < line->pointCount ? line->points[n] : line->tail[n - line->pointCount];
+        PaintStrokeBounds point = { (float)p.x, (float)p.y, (float)p.x, (float)p.y };
+        line->bounds            = PaintStrokeBoundsUnion(line->bounds, point);
+    }
+    PaintStrokeIndexInsert(&engine->index, line->slot, PaintStrokeBoundsInset(line->bounds, -(float)line->style.width));
+}
+
+// Apply all changes to a line when the mode changes:
+
+static void PaintStrokeEngineSetMode(PaintStrokeEngine *engine, PaintStrokeLine *line, int mode) {
+    
+    PaintLineStyle *style = &line->style;
+    style->mode           = mode;
+    style->width          = engine->presets.width;
+    style->bright         = engine->presets.bright;
+    style->alpha          = engine->presets.alpha;
+    switch (mode) {
+        case  1:
+        case 10:
+            style->color  = 1;
+            break;
+        
+        case  2:
+        case 20:
+            style->color  = 2;
+            break;
+        
+        case  3:
+        case 30:
+            style->color  = 3;
+            style->width  = 50.0;
+            style->bright = 1.0;
+            style->alpha  = 0.33;
+            break;
+        
+        case  9:
+            style->color  = 9;
+            style->width  = 2 * engine->presets.width;
+            break;
+        
+        default:
+            style->color  = 0;
+            break;
+    }
+    
+    // The width may have changed:
+    PaintStrokeEngineIndexLine(engine, line, line->pointCount + line->tailCount);
+    PaintStrokeEngineListLine(engine, line);
+}
+
+// Only the numbers the spline needs are kept, in the columns of the line:
+
+static void PaintStrokeLineAddTouches(PaintStrokeLine *line, const PaintStrokeTouch *touches, size_t count) {
+    
+    for (size_t n = 0; n < count; n++) {
+        PaintTouchColumnsAppend(&line->touches, &touches[n].control, touches[n].classification);
+        if (touches[n].classification < 3) {
+            PaintPredictorUpdate(&line->predictor, &touches[n].control);
+            PaintPoint velocity = touches[n].control.velocity;
+            double speed        = sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+            line->speed         = line->touches.count > 1 ? DAMPING * line->speed + (1.0 - DAMPING) * speed : speed;
+        }
+    }
+}
+
+// The width factors of the points start … end-1 go from the one at start, where the line ended
+// before, to the one of the current speed, so the width follows the speed without steps:
+
+static void PaintStrokeEngineWiden(PaintStrokeEngine *engine, PaintStrokeLine *line, size_t start, size_t end) {
+    
+    PaintFloat target = (PaintFloat)PaintStrokeWidthForSpeed(&engine->widthRange, line->speed);
+    PaintFloat from   = start > 0 ? line->widths[start] : target;
+    for (size_t n = start; n < end; n++) {
+        line->widths[n] = end - start > 1 ? from + (target - from) * (PaintFloat)(n - start) / (PaintFloat)(end - start - 1)
+                                          : target;
+    }
+}
+
+// Feed the touches of the line from index firstTouch on into its spline stream. Palm touches and
+// extrapolated points are skipped. Returns the number of points the stream emitted, including the
+// repeated last point:
+
+static size_t PaintStrokeEngineFeed(PaintStrokeEngine *engine, PaintStrokeLine *line, size_t firstTouch) {
+    
+    PaintSplineControl *controls = PaintGrow(engine->controls, &engine->controlCapacity,
+                                             line->touches.count - firstTouch + 1, sizeof(PaintSplineControl));
+    if (!controls) {
+        return 0;
+    }
+    engine->controls = controls;
+    size_t length    = PaintTouchColumnsSplineControls(&line->touches, firstTouch, engine->controls);
+    
+    // The stream starts with the point where the line ends now, so it overwrites that one:
+    size_t start       = line->pointCount ? line->pointCount - 1 : 0;
+    PaintPoint *points = PaintGrow(line->points, &line->pointCapacity,
+                                   start + PaintSplineStreamMaxPoints(length, engine->maxSplinePoints), sizeof(PaintPoint));
+    if (!points) {
+        return 0;
+    }
+    line->points   = points;
+    size_t written = PaintSplineStreamFeed(&line->stream, engine->controls, length,
+                                           engine->maxSplinePoints, line->points + start);
+    if (written > 0) {
+        engine->statistics.points += start + written - line->pointCount;
+        line->pointCount           = start + written;
+        if (line->widths) {
+            
+            // Without room for the factors the line falls back to a constant width:
+            PaintFloat *widths = PaintGrow(line->widths, &line->widthCapacity, line->pointCapacity, sizeof(PaintFloat));
+            if (!widths) {
+                free(line->widths);
+                line->widths        = NULL;
+                line->widthCapacity = 0;
+                return written;
+            }
+            line->widths = widths;
+            PaintStrokeEngineWiden(engine, line, start, line->pointCount);
+        }
+    }
+    return written;
+}
+
+// Open a new line if a new line start is detected:
+
+static void PaintStrokeEngineOpenLine(PaintStrokeEngine *engine, uint32_t lineID,
+                                      const PaintStrokeTouch *touches, size_t count) {
+    
+    // Everything the line needs comes first; without it the line is not opened and its slot
+    // stays free:
+    uint32_t slot         = engine->freeSlotCount ? engine->freeSlots[engine->freeSlotCount - 1] : engine->slotCount;
+    PaintStrokeLine *line = calloc(1, sizeof(PaintStrokeLine));
+    PaintPoint *tail      = malloc((engine->maxSplinePoints + 1) * sizeof(PaintPoint));
+    PaintStrokeLine **slotLines = PaintGrow(engine->slotLines, &engine->slotCapacity, slot + 1, sizeof(PaintStrokeLine *));
+    if (slotLines) {
+        engine->slotLines = slotLines;
+    }
+    PaintStrokeLine **lines = PaintGrow(engine->lines, &engine->lineCapacity, engine->lineCount + 1, sizeof(PaintStrokeLine *));
+    if (lines) {
+        engine->lines = lines;
+    }
+    if (line && engine->widthByRange) {
+        line->widths     = PaintGrow(NULL, &line->widthCapacity, 16, sizeof(PaintFloat));
+        line->tailWidths = malloc((engine->maxSplinePoints + 1) * sizeof(PaintFloat));
+    }
+    if (!line || !tail || !slotLines || !lines || (engine->widthByRange && (!line->widths || !line->tailWidths))) {
+        if (line) {
+            free(line->widths);
+            free(line->tailWidths);
+        }
+        free(line);
+        free(tail);
+        return;
+    }
+    if (engine->freeSlotCount) {
+        engine->freeSlotCount--;
+    } else {
+        engine->slotCount++;
+    }
+    line->lineID          = lineID;
+    line->slot            = slot;
+    line->tail            = tail;
+    line->bounds          = PaintStrokeBoundsEmpty;
+    line->order           = engine->lineOrder++;
+    line->modeList        = -1;
+    line->firstTimestamp  = touches[0].control.timestamp;
+    engine->slotLines[line->slot] = line;
+    PaintSplineStreamInit(&line->stream);
+    PaintSplineStreamSetTolerance(&line->stream, engine->tolerance);
+    PaintPredictorInit(&line->predictor, &engine->predictor);
+    
+    // Pen lines get a preliminary style, inherited from the last confirmed line:
+    line->style = engine->lastLine;
+    PaintStrokeEngineSetMode(engine, line, line->style.mode);
+    PaintStrokeLineAddTouches(line, touches, count);
+    PaintStrokeEngineFeed(engine, line, 0);
+    PaintStrokeEngineIndexLine(engine, line, 0);
+    
+    // Depending on the line type, we choose a square or round line start:
+    line->buttCap = (count > 0 && touches[count - 1].classification == 1 && line->style.mode == 3);
+    
+    engine->lines[engine->lineCount++] = line;
+    PaintLineTableEntry *entry         = PaintLineTableInsert(&engine->table, lineID);
+    if (entry && !entry->value) {
+        entry->value = line;
+        PaintStrokeEngineListLine(engine, line);
+    }
+    engine->statistics.linesOpened++;
+    if (engine->callbacks.lineOpened) engine->callbacks.lineOpened(engine->callbacks.context, line);
+}
+
+// Add the most recent increment to an existing line:
+
+static void PaintStrokeEnginePaintIncrement(PaintStrokeEngine *engine, uint32_t lineID,
+                                            const PaintStrokeTouch *touches, size_t count, int end) {
+    
+    PaintStrokeLine *line = PaintStrokeEngineFindLine(engine, lineID);
+    if (!line || count == 0) {
+        return;
+    }
+    const PaintStrokeTouch *lastTouch = &touches[count - 1];
+    
+    // If palm touches are reported or the pen mode is negative, delete the line:
+    if (lastTouch->classification == 3 || line->style.mode < 0) {
+        PaintStrokeEngineFinishLine(engine, line, 0);
+        PaintStrokeEngineRemoveKey(engine, lineID);
+        return;
+    }
+    
+    // Finger touches get mode 9:
+    if (lastTouch->classification == 2 || lastTouch->classification == 6) {
+        PaintStrokeEngineSetMode(engine, line, 9);
+        if (engine->callbacks.lineStyled) engine->callbacks.lineStyled(engine->callbacks.context, line);
+    }
+    
+    // Extend the line by all non-extrapolated points:
+    size_t firstTouch = line->touches.count;
+    for (size_t n = 0; n < count; n++) {
+        if (touches[n].classification < 3) {
+            PaintStrokeLineAddTouches(line, &touches[n], 1);
+            engine->lineSpeed = DAMPING * engine->lineSpeed
+                              + (1.0 - DAMPING) * (touches[n].control.velocity.x + touches[n].control.velocity.y);
+        }
+    }
+    size_t firstPoint = line->pointCount;
+    size_t written    = PaintStrokeEngineFeed(engine, line, firstTouch);
+    
+    // Extra points towards the predicted pen position, or if there is an extrapolated point.
+    // They replace the tail of the last increment. The last increment is not predicted, the
+    // pen has been lifted:
+    line->tailCount = 0;
+    PaintPoint predicted;
+    if (written > 0 && !end && line->predictor.config.kind != PaintPredictorOff
+        && PaintPredictorPredict(&line->predictor, line->predictor.config.lookahead, &predicted)) {
+        line->tailCount = PaintSplineStreamTailTo(&line->stream, predicted, engine->maxSplinePoints, line->tail);
+    } else if (written > 0 && lastTouch->classification > 3) {
+        line->tailCount = PaintSplineStreamTail(&line->stream, engine->maxSplinePoints, line->tail);
+    }
+    PaintStrokeEngineWidenTail(line);
+    engine->statistics.tailPoints += line->tailCount;
+    PaintStrokeEngineIndexLine(engine, line, firstPoint ? firstPoint - 1 : 0);
+    if (engine->callbacks.lineExtended) engine->callbacks.lineExtended(engine->callbacks.context, line, firstPoint);
+    
+    // End detected: Close the line and transfer it to the bitmap:
+    if (end) {
+        PaintStrokeEngineFinishLine(engine, line, 1);
+        PaintStrokeEngineRemoveKey(engine, lineID);
+    }
+}
+
+#pragma mark - Events
+
+PaintStrokeEngine *PaintStrokeEngineCreate(size_t maxSplinePoints, const PaintStrokeCallbacks *callbacks) {
+    
+    PaintStrokeEngine *engine = calloc(1, sizeof(PaintStrokeEngine));
+    if (!engine) {
+        return NULL;
+    }
+    if (PaintLineTableInit(&engine->table, 64) != 0) {
+        free(engine);
+        return NULL;
+    }
+    if (PaintStrokeIndexInit(&engine->index, INDEX_CELL, INDEX_BUCKETS) != 0) {
+        PaintLineTableFree(&engine->table);
+        free(engine);
+        return NULL;
+    }
+    engine->maxSplinePoints = maxSplinePoints;
+    engine->presets         = PaintLineStyleDefault();
+    engine->lastLine        = PaintLineStyleDefault();
+    if (callbacks) {
+        engine->callbacks   = *callbacks;
+    }
+    return engine;
+}
+
+void PaintStrokeEngineDestroy(PaintStrokeEngine *engine) {
+    
+    if (!engine) {
+        return;
+    }
+    for (size_t n = 0; n < engine->lineCount; n++) {
+        PaintStrokeLineFree(engine->lines[n]);
+    }
+    free(engine->lines);
+    free(engine->freeSlots);
+    free(engine->slotLines);
+    free(engine->foundSlots);
+    free(engine->decided);
+    PaintLineTableFree(&engine->table);
+    PaintStrokeIndexFree(&engine->index);
+    free(engine->controls);
+    free(engine);
+}
+
+void PaintStrokeEngineSetTolerance(PaintStrokeEngine *engine, double tolerance) {
+    
+    engine->tolerance = tolerance;
+}
+
+void PaintStrokeEngineSetPredictor(PaintStrokeEngine *engine, PaintPredictorConfig config) {
+    
+    engine->predictor = config;
+}
+
+void PaintStrokeEngineSetWidthRange(PaintStrokeEngine *engine, const PaintStrokeWidthRange *range) {
+    
+    engine->widthByRange = range != NULL;
+    if (range) {
+        engine->widthRange = *range;
+    }
+}
+
+void PaintStrokeEngineSetPresets(PaintStrokeEngine *engine, PaintLineStyle presets) {
+    
+    engine->presets.width  = presets.width;
+    engine->presets.alpha  = presets.alpha;
+    engine->presets.bright = presets.bright;
+}
+
+void PaintStrokeEngineIncrement(PaintStrokeEngine *engine, uint32_t lineID,
+                                const PaintStrokeTouch *touches, size_t count, PaintStrokeSource source) {
+    
+    if (count == 0) {
+        return;
+    }
+    engine->statistics.increments++;
+    engine->statistics.touches += count;
+    
+    // The analyzer selects the touch handling according to type:
+    if (source == PaintStrokeFromAnalyzer) {
+        switch (touches[0].classification) {
+                
+                // First a finger touch
+            case 2:
+            case 6:
+                switch (touches[0].state) {
+                    case 1:
+                        PaintStrokeEngineOpenLine(engine, lineID, touches, count);
+                        break;
+                    
+                    case 2:
+                        PaintStrokeEnginePaintIncrement(engine, lineID, touches, count, 0);
+                        break;
+                    
+                    default:
+                        PaintStrokeEnginePaintIncrement(engine, lineID, touches, count, 1);
+                }
+                return;
+                
+                // Next a palm touch to ignore
+            case 3:
+                return;
+                
+                // Pen line points are handled like the ones from the recognizer:
+            default:
+                break;
+        }
+    }
+    
+    // If the key is new, open a line. If we get consecutive points, we extend it:
+    if (!PaintStrokeEngineHasKey(engine, lineID)) {
+        PaintStrokeEngineAddKey(engine, lineID);
+        PaintStrokeEngineOpenLine(engine, lineID, touches, count);
+    } else {
+        PaintStrokeEnginePaintIncrement(engine, lineID, touches, count, 0);
+    }
+}
+
+static int PaintStrokeLineCompareOrder(const void *a, const void *b) {
+    
+    uint64_t left = (*(PaintStrokeLine *const *)a)->order, right = (*(PaintStrokeLine *const *)b)->order;
+    return (left > right) - (left < right);
+}
+
+void PaintStrokeEngineApplyPenModes(PaintStrokeEngine *engine, const PaintStrokeModeChange *changes, size_t count) {
+    
+    for (size_t n = 0; n < count; n++) {
+        PaintStrokeLine *line = PaintStrokeEngineFindLine(engine, changes[n].lineID);
+        if (!line) continue;
+        
+        line->style.mode = changes[n].mode;
+        if (line->style.mode > 9) {
+            PaintStrokeEngineSetMode(engine, line, line->style.mode);
+            if (engine->callbacks.lineStyled) engine->callbacks.lineStyled(engine->callbacks.context, line);
+            
+            // Realistically, there can only be one good line. Save its properties,
+            // so the line can serve as a template for future lines.
+            engine->lastLine = line->style;
+            
+            // A negative penMode means we should erase the line and remove it from memory:
+        } else if (line->style.mode < 0) {
+            PaintStrokeEngineRemoveKey(engine, line->lineID);
+            PaintStrokeEngineFinishLine(engine, line, 0);
+        } else {
+            PaintStrokeEngineListLine(engine, line);
+        }
+    }
+    
+    // Now apply the newly found penMode retrospectively to the other lines. The undecided pen
+    // lines are the ones with a key. Only the lists of the other modes are looked at, and the
+    // lines are handled in the order they were opened:
+    if (engine->lastLine.mode > 9 && engine->keyCount > 1) {
+        int mode      = engine->lastLine.mode;
+        int skipped   = PaintStrokeModeList(mode);
+        size_t listed = 0;
+        for (int list = 0; list < MODE_LISTS; list++) {
+            if (list > 0 && list == skipped) continue;
+            for (PaintStrokeLine *line = engine->modeLists[list]; line; line = line->modeNext) {
+                PaintStrokeLine **decided = PaintGrow(engine->decided, &engine->decidedCapacity, listed + 1,
+                                                      sizeof(PaintStrokeLine *));
+                if (!decided) break;
+                
+                engine->decided           = decided;
+                engine->decided[listed++] = line;
+            }
+        }
+        engine->statistics.modeChecks += listed;
+        qsort(engine->decided, listed, sizeof(PaintStrokeLine *), PaintStrokeLineCompareOrder);
+        
+        size_t decided = 0;
+        for (size_t k = 0; k < listed; k++) {
+            PaintStrokeLine *line = engine->decided[k];
+            int notified          = 0;
+            for (size_t n = 0; n < count; n++) {
+                if (changes[n].lineID == line->lineID) notified = 1;
+            }
+            if (notified || line->style.mode == mode) continue;
+            
+            PaintStrokeEngineSetMode(engine, line, mode);
+            if (engine->callbacks.lineStyled) engine->callbacks.lineStyled(engine->callbacks.context, line);
+            PaintStrokeEngineRemoveKey(engine, line->lineID);
+            engine->decided[decided++] = line;
+        }
+        
+        // Paint these lines to the bitmap, all in one go:
+        PaintStrokeEngineCommitLines(engine, engine->decided, decided);
+    }
+}
+
+void PaintStrokeEngineEndLines(PaintStrokeEngine *engine, const PaintStrokeModeChange *changes, size_t count) {
+    
+    for (size_t n = 0; n < count; n++) {
+        PaintStrokeLine *line = PaintStrokeEngineFindLine(engine, changes[n].lineID);
+        if (!line) continue;
+        
+        // If the line has been identified as finger line (mode 9) before, we must not overwrite
+        // this here! The message for finger lines is 0, which would make it an undefined line.
+        if (line->style.mode != 9) {
+            line->style.mode = changes[n].mode;
+        }
+        PaintStrokeEngineListLine(engine, line);
+        
+        // … but only when we are sure about the line!
+        if (line->style.mode > 0) {
+            line->style.color = (line->style.mode > 9) ? line->style.mode / 10 : line->style.mode;
+            
+            // Add a little extrapolation at the end of the line to catch the last point:
+            line->tailCount = PaintSplineStreamTail(&line->stream, engine->maxSplinePoints, line->tail);
+            PaintStrokeEngineWidenTail(line);
+            PaintStrokeEngineRemoveKey(engine, line->lineID);
+            PaintStrokeEngineFinishLine(engine, line, line->pointCount > 0);
+            
+        } else if (line->style.mode < 0) {
+            
+            // Finger smudge: Delete the line:
+            PaintStrokeEngineRemoveKey(engine, line->lineID);
+            PaintStrokeEngineFinishLine(engine, line, 0);
+        }
+    }
+}
+
+void PaintStrokeEngineErase(PaintStrokeEngine *engine) {
+    
+    while (engine->lineCount > 0) {
+        PaintStrokeEngineFinishLine(engine, engine->lines[engine->lineCount - 1], 0);
+    }
+}
+
+size_t PaintStrokeEngineLinesInRect(PaintStrokeEngine *engine, PaintStrokeBounds rect,
+                                    const PaintStrokeLine **out, size_t max) {
+    
+    // There cannot be more lines in the rect than there are lines:
+    uint32_t *foundSlots = PaintGrow(engine->foundSlots, &engine->foundCapacity, engine->lineCount + 1, sizeof(uint32_t));
+    if (!foundSlots) {
+        return 0;
+    }
+    engine->foundSlots = foundSlots;
+    size_t found       = PaintStrokeIndexQuery(&engine->index, rect, engine->foundSlots, engine->lineCount);
+    for (size_t n = 0; n < found && n < max; n++) {
+        out[n] = engine->slotLines[engine->foundSlots[n]];
+    }
+    return found;
+}
+
+// Drop the live lines in rect, but the ones known to be pen lines if keepPen is set:
+
+static size_t PaintStrokeEngineDropLinesInRect(PaintStrokeEngine *engine, PaintStrokeBounds rect, int keepPen) {
+    
+    // Collect the lines first, dropping a line changes the index:
+    const PaintStrokeLine **lines = malloc((engine->lineCount + 1) * sizeof(PaintStrokeLine *));
+    if (!lines) {
+        return 0;
+    }
+    size_t found   = PaintStrokeEngineLinesInRect(engine, rect, lines, engine->lineCount);
+    size_t dropped = 0;
+    for (size_t n = 0; n < found; n++) {
+        if (keepPen && lines[n]->style.mode > 9) continue;
+        
+        uint32_t lineID = lines[n]->lineID;
+        PaintStrokeEngineFinishLine(engine, (PaintStrokeLine *)lines[n], 0);
+        PaintStrokeEngineRemoveKey(engine, lineID);
+        dropped++;
+    }
+    free(lines);
+    return dropped;
+}
+
+size_t PaintStrokeEngineEraseRect(PaintStrokeEngine *engine, PaintStrokeBounds rect) {
+    
+    return PaintStrokeEngineDropLinesInRect(engine, rect, 0);
+}
+
+size_t PaintStrokeEngineErasePalm(PaintStrokeEngine *engine, PaintStrokeBounds rect) {
+    
+    return PaintStrokeEngineDropLinesInRect(engine, rect, 1);
+}
+
+#pragma mark - Inspection
+
+size_t PaintStrokeEngineLineCount(const PaintStrokeEngine *engine) {
+    
+    return engine->lineCount;
+}
+
+const PaintStrokeLine *PaintStrokeEngineLineAtIndex(const PaintStrokeEngine *engine, size_t index) {
+    
+    return index < engine->lineCount ? engine->lines[index] : NULL;
+}
+
+const PaintStrokeLine *PaintStrokeEngineLineInSlot(const PaintStrokeEngine *engine, uint32_t slot) {
+    
+    return slot < engine->slotCount ? engine->slotLines[slot] : NULL;
+}
+
+double PaintStrokeEngineLineSpeed(const PaintStrokeEngine *engine) {
+    
+    return engine->lineSpeed;
+}
+
+PaintStrokeStatistics PaintStrokeEngineGetStatistics(const PaintStrokeEngine *engine) {
+    
+    return engine->statistics;
+}
@@ -0,0 +1,218 @@
+//
+//  PaintStrokeEngine.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  The line assembly of the drawing pipeline without any UI: it opens lines for new touch
+//  increments, extends them through the spline stream, applies pen modes and decides when a
+//  line goes into the bitmap or gets thrown away. DetailViewController feeds it from the
+//  recognizer and turns the callbacks into layers; Tools/paintreplay.c feeds it from a touch
+//  recording, so the same logic runs headless and at full speed on any machine.
+//
+
+#ifndef PaintStrokeEngine_h
+#define PaintStrokeEngine_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintSplineKernel.h"
+#include "PaintLineTable.h"
+#include "PaintPredictor.h"
+#include "PaintStrokeIndex.h"
+#include "PaintStrokeOutline.h"
+#include "PaintTouchColumns.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Appearance of a line. The mode is the same as in PaintViewLine:
+ *  -1 palm, 0 open, 1 … 3 pen modes (10 … 30 once confirmed), 9 finger.
+ */
+typedef struct PaintLineStyle {
+    int    mode;
+    int    color;
+    double width;
+    double alpha;
+    double bright;
+} PaintLineStyle;
+
+/**
+ *  The line style PaintViewLine starts with.
+ */
+PaintLineStyle PaintLineStyleDefault(void);
+
+/**
+ *  One touch of an increment with the fields of SID_Touch the engine looks at.
+ */
+typedef struct PaintStrokeTouch {
+    PaintSplineControl control;
+    int                classification;
+    int                state;
+} PaintStrokeTouch;
+
+/**
+ *  Which path the increment came through. The touch analyzer reports finger lines with their
+ *  touch state; the recognizer only reports pen lines.
+ */
+typedef enum PaintStrokeSource {
+    PaintStrokeFromRecognizer = 0,
+    PaintStrokeFromAnalyzer   = 1,
+} PaintStrokeSource;
+
+typedef struct PaintStrokeLine {
+    uint32_t           lineID;
+    uint32_t           slot;            // Small index, unique among the live lines and reused after them
+    PaintLineStyle     style;
+    int                buttCap;         // Square line start, for yellow pen lines
+    PaintSplineStream  stream;
+    PaintPredictor     predictor;       // Where the pen goes next, for the tail
+    PaintTouchColumns  touches;         // Constituents of the line
+    double             firstTimestamp;  // Of the first touch, when the line was opened
+    PaintPoint        *points;          // Stable spline points
+    size_t             pointCount;
+    size_t             pointCapacity;
+    PaintPoint        *tail;            // Speculative continuation, replaced with every increment
+    size_t             tailCount;
+    PaintFloat        *widths;          // Width factor by point and by tail point, NULL for a
+    PaintFloat        *tailWidths;      // constant width
+    size_t             widthCapacity;
+    double             speed;           // Of the pen, filtered, for the width
+    PaintStrokeBounds  bounds;          // Of all points and tails so far, without the line width
+    uint64_t           order;           // Counts the lines in the order they were opened
+    int                modeList;        // The list of pen lines with the same mode, -1 for others
+    struct PaintStrokeLine *modePrevious;
+    struct PaintStrokeLine *modeNext;
+} PaintStrokeLine;
+
+/**
+ *  What the engine tells its owner. All callbacks are optional. The line is only valid during
+ *  the call.
+ *
+ *  lineExtended passes the index of the first new stable point; the tail has been replaced.
+ *  lineCommitted means the line (points and tail) goes into the bitmap, lineRemoved that it
+ *  is dropped without a trace. Both end the life of the line.
+ *
+ *  linesCommitted, if set, replaces lineCommitted where several lines go into the bitmap at
+ *  once, as when a pen mode is applied to the undecided lines, so they can be painted in one
+ *  pass. The lines are in the order they were opened.
+ */
+typedef struct PaintStrokeCallbacks {
+    void  *context;
+    void (*lineOpened)(void *context, const PaintStrokeLine *line);
+    void (*lineStyled)(void *context, const PaintStrokeLine *line);
+    void (*lineExtended)(void *context, const PaintStrokeLine *line, size_t firstPoint);
+    void (*lineCommitted)(void *context, const PaintStrokeLine *line);
+    void (*lineRemoved)(void *context, const PaintStrokeLine *line);
+    void (*linesCommitted)(void *context, const PaintStrokeLine *const *lines, size_t count);
+} PaintStrokeCallbacks;
+
+/**
+ *  A pen mode or line ended message for one line.
+ */
+typedef struct PaintStrokeModeChange {
+    uint32_t lineID;
+    int      mode;
+} PaintStrokeModeChange;
+
+typedef struct PaintStrokeStatistics {
+    size_t increments;
+    size_t touches;
+    size_t points;                      // stable spline points
+    size_t tailPoints;
+    size_t linesOpened;
+    size_t linesCommitted;
+    size_t linesRemoved;
+    size_t modeChecks;                  // Lines looked at to apply a pen mode to the undecided ones
+} PaintStrokeStatistics;
+
+typedef struct PaintStrokeEngine PaintStrokeEngine;
+
+PaintStrokeEngine *PaintStrokeEngineCreate(size_t maxSplinePoints, const PaintStrokeCallbacks *callbacks);
+void PaintStrokeEngineDestroy(PaintStrokeEngine *engine);
+
+/**
+ *  Maximum deviation of the spline polygon in points for lines opened from now on, see
+ *  PaintSplineStreamSetTolerance(). 0, the default, derives the vertex count from the speed.
+ */
+void PaintStrokeEngineSetTolerance(PaintStrokeEngine *engine, double tolerance);
+
+/**
+ *  Motion predictor for the tail of lines opened from now on. With PaintPredictorOff, the
+ *  default, a line only gets a tail when the recognizer reports an extrapolated point. With a
+ *  predictor every increment gets one, towards where the pen is predicted config.lookahead
+ *  after the newest touch. Committed lines end with the extrapolated tail instead, at their
+ *  last touch.
+ */
+void PaintStrokeEngineSetPredictor(PaintStrokeEngine *engine, PaintPredictorConfig config);
+
+/**
+ *  Width by speed for lines opened from now on, see PaintStrokeOutline.h. Their points get a
+ *  factor of the line width each, in widths and tailWidths. NULL, the default, keeps the width
+ *  constant and the lines without widths.
+ */
+void PaintStrokeEngineSetWidthRange(PaintStrokeEngine *engine, const PaintStrokeWidthRange *range);
+
+/**
+ *  Width, alpha and brightness chosen in the controls. The mode and color are ignored.
+ */
+void PaintStrokeEngineSetPresets(PaintStrokeEngine *engine, PaintLineStyle presets);
+
+/**
+ *  A new increment of touches for a line, as reported by the analyzer or the recognizer.
+ */
+void PaintStrokeEngineIncrement(PaintStrokeEngine *engine, uint32_t lineID,
+                                const PaintStrokeTouch *touches, size_t count, PaintStrokeSource source);
+
+/**
+ *  The contents of one SID_PenModeNotification and one SID_LineEndedNotification.
+ */
+void PaintStrokeEngineApplyPenModes(PaintStrokeEngine *engine, const PaintStrokeModeChange *changes, size_t count);
+void PaintStrokeEngineEndLines(PaintStrokeEngine *engine, const PaintStrokeModeChange *changes, size_t count);
+
+/**
+ *  Drop all lines which are still being drawn.
+ */
+void PaintStrokeEngineErase(PaintStrokeEngine *engine);
+
+/**
+ *  The live lines which intersect rect, with their line width. Up to max of them are written
+ *  to out, the return value counts all of them. The lines are only valid until the next call
+ *  which changes the engine.
+ */
+size_t PaintStrokeEngineLinesInRect(PaintStrokeEngine *engine, PaintStrokeBounds rect,
+                                    const PaintStrokeLine **out, size_t max);
+
+/**
+ *  Drop the live lines which intersect rect, like palm lines. Returns how many there were.
+ */
+size_t PaintStrokeEngineEraseRect(PaintStrokeEngine *engine, PaintStrokeBounds rect);
+
+/**
+ *  Drop the live lines under the palm in rect, but not the ones already known to be pen lines,
+ *  which may reach into it while the hand rests next to the tip. Returns how many were dropped.
+ */
+size_t PaintStrokeEngineErasePalm(PaintStrokeEngine *engine, PaintStrokeBounds rect);
+
+/**
+ *  The lines still being drawn, in the order they were opened.
+ */
+size_t PaintStrokeEngineLineCount(const PaintStrokeEngine *engine);
+const PaintStrokeLine *PaintStrokeEngineLineAtIndex(const PaintStrokeEngine *engine, size_t index);
+
+/**
+ *  The live line in slot, or NULL if the slot is free. Lets the owner keep work for a line
+ *  after a callback and find the line again later.
+ */
+const PaintStrokeLine *PaintStrokeEngineLineInSlot(const PaintStrokeEngine *engine, uint32_t slot);
+
+double PaintStrokeEngineLineSpeed(const PaintStrokeEngine *engine);
+PaintStrokeStatistics PaintStrokeEngineGetStatistics(const PaintStrokeEngine *engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokeEngine_h */
@@ -0,0 +1,453 @@
+//
+//  PaintStrokeFile.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "PaintStrokeFile.h"
+
+#define PAINT_STROKE_FILE_MAGIC   "PSTK"
+#define PAINT_STROKE_INDEX_MAGIC  "PSTI"
+#define PAINT_STROKE_FILE_VERSION 2
+
+// Flags of a stroke:
+#define STROKE_TIMED 0x1
+#define STROKE_WIDTHS 0x2
+
+// Steps per unit of the width factors of a stroke:
+#define WIDTH_STEPS  64
+
+// A varint takes up to 10 bytes; style and count up to this much, an index entry up to this:
+#define VARINT_BYTES 10
+#define STROKE_PREFIX_BYTES (6 * VARINT_BYTES + 3)
+#define INDEX_ENTRY_BYTES   (6 * VARINT_BYTES)
+
+#pragma mark - Varints
+
+static inline uint64_t PaintZigZag(int64_t value) {
+    
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t PaintUnZigZag(uint64_t value) {
+    
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+static inline size_t PaintVarintPut(uint8_t *out, uint64_t value) {
+    
+    size_t n = 0;
+    while (value >= 0x80) {
+        out[n++] = (uint8_t)(value | 0x80);
+        value  >>= 7;
+    }
+    out[n++] = (uint8_t)value;
+    return n;
+}
+
+// Read a varint from *in, not beyond end. Returns 0 if it runs over the end or is too long:
+
+static inline int PaintVarintGet(const uint8_t **in, const uint8_t *end, uint64_t *value) {
+    
+    const uint8_t *p = *in;
+    uint64_t result  = 0;
+    for (unsigned shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *in    = p;
+            *value = result;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#pragma mark - Encoding
+
+// Layout of a stroke: count, flags, mode, color, width in grid steps, alpha and brightness in
+// 1/255, the first point, then the differences to the point before. Strokes with widths follow
+// with the change of the width factor from point to point, in 1/64. Timed strokes follow with
+// the first timestamp and the change of the interval from one touch to the next, in µs.
+
+size_t PaintStrokeEncodedMaxBytes(size_t count, int timed) {
+    
+    return STROKE_PREFIX_BYTES + count * (timed ? 4 : 3) * VARINT_BYTES;
+}
+
+static uint8_t PaintStrokeUnit(double value) {
+    
+    return (uint8_t)lround(fmin(fmax(value, 0.0), 1.0) * 255.0);
+}
+
+size_t PaintStrokeEncode(const PaintStrokeData *stroke, uint32_t grid, uint8_t *out) {
+    
+    uint8_t *p = out;
+    p += PaintVarintPut(p, stroke->count);
+    *p++ = (stroke->timestamps ? STROKE_TIMED : 0) | (stroke->widths ? STROKE_WIDTHS : 0);
+    p += PaintVarintPut(p, PaintZigZag(stroke->style.mode));
+    p += PaintVarintPut(p, PaintZigZag(stroke->style.color));
+    p += PaintVarintPut(p, (uint64_t)llround(fmax(stroke->style.width, 0.0) * grid));
+    *p++ = PaintStrokeUnit(stroke->style.alpha);
+    *p++ = PaintStrokeUnit(stroke->style.bright);
+    
+    int64_t x = 0, y = 0;
+    for (size_t n = 0; n < stroke->count; n++) {
+        int64_t gx = llround((double)stroke->points[n].x * grid);
+        int64_t gy = llround((double)stroke->points[n].y * grid);
+        p += PaintVarintPut(p, PaintZigZag(gx - x));
+        p += PaintVarintPut(p, PaintZigZag(gy - y));
+        x  = gx;
+        y  = gy;
+    }
+    int64_t factor = 0;
+    for (size_t n = 0; stroke->widths && n < stroke->count; n++) {
+        int64_t next = llround((double)stroke->widths[n] * WIDTH_STEPS);
+        p     += PaintVarintPut(p, PaintZigZag(next - factor));
+        factor = next;
+    }
+    if (stroke->timestamps && stroke->count > 0) {
+        int64_t time = llround(stroke->timestamps[0] * 1e6), interval = 0;
+        p += PaintVarintPut(p, PaintZigZag(time));
+        for (size_t n = 1; n < stroke->count; n++) {
+            int64_t next = llround(stroke->timestamps[n] * 1e6);
+            p       += PaintVarintPut(p, PaintZigZag(next - time - interval));
+            interval = next - time;
+            time     = next;
+        }
+    }
+    return (size_t)(p - out);
+}
+
+long PaintStrokeDecode(const uint8_t *in, size_t length, uint32_t grid, PaintStrokeData *stroke, size_t capacity) {
+    
+    const uint8_t *p = in, *end = in + length;
+    uint64_t count, mode, color, width;
+    if (!PaintVarintGet(&p, end, &count) || count > capacity || p >= end) {
+        return -1;
+    }
+    uint8_t flags = *p++;
+    if (!PaintVarintGet(&p, end, &mode) || !PaintVarintGet(&p, end, &color) || !PaintVarintGet(&p, end, &width)
+        || end - p < 2) {
+        return -1;
+    }
+    stroke->style.mode   = (int)PaintUnZigZag(mode);
+    stroke->style.color  = (int)PaintUnZigZag(color);
+    stroke->style.width  = (double)width / grid;
+    stroke->style.alpha  = p[0] / 255.0;
+    stroke->style.bright = p[1] / 255.0;
+    p += 2;
+    
+    double step = 1.0 / grid;
+    int64_t x = 0, y = 0;
+    for (size_t n = 0; n < count; n++) {
+        uint64_t dx, dy;
+        if (!PaintVarintGet(&p, end, &dx) || !PaintVarintGet(&p, end, &dy)) {
+            return -1;
+        }
+        x += PaintUnZigZag(dx);
+        y += PaintUnZigZag(dy);
+        stroke->points[n] = (PaintStoredPoint){ (float)(x * step), (float)(y * step) };
+    }
+    
+    // The widths have to be read past even if they are not wanted, the timestamps follow:
+    int64_t factor = 0;
+    for (size_t n = 0; (flags & STROKE_WIDTHS) && n < count; n++) {
+        uint64_t change;
+        if (!PaintVarintGet(&p, end, &change)) {
+            return -1;
+        }
+        factor += PaintUnZigZag(change);
+        if (stroke->widths) stroke->widths[n] = (float)factor / WIDTH_STEPS;
+    }
+    if (!(flags & STROKE_WIDTHS)) {
+        stroke->widths = NULL;
+    }
+    if (!(flags & STROKE_TIMED)) {
+        stroke->timestamps = NULL;
+    } else if (stroke->timestamps && count > 0) {
+        uint64_t value;
+        if (!PaintVarintGet(&p, end, &value)) {
+            return -1;
+        }
+        int64_t time = PaintUnZigZag(value), interval = 0;
+        stroke->timestamps[0] = time * 1e-6;
+        for (size_t n = 1; n < count; n++) {
+            if (!PaintVarintGet(&p, end, &value)) {
+                return -1;
+            }
+            interval += PaintUnZigZag(value);
+            time     += interval;
+            stroke->timestamps[n] = time * 1e-6;
+        }
+    }
+    stroke->count = (size_t)count;
+    return (long)count;
+}
+
+#pragma mark - Writing
+
+struct PaintStrokeWriter {
+    FILE     *file;
+    uint32_t  grid;
+    uint64_t  offset;                   // Bytes written so far
+    uint8_t  *buffer;                   // The encoded stroke
+    size_t    bufferCapacity;
+    uint8_t  *index;                    // Length, point count and bounds of each stroke, as varints
+    size_t    indexLength;
+    size_t    indexCapacity;
+    uint64_t  count;
+    int       failed;
+};
+
+static void *PaintStrokeFileGrow(void *buffer, size_t *capacity, size_t needed) {
+    
+    if (needed <= *capacity) {
+        return buffer;
+    }
+    size_t grown = *capacity ? 2 * *capacity : 4096;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *grownBuffer = realloc(buffer, grown);
+    if (grownBuffer) {
+        *capacity = grown;
+    }
+    return grownBuffer;
+}
+
+PaintStrokeWriter *PaintStrokeWriterCreate(const char *path, uint32_t grid) {
+    
+    PaintStrokeWriter *writer = calloc(1, sizeof(PaintStrokeWriter));
+    if (!writer) {
+        return NULL;
+    }
+    writer->file = fopen(path, "wb");
+    writer->grid = grid ? grid : PAINT_STROKE_FILE_GRID;
+    PaintStrokeFileHeader header = { .version = PAINT_STROKE_FILE_VERSION, .grid = writer->grid };
+    memcpy(header.magic, PAINT_STROKE_FILE_MAGIC, sizeof(header.magic));
+    if (!writer->file || fwrite(&header, sizeof(header), 1, writer->file) != 1) {
+        if (writer->file) fclose(writer->file);
+        free(writer);
+        return NULL;
+    }
+    writer->offset = sizeof(header);
+    return writer;
+}
+
+int PaintStrokeWriterAppend(PaintStrokeWriter *writer, const PaintStrokeData *stroke) {
+    
+    uint8_t *buffer = PaintStrokeFileGrow(writer->buffer, &writer->bufferCapacity,
+                                          PaintStrokeEncodedMaxBytes(stroke->count, stroke->timestamps != NULL));
+    uint8_t *index  = PaintStrokeFileGrow(writer->index, &writer->indexCapacity, writer->indexLength + INDEX_ENTRY_BYTES);
+    if (buffer) writer->buffer = buffer;
+    if (index)  writer->index  = index;
+    if (!buffer || !index) {
+        writer->failed = 1;
+        return -1;
+    }
+    size_t length = PaintStrokeEncode(stroke, writer->grid, writer->buffer);
+    if (fwrite(writer->buffer, 1, length, writer->file) != length) {
+        writer->failed = 1;
+        return -1;
+    }
+    writer->indexLength += PaintVarintPut(writer->index + writer->indexLength, length);
+    writer->indexLength += PaintVarintPut(writer->index + writer->indexLength, stroke->count);
+    
+    // The bounds of the painted stroke, with its width, rounded outwards to the grid:
+    PaintStrokeBounds bounds = PaintStrokeBoundsEmpty;
+    for (size_t n = 0; n < stroke->count; n++) {
+        PaintStrokeBounds point = { stroke->points[n].x, stroke->points[n].y, stroke->points[n].x, stroke->points[n].y };
+        bounds                  = PaintStrokeBoundsUnion(bounds, point);
+    }
+    if (stroke->count > 0) {
+        bounds       = PaintStrokeBoundsInset(bounds, -(float)stroke->style.width);
+        int64_t minX = (int64_t)floor((double)bounds.minX * writer->grid);
+        int64_t minY = (int64_t)floor((double)bounds.minY * writer->grid);
+        writer->indexLength += PaintVarintPut(writer->index + writer->indexLength, PaintZigZag(minX));
+        writer->indexLength += PaintVarintPut(writer->index + writer->indexLength, PaintZigZag(minY));
+        writer->indexLength += PaintVarintPut(writer->index + writer->indexLength,
+                                              (uint64_t)((int64_t)ceil((double)bounds.maxX * writer->grid) - minX));
+        writer->indexLength += PaintVarintPut(writer->index + writer->indexLength,
+                                              (uint64_t)((int64_t)ceil((double)bounds.maxY * writer->grid) - minY));
+    }
+    writer->offset      += length;
+    writer->count++;
+    return 0;
+}
+
+uint64_t PaintStrokeWriterBytes(const PaintStrokeWriter *writer) {
+    
+    return writer->offset;
+}
+
+int PaintStrokeWriterClose(PaintStrokeWriter *writer) {
+    
+    PaintStrokeFileTrailer trailer = { .indexOffset = writer->offset, .strokeCount = writer->count };
+    memcpy(trailer.magic, PAINT_STROKE_INDEX_MAGIC, sizeof(trailer.magic));
+    int failed = writer->failed
+              || fwrite(writer->index, 1, writer->indexLength, writer->file) != writer->indexLength
+              || fwrite(&trailer, sizeof(trailer), 1, writer->file) != 1;
+    failed |= (fclose(writer->file) != 0);
+    free(writer->buffer);
+    free(writer->index);
+    free(writer);
+    return failed ? -1 : 0;
+}
+
+int PaintStrokeStoreWrite(const PaintStrokeStore *store, const char *path, uint32_t grid) {
+    
+    PaintStrokeWriter *writer = PaintStrokeWriterCreate(path, grid);
+    if (!writer) {
+        return -1;
+    }
+    for (size_t n = 0; n < store->count; n++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(store, n);
+        if (stroke->erased) continue;
+        
+        PaintStrokeData data = { .style  = PaintStrokeStoreStyle(stroke),
+                                 .points = (PaintStoredPoint *)PaintStrokeStorePoints(store, stroke),
+                                 .count  = stroke->pointCount,
+                                 .widths = (float *)PaintStrokeStoreWidths(store, stroke) };
+        PaintStrokeWriterAppend(writer, &data);
+    }
+    return PaintStrokeWriterClose(writer);
+}
+
+#pragma mark - Reading
+
+struct PaintStrokeReader {
+    const uint8_t     *map;             // The whole file, read only
+    size_t             size;
+    uint32_t           grid;
+    size_t             count;
+    uint64_t          *offsets;         // count + 1 entries, the last one is the index
+    uint32_t          *pointCounts;
+    PaintStrokeBounds *bounds;
+};
+
+void PaintStrokeReaderClose(PaintStrokeReader *reader) {
+    
+    if (!reader) {
+        return;
+    }
+    if (reader->map) munmap((void *)reader->map, reader->size);
+    free(reader->offsets);
+    free(reader->pointCounts);
+    free(reader->bounds);
+    free(reader);
+}
+
+PaintStrokeReader *PaintStrokeReaderOpen(const char *path) {
+    
+    int file = open(path, O_RDONLY);
+    if (file < 0) {
+        return NULL;
+    }
+    struct stat status;
+    PaintStrokeReader *reader = calloc(1, sizeof(PaintStrokeReader));
+    if (reader && fstat(file, &status) == 0 && status.st_size >= (off_t)(sizeof(PaintStrokeFileHeader) + sizeof(PaintStrokeFileTrailer))) {
+        void *map    = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        reader->map  = map == MAP_FAILED ? NULL : map;
+        reader->size = (size_t)status.st_size;
+    }
+    close(file);
+    if (!reader || !reader->map) {
+        PaintStrokeReaderClose(reader);
+        return NULL;
+    }
+    
+    // Header, trailer, and the index between the strokes and the trailer:
+    PaintStrokeFileHeader header;
+    PaintStrokeFileTrailer trailer;
+    memcpy(&header, reader->map, sizeof(header));
+    memcpy(&trailer, reader->map + reader->size - sizeof(trailer), sizeof(trailer));
+    if (memcmp(header.magic, PAINT_STROKE_FILE_MAGIC, sizeof(header.magic)) != 0
+        || header.version != PAINT_STROKE_FILE_VERSION || header.grid == 0
+        || memcmp(trailer.magic, PAINT_STROKE_INDEX_MAGIC, sizeof(trailer.magic)) != 0
+        || trailer.indexOffset < sizeof(header) || trailer.indexOffset > reader->size - sizeof(trailer)
+        || trailer.strokeCount > reader->size) {
+        PaintStrokeReaderClose(reader);
+        return NULL;
+    }
+    reader->grid        = header.grid;
+    reader->count       = (size_t)trailer.strokeCount;
+    reader->offsets     = malloc((reader->count + 1) * sizeof(uint64_t));
+    reader->pointCounts = malloc((reader->count + 1) * sizeof(uint32_t));
+    reader->bounds      = malloc((reader->count + 1) * sizeof(PaintStrokeBounds));
+    int damaged         = !reader->offsets || !reader->pointCounts || !reader->bounds;
+    
+    const uint8_t *p = reader->map + trailer.indexOffset, *end = reader->map + reader->size - sizeof(trailer);
+    uint64_t offset  = sizeof(header);
+    double step      = 1.0 / reader->grid;
+    for (size_t n = 0; n < reader->count && !damaged; n++) {
+        uint64_t length = 0, points = 0, minX = 0, minY = 0, width = 0, height = 0;
+        damaged = !PaintVarintGet(&p, end, &length) || !PaintVarintGet(&p, end, &points)
+               || points > UINT32_MAX || offset + length > trailer.indexOffset;
+        if (!damaged && points > 0) {
+            damaged = !PaintVarintGet(&p, end, &minX) || !PaintVarintGet(&p, end, &minY)
+                   || !PaintVarintGet(&p, end, &width) || !PaintVarintGet(&p, end, &height);
+        }
+        int64_t x = PaintUnZigZag(minX), y = PaintUnZigZag(minY);
+        reader->offsets[n]     = offset;
+        reader->pointCounts[n] = (uint32_t)points;
+        reader->bounds[n]      = points == 0 ? PaintStrokeBoundsEmpty
+                               : (PaintStrokeBounds){ (float)(x * step), (float)(y * step),
+                                                      (float)((x + (int64_t)width) * step), (float)((y + (int64_t)height) * step) };
+        offset += length;
+    }
+    if (damaged) {
+        PaintStrokeReaderClose(reader);
+        return NULL;
+    }
+    reader->offsets[reader->count] = offset;
+    return reader;
+}
+
+size_t PaintStrokeReaderCount(const PaintStrokeReader *reader) {
+    
+    return reader->count;
+}
+
+uint32_t PaintStrokeReaderGrid(const PaintStrokeReader *reader) {
+    
+    return reader->grid;
+}
+
+size_t PaintStrokeReaderPointCount(const PaintStrokeReader *reader, size_t index) {
+    
+    return index < reader->count ? reader->pointCounts[index] : 0;
+}
+
+PaintStrokeBounds PaintStrokeReaderBounds(const PaintStrokeReader *reader, size_t index) {
+    
+    return index < reader->count ? reader->bounds[index] : PaintStrokeBoundsEmpty;
+}
+
+size_t PaintStrokeReaderQuery(const PaintStrokeReader *reader, PaintStrokeBounds bounds, uint32_t *indices, size_t capacity) {
+    
+    size_t found = 0;
+    for (size_t n = 0; n < reader->count; n++) {
+        if (!PaintStrokeBoundsIntersect(reader->bounds[n], bounds)) continue;
+        if (found < capacity) indices[found] = (uint32_t)n;
+        found++;
+    }
+    return found;
+}
+
+long PaintStrokeReaderRead(const PaintStrokeReader *reader, size_t index, PaintStrokeData *stroke, size_t capacity) {
+    
+    if (index >= reader->count) {
+        return -1;
+    }
+    return PaintStrokeDecode(reader->map + reader->offsets[index], (size_t)(reader->offsets[index + 1] - reader->offsets[index]),
+                             reader->grid, stroke, capacity);
+}
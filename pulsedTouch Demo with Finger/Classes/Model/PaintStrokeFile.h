@@ -0,0 +1,155 @@
+//
+//  PaintStrokeFile.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Compact file format for strokes, for saved drawings and for the lines of touch recordings.
+//  Each stroke keeps its style, its points on a fixed sub-pixel grid and, if it has them, the
+//  timestamps of its points in microseconds and the width factors of a line whose width
+//  follows the speed. Points and width factors are stored as the difference to the one before,
+//  timestamps as the change of the sampling interval, all as zig-zag varints; smooth
+//  handwriting then needs a byte or two per coordinate and about one per timestamp or width.
+//
+//  The file is a 16 byte header, the strokes one after the other, an index with the length,
+//  point count and bounds of every stroke, and a 24 byte trailer which points to the index. The
+//  reader maps the file and loads the index only, so any stroke can be decoded on its own, and
+//  the strokes in a rect can be found before any of them is decoded. Writing and reading are
+//  single streaming passes over the points into the caller's buffers; nothing is allocated per
+//  point.
+//
+
+#ifndef PaintStrokeFile_h
+#define PaintStrokeFile_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "PaintStrokeStore.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Grid steps per point the app writes with. A point is at most 1/32 point off, a tenth of a
+// pixel on a 3x screen:
+#define PAINT_STROKE_FILE_GRID 16
+
+/**
+ *  One stroke in memory. timestamps is NULL for strokes without time, such as those of the
+ *  stroke store, widths for strokes of a constant width.
+ */
+typedef struct PaintStrokeData {
+    PaintLineStyle    style;
+    PaintStoredPoint *points;
+    double           *timestamps;
+    size_t            count;
+    float            *widths;           // Factors of style.width, in steps of 1/64
+} PaintStrokeData;
+
+typedef struct PaintStrokeFileHeader {
+    char     magic[4];                  // "PSTK"
+    uint32_t version;
+    uint32_t grid;                      // Grid steps per point
+    uint32_t reserved;
+} PaintStrokeFileHeader;
+
+typedef struct PaintStrokeFileTrailer {
+    uint64_t indexOffset;
+    uint64_t strokeCount;
+    char     magic[4];                  // "PSTI"
+    uint32_t reserved;
+} PaintStrokeFileTrailer;
+
+#pragma mark - Encoding
+
+/**
+ *  Upper bound for the encoded size of a stroke of count points.
+ */
+size_t PaintStrokeEncodedMaxBytes(size_t count, int timed);
+
+/**
+ *  Encode a stroke into out, which has room for PaintStrokeEncodedMaxBytes(). Returns the
+ *  number of bytes written.
+ */
+size_t PaintStrokeEncode(const PaintStrokeData *stroke, uint32_t grid, uint8_t *out);
+
+/**
+ *  Decode a stroke of length bytes into stroke->points and, if it has them and the buffers are
+ *  set, stroke->timestamps and stroke->widths; all have room for capacity points. A stroke
+ *  without time sets stroke->timestamps to NULL, one without widths stroke->widths. Returns
+ *  the number of points, or -1 if the data is damaged or does not fit.
+ */
+long PaintStrokeDecode(const uint8_t *in, size_t length, uint32_t grid, PaintStrokeData *stroke, size_t capacity);
+
+#pragma mark - Writing
+
+typedef struct PaintStrokeWriter PaintStrokeWriter;
+
+/**
+ *  Create the file and write the header. Returns NULL with errno set if that fails.
+ */
+PaintStrokeWriter *PaintStrokeWriterCreate(const char *path, uint32_t grid);
+
+/**
+ *  Append a stroke. Returns 0, or -1 if it cannot be written.
+ */
+int PaintStrokeWriterAppend(PaintStrokeWriter *writer, const PaintStrokeData *stroke);
+
+/**
+ *  Bytes written so far, without the index.
+ */
+uint64_t PaintStrokeWriterBytes(const PaintStrokeWriter *writer);
+
+/**
+ *  Write the index and the trailer, close the file and free the writer. Returns 0, or -1 if
+ *  anything could not be written.
+ */
+int PaintStrokeWriterClose(PaintStrokeWriter *writer);
+
+/**
+ *  Write the strokes of a store which have not been erased. Returns 0 or -1.
+ */
+int PaintStrokeStoreWrite(const PaintStrokeStore *store, const char *path, uint32_t grid);
+
+#pragma mark - Reading
+
+typedef struct PaintStrokeReader PaintStrokeReader;
+
+/**
+ *  Map a stroke file and load its index. Returns NULL if it is missing or no stroke file. The
+ *  strokes are decoded from the mapping, so several threads may read from one reader at once.
+ */
+PaintStrokeReader *PaintStrokeReaderOpen(const char *path);
+void PaintStrokeReaderClose(PaintStrokeReader *reader);
+
+size_t   PaintStrokeReaderCount(const PaintStrokeReader *reader);
+uint32_t PaintStrokeReaderGrid(const PaintStrokeReader *reader);
+
+/**
+ *  Points of stroke index, from the index, so the caller can size its buffers.
+ */
+size_t PaintStrokeReaderPointCount(const PaintStrokeReader *reader, size_t index);
+
+/**
+ *  Bounds of stroke index with its line width, from the index, a grid step larger than the
+ *  stroke at most. Empty for a stroke without points.
+ */
+PaintStrokeBounds PaintStrokeReaderBounds(const PaintStrokeReader *reader, size_t index);
+
+/**
+ *  The strokes whose bounds intersect bounds, in the order of the file. Up to capacity of them
+ *  go to indices; returns how many there are.
+ */
+size_t PaintStrokeReaderQuery(const PaintStrokeReader *reader, PaintStrokeBounds bounds, uint32_t *indices, size_t capacity);
+
+/**
+ *  Read stroke index, see PaintStrokeDecode(). Returns the number of points or -1.
+ */
+long PaintStrokeReaderRead(const PaintStrokeReader *reader, size_t index, PaintStrokeData *stroke, size_t capacity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokeFile_h */
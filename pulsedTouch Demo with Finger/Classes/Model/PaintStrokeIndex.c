@@ -0,0 +1,223 @@
+//
+//  PaintStrokeIndex.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintStrokeIndex.h"
+
+typedef struct PaintStrokeIndexRange {
+    int32_t column0, row0, column1, row1;   // Inclusive
+} PaintStrokeIndexRange;
+
+static inline int32_t PaintStrokeIndexCell(const PaintStrokeIndex *index, float coordinate) {
+    
+    float cell = floorf(coordinate / index->cellSize);
+    return cell < -1e9f ? -1000000000 : (cell > 1e9f ? 1000000000 : (int32_t)cell);
+}
+
+static inline PaintStrokeIndexRange PaintStrokeIndexRangeOf(const PaintStrokeIndex *index, PaintStrokeBounds bounds) {
+    
+    PaintStrokeIndexRange range = { PaintStrokeIndexCell(index, bounds.minX), PaintStrokeIndexCell(index, bounds.minY),
+                                    PaintStrokeIndexCell(index, bounds.maxX), PaintStrokeIndexCell(index, bounds.maxY) };
+    return range;
+}
+
+static inline int PaintStrokeIndexRangeContains(PaintStrokeIndexRange range, int32_t column, int32_t row) {
+    
+    return column >= range.column0 && column <= range.column1 && row >= range.row0 && row <= range.row1;
+}
+
+static inline PaintStrokeIndexBucket *PaintStrokeIndexBucketOf(const PaintStrokeIndex *index, int32_t column, int32_t row) {
+    
+    uint32_t hash = ((uint32_t)column * 73856093u) ^ ((uint32_t)row * 19349663u);
+    return &index->buckets[hash & index->bucketMask];
+}
+
+int PaintStrokeIndexInit(PaintStrokeIndex *index, float cellSize, size_t buckets) {
+    
+    memset(index, 0, sizeof(PaintStrokeIndex));
+    size_t size = 16;
+    while (size < buckets) {
+        size *= 2;
+    }
+    index->buckets = calloc(size, sizeof(PaintStrokeIndexBucket));
+    if (!index->buckets) {
+        return -1;
+    }
+    index->cellSize   = cellSize;
+    index->bucketMask = size - 1;
+    return 0;
+}
+
+void PaintStrokeIndexFree(PaintStrokeIndex *index) {
+    
+    if (index->buckets) {
+        for (size_t n = 0; n <= index->bucketMask; n++) {
+            free(index->buckets[n].items);
+        }
+    }
+    free(index->buckets);
+    free(index->bounds);
+    free(index->visited);
+    memset(index, 0, sizeof(PaintStrokeIndex));
+}
+
+void PaintStrokeIndexClear(PaintStrokeIndex *index) {
+    
+    for (size_t n = 0; n <= index->bucketMask; n++) {
+        index->buckets[n].count = 0;
+    }
+    for (size_t item = 0; item < index->itemCapacity; item++) {
+        index->bounds[item] = PaintStrokeBoundsEmpty;
+    }
+    index->count = 0;
+}
+
+static int PaintStrokeIndexReserve(PaintStrokeIndex *index, uint32_t item) {
+    
+    if (item < index->itemCapacity) {
+        return 0;
+    }
+    size_t capacity = index->itemCapacity ? index->itemCapacity : 64;
+    while (capacity <= item) {
+        capacity *= 2;
+    }
+    PaintStrokeBounds *bounds = realloc(index->bounds, capacity * sizeof(PaintStrokeBounds));
+    if (!bounds) {
+        return -1;
+    }
+    index->bounds     = bounds;
+    uint32_t *visited = realloc(index->visited, capacity * sizeof(uint32_t));
+    if (!visited) {
+        return -1;
+    }
+    index->visited = visited;
+    for (size_t n = index->itemCapacity; n < capacity; n++) {
+        index->bounds[n]  = PaintStrokeBoundsEmpty;
+        index->visited[n] = 0;
+    }
+    index->itemCapacity = capacity;
+    return 0;
+}
+
+static int PaintStrokeIndexPush(PaintStrokeIndexBucket *bucket, uint32_t item) {
+    
+    if (bucket->count == bucket->capacity) {
+        uint32_t capacity = bucket->capacity ? 2 * bucket->capacity : 8;
+        uint32_t *items   = realloc(bucket->items, capacity * sizeof(uint32_t));
+        if (!items) {
+            return -1;
+        }
+        bucket->items    = items;
+        bucket->capacity = capacity;
+    }
+    bucket->items[bucket->count++] = item;
+    return 0;
+}
+
+int PaintStrokeIndexInsert(PaintStrokeIndex *index, uint32_t item, PaintStrokeBounds bounds) {
+    
+    if (PaintStrokeBoundsIsEmpty(bounds)) {
+        return 0;
+    }
+    if (PaintStrokeIndexReserve(index, item) != 0) {
+        return -1;
+    }
+    PaintStrokeBounds old = index->bounds[item];
+    int isNew             = PaintStrokeBoundsIsEmpty(old);
+    PaintStrokeBounds now = isNew ? bounds : PaintStrokeBoundsUnion(old, bounds);
+    PaintStrokeIndexRange oldRange = PaintStrokeIndexRangeOf(index, old);
+    PaintStrokeIndexRange range    = PaintStrokeIndexRangeOf(index, now);
+    if (!isNew && memcmp(&oldRange, &range, sizeof(range)) == 0) {
+        index->bounds[item] = now;
+        return 0;
+    }
+    
+    // Only the cells the item did not cover before get an entry:
+    for (int32_t row = range.row0; row <= range.row1; row++) {
+        for (int32_t column = range.column0; column <= range.column1; column++) {
+            if (!isNew && PaintStrokeIndexRangeContains(oldRange, column, row)) continue;
+            
+            if (PaintStrokeIndexPush(PaintStrokeIndexBucketOf(index, column, row), item) != 0) {
+                return -1;
+            }
+        }
+    }
+    index->bounds[item] = now;
+    index->count       += isNew;
+    return 0;
+}
+
+void PaintStrokeIndexRemove(PaintStrokeIndex *index, uint32_t item) {
+    
+    if (item >= index->itemCapacity || PaintStrokeBoundsIsEmpty(index->bounds[item])) {
+        return;
+    }
+    
+    // One entry per cell, cells which share a bucket have one entry each:
+    PaintStrokeIndexRange range = PaintStrokeIndexRangeOf(index, index->bounds[item]);
+    for (int32_t row = range.row0; row <= range.row1; row++) {
+        for (int32_t column = range.column0; column <= range.column1; column++) {
+            PaintStrokeIndexBucket *bucket = PaintStrokeIndexBucketOf(index, column, row);
+            for (uint32_t n = 0; n < bucket->count; n++) {
+                if (bucket->items[n] == item) {
+                    bucket->items[n] = bucket->items[--bucket->count];
+                    break;
+                }
+            }
+        }
+    }
+    index->bounds[item] = PaintStrokeBoundsEmpty;
+    index->count--;
+}
+
+static inline size_t PaintStrokeIndexCollect(PaintStrokeIndex *index, const PaintStrokeIndexBucket *bucket,
+                                             PaintStrokeBounds rect, uint32_t *out, size_t max, size_t found) {
+    
+    index->entriesTested += bucket->count;
+    for (uint32_t n = 0; n < bucket->count; n++) {
+        uint32_t item = bucket->items[n];
+        if (index->visited[item] == index->stamp) continue;
+        
+        index->visited[item] = index->stamp;
+        if (PaintStrokeBoundsIntersect(index->bounds[item], rect)) {
+            if (found < max) out[found] = item;
+            found++;
+        }
+    }
+    return found;
+}
+
+size_t PaintStrokeIndexQuery(PaintStrokeIndex *index, PaintStrokeBounds rect, uint32_t *out, size_t max) {
+    
+    if (index->count == 0 || PaintStrokeBoundsIsEmpty(rect)) {
+        return 0;
+    }
+    index->queries++;
+    if (++index->stamp == 0) {
+        memset(index->visited, 0, index->itemCapacity * sizeof(uint32_t));
+        index->stamp = 1;
+    }
+    
+    // A rect with more cells than there are buckets looks at every bucket once instead:
+    size_t found                = 0;
+    PaintStrokeIndexRange range = PaintStrokeIndexRangeOf(index, rect);
+    double cells                = ((double)range.column1 - range.column0 + 1) * ((double)range.row1 - range.row0 + 1);
+    if (cells > index->bucketMask + 1) {
+        for (size_t n = 0; n <= index->bucketMask; n++) {
+            found = PaintStrokeIndexCollect(index, &index->buckets[n], rect, out, max, found);
+        }
+        return found;
+    }
+    for (int32_t row = range.row0; row <= range.row1; row++) {
+        for (int32_t column = range.column0; column <= range.column1; column++) {
+            found = PaintStrokeIndexCollect(index, PaintStrokeIndexBucketOf(index, column, row), rect, out, max, found);
+        }
+    }
+    return found;
+}
@@ -0,0 +1,106 @@
+//
+//  PaintStrokeIndex.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Which strokes intersect a rect? A uniform grid over the bounds of the strokes answers that
+//  by looking at the cells under the rect only, no matter how many strokes there are. The grid
+//  is hashed into a fixed number of buckets, so it needs no canvas size and costs the same in
+//  any orientation. PaintStrokeEngine keeps one for the live lines, PaintView one for the
+//  committed strokes.
+//
+
+#ifndef PaintStrokeIndex_h
+#define PaintStrokeIndex_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PaintStrokeBounds {
+    float minX, minY, maxX, maxY;
+} PaintStrokeBounds;
+
+#define PaintStrokeBoundsEmpty ((PaintStrokeBounds){ 1e30f, 1e30f, -1e30f, -1e30f })
+
+static inline int PaintStrokeBoundsIsEmpty(PaintStrokeBounds bounds) {
+    return bounds.minX > bounds.maxX || bounds.minY > bounds.maxY;
+}
+
+static inline int PaintStrokeBoundsIntersect(PaintStrokeBounds a, PaintStrokeBounds b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+static inline PaintStrokeBounds PaintStrokeBoundsUnion(PaintStrokeBounds a, PaintStrokeBounds b) {
+    PaintStrokeBounds bounds = { a.minX < b.minX ? a.minX : b.minX, a.minY < b.minY ? a.minY : b.minY,
+                                 a.maxX > b.maxX ? a.maxX : b.maxX, a.maxY > b.maxY ? a.maxY : b.maxY };
+    return bounds;
+}
+
+static inline PaintStrokeBounds PaintStrokeBoundsInset(PaintStrokeBounds bounds, float inset) {
+    PaintStrokeBounds inner = { bounds.minX + inset, bounds.minY + inset, bounds.maxX - inset, bounds.maxY - inset };
+    return inner;
+}
+
+typedef struct PaintStrokeIndexBucket {
+    uint32_t *items;
+    uint32_t  count;
+    uint32_t  capacity;
+} PaintStrokeIndexBucket;
+
+/**
+ *  Items are small numbers the owner chooses, like the index of a stroke in the store or the
+ *  slot of a live line. Each item sits in the bucket of every cell its bounds touch.
+ */
+typedef struct PaintStrokeIndex {
+    float                   cellSize;
+    size_t                  bucketMask;     // bucket count - 1, a power of two
+    PaintStrokeIndexBucket *buckets;
+    PaintStrokeBounds      *bounds;         // By item, empty if the item is not in the index
+    uint32_t               *visited;        // Query stamp by item, so each item is reported once
+    size_t                  itemCapacity;
+    uint32_t                stamp;
+    size_t                  count;
+    uint64_t                queries;
+    uint64_t                entriesTested;  // Bucket entries looked at by all queries
+} PaintStrokeIndex;
+
+/**
+ *  Returns 0 on success and -1 if the buckets cannot be allocated. buckets is rounded up to a
+ *  power of two; about as many as cells on the screen keeps the buckets short.
+ */
+int  PaintStrokeIndexInit(PaintStrokeIndex *index, float cellSize, size_t buckets);
+void PaintStrokeIndexFree(PaintStrokeIndex *index);
+
+/**
+ *  Remove all items, but keep the memory.
+ */
+void PaintStrokeIndexClear(PaintStrokeIndex *index);
+
+/**
+ *  Add an item, or grow its bounds to include bounds if it is in the index already. Growing
+ *  only touches the cells which are new, so a line can be updated with every increment.
+ *  Returns 0, or -1 if the index cannot grow.
+ */
+int  PaintStrokeIndexInsert(PaintStrokeIndex *index, uint32_t item, PaintStrokeBounds bounds);
+void PaintStrokeIndexRemove(PaintStrokeIndex *index, uint32_t item);
+
+static inline PaintStrokeBounds PaintStrokeIndexBounds(const PaintStrokeIndex *index, uint32_t item) {
+    return item < index->itemCapacity ? index->bounds[item] : PaintStrokeBoundsEmpty;
+}
+
+/**
+ *  The items whose bounds intersect rect, in no particular order. Up to max of them are
+ *  written to out; the return value is the number of all of them.
+ */
+size_t PaintStrokeIndexQuery(PaintStrokeIndex *index, PaintStrokeBounds rect, uint32_t *out, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokeIndex_h */
@@ -0,0 +1,355 @@
+//
+//  PaintStrokeOutline.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintStrokeOutline.h"
+
+// Handwriting speeds: below about 60 points/s the pen rests or draws a careful detail, above
+// about 900 points/s it is a quick flourish:
+#define SLOW_SPEED   60.0
+#define FAST_SPEED  900.0
+
+// Points closer than this to the one before carry no direction:
+#define MIN_STEP     1e-3
+
+// Most steps of an arc of half a turn, however wide the line is. A join or a cap adds at most
+// one arc to a side, plus the points it connects:
+#define ARC_STEPS    16
+#define JOIN_POINTS  (ARC_STEPS + 1)
+#define CAP_POINTS   (2 * ARC_STEPS + 2)
+
+// The columns of the scratch buffer: x, y and radius of the points, then direction and the
+// offsets of both sides by segment:
+#define COLUMNS      9
+
+PaintStrokeWidthRange PaintStrokeWidthRangeDefault(double minFactor, double maxFactor) {
+    
+    PaintStrokeWidthRange range = { .minFactor = minFactor,
+                                    .maxFactor = maxFactor,
+                                    .slowSpeed = SLOW_SPEED,
+                                    .fastSpeed = FAST_SPEED };
+    return range;
+}
+
+double PaintStrokeWidthForSpeed(const PaintStrokeWidthRange *range, double speed) {
+    
+    if (speed <= range->slowSpeed || range->fastSpeed <= range->slowSpeed) {
+        return range->maxFactor;
+    }
+    if (speed >= range->fastSpeed) {
+        return range->minFactor;
+    }
+    double t = (speed - range->slowSpeed) / (range->fastSpeed - range->slowSpeed);
+    return range->maxFactor + t * (range->minFactor - range->maxFactor);
+}
+
+#pragma mark - Life Cycle
+
+void PaintStrokeOutlineInit(PaintStrokeOutline *outline, double tolerance) {
+    
+    memset(outline, 0, sizeof(PaintStrokeOutline));
+    outline->tolerance = (PaintFloat)tolerance;
+}
+
+void PaintStrokeOutlineFree(PaintStrokeOutline *outline) {
+    
+    free(outline->left);
+    free(outline->right);
+    free(outline->ring);
+    free(outline->scratch);
+    PaintStrokeOutlineInit(outline, outline->tolerance);
+}
+
+void PaintStrokeOutlineReset(PaintStrokeOutline *outline) {
+    
+    memset(&outline->state, 0, sizeof(PaintStrokeOutlineState));
+}
+
+static int PaintStrokeOutlineGrow(void **buffer, size_t *capacity, size_t needed, size_t size) {
+    
+    if (needed <= *capacity) {
+        return 0;
+    }
+    size_t grown = *capacity ? 2 * *capacity : 256;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *resized = realloc(*buffer, grown * size);
+    if (!resized) {
+        return -1;
+    }
+    *buffer   = resized;
+    *capacity = grown;
+    return 0;
+}
+
+// Room for count more points on both sides and for their columns:
+
+static int PaintStrokeOutlineReserve(PaintStrokeOutline *outline, size_t count) {
+    
+    PaintStrokeOutlineState *state = &outline->state;
+    size_t sides    = (state->leftCount > state->rightCount ? state->leftCount : state->rightCount) + count * JOIN_POINTS;
+    size_t capacity = outline->sideCapacity;
+    if (sides > capacity) {
+        if (PaintStrokeOutlineGrow((void **)&outline->left, &capacity, sides, sizeof(PaintPoint)) != 0) {
+            return -1;
+        }
+        capacity = outline->sideCapacity;
+        if (PaintStrokeOutlineGrow((void **)&outline->right, &capacity, sides, sizeof(PaintPoint)) != 0) {
+            return -1;
+        }
+        outline->sideCapacity = capacity;
+    }
+    size_t columns = outline->scratchCapacity / COLUMNS;
+    if (count + 1 > columns) {
+        size_t scratch = outline->scratchCapacity;
+        if (PaintStrokeOutlineGrow((void **)&outline->scratch, &scratch, COLUMNS * (count + 1), sizeof(PaintFloat)) != 0) {
+            return -1;
+        }
+        outline->scratchCapacity = scratch;
+    }
+    return 0;
+}
+
+#pragma mark - Joins and Caps
+
+static inline PaintPoint PaintStrokeOutlineOffset(PaintPoint center, PaintFloat radius, PaintPoint direction) {
+    
+    PaintPoint p = { center.x + radius * direction.x, center.y + radius * direction.y };
+    return p;
+}
+
+// The largest angle between two points of an arc of radius which keeps the chord within the
+// tolerance, but no less than half a turn in ARC_STEPS:
+
+static PaintFloat PaintStrokeOutlineStep(PaintFloat tolerance, PaintFloat radius) {
+    
+    if (radius <= tolerance) {
+        return (PaintFloat)M_PI;
+    }
+    PaintFloat step = 2.0 * acos(1.0 - tolerance / radius);
+    return step > M_PI / ARC_STEPS ? step : (PaintFloat)(M_PI / ARC_STEPS);
+}
+
+// The points of the arc around center strictly between the unit directions from and to, the
+// short way round. Returns how many there are:
+
+static size_t PaintStrokeOutlineArc(PaintPoint *out, PaintPoint center, PaintFloat radius,
+                                    PaintPoint from, PaintPoint to, PaintFloat step) {
+    
+    PaintFloat angle = atan2(from.x * to.y - from.y * to.x, from.x * to.x + from.y * to.y);
+    size_t steps     = (size_t)ceil(fabs(angle) / step);
+    if (steps < 2) {
+        return 0;
+    }
+    steps = steps < ARC_STEPS ? steps : ARC_STEPS;
+    PaintFloat c = cos(angle / steps), s = sin(angle / steps);
+    PaintPoint u = from;
+    for (size_t n = 1; n < steps; n++) {
+        PaintPoint rotated = { u.x * c - u.y * s, u.x * s + u.y * c };
+        u          = rotated;
+        out[n - 1] = PaintStrokeOutlineOffset(center, radius, u);
+    }
+    return steps - 1;
+}
+
+// One side of the join at a vertex, from the end of the segment before to the start of the
+// next one. The inner side goes through the vertex, which keeps the filled outline right
+// however sharp the turn. The outer side gets an arc, unless connecting the two offsets
+// directly stays within the tolerance anyway:
+
+static size_t PaintStrokeOutlineJoin(PaintPoint *out, PaintPoint center, PaintFloat radius,
+                                     PaintPoint from, PaintPoint to, int inner, PaintFloat tolerance) {
+    
+    size_t count  = 0;
+    out[count++]  = PaintStrokeOutlineOffset(center, radius, from);
+    if (inner) {
+        out[count++] = center;
+    } else if (radius > tolerance) {
+        
+        // The chord misses the arc by radius (1 - cos(angle / 2)):
+        PaintFloat half2 = 0.5 * (1.0 + from.x * to.x + from.y * to.y);
+        PaintFloat limit = 1.0 - tolerance / radius;
+        if (half2 < limit * limit) {
+            count += PaintStrokeOutlineArc(out + count, center, radius, from, to, PaintStrokeOutlineStep(tolerance, radius));
+        }
+    }
+    out[count++] = PaintStrokeOutlineOffset(center, radius, to);
+    return count;
+}
+
+// A round cap around center from the side offset from over the direction via to the side
+// offset to, without the offsets themselves. Both halves are less than half a turn:
+
+static size_t PaintStrokeOutlineCap(PaintPoint *out, PaintPoint center, PaintFloat radius,
+                                    PaintPoint from, PaintPoint via, PaintPoint to, PaintFloat tolerance) {
+    
+    PaintFloat step = PaintStrokeOutlineStep(tolerance, radius);
+    size_t count    = PaintStrokeOutlineArc(out, center, radius, from, via, step);
+    out[count++]    = PaintStrokeOutlineOffset(center, radius, via);
+    return count + PaintStrokeOutlineArc(out + count, center, radius, via, to, step);
+}
+
+#pragma mark - Outline
+
+int PaintStrokeOutlineAppend(PaintStrokeOutline *outline, const PaintPoint *points, const PaintFloat *radii, size_t count) {
+    
+    if (count == 0) {
+        return 0;
+    }
+    if (PaintStrokeOutlineReserve(outline, count) != 0) {
+        return -1;
+    }
+    PaintStrokeOutlineState *state = &outline->state;
+    size_t columns = outline->scratchCapacity / COLUMNS;
+    PaintFloat *x  = outline->scratch, *y = x + columns, *r = y + columns;
+    PaintFloat *dx = r + columns, *dy = dx + columns;
+    PaintFloat *lx = dy + columns, *ly = lx + columns, *rx = ly + columns, *ry = rx + columns;
+    
+    // The new points after the last one, without those which do not move:
+    size_t kept = 0;
+    if (state->pointCount > 0) {
+        x[0] = state->last.x;
+        y[0] = state->last.y;
+        r[0] = state->lastRadius;
+        kept = 1;
+    }
+    for (size_t n = 0; n < count; n++) {
+        if (kept > 0) {
+            PaintFloat ex = points[n].x - x[kept - 1], ey = points[n].y - y[kept - 1];
+            if (ex * ex + ey * ey < MIN_STEP * MIN_STEP) continue;
+        }
+        x[kept] = points[n].x;
+        y[kept] = points[n].y;
+        r[kept] = radii[n];
+        kept++;
+    }
+    if (state->pointCount == 0) {
+        state->first       = state->last       = points[0];
+        state->firstRadius = state->lastRadius = radii[0];
+        state->pointCount  = 1;
+    }
+    size_t segments = kept - 1;
+    
+    // The sides of all segments in one pass without branches. The tangent common to the circles
+    // at both ends leans towards the smaller one: its offset u from the axis has
+    // u · direction = (r0 - r1) / length. Circles almost inside each other keep some slope:
+    for (size_t s = 0; s < segments; s++) {
+        PaintFloat ex      = x[s + 1] - x[s], ey = y[s + 1] - y[s];
+        PaintFloat inverse = 1.0 / sqrt(ex * ex + ey * ey);
+        PaintFloat ux      = ex * inverse, uy = ey * inverse;
+        PaintFloat sine    = (r[s] - r[s + 1]) * inverse;
+        sine               = sine > 0.99 ? 0.99 : (sine < -0.99 ? -0.99 : sine);
+        PaintFloat cosine  = sqrt(1.0 - sine * sine);
+        dx[s] = ux;
+        dy[s] = uy;
+        lx[s] = -uy * cosine + ux * sine;
+        ly[s] =  ux * cosine + uy * sine;
+        rx[s] =  uy * cosine + ux * sine;
+        ry[s] = -ux * cosine + uy * sine;
+    }
+    
+    // Then the joins, one vertex after the other. The end of the last segment waits for the
+    // next one or for the cap:
+    PaintFloat tolerance = outline->tolerance;
+    for (size_t s = 0; s < segments; s++) {
+        PaintPoint vertex    = { x[s], y[s] };
+        PaintPoint direction = { dx[s], dy[s] };
+        PaintPoint left      = { lx[s], ly[s] }, right = { rx[s], ry[s] };
+        if (state->pointCount == 1) {
+            state->firstDirection = direction;
+            state->firstLeft      = left;
+            state->firstRight     = right;
+            outline->left[state->leftCount++]   = PaintStrokeOutlineOffset(vertex, r[s], left);
+            outline->right[state->rightCount++] = PaintStrokeOutlineOffset(vertex, r[s], right);
+        } else {
+            PaintFloat turn    = state->lastDirection.x * direction.y - state->lastDirection.y * direction.x;
+            state->leftCount  += PaintStrokeOutlineJoin(outline->left + state->leftCount, vertex, r[s],
+                                                        state->lastLeft, left, turn > 0.0, tolerance);
+            state->rightCount += PaintStrokeOutlineJoin(outline->right + state->rightCount, vertex, r[s],
+                                                        state->lastRight, right, turn < 0.0, tolerance);
+        }
+        state->last.x        = x[s + 1];
+        state->last.y        = y[s + 1];
+        state->lastRadius    = r[s + 1];
+        state->lastDirection = direction;
+        state->lastLeft      = left;
+        state->lastRight     = right;
+        state->pointCount++;
+    }
+    return 0;
+}
+
+const PaintPoint *PaintStrokeOutlineClose(PaintStrokeOutline *outline, const PaintPoint *tail, const PaintFloat *tailRadii,
+                                          size_t tailCount, int buttCap, size_t *count) {
+    
+    *count = 0;
+    if (outline->state.pointCount == 0) {
+        return NULL;
+    }
+    
+    // The tail goes on the sides like stable points, and is taken off again afterwards:
+    PaintStrokeOutlineState stable = outline->state;
+    if (PaintStrokeOutlineAppend(outline, tail, tailRadii, tailCount) != 0) {
+        return NULL;
+    }
+    PaintStrokeOutlineState *state = &outline->state;
+    size_t needed = state->leftCount + state->rightCount + 2 * CAP_POINTS + 2;
+    if (PaintStrokeOutlineGrow((void **)&outline->ring, &outline->ringCapacity, needed, sizeof(PaintPoint)) != 0) {
+        outline->state = stable;
+        return NULL;
+    }
+    
+    // A single point is a dot:
+    PaintPoint *ring     = outline->ring;
+    PaintFloat tolerance = outline->tolerance;
+    size_t n             = 0;
+    if (state->pointCount == 1) {
+        if (!buttCap) {
+            PaintPoint east = { 1.0, 0.0 }, south = { 0.0, 1.0 }, west = { -1.0, 0.0 }, north = { 0.0, -1.0 };
+            ring[n++] = PaintStrokeOutlineOffset(state->last, state->lastRadius, east);
+            n        += PaintStrokeOutlineCap(ring + n, state->last, state->lastRadius, east, south, west, tolerance);
+            ring[n++] = PaintStrokeOutlineOffset(state->last, state->lastRadius, west);
+            n        += PaintStrokeOutlineCap(ring + n, state->last, state->lastRadius, west, north, east, tolerance);
+        }
+    } else {
+        
+        // Along the left side, around the end, back along the right side and around the start:
+        memcpy(ring, outline->left, state->leftCount * sizeof(PaintPoint));
+        n         = state->leftCount;
+        ring[n++] = PaintStrokeOutlineOffset(state->last, state->lastRadius, state->lastLeft);
+        if (!buttCap) {
+            n += PaintStrokeOutlineCap(ring + n, state->last, state->lastRadius,
+                                       state->lastLeft, state->lastDirection, state->lastRight, tolerance);
+        }
+        ring[n++] = PaintStrokeOutlineOffset(state->last, state->lastRadius, state->lastRight);
+        for (size_t k = state->rightCount; k > 0; k--) {
+            ring[n++] = outline->right[k - 1];
+        }
+        if (!buttCap) {
+            PaintPoint back = { -state->firstDirection.x, -state->firstDirection.y };
+            n += PaintStrokeOutlineCap(ring + n, state->first, state->firstRadius,
+                                       state->firstRight, back, state->firstLeft, tolerance);
+        }
+    }
+    outline->state = stable;
+    *count         = n;
+    return n > 0 ? ring : NULL;
+}
+
+const PaintPoint *PaintStrokeOutlineOfPoints(PaintStrokeOutline *outline, const PaintPoint *points, const PaintFloat *radii,
+                                             size_t count, int buttCap, size_t *ringCount) {
+    
+    PaintStrokeOutlineReset(outline);
+    if (PaintStrokeOutlineAppend(outline, points, radii, count) != 0) {
+        *ringCount = 0;
+        return NULL;
+    }
+    return PaintStrokeOutlineClose(outline, NULL, NULL, 0, buttCap, ringCount);
+}
@@ -0,0 +1,114 @@
+//
+//  PaintStrokeOutline.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Outline of a line whose width changes along it: the line gets wider where the pen moves
+//  slowly and thinner where it moves fast, between the minimum and maximum width of
+//  PaintViewData. The outline is a closed polygon around the spline points, to be filled with
+//  the nonzero rule, with round joins and round or butt caps.
+//
+//  Each point has its own radius. The sides of a segment are the tangents common to the
+//  circles at its ends, one pass over all new segments computes them without any branch;
+//  the joins and caps are arcs of the circles, with just enough steps to stay within the
+//  tolerance. The sides are kept as the points arrive, so a new increment only outlines its
+//  own points; the tail and the caps are added to a copy each time the outline is closed.
+//
+
+#ifndef PaintStrokeOutline_h
+#define PaintStrokeOutline_h
+
+#include <stddef.h>
+#include "PaintSplineKernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  How the width follows the speed of the pen. The width is a factor of the line width of the
+ *  style: maxFactor at slowSpeed and below, minFactor at fastSpeed and above, linear between.
+ */
+typedef struct PaintStrokeWidthRange {
+    double minFactor;
+    double maxFactor;
+    double slowSpeed;                   // points/s
+    double fastSpeed;
+} PaintStrokeWidthRange;
+
+/**
+ *  The range the app uses for the factors of PaintViewData, with the speeds of handwriting.
+ */
+PaintStrokeWidthRange PaintStrokeWidthRangeDefault(double minFactor, double maxFactor);
+
+/**
+ *  The width factor for a pen speed in points/s.
+ */
+double PaintStrokeWidthForSpeed(const PaintStrokeWidthRange *range, double speed);
+
+/**
+ *  Where the outline of a line stands: its sides so far and the ends they wait at.
+ */
+typedef struct PaintStrokeOutlineState {
+    size_t     leftCount;
+    size_t     rightCount;
+    size_t     pointCount;              // Points outlined so far
+    PaintPoint first, last;
+    PaintFloat firstRadius, lastRadius;
+    PaintPoint firstDirection, lastDirection;   // Of the first and the last segment
+    PaintPoint firstLeft, firstRight;   // Unit offsets of the sides at the start of the first
+    PaintPoint lastLeft, lastRight;     // and the end of the last segment
+} PaintStrokeOutlineState;
+
+/**
+ *  The outline of one line. Points closer than 1/1000 point to the one before are skipped.
+ */
+typedef struct PaintStrokeOutline {
+    PaintFloat              tolerance;  // Maximum deviation of the arcs, points
+    PaintStrokeOutlineState state;
+    PaintPoint             *left;       // The sides so far, from the start of the line
+    PaintPoint             *right;
+    size_t                  sideCapacity;
+    PaintPoint             *ring;       // The closed outline
+    size_t                  ringCapacity;
+    PaintFloat             *scratch;    // Coordinates and segments of an append, by column
+    size_t                  scratchCapacity;
+} PaintStrokeOutline;
+
+void PaintStrokeOutlineInit(PaintStrokeOutline *outline, double tolerance);
+void PaintStrokeOutlineFree(PaintStrokeOutline *outline);
+
+/**
+ *  Start a new line, but keep the memory.
+ */
+void PaintStrokeOutlineReset(PaintStrokeOutline *outline);
+
+/**
+ *  Append count stable points with the radius of the line at each of them. The side of the
+ *  last segment waits for the next point, its join depends on it. Returns 0, or -1 if there
+ *  is no memory; the points are not appended then.
+ */
+int PaintStrokeOutlineAppend(PaintStrokeOutline *outline, const PaintPoint *points, const PaintFloat *radii, size_t count);
+
+/**
+ *  The closed outline of the points so far and the tail after them, with the caps at both
+ *  ends; tailRadii has a radius for every tail point. The tail does not change the outline,
+ *  the next call replaces it. Returns the ring, valid until the next call, and its length in
+ *  count; NULL if the line has no points, if there is no memory, or for a single point with
+ *  butt caps.
+ */
+const PaintPoint *PaintStrokeOutlineClose(PaintStrokeOutline *outline, const PaintPoint *tail, const PaintFloat *tailRadii,
+                                          size_t tailCount, int buttCap, size_t *count);
+
+/**
+ *  The whole outline of count points in one go, the same as Reset, Append and Close.
+ */
+const PaintPoint *PaintStrokeOutlineOfPoints(PaintStrokeOutline *outline, const PaintPoint *points, const PaintFloat *radii,
+                                             size_t count, int buttCap, size_t *ringCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokeOutline_h */
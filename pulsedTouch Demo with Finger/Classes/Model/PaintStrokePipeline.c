@@ -0,0 +1,887 @@
+//
+//  PaintStrokePipeline.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "PaintRing.h"
+#include "PaintStrokePipeline.h"
+
+// Queue sizes. Touches and mode changes travel in their own queues, ahead of the event:
+#define COMMAND_CAPACITY  4096
+#define TOUCH_CAPACITY   16384
+#define CHANGE_CAPACITY   1024
+#define RESULT_CAPACITY   4096
+#define POINT_CAPACITY   65536
+
+// Longer runs of new points are handed back in pieces of this size:
+#define POINT_CHUNK      16384
+
+// How long a side waits for room in a full queue:
+#define FULL_WAIT_NS     50000L
+
+typedef enum PaintStrokeCommandKind {
+    PaintStrokeCommandIncrement,
+    PaintStrokeCommandPenModes,
+    PaintStrokeCommandEndLines,
+    PaintStrokeCommandPresets,
+    PaintStrokeCommandTolerance,
+    PaintStrokeCommandPredictor,
+    PaintStrokeCommandWidthRange,
+    PaintStrokeCommandErase,
+    PaintStrokeCommandEraseRect,
+    PaintStrokeCommandErasePalm,
+} PaintStrokeCommandKind;
+
+typedef struct PaintStrokeCommand {
+    PaintStrokeCommandKind kind;
+    PaintStrokeSource      source;
+    uint32_t               lineID;
+    uint32_t               count;       // Touches or mode changes waiting in their queue
+    int                    more;        // Only a piece of them, the rest comes with the next event
+    PaintLineStyle         presets;
+    double                 tolerance;
+    PaintPredictorConfig   predictor;
+    PaintStrokeWidthRange  widthRange;
+    int                    widthByRange;
+    PaintStrokeBounds      rect;
+} PaintStrokeCommand;
+
+typedef enum PaintStrokeResultKind {
+    PaintStrokeResultOpened,
+    PaintStrokeResultPoints,            // Only points, ahead of a long update
+    PaintStrokeResultStyled,
+    PaintStrokeResultExtended,
+    PaintStrokeResultCommitted,
+    PaintStrokeResultRemoved,
+} PaintStrokeResultKind;
+
+// The state of a line after an update. firstPoint … firstPoint + pointCount - 1 and the tail
+// wait in the point queue, and their width factors in the width queue if the line has them.
+// The points start one before the last ones handed back, the spline stream rewrites that one:
+typedef struct PaintStrokeResult {
+    PaintStrokeResultKind kind;
+    uint32_t              slot;
+    uint32_t              lineID;
+    int                   buttCap;
+    PaintLineStyle        style;
+    PaintStrokeBounds     bounds;
+    uint64_t              order;
+    double                firstTimestamp;
+    size_t                firstPoint;
+    uint32_t              pointCount;
+    uint32_t              tailCount;
+    int                   widths;
+    size_t                extendedFrom;
+    PaintSplineControl    lastTouch;    // Of a committed line
+    int                   lastClassification;
+    PaintStrokeTiming     timing;
+} PaintStrokeResult;
+
+struct PaintStrokePipeline {
+    
+    // Producer, the main thread:
+    PaintRing              commands;
+    PaintRing              touches;
+    PaintRing              changes;
+    PaintLineStyle         presets;
+    int                    presetsSent;
+    size_t                 pushed;
+    size_t                 producerWaits;
+    
+    // Worker:
+    PaintStrokeEngine     *engine;
+    size_t                 maxSplinePoints;
+    pthread_t              worker;
+    pthread_mutex_t        lock;
+    pthread_cond_t         wake;
+    int                    waiting;         // The worker sleeps until the producer signals
+    int                    stop;
+    size_t                 done;            // Events handled
+    PaintStrokeTouch      *touchBuffer;
+    size_t                 touchCapacity;
+    size_t                 touchPieces;     // Touches of an event which came in pieces, so far
+    PaintStrokeModeChange *changeBuffer;
+    size_t                 changeCapacity;
+    size_t                 changePieces;
+    size_t                *sentPoints;      // Points handed back, by slot
+    size_t                 sentCapacity;
+    PaintStrokeTiming      working;
+    double                 started;
+    double                 lineSpeed;
+    PaintLatency          *latency;
+    double               (*now)(void);
+    size_t                 results;
+    size_t                 workerWaits;
+    double                 workerSeconds;
+    
+    // Back to the main thread:
+    PaintRing              resultQueue;
+    PaintRing              points;
+    PaintRing              widths;
+    PaintStrokeCallbacks   callbacks;
+    PaintStrokeLine      **lines;           // Mirror lines in the order they were opened
+    size_t                 lineCount;
+    size_t                 lineCapacity;
+    PaintStrokeLine      **slotLines;       // The same by slot
+    size_t                 slotCapacity;
+    PaintStrokeLine      **committed;       // Commits not passed on yet
+    size_t                 committedCount;
+    size_t                 committedCapacity;
+    PaintStrokeTiming      timing;
+};
+
+static double PaintStrokePipelineMonotonic(void) {
+    
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+static void PaintStrokePipelineNap(void) {
+    
+    struct timespec nap = { 0, FULL_WAIT_NS };
+    nanosleep(&nap, NULL);
+}
+
+static void *PaintStrokePipelineGrow(void *buffer, size_t *capacity, size_t needed, size_t size) {
+    
+    if (needed <= *capacity) {
+        return buffer;
+    }
+    size_t grown = *capacity ? 2 * *capacity : 16;
+    while (grown < needed) {
+        grown *= 2;
+    }
+    void *resized = realloc(buffer, grown * size);
+    if (resized) {
+        memset((unsigned char *)resized + *capacity * size, 0, (grown - *capacity) * size);
+        *capacity = grown;
+    }
+    return resized;
+}
+
+#pragma mark - Worker
+
+// Hand a result back, waiting while the main thread has not taken the earlier ones. Once the
+// pipeline stops nobody takes them any more, and they are dropped:
+
+static int PaintStrokePipelinePushItems(PaintStrokePipeline *pipeline, PaintRing *ring, const void *items, size_t count) {
+    
+    while (!PaintRingPush(ring, items, count)) {
+        if (__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE)) return 0;
+        __atomic_fetch_add(&pipeline->workerWaits, 1, __ATOMIC_RELAXED);
+        PaintStrokePipelineNap();
+    }
+    return 1;
+}
+
+static void PaintStrokePipelinePush(PaintStrokePipeline *pipeline, PaintStrokeResult *result,
+                                    const PaintPoint *points, const PaintPoint *tail,
+                                    const PaintFloat *widths, const PaintFloat *tailWidths) {
+    
+    if (!PaintStrokePipelinePushItems(pipeline, &pipeline->points, points, result->pointCount)
+        || !PaintStrokePipelinePushItems(pipeline, &pipeline->points, tail, result->tailCount)) return;
+    if (result->widths
+        && (!PaintStrokePipelinePushItems(pipeline, &pipeline->widths, widths, result->pointCount)
+            || !PaintStrokePipelinePushItems(pipeline, &pipeline->widths, tailWidths, result->tailCount))) return;
+    if (!PaintStrokePipelinePushItems(pipeline, &pipeline->resultQueue, result, 1)) return;
+    __atomic_fetch_add(&pipeline->results, 1, __ATOMIC_RELAXED);
+}
+
+// Hand back the state of the line with the points which are new since the last time:
+
+static void PaintStrokePipelineSync(PaintStrokePipeline *pipeline, const PaintStrokeLine *line,
+                                    PaintStrokeResultKind kind, size_t extendedFrom) {
+    
+    size_t *sentPoints = PaintStrokePipelineGrow(pipeline->sentPoints, &pipeline->sentCapacity,
+                                                 line->slot + 1, sizeof(size_t));
+    if (!sentPoints) {
+        return;
+    }
+    pipeline->sentPoints = sentPoints;
+    if (kind == PaintStrokeResultOpened) {
+        pipeline->sentPoints[line->slot] = 0;
+    }
+    size_t sent  = pipeline->sentPoints[line->slot];
+    size_t first = sent ? sent - 1 : 0;
+    first        = first < line->pointCount ? first : line->pointCount;
+    
+    PaintStrokeResult result = {
+        .slot           = line->slot,
+        .lineID         = line->lineID,
+        .buttCap        = line->buttCap,
+        .style          = line->style,
+        .bounds         = line->bounds,
+        .order          = line->order,
+        .firstTimestamp = line->firstTimestamp,
+        .widths         = line->widths != NULL,
+        .extendedFrom   = extendedFrom,
+        .timing         = pipeline->working,
+    };
+    result.timing.seconds = pipeline->working.touched > 0.0 ? pipeline->now() - pipeline->started : 0.0;
+    
+    while (line->pointCount - first > POINT_CHUNK) {
+        result.kind       = PaintStrokeResultPoints;
+        result.firstPoint = first;
+        result.pointCount = POINT_CHUNK;
+        PaintStrokePipelinePush(pipeline, &result, line->points + first, NULL,
+                                line->widths ? line->widths + first : NULL, NULL);
+        first += POINT_CHUNK;
+    }
+    result.kind       = kind;
+    result.firstPoint = first;
+    result.pointCount = (uint32_t)(line->pointCount - first);
+    result.tailCount  = (uint32_t)line->tailCount;
+    if (kind == PaintStrokeResultCommitted && line->touches.count > 0) {
+        result.lastTouch          = PaintTouchColumnsControl(&line->touches, line->touches.count - 1);
+        result.lastClassification = PaintTouchColumnsClassification(&line->touches, line->touches.count - 1);
+    }
+    PaintStrokePipelinePush(pipeline, &result, line->points + first, line->tail,
+                            line->widths ? line->widths + first : NULL, line->tailWidths);
+    pipeline->sentPoints[line->slot] = line->pointCount;
+}
+
+static void PaintStrokePipelineOpened(void *context, const PaintStrokeLine *line) {
+    
+    PaintStrokePipelineSync(context, line, PaintStrokeResultOpened, 0);
+}
+
+static void PaintStrokePipelineStyled(void *context, const PaintStrokeLine *line) {
+    
+    PaintStrokePipelineSync(context, line, PaintStrokeResultStyled, 0);
+}
+
+static void PaintStrokePipelineExtended(void *context, const PaintStrokeLine *line, size_t firstPoint) {
+    
+    PaintStrokePipeline *pipeline = context;
+    if (pipeline->latency && pipeline->working.touched > 0.0) {
+        PaintLatencyRecord(pipeline->latency, PaintLatencySplined, pipeline->now() - pipeline->working.touched);
+    }
+    PaintStrokePipelineSync(pipeline, line, PaintStrokeResultExtended, firstPoint);
+}
+
+static void PaintStrokePipelineCommitted(void *context, const PaintStrokeLine *line) {
+    
+    PaintStrokePipelineSync(context, line, PaintStrokeResultCommitted, 0);
+}
+
+static void PaintStrokePipelineRemoved(void *context, const PaintStrokeLine *line) {
+    
+    PaintStrokePipeline *pipeline = context;
+    PaintStrokeResult result      = { .kind = PaintStrokeResultRemoved, .slot = line->slot, .lineID = line->lineID,
+                                      .timing = pipeline->working };
+    PaintStrokePipelinePush(pipeline, &result, NULL, NULL, NULL, NULL);
+}
+
+// The payload of an event was queued before the event, so it is there. It goes into the buffer
+// after the pieces taken so far; the event which ends them gets all of them:
+
+static size_t PaintStrokePipelineTake(PaintRing *ring, void **buffer, size_t *capacity, size_t *pieces,
+                                      const PaintStrokeCommand *command, size_t size) {
+    
+    void *grown = PaintStrokePipelineGrow(*buffer, capacity, *pieces + command->count, size);
+    if (grown) {
+        *buffer  = grown;
+        *pieces += PaintRingPop(ring, (unsigned char *)*buffer + *pieces * size, command->count);
+    } else {
+        void *skipped = malloc(size);
+        for (size_t n = 0; skipped && n < command->count; n++) PaintRingPop(ring, skipped, 1);
+        free(skipped);
+    }
+    if (command->more) {
+        return 0;
+    }
+    size_t count = *pieces;
+    *pieces      = 0;
+    return count;
+}
+
+static void PaintStrokePipelineRun(PaintStrokePipeline *pipeline, const PaintStrokeCommand *command) {
+    
+    PaintStrokeEngine *engine = pipeline->engine;
+    double start              = pipeline->now();
+    pipeline->working         = (PaintStrokeTiming){ 0.0, 0.0 };
+    pipeline->started         = start;
+    size_t count;
+    switch (command->kind) {
+        case PaintStrokeCommandIncrement:
+            count = PaintStrokePipelineTake(&pipeline->touches, (void **)&pipeline->touchBuffer, &pipeline->touchCapacity,
+                                            &pipeline->touchPieces, command, sizeof(PaintStrokeTouch));
+            if (command->more) {
+                break;
+            }
+            
+            // The latency of an increment is that of its oldest touch:
+            for (size_t n = 0; n < count; n++) {
+                double timestamp = pipeline->touchBuffer[n].control.timestamp;
+                if (timestamp > 0.0 && (pipeline->working.touched == 0.0 || timestamp < pipeline->working.touched)) {
+                    pipeline->working.touched = timestamp;
+                }
+            }
+            PaintStrokeEngineIncrement(engine, command->lineID, pipeline->touchBuffer, count, command->source);
+            double speed = PaintStrokeEngineLineSpeed(engine);
+            __atomic_store(&pipeline->lineSpeed, &speed, __ATOMIC_RELAXED);
+            break;
+        
+        case PaintStrokeCommandPenModes:
+            count = PaintStrokePipelineTake(&pipeline->changes, (void **)&pipeline->changeBuffer, &pipeline->changeCapacity,
+                                            &pipeline->changePieces, command, sizeof(PaintStrokeModeChange));
+            if (command->more) {
+                break;
+            }
+            PaintStrokeEngineApplyPenModes(engine, pipeline->changeBuffer, count);
+            break;
+        
+        case PaintStrokeCommandEndLines:
+            count = PaintStrokePipelineTake(&pipeline->changes, (void **)&pipeline->changeBuffer, &pipeline->changeCapacity,
+                                            &pipeline->changePieces, command, sizeof(PaintStrokeModeChange));
+            if (command->more) {
+                break;
+            }
+            PaintStrokeEngineEndLines(engine, pipeline->changeBuffer, count);
+            break;
+        
+        case PaintStrokeCommandPresets:
+            PaintStrokeEngineSetPresets(engine, command->presets);
+            break;
+        
+        case PaintStrokeCommandTolerance:
+            PaintStrokeEngineSetTolerance(engine, command->tolerance);
+            break;
+        
+        case PaintStrokeCommandPredictor:
+            PaintStrokeEngineSetPredictor(engine, command->predictor);
+            break;
+        
+        case PaintStrokeCommandWidthRange:
+            PaintStrokeEngineSetWidthRange(engine, command->widthByRange ? &command->widthRange : NULL);
+            break;
+        
+        case PaintStrokeCommandErase:
+            PaintStrokeEngineErase(engine);
+            break;
+        
+        case PaintStrokeCommandEraseRect:
+            PaintStrokeEngineEraseRect(engine, command->rect);
+            break;
+        
+        case PaintStrokeCommandErasePalm:
+            PaintStrokeEngineErasePalm(engine, command->rect);
+            break;
+    }
+    double seconds = pipeline->workerSeconds + pipeline->now() - start;
+    __atomic_store(&pipeline->workerSeconds, &seconds, __ATOMIC_RELAXED);
+    __atomic_store_n(&pipeline->done, pipeline->done + 1, __ATOMIC_RELEASE);
+}
+
+// The worker sleeps when there is nothing to do. It announces that before it looks at the queue
+// a last time, and the producer looks for the announcement after queueing, so one of the two
+// always sees the other:
+
+static void *PaintStrokePipelineWorker(void *context) {
+    
+    PaintStrokePipeline *pipeline = context;
+    PaintStrokeCommand command;
+    for (;;) {
+        if (PaintRingPop(&pipeline->commands, &command, 1)) {
+            PaintStrokePipelineRun(pipeline, &command);
+            continue;
+        }
+        pthread_mutex_lock(&pipeline->lock);
+        __atomic_store_n(&pipeline->waiting, 1, __ATOMIC_SEQ_CST);
+        while (PaintRingCount(&pipeline->commands) == 0 && !__atomic_load_n(&pipeline->stop, __ATOMIC_SEQ_CST)) {
+            pthread_cond_wait(&pipeline->wake, &pipeline->lock);
+        }
+        __atomic_store_n(&pipeline->waiting, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pipeline->lock);
+        if (__atomic_load_n(&pipeline->stop, __ATOMIC_ACQUIRE)) break;
+    }
+    return NULL;
+}
+
+#pragma mark - Life Cycle
+
+PaintStrokePipeline *PaintStrokePipelineCreate(size_t maxSplinePoints, const PaintStrokeCallbacks *callbacks,
+                                               PaintLatency *latency, double (*now)(void)) {
+    
+    PaintStrokePipeline *pipeline = calloc(1, sizeof(PaintStrokePipeline));
+    if (!pipeline) {
+        return NULL;
+    }
+    PaintStrokeCallbacks worker = {
+        .context       = pipeline,
+        .lineOpened    = PaintStrokePipelineOpened,
+        .lineStyled    = PaintStrokePipelineStyled,
+        .lineExtended  = PaintStrokePipelineExtended,
+        .lineCommitted = PaintStrokePipelineCommitted,
+        .lineRemoved   = PaintStrokePipelineRemoved,
+    };
+    if (callbacks) {
+        pipeline->callbacks = *callbacks;
+    }
+    pipeline->latency         = latency;
+    pipeline->now             = now ? now : PaintStrokePipelineMonotonic;
+    pipeline->maxSplinePoints = maxSplinePoints;
+    pipeline->engine          = PaintStrokeEngineCreate(maxSplinePoints, &worker);
+    
+    int failed = !pipeline->engine
+              || PaintRingInit(&pipeline->commands, sizeof(PaintStrokeCommand), COMMAND_CAPACITY) != 0
+              || PaintRingInit(&pipeline->touches, sizeof(PaintStrokeTouch), TOUCH_CAPACITY) != 0
+              || PaintRingInit(&pipeline->changes, sizeof(PaintStrokeModeChange), CHANGE_CAPACITY) != 0
+              || PaintRingInit(&pipeline->resultQueue, sizeof(PaintStrokeResult), RESULT_CAPACITY) != 0
+              || PaintRingInit(&pipeline->points, sizeof(PaintPoint), POINT_CAPACITY) != 0
+              || PaintRingInit(&pipeline->widths, sizeof(PaintFloat), POINT_CAPACITY) != 0;
+    if (!failed) {
+        pthread_mutex_init(&pipeline->lock, NULL);
+        pthread_cond_init(&pipeline->wake, NULL);
+        if (pthread_create(&pipeline->worker, NULL, PaintStrokePipelineWorker, pipeline) != 0) {
+            pthread_cond_destroy(&pipeline->wake);
+            pthread_mutex_destroy(&pipeline->lock);
+            failed = 1;
+        }
+    }
+    if (failed) {
+        PaintStrokeEngineDestroy(pipeline->engine);
+        PaintRingFree(&pipeline->commands);
+        PaintRingFree(&pipeline->touches);
+        PaintRingFree(&pipeline->changes);
+        PaintRingFree(&pipeline->resultQueue);
+        PaintRingFree(&pipeline->points);
+        PaintRingFree(&pipeline->widths);
+        free(pipeline);
+        return NULL;
+    }
+    return pipeline;
+}
+
+static void PaintStrokePipelineFreeLine(PaintStrokeLine *line) {
+    
+    PaintTouchColumnsRelease(&line->touches);
+    free(line->points);
+    free(line->tail);
+    free(line->widths);
+    free(line->tailWidths);
+    free(line);
+}
+
+void PaintStrokePipelineDestroy(PaintStrokePipeline *pipeline) {
+    
+    if (!pipeline) {
+        return;
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    __atomic_store_n(&pipeline->stop, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&pipeline->wake);
+    pthread_mutex_unlock(&pipeline->lock);
+    pthread_join(pipeline->worker, NULL);
+    pthread_cond_destroy(&pipeline->wake);
+    pthread_mutex_destroy(&pipeline->lock);
+    
+    for (size_t n = 0; n < pipeline->lineCount; n++) {
+        PaintStrokePipelineFreeLine(pipeline->lines[n]);
+    }
+    for (size_t n = 0; n < pipeline->committedCount; n++) {
+        PaintStrokePipelineFreeLine(pipeline->committed[n]);
+    }
+    free(pipeline->lines);
+    free(pipeline->slotLines);
+    free(pipeline->committed);
+    free(pipeline->touchBuffer);
+    free(pipeline->changeBuffer);
+    free(pipeline->sentPoints);
+    PaintStrokeEngineDestroy(pipeline->engine);
+    PaintRingFree(&pipeline->commands);
+    PaintRingFree(&pipeline->touches);
+    PaintRingFree(&pipeline->changes);
+    PaintRingFree(&pipeline->resultQueue);
+    PaintRingFree(&pipeline->points);
+    PaintRingFree(&pipeline->widths);
+    free(pipeline);
+}
+
+#pragma mark - Producer
+
+// While the queue to the worker is full, the worker may be waiting for room in the queue back.
+// The producer is the consumer, too, so it takes the results meanwhile:
+
+static void PaintStrokePipelineWaitForWorker(PaintStrokePipeline *pipeline) {
+    
+    pipeline->producerWaits++;
+    if (PaintStrokePipelineDrain(pipeline) == 0) {
+        PaintStrokePipelineNap();
+    }
+}
+
+// Queue the payload, then the event, and wake the worker if it sleeps:
+
+static void PaintStrokePipelinePost(PaintStrokePipeline *pipeline, const PaintStrokeCommand *command,
+                                    PaintRing *payload, const void *items) {
+    
+    while (payload && !PaintRingPush(payload, items, command->count)) {
+        PaintStrokePipelineWaitForWorker(pipeline);
+    }
+    while (!PaintRingPush(&pipeline->commands, command, 1)) {
+        PaintStrokePipelineWaitForWorker(pipeline);
+    }
+    pipeline->pushed++;
+    if (__atomic_load_n(&pipeline->waiting, __ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&pipeline->lock);
+        pthread_cond_signal(&pipeline->wake);
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+}
+
+// A payload larger than its whole queue goes in pieces, each with an event marked to have more
+// coming. The worker collects them and handles the event once, with all of its payload:
+
+static void PaintStrokePipelineSend(PaintStrokePipeline *pipeline, const PaintStrokeCommand *command,
+                                    PaintRing *payload, const void *items) {
+    
+    size_t capacity           = payload ? PaintRingCapacity(payload) : 0;
+    PaintStrokeCommand piece  = *command;
+    const unsigned char *next = items;
+    for (size_t left = command->count; payload && left > capacity; left -= capacity) {
+        piece.count = (uint32_t)capacity;
+        piece.more  = 1;
+        PaintStrokePipelinePost(pipeline, &piece, payload, next);
+        next       += capacity * payload->itemSize;
+        piece.count = (uint32_t)(left - capacity);
+    }
+    piece.more = 0;
+    PaintStrokePipelinePost(pipeline, &piece, payload, next);
+}
+
+void PaintStrokePipelineSetTolerance(PaintStrokePipeline *pipeline, double tolerance) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandTolerance, .tolerance = tolerance };
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+void PaintStrokePipelineSetPredictor(PaintStrokePipeline *pipeline, PaintPredictorConfig config) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandPredictor, .predictor = config };
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+void PaintStrokePipelineSetWidthRange(PaintStrokePipeline *pipeline, const PaintStrokeWidthRange *range) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandWidthRange, .widthByRange = range != NULL };
+    if (range) {
+        command.widthRange = *range;
+    }
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+// The controller sets the presets before every event, only changes are passed on:
+
+void PaintStrokePipelineSetPresets(PaintStrokePipeline *pipeline, PaintLineStyle presets) {
+    
+    if (pipeline->presetsSent && presets.width == pipeline->presets.width && presets.alpha == pipeline->presets.alpha
+        && presets.bright == pipeline->presets.bright) {
+        return;
+    }
+    pipeline->presets          = presets;
+    pipeline->presetsSent      = 1;
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandPresets, .presets = presets };
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+void PaintStrokePipelineIncrement(PaintStrokePipeline *pipeline, uint32_t lineID,
+                                  const PaintStrokeTouch *touches, size_t count, PaintStrokeSource source) {
+    
+    if (count == 0) {
+        return;
+    }
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandIncrement, .source = source, .lineID = lineID,
+                                   .count = (uint32_t)count };
+    PaintStrokePipelineSend(pipeline, &command, &pipeline->touches, touches);
+}
+
+void PaintStrokePipelineApplyPenModes(PaintStrokePipeline *pipeline, const PaintStrokeModeChange *changes, size_t count) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandPenModes, .count = (uint32_t)count };
+    PaintStrokePipelineSend(pipeline, &command, &pipeline->changes, changes);
+}
+
+void PaintStrokePipelineEndLines(PaintStrokePipeline *pipeline, const PaintStrokeModeChange *changes, size_t count) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandEndLines, .count = (uint32_t)count };
+    PaintStrokePipelineSend(pipeline, &command, &pipeline->changes, changes);
+}
+
+void PaintStrokePipelineErase(PaintStrokePipeline *pipeline) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandErase };
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+void PaintStrokePipelineEraseRect(PaintStrokePipeline *pipeline, PaintStrokeBounds rect) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandEraseRect, .rect = rect };
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+void PaintStrokePipelineErasePalm(PaintStrokePipeline *pipeline, PaintStrokeBounds rect) {
+    
+    PaintStrokeCommand command = { .kind = PaintStrokeCommandErasePalm, .rect = rect };
+    PaintStrokePipelineSend(pipeline, &command, NULL, NULL);
+}
+
+#pragma mark - Consumer
+
+// Pop the width factors of a result which comes without a line to take them:
+
+static void PaintStrokePipelineSkipWidths(PaintStrokePipeline *pipeline, size_t count) {
+    
+    PaintFloat skipped;
+    for (size_t n = 0; n < count; n++) PaintRingPop(&pipeline->widths, &skipped, 1);
+}
+
+static void PaintStrokePipelineReceiveWidths(PaintStrokePipeline *pipeline, PaintStrokeLine *line,
+                                             const PaintStrokeResult *result) {
+    
+    size_t tailCount = result->kind != PaintStrokeResultPoints ? result->tailCount : 0;
+    PaintFloat *widths = PaintStrokePipelineGrow(line->widths, &line->widthCapacity, line->pointCapacity, sizeof(PaintFloat));
+    if (!line->tailWidths) {
+        line->tailWidths = malloc((pipeline->maxSplinePoints + 1) * sizeof(PaintFloat));
+    }
+    line->widths = widths ? widths : line->widths;
+    
+    // Without all of them the line falls back to a constant width:
+    if (!widths || !line->tailWidths || line->pointCount != result->firstPoint + result->pointCount) {
+        PaintStrokePipelineSkipWidths(pipeline, result->pointCount + tailCount);
+        free(line->widths);
+        line->widths        = NULL;
+        line->widthCapacity = 0;
+        return;
+    }
+    PaintRingPop(&pipeline->widths, line->widths + result->firstPoint, result->pointCount);
+    PaintRingPop(&pipeline->widths, line->tailWidths, tailCount);
+}
+
+// Copy the state of a result into the mirror line:
+
+static void PaintStrokePipelineReceive(PaintStrokePipeline *pipeline, PaintStrokeLine *line,
+                                       const PaintStrokeResult *result) {
+    
+    line->style   = result->style;
+    line->buttCap = result->buttCap;
+    line->bounds  = result->bounds;
+    
+    size_t end = result->firstPoint + result->pointCount;
+    PaintPoint *points = PaintStrokePipelineGrow(line->points, &line->pointCapacity, end, sizeof(PaintPoint));
+    if (points) {
+        line->points = points;
+        PaintRingPop(&pipeline->points, line->points + result->firstPoint, result->pointCount);
+        line->pointCount = end;
+    } else {
+        PaintPoint skipped;
+        for (uint32_t n = 0; n < result->pointCount; n++) PaintRingPop(&pipeline->points, &skipped, 1);
+    }
+    if (result->kind != PaintStrokeResultPoints) {
+        PaintRingPop(&pipeline->points, line->tail, result->tailCount);
+        line->tailCount = result->tailCount;
+    }
+    if (result->widths) {
+        PaintStrokePipelineReceiveWidths(pipeline, line, result);
+    }
+}
+
+// A line leaves the mirror when it is committed or removed:
+
+static void PaintStrokePipelineUnlist(PaintStrokePipeline *pipeline, PaintStrokeLine *line) {
+    
+    for (size_t n = 0; n < pipeline->lineCount; n++) {
+        if (pipeline->lines[n] == line) {
+            memmove(pipeline->lines + n, pipeline->lines + n + 1, (pipeline->lineCount - n - 1) * sizeof(PaintStrokeLine *));
+            pipeline->lineCount--;
+            break;
+        }
+    }
+    pipeline->slotLines[line->slot] = NULL;
+}
+
+static void PaintStrokePipelinePassCommits(PaintStrokePipeline *pipeline) {
+    
+    if (pipeline->committedCount == 0) {
+        return;
+    }
+    pipeline->callbacks.linesCommitted(pipeline->callbacks.context, (const PaintStrokeLine *const *)pipeline->committed,
+                                       pipeline->committedCount);
+    for (size_t n = 0; n < pipeline->committedCount; n++) {
+        PaintStrokePipelineFreeLine(pipeline->committed[n]);
+    }
+    pipeline->committedCount = 0;
+}
+
+static PaintStrokeLine *PaintStrokePipelineOpen(PaintStrokePipeline *pipeline, const PaintStrokeResult *result) {
+    
+    PaintStrokeLine *line = calloc(1, sizeof(PaintStrokeLine));
+    PaintPoint *tail      = malloc((pipeline->maxSplinePoints + 1) * sizeof(PaintPoint));
+    PaintStrokeLine **slotLines = PaintStrokePipelineGrow(pipeline->slotLines, &pipeline->slotCapacity,
+                                                          result->slot + 1, sizeof(PaintStrokeLine *));
+    if (slotLines) {
+        pipeline->slotLines = slotLines;
+    }
+    PaintStrokeLine **lines = PaintStrokePipelineGrow(pipeline->lines, &pipeline->lineCapacity,
+                                                      pipeline->lineCount + 1, sizeof(PaintStrokeLine *));
+    if (lines) {
+        pipeline->lines = lines;
+    }
+    if (!line || !tail || !slotLines || !lines) {
+        free(line);
+        free(tail);
+        return NULL;
+    }
+    line->lineID         = result->lineID;
+    line->slot           = result->slot;
+    line->order          = result->order;
+    line->modeList       = -1;
+    line->firstTimestamp = result->firstTimestamp;
+    line->tail           = tail;
+    pipeline->slotLines[line->slot]          = line;
+    pipeline->lines[pipeline->lineCount++] = line;
+    return line;
+}
+
+size_t PaintStrokePipelineDrain(PaintStrokePipeline *pipeline) {
+    
+    const PaintStrokeCallbacks *callbacks = &pipeline->callbacks;
+    PaintStrokeResult result;
+    size_t drained = 0;
+    while (PaintRingPop(&pipeline->resultQueue, &result, 1)) {
+        drained++;
+        pipeline->timing      = result.timing;
+        PaintStrokeLine *line = result.slot < pipeline->slotCapacity ? pipeline->slotLines[result.slot] : NULL;
+        
+        // A new line may come with its first points ahead. The slot of a committed line may be
+        // taken again, so the commits go out first:
+        if (!line && (result.kind == PaintStrokeResultOpened || result.kind == PaintStrokeResultPoints)) {
+            PaintStrokePipelinePassCommits(pipeline);
+            line = PaintStrokePipelineOpen(pipeline, &result);
+        }
+        if (!line) {
+            
+            // No memory for the mirror: the points are skipped, the line is not shown.
+            PaintPoint skipped;
+            size_t count = result.pointCount + (result.kind != PaintStrokeResultPoints ? result.tailCount : 0);
+            for (size_t n = 0; n < count; n++) PaintRingPop(&pipeline->points, &skipped, 1);
+            if (result.widths) PaintStrokePipelineSkipWidths(pipeline, count);
+            continue;
+        }
+        if (result.kind != PaintStrokeResultRemoved) {
+            PaintStrokePipelineReceive(pipeline, line, &result);
+        }
+        
+        switch (result.kind) {
+            case PaintStrokeResultOpened:
+                if (callbacks->lineOpened) callbacks->lineOpened(callbacks->context, line);
+                break;
+            
+            case PaintStrokeResultPoints:
+                break;
+            
+            case PaintStrokeResultStyled:
+                if (callbacks->lineStyled) callbacks->lineStyled(callbacks->context, line);
+                break;
+            
+            case PaintStrokeResultExtended:
+                if (callbacks->lineExtended) callbacks->lineExtended(callbacks->context, line, result.extendedFrom);
+                break;
+            
+            case PaintStrokeResultCommitted:
+                PaintStrokePipelineUnlist(pipeline, line);
+                PaintTouchColumnsAppend(&line->touches, &result.lastTouch, result.lastClassification);
+                if (callbacks->linesCommitted) {
+                    PaintStrokeLine **committed = PaintStrokePipelineGrow(pipeline->committed, &pipeline->committedCapacity,
+                                                                          pipeline->committedCount + 1,
+                                                                          sizeof(PaintStrokeLine *));
+                    if (committed) {
+                        pipeline->committed = committed;
+                        pipeline->committed[pipeline->committedCount++] = line;
+                        break;
+                    }
+                    PaintStrokePipelinePassCommits(pipeline);
+                    callbacks->linesCommitted(callbacks->context, (const PaintStrokeLine *const *)&line, 1);
+                } else if (callbacks->lineCommitted) {
+                    callbacks->lineCommitted(callbacks->context, line);
+                }
+                PaintStrokePipelineFreeLine(line);
+                break;
+            
+            case PaintStrokeResultRemoved:
+                PaintStrokePipelineUnlist(pipeline, line);
+                if (callbacks->lineRemoved) callbacks->lineRemoved(callbacks->context, line);
+                PaintStrokePipelineFreeLine(line);
+                break;
+        }
+    }
+    PaintStrokePipelinePassCommits(pipeline);
+    return drained;
+}
+
+void PaintStrokePipelineFlush(PaintStrokePipeline *pipeline) {
+    
+    while (__atomic_load_n(&pipeline->done, __ATOMIC_ACQUIRE) != pipeline->pushed) {
+        if (PaintStrokePipelineDrain(pipeline) == 0) {
+            PaintStrokePipelineNap();
+        }
+    }
+    PaintStrokePipelineDrain(pipeline);
+}
+
+int PaintStrokePipelineIdle(const PaintStrokePipeline *pipeline) {
+    
+    return __atomic_load_n(&pipeline->done, __ATOMIC_ACQUIRE) == pipeline->pushed
+        && PaintRingCount(&pipeline->resultQueue) == 0;
+}
+
+PaintStrokeTiming PaintStrokePipelineTiming(const PaintStrokePipeline *pipeline) {
+    
+    return pipeline->timing;
+}
+
+size_t PaintStrokePipelineLineCount(const PaintStrokePipeline *pipeline) {
+    
+    return pipeline->lineCount;
+}
+
+const PaintStrokeLine *PaintStrokePipelineLineAtIndex(const PaintStrokePipeline *pipeline, size_t index) {
+    
+    return index < pipeline->lineCount ? pipeline->lines[index] : NULL;
+}
+
+const PaintStrokeLine *PaintStrokePipelineLineInSlot(const PaintStrokePipeline *pipeline, uint32_t slot) {
+    
+    return slot < pipeline->slotCapacity ? pipeline->slotLines[slot] : NULL;
+}
+
+double PaintStrokePipelineLineSpeed(const PaintStrokePipeline *pipeline) {
+    
+    double speed;
+    __atomic_load(&pipeline->lineSpeed, &speed, __ATOMIC_RELAXED);
+    return speed;
+}
+
+PaintStrokePipelineStatistics PaintStrokePipelineGetStatistics(const PaintStrokePipeline *pipeline) {
+    
+    PaintStrokePipelineStatistics statistics = {
+        .commands      = pipeline->pushed,
+        .results       = __atomic_load_n(&pipeline->results, __ATOMIC_RELAXED),
+        .producerWaits = pipeline->producerWaits,
+        .workerWaits   = __atomic_load_n(&pipeline->workerWaits, __ATOMIC_RELAXED),
+    };
+    __atomic_load(&pipeline->workerSeconds, &statistics.workerSeconds, __ATOMIC_RELAXED);
+    return statistics;
+}
+
+PaintStrokeStatistics PaintStrokePipelineEngineStatistics(const PaintStrokePipeline *pipeline) {
+    
+    return PaintStrokeEngineGetStatistics(pipeline->engine);
+}
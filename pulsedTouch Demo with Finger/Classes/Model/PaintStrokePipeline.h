@@ -0,0 +1,128 @@
+//
+//  PaintStrokePipeline.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Runs the stroke engine on a worker thread. The main thread pushes increments, pen modes and
+//  line ended messages into lock-free queues and returns to the touch handling at once; the
+//  worker assembles the lines, runs the splines and applies palm rejection and pen modes in
+//  exactly the order the events arrived. What changed comes back through a second queue as
+//  ready vertex buffers: new stable points and the current tail of each line.
+//
+//  PaintStrokePipelineDrain(), called on the main thread once per display frame, copies them
+//  into mirror lines and calls the usual PaintStrokeCallbacks with those, so the owner handles
+//  lines as it does with the engine itself. Everything of one line stays in order; a line the
+//  worker drops mid-stream comes back as lineRemoved after its last update.
+//
+
+#ifndef PaintStrokePipeline_h
+#define PaintStrokePipeline_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintLatency.h"
+#include "PaintStrokeEngine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PaintStrokePipeline PaintStrokePipeline;
+
+/**
+ *  Where the drained callback came from: the oldest touch of the increment the worker was
+ *  handling, 0 for other events, and how long the worker had been at it by then.
+ */
+typedef struct PaintStrokeTiming {
+    double touched;
+    double seconds;
+} PaintStrokeTiming;
+
+typedef struct PaintStrokePipelineStatistics {
+    size_t commands;                    // Events handed to the worker
+    size_t results;                     // Line updates handed back
+    size_t producerWaits;               // Times the queue to the worker was full
+    size_t workerWaits;                 // Times the queue back was full
+    double workerSeconds;               // Spent in the engine
+} PaintStrokePipelineStatistics;
+
+/**
+ *  Create the engine and start the worker. The callbacks are called from
+ *  PaintStrokePipelineDrain() only. If latency is set, the worker records the splined stage
+ *  in it, with now as the clock of the touch timestamps (CACurrentMediaTime() on the device,
+ *  the monotonic clock if NULL). Returns NULL if there is no memory or no thread.
+ */
+PaintStrokePipeline *PaintStrokePipelineCreate(size_t maxSplinePoints, const PaintStrokeCallbacks *callbacks,
+                                               PaintLatency *latency, double (*now)(void));
+
+/**
+ *  Stop the worker and drop everything still queued, without callbacks.
+ */
+void PaintStrokePipelineDestroy(PaintStrokePipeline *pipeline);
+
+#pragma mark - Producer
+
+/**
+ *  The same as the engine functions of the same names. They only queue the event. If the
+ *  worker is that far behind that the queue is full, they drain while they wait, so the thread
+ *  which calls them must be the one which drains.
+ */
+void PaintStrokePipelineSetTolerance(PaintStrokePipeline *pipeline, double tolerance);
+void PaintStrokePipelineSetPredictor(PaintStrokePipeline *pipeline, PaintPredictorConfig config);
+void PaintStrokePipelineSetWidthRange(PaintStrokePipeline *pipeline, const PaintStrokeWidthRange *range);
+void PaintStrokePipelineSetPresets(PaintStrokePipeline *pipeline, PaintLineStyle presets);
+void PaintStrokePipelineIncrement(PaintStrokePipeline *pipeline, uint32_t lineID,
+                                  const PaintStrokeTouch *touches, size_t count, PaintStrokeSource source);
+void PaintStrokePipelineApplyPenModes(PaintStrokePipeline *pipeline, const PaintStrokeModeChange *changes, size_t count);
+void PaintStrokePipelineEndLines(PaintStrokePipeline *pipeline, const PaintStrokeModeChange *changes, size_t count);
+void PaintStrokePipelineErase(PaintStrokePipeline *pipeline);
+void PaintStrokePipelineEraseRect(PaintStrokePipeline *pipeline, PaintStrokeBounds rect);
+void PaintStrokePipelineErasePalm(PaintStrokePipeline *pipeline, PaintStrokeBounds rect);
+
+#pragma mark - Consumer
+
+/**
+ *  Take over what the worker has done so far and call back for it. Consecutive commits go to
+ *  linesCommitted if it is set. The callbacks must not queue events. Returns the number of
+ *  updates.
+ */
+size_t PaintStrokePipelineDrain(PaintStrokePipeline *pipeline);
+
+/**
+ *  Wait until the worker has handled every event, and drain.
+ */
+void PaintStrokePipelineFlush(PaintStrokePipeline *pipeline);
+
+/**
+ *  1 if the worker has handled every event and everything has been drained.
+ */
+int PaintStrokePipelineIdle(const PaintStrokePipeline *pipeline);
+
+PaintStrokeTiming PaintStrokePipelineTiming(const PaintStrokePipeline *pipeline);
+
+/**
+ *  The mirror lines, as of the last drain: points, tail, style, bounds and firstTimestamp like
+ *  in the engine, and of the touches the last one once the line is committed.
+ */
+size_t PaintStrokePipelineLineCount(const PaintStrokePipeline *pipeline);
+const PaintStrokeLine *PaintStrokePipelineLineAtIndex(const PaintStrokePipeline *pipeline, size_t index);
+const PaintStrokeLine *PaintStrokePipelineLineInSlot(const PaintStrokePipeline *pipeline, uint32_t slot);
+
+/**
+ *  The line speed of the engine after the last increment, can be read from any thread.
+ */
+double PaintStrokePipelineLineSpeed(const PaintStrokePipeline *pipeline);
+PaintStrokePipelineStatistics PaintStrokePipelineGetStatistics(const PaintStrokePipeline *pipeline);
+
+/**
+ *  The statistics of the engine itself. Only right after PaintStrokePipelineFlush(), while the
+ *  worker has nothing to do.
+ */
+PaintStrokeStatistics PaintStrokePipelineEngineStatistics(const PaintStrokePipeline *pipeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokePipeline_h */
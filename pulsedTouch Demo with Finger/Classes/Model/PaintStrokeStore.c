@@ -0,0 +1,287 @@
+//
+//  PaintStrokeStore.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintStrokeStore.h"
+
+void PaintStrokeStoreInit(PaintStrokeStore *store) {
+    
+    memset(store, 0, sizeof(PaintStrokeStore));
+}
+
+void PaintStrokeStoreFree(PaintStrokeStore *store) {
+    
+    free(store->strokes);
+    free(store->points);
+    free(store->widths);
+    free(store->stack);
+    free(store->keep);
+    PaintStrokeStoreInit(store);
+}
+
+void PaintStrokeStoreClear(PaintStrokeStore *store) {
+    
+    store->count      = 0;
+    store->pointCount = 0;
+    store->pointsIn   = 0;
+}
+
+#pragma mark - Simplification
+
+// Squared distance of p from the segment a … b:
+
+static inline float PaintStrokeStoreDistance2(PaintStoredPoint p, PaintStoredPoint a, PaintStoredPoint b) {
+    
+    float dx = b.x - a.x, dy = b.y - a.y;
+    float px = p.x - a.x, py = p.y - a.y;
+    float length2 = dx * dx + dy * dy;
+    float t       = length2 > 0.0f ? (px * dx + py * dy) / length2 : 0.0f;
+    t             = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    px           -= t * dx;
+    py           -= t * dy;
+    return px * px + py * py;
+}
+
+static int PaintStrokeStoreReserveScratch(PaintStrokeStore *store, size_t count) {
+    
+    if (count <= store->scratchCapacity) {
+        return 0;
+    }
+    size_t capacity = store->scratchCapacity ? store->scratchCapacity : 256;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    uint32_t *stack = realloc(store->stack, 2 * capacity * sizeof(uint32_t));
+    if (!stack) {
+        return -1;
+    }
+    store->stack  = stack;
+    uint8_t *keep = realloc(store->keep, capacity);
+    if (!keep) {
+        return -1;
+    }
+    store->keep            = keep;
+    store->scratchCapacity = capacity;
+    return 0;
+}
+
+size_t PaintStrokeStoreSimplify(PaintStrokeStore *store, PaintStoredPoint *points, size_t count, double tolerance) {
+    
+    if (count < 3 || PaintStrokeStoreReserveScratch(store, count) != 0) {
+        return count;
+    }
+    uint32_t *stack      = store->stack;
+    uint8_t  *keep       = store->keep;
+    float     tolerance2 = (float)(tolerance * tolerance);
+    memset(keep, 0, count);
+    keep[0] = keep[count - 1] = 1;
+    
+    // Spans still to be looked at go on a stack instead of recursion. Every span on the stack
+    // holds at least one point no other span holds, so count pairs are always enough:
+    size_t depth   = 0;
+    stack[depth++] = 0;
+    stack[depth++] = (uint32_t)(count - 1);
+    while (depth > 0) {
+        uint32_t last  = stack[--depth];
+        uint32_t first = stack[--depth];
+        float    worst = 0.0f;
+        uint32_t split = 0;
+        for (uint32_t n = first + 1; n < last; n++) {
+            float distance2 = PaintStrokeStoreDistance2(points[n], points[first], points[last]);
+            if (distance2 > worst) {
+                worst = distance2;
+                split = n;
+            }
+        }
+        if (worst > tolerance2) {
+            keep[split] = 1;
+            if (split - first > 1) {
+                stack[depth++] = first;
+                stack[depth++] = split;
+            }
+            if (last - split > 1) {
+                stack[depth++] = split;
+                stack[depth++] = last;
+            }
+        }
+    }
+    
+    size_t kept = 0;
+    for (size_t n = 0; n < count; n++) {
+        if (keep[n]) {
+            points[kept++] = points[n];
+        }
+    }
+    return kept;
+}
+
+#pragma mark - Strokes
+
+// Room for one more stroke of total points, with width factors if varying. The width array
+// comes with the first stroke which needs it; the strokes before get factor 1:
+
+static int PaintStrokeStoreReserve(PaintStrokeStore *store, size_t total, int varying) {
+    
+    if (store->count == store->capacity) {
+        size_t capacity            = store->capacity ? 2 * store->capacity : 64;
+        PaintStoredStroke *strokes = realloc(store->strokes, capacity * sizeof(PaintStoredStroke));
+        if (!strokes) {
+            return -1;
+        }
+        store->strokes  = strokes;
+        store->capacity = capacity;
+    }
+    if (store->pointCount + total > store->pointCapacity) {
+        size_t capacity = store->pointCapacity ? store->pointCapacity : 4096;
+        while (capacity < store->pointCount + total) {
+            capacity *= 2;
+        }
+        PaintStoredPoint *stored = realloc(store->points, capacity * sizeof(PaintStoredPoint));
+        if (!stored) {
+            return -1;
+        }
+        store->points = stored;
+        if (store->widths) {
+            float *widths = realloc(store->widths, capacity * sizeof(float));
+            if (!widths) {
+                return -1;
+            }
+            store->widths = widths;
+        }
+        store->pointCapacity = capacity;
+    }
+    if (varying && !store->widths) {
+        store->widths = malloc(store->pointCapacity * sizeof(float));
+        if (!store->widths) {
+            return -1;
+        }
+        for (size_t n = 0; n < store->pointCount; n++) {
+            store->widths[n] = 1.0f;
+        }
+    }
+    return 0;
+}
+
+// The next stroke has its kept points at the end of the point array, and their width factors
+// at the end of the width array if it varies; total were handed in:
+
+static long PaintStrokeStoreFinish(PaintStrokeStore *store, size_t kept, size_t total, PaintLineStyle style, int varying) {
+    
+    const PaintStoredPoint *stored = &store->points[store->pointCount];
+    PaintStoredStroke *stroke      = &store->strokes[store->count];
+    stroke->varying    = (uint8_t)(varying != 0);
+    stroke->widest     = varying ? 0.0f : 1.0f;
+    for (size_t n = 0; varying && n < kept; n++) {
+        stroke->widest = fmaxf(stroke->widest, store->widths[store->pointCount + n]);
+    }
+    if (store->widths && !varying) {
+        for (size_t n = 0; n < kept; n++) {
+            store->widths[store->pointCount + n] = 1.0f;
+        }
+    }
+    stroke->firstPoint = (uint32_t)store->pointCount;
+    stroke->pointCount = (uint32_t)kept;
+    stroke->pointsIn   = (uint32_t)total;
+    stroke->width      = (float)style.width;
+    stroke->alpha      = (float)style.alpha;
+    stroke->bright     = (float)style.bright;
+    stroke->mode       = (int8_t)style.mode;
+    stroke->color      = (int8_t)style.color;
+    stroke->erased     = 0;
+    stroke->bounds     = PaintStrokeBoundsEmpty;
+    for (size_t n = 0; n < kept; n++) {
+        PaintStrokeBounds point = { stored[n].x, stored[n].y, stored[n].x, stored[n].y };
+        stroke->bounds          = PaintStrokeBoundsUnion(stroke->bounds, point);
+    }
+    store->pointCount += kept;
+    store->pointsIn   += total;
+    return (long)store->count++;
+}
+
+long PaintStrokeStoreAdd(PaintStrokeStore *store, const PaintPoint *points, size_t count,
+                         const PaintPoint *tail, size_t tailCount, PaintLineStyle style, double tolerance) {
+    
+    return PaintStrokeStoreAddWidths(store, points, NULL, count, tail, NULL, tailCount, style, tolerance);
+}
+
+long PaintStrokeStoreAddWidths(PaintStrokeStore *store, const PaintPoint *points, const PaintFloat *widths, size_t count,
+                               const PaintPoint *tail, const PaintFloat *tailWidths, size_t tailCount,
+                               PaintLineStyle style, double tolerance) {
+    
+    size_t total = count + tailCount;
+    int varying  = widths && (tailWidths || tailCount == 0);
+    if (PaintStrokeStoreReserve(store, total, varying) != 0) {
+        return -1;
+    }
+    
+    // The polygon goes to the end of the point array and is simplified right there:
+    PaintStoredPoint *stored = &store->points[store->pointCount];
+    for (size_t n = 0; n < total; n++) {
+        PaintPoint p = n < count ? points[n] : tail[n - count];
+        stored[n]    = (PaintStoredPoint){ (float)p.x, (float)p.y };
+    }
+    size_t kept = PaintStrokeStoreSimplify(store, stored, total, tolerance);
+    
+    // The simplifier marked the points it kept:
+    if (varying) {
+        float *factors = &store->widths[store->pointCount];
+        for (size_t n = 0, k = 0; n < total; n++) {
+            if (kept == total || store->keep[n]) {
+                factors[k++] = (float)(n < count ? widths[n] : tailWidths[n - count]);
+            }
+        }
+    }
+    return PaintStrokeStoreFinish(store, kept, total, style, varying);
+}
+
+long PaintStrokeStoreAppend(PaintStrokeStore *store, const PaintStoredPoint *points, size_t count, PaintLineStyle style) {
+    
+    return PaintStrokeStoreAppendWidths(store, points, NULL, count, style);
+}
+
+long PaintStrokeStoreAppendWidths(PaintStrokeStore *store, const PaintStoredPoint *points, const float *widths,
+                                  size_t count, PaintLineStyle style) {
+    
+    if (PaintStrokeStoreReserve(store, count, widths != NULL) != 0) {
+        return -1;
+    }
+    if (count > 0) {
+        memcpy(&store->points[store->pointCount], points, count * sizeof(PaintStoredPoint));
+    }
+    if (count > 0 && widths) {
+        memcpy(&store->widths[store->pointCount], widths, count * sizeof(float));
+    }
+    return PaintStrokeStoreFinish(store, count, count, style, widths != NULL);
+}
+
+void PaintStrokeStoreErase(PaintStrokeStore *store, size_t index) {
+    
+    store->strokes[index].erased = 1;
+}
+
+PaintLineStyle PaintStrokeStoreStyle(const PaintStoredStroke *stroke) {
+    
+    PaintLineStyle style = { .mode   = stroke->mode,
+                             .color  = stroke->color,
+                             .width  = stroke->width,
+                             .alpha  = stroke->alpha,
+                             .bright = stroke->bright };
+    return style;
+}
+
+size_t PaintStrokeStoreStrokeBytes(const PaintStoredStroke *stroke) {
+    
+    return sizeof(PaintStoredStroke) + stroke->pointCount * (sizeof(PaintStoredPoint) + (stroke->varying ? sizeof(float) : 0));
+}
+
+size_t PaintStrokeStoreBytes(const PaintStrokeStore *store) {
+    
+    return store->count * sizeof(PaintStoredStroke)
+         + store->pointCount * (sizeof(PaintStoredPoint) + (store->widths ? sizeof(float) : 0));
+}
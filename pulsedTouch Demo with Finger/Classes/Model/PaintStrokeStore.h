@@ -0,0 +1,135 @@
+//
+//  PaintStrokeStore.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  The committed lines as vectors. When a line goes into the bitmap, its polygon is simplified
+//  within a tolerance and kept here with its style; PaintView paints the bitmap from the store,
+//  so it can be painted again at any time without the touches.
+//
+
+#ifndef PaintStrokeStore_h
+#define PaintStrokeStore_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintSplineKernel.h"
+#include "PaintStrokeEngine.h"
+#include "PaintStrokeIndex.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Points are kept in single precision, that is good to 1/10000 of a point on any screen.
+ */
+typedef struct PaintStoredPoint {
+    float x, y;
+} PaintStoredPoint;
+
+/**
+ *  One stroke. Its points are pointCount entries from firstPoint on in the point array of the
+ *  store; pointsIn is the length of the polygon before simplification. An erased stroke keeps
+ *  its place, so the indices of the others stay valid. A stroke whose width follows the speed
+ *  has a width factor for each point at the same place in the width array.
+ */
+typedef struct PaintStoredStroke {
+    uint32_t          firstPoint;
+    uint32_t          pointCount;
+    uint32_t          pointsIn;
+    float             width, alpha, bright;
+    float             widest;           // Largest width factor, 1 for a constant width
+    PaintStrokeBounds bounds;           // Bounds of the points, without the line width
+    int8_t            mode, color;
+    uint8_t           erased;
+    uint8_t           varying;          // Has width factors
+} PaintStoredStroke;
+
+typedef struct PaintStrokeStore {
+    PaintStoredStroke *strokes;
+    size_t             count;
+    size_t             capacity;
+    PaintStoredPoint  *points;
+    size_t             pointCount;
+    size_t             pointCapacity;
+    size_t             pointsIn;        // All points handed in, before simplification
+    float             *widths;          // Width factors by point, once a stroke has them
+    uint32_t          *stack;           // Scratch space of the simplifier
+    uint8_t           *keep;
+    size_t             scratchCapacity;
+} PaintStrokeStore;
+
+void PaintStrokeStoreInit(PaintStrokeStore *store);
+void PaintStrokeStoreFree(PaintStrokeStore *store);
+
+/**
+ *  Forget all strokes, but keep the memory for the next ones.
+ */
+void PaintStrokeStoreClear(PaintStrokeStore *store);
+
+/**
+ *  Add a committed line: count points followed by tailCount tail points, as the engine hands
+ *  them to lineCommitted. The polygon is simplified with Douglas–Peucker: a point is dropped
+ *  if the polygon without it stays within tolerance points of it. The ends are always kept.
+ *  Returns the index of the stroke, or -1 if the store cannot grow.
+ */
+long PaintStrokeStoreAdd(PaintStrokeStore *store, const PaintPoint *points, size_t count,
+                         const PaintPoint *tail, size_t tailCount, PaintLineStyle style, double tolerance);
+
+/**
+ *  The same for a line whose width follows the speed, with a width factor for each point and
+ *  tail point. The factors between the points kept go along with them. Without widths it is
+ *  PaintStrokeStoreAdd().
+ */
+long PaintStrokeStoreAddWidths(PaintStrokeStore *store, const PaintPoint *points, const PaintFloat *widths, size_t count,
+                               const PaintPoint *tail, const PaintFloat *tailWidths, size_t tailCount,
+                               PaintLineStyle style, double tolerance);
+
+/**
+ *  Add a stroke as it is, without simplifying it, such as one read from a stroke file. Returns
+ *  the index of the stroke, or -1 if the store cannot grow.
+ */
+long PaintStrokeStoreAppend(PaintStrokeStore *store, const PaintStoredPoint *points, size_t count, PaintLineStyle style);
+long PaintStrokeStoreAppendWidths(PaintStrokeStore *store, const PaintStoredPoint *points, const float *widths,
+                                  size_t count, PaintLineStyle style);
+
+/**
+ *  Simplify count points in place with Douglas–Peucker. Returns the number of points kept.
+ */
+size_t PaintStrokeStoreSimplify(PaintStrokeStore *store, PaintStoredPoint *points, size_t count, double tolerance);
+
+/**
+ *  Mark a stroke as erased. Its points stay in the store until it is cleared.
+ */
+void PaintStrokeStoreErase(PaintStrokeStore *store, size_t index);
+
+static inline const PaintStoredStroke *PaintStrokeStoreStroke(const PaintStrokeStore *store, size_t index) {
+    return &store->strokes[index];
+}
+
+static inline const PaintStoredPoint *PaintStrokeStorePoints(const PaintStrokeStore *store, const PaintStoredStroke *stroke) {
+    return &store->points[stroke->firstPoint];
+}
+
+/**
+ *  The width factors of a stroke, NULL for a constant width.
+ */
+static inline const float *PaintStrokeStoreWidths(const PaintStrokeStore *store, const PaintStoredStroke *stroke) {
+    return stroke->varying ? &store->widths[stroke->firstPoint] : NULL;
+}
+
+PaintLineStyle PaintStrokeStoreStyle(const PaintStoredStroke *stroke);
+
+/**
+ *  What one stroke and all strokes take in the store.
+ */
+size_t PaintStrokeStoreStrokeBytes(const PaintStoredStroke *stroke);
+size_t PaintStrokeStoreBytes(const PaintStrokeStore *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokeStore_h */
@@ -0,0 +1,405 @@
+//
+//  PaintStrokeTimeline.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintStrokeTimeline.h"
+#include "PaintTileStore.h"
+
+// Keyframes start with room for this many:
+#define TIMELINE_KEYFRAMES 16
+
+static int PaintTimelineAddKeyframe(PaintStrokeTimeline *timeline) {
+    
+    if (timeline->keyframeCount == timeline->keyframeCapacity) {
+        size_t capacity = timeline->keyframeCapacity ? 2 * timeline->keyframeCapacity : TIMELINE_KEYFRAMES;
+        PaintTimelineKeyframe *keyframes = realloc(timeline->keyframes, capacity * sizeof(PaintTimelineKeyframe));
+        if (!keyframes) {
+            return -1;
+        }
+        timeline->keyframes        = keyframes;
+        timeline->keyframeCapacity = capacity;
+    }
+    size_t tileCount = PaintTileGridCount(&timeline->grid);
+    PaintTimelineKeyframe keyframe = { 0.0, 0, 0, calloc(tileCount + 1, sizeof(uint8_t *)),
+                                       calloc(tileCount + 1, sizeof(size_t)), calloc(tileCount + 1, 1) };
+    if (!keyframe.packed || !keyframe.packedBytes || !keyframe.owned) {
+        free(keyframe.packed);
+        free(keyframe.packedBytes);
+        free(keyframe.owned);
+        return -1;
+    }
+    timeline->keyframes[timeline->keyframeCount++] = keyframe;
+    return 0;
+}
+
+int PaintStrokeTimelineInit(PaintStrokeTimeline *timeline, double width, double height, double tileSize,
+                            double scale, double interval) {
+    
+    memset(timeline, 0, sizeof(PaintStrokeTimeline));
+    PaintStrokeStoreInit(&timeline->store);
+    timeline->interval = interval > 0.0 ? interval : 1.0;
+    timeline->origin   = NAN;
+    timeline->latest   = -INFINITY;
+    if (PaintTileGridInit(&timeline->grid, width, height, tileSize, scale) != 0) {
+        return -1;
+    }
+    size_t tileCount     = PaintTileGridCount(&timeline->grid);
+    size_t tilePixels    = (size_t)ceil(tileSize * scale);
+    timeline->scratch    = calloc(2 * tileCount + 1, sizeof(uint32_t *));
+    timeline->changed    = calloc(tileCount + 1, 1);
+    timeline->packBuffer = malloc(PaintTilePackedMaxBytes(tilePixels * tilePixels));
+    if (!timeline->scratch || !timeline->changed || !timeline->packBuffer) {
+        return -1;
+    }
+    
+    // The canvas before the first stroke, white:
+    if (PaintTimelineAddKeyframe(timeline) != 0) {
+        return -1;
+    }
+    timeline->keyframes[0].time = -INFINITY;
+    return 0;
+}
+
+void PaintStrokeTimelineFree(PaintStrokeTimeline *timeline) {
+    
+    size_t tileCount = PaintTileGridCount(&timeline->grid);
+    for (size_t n = 0; n < timeline->keyframeCount; n++) {
+        PaintTimelineKeyframe *keyframe = &timeline->keyframes[n];
+        for (size_t tile = 0; tile < tileCount; tile++) {
+            if (keyframe->owned[tile]) free(keyframe->packed[tile]);
+        }
+        free(keyframe->packed);
+        free(keyframe->packedBytes);
+        free(keyframe->owned);
+    }
+    free(timeline->keyframes);
+    free(timeline->times);
+    free(timeline->erases);
+    free(timeline->scratch);
+    free(timeline->changed);
+    free(timeline->packBuffer);
+    PaintStrokeStoreFree(&timeline->store);
+    PaintTileGridFree(&timeline->grid);
+    memset(timeline, 0, sizeof(PaintStrokeTimeline));
+}
+
+#pragma mark - Recording
+
+long PaintStrokeTimelineAdd(PaintStrokeTimeline *timeline, const PaintStoredPoint *points, const float *widths,
+                            size_t count, PaintLineStyle style, double start, double end) {
+    
+    if (timeline->store.count == timeline->timesCapacity) {
+        size_t capacity = timeline->timesCapacity ? 2 * timeline->timesCapacity : 256;
+        PaintTimedStroke *times = realloc(timeline->times, capacity * sizeof(PaintTimedStroke));
+        if (!times) {
+            return -1;
+        }
+        timeline->times         = times;
+        timeline->timesCapacity = capacity;
+    }
+    long index = PaintStrokeStoreAppendWidths(&timeline->store, points, widths, count, style);
+    if (index < 0) {
+        return -1;
+    }
+    
+    // The strokes stay in the order of their ends:
+    end   = fmax(end, timeline->latest);
+    start = fmin(start, end);
+    timeline->times[index] = (PaintTimedStroke){ start, end, INFINITY };
+    timeline->latest       = end;
+    if (isnan(timeline->origin)) {
+        timeline->origin = start;
+    }
+    return index;
+}
+
+// Erase one stroke, and widen bounds by what it had painted. Returns whether it was on the canvas:
+
+static int PaintTimelineEraseStroke(PaintStrokeTimeline *timeline, size_t index, double time, PaintStrokeBounds *bounds) {
+    
+    if (index >= timeline->store.count || timeline->times[index].erasedAt != INFINITY) {
+        return 0;
+    }
+    const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&timeline->store, index);
+    timeline->times[index].erasedAt = time;
+    if (stroke->pointCount) {
+        *bounds = PaintStrokeBoundsUnion(*bounds, PaintRasterStrokeReach(stroke, timeline->grid.scale));
+    }
+    return 1;
+}
+
+// Room for one more erase event:
+
+static int PaintTimelineReserveErase(PaintStrokeTimeline *timeline) {
+    
+    if (timeline->eraseCount < timeline->eraseCapacity) {
+        return 0;
+    }
+    size_t capacity = timeline->eraseCapacity ? 2 * timeline->eraseCapacity : 64;
+    PaintTimelineErase *erases = realloc(timeline->erases, capacity * sizeof(PaintTimelineErase));
+    if (!erases) {
+        return -1;
+    }
+    timeline->erases        = erases;
+    timeline->eraseCapacity = capacity;
+    return 0;
+}
+
+static void PaintTimelineAddErase(PaintStrokeTimeline *timeline, double time, PaintStrokeBounds bounds) {
+    
+    timeline->erases[timeline->eraseCount++] = (PaintTimelineErase){ time, bounds };
+    timeline->latest = time;
+}
+
+int PaintStrokeTimelineErase(PaintStrokeTimeline *timeline, const uint32_t *indices, size_t count, double time) {
+    
+    if (PaintTimelineReserveErase(timeline) != 0) {
+        return -1;
+    }
+    time = fmax(time, timeline->latest);
+    PaintStrokeBounds bounds = PaintStrokeBoundsEmpty;
+    int erased               = 0;
+    for (size_t n = 0; n < count; n++) {
+        erased |= PaintTimelineEraseStroke(timeline, indices[n], time, &bounds);
+    }
+    if (erased) {
+        PaintTimelineAddErase(timeline, time, bounds);
+    }
+    return 0;
+}
+
+int PaintStrokeTimelineClear(PaintStrokeTimeline *timeline, double time) {
+    
+    if (PaintTimelineReserveErase(timeline) != 0) {
+        return -1;
+    }
+    time = fmax(time, timeline->latest);
+    PaintStrokeBounds bounds = PaintStrokeBoundsEmpty;
+    int erased               = 0;
+    for (size_t index = 0; index < timeline->store.count; index++) {
+        erased |= PaintTimelineEraseStroke(timeline, index, time, &bounds);
+    }
+    if (erased) {
+        PaintTimelineAddErase(timeline, time, bounds);
+    }
+    return 0;
+}
+
+#pragma mark - Seeking
+
+size_t PaintStrokeTimelineCommitted(const PaintStrokeTimeline *timeline, double time) {
+    
+    size_t low = 0, high = timeline->store.count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (timeline->times[middle].end <= time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+int PaintStrokeTimelineVisible(const PaintStrokeTimeline *timeline, size_t index, double time) {
+    
+    const PaintTimedStroke *times = &timeline->times[index];
+    return times->end <= time && time < times->erasedAt;
+}
+
+static size_t PaintTimelineErasesUntil(const PaintStrokeTimeline *timeline, double time) {
+    
+    size_t low = 0, high = timeline->eraseCount;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (timeline->erases[middle].time <= time) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// The keyframe a seek to time starts from, if all keyframes up to there were made:
+
+static size_t PaintTimelineKeyframeFor(const PaintStrokeTimeline *timeline, double time) {
+    
+    if (isnan(timeline->origin) || !(time >= timeline->origin + timeline->interval)) {
+        return 0;
+    }
+    double last = floor((timeline->latest - timeline->origin) / timeline->interval) + 1.0;
+    return (size_t)fmin(floor((time - timeline->origin) / timeline->interval), last);
+}
+
+static int PaintTimelineUnpack(const PaintStrokeTimeline *timeline, size_t index, uint32_t *const *tiles) {
+    
+    const PaintTimelineKeyframe *keyframe = &timeline->keyframes[index];
+    for (size_t tile = 0; tile < PaintTileGridCount(&timeline->grid); tile++) {
+        if (PaintTileUnpack(keyframe->packed[tile], keyframe->packedBytes[tile], tiles[tile],
+                            PaintTileGridTileBytes(&timeline->grid, tile) / sizeof(uint32_t)) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Tiles which show keyframe index go on to time: the tiles under strokes erased since are
+// painted again from all strokes on the canvas, the others get the strokes committed since
+// over them. Marks the tiles which may have changed.
+
+static int PaintTimelineReplay(PaintStrokeTimeline *timeline, PaintRasterPool *pool, size_t index, double time,
+                               uint32_t *const *tiles) {
+    
+    const PaintTileGrid *grid = &timeline->grid;
+    size_t tileCount = PaintTileGridCount(grid);
+    size_t first     = timeline->keyframes[index].strokes;
+    size_t erases    = timeline->keyframes[index].erases;
+    size_t end       = PaintStrokeTimelineCommitted(timeline, time);
+    size_t lastErase = PaintTimelineErasesUntil(timeline, time);
+    for (size_t n = 0; n < end; n++) {
+        timeline->store.strokes[n].erased = timeline->times[n].erasedAt <= time;
+    }
+    
+    memset(timeline->changed, 0, tileCount);
+    int repaint = 0;
+    for (size_t n = erases; n < lastErase; n++) {
+        PaintStrokeBounds bounds = timeline->erases[n].bounds;
+        size_t c0, r0, c1, r1;
+        if (PaintStrokeBoundsIsEmpty(bounds) ||
+            !PaintTileGridRange(grid, bounds.minX, bounds.minY, bounds.maxX - bounds.minX, bounds.maxY - bounds.minY,
+                                &c0, &r0, &c1, &r1)) continue;
+        
+        for (size_t row = r0; row < r1; row++) {
+            memset(timeline->changed + row * grid->columns + c0, 2, c1 - c0);
+        }
+        repaint = 1;
+    }
+    uint32_t **dirty = timeline->scratch, **clean = timeline->scratch + tileCount;
+    for (size_t tile = 0; tile < tileCount; tile++) {
+        dirty[tile] = timeline->changed[tile] ? tiles[tile] : NULL;
+        clean[tile] = timeline->changed[tile] ? NULL : tiles[tile];
+        if (dirty[tile]) {
+            PaintTileUnpack(NULL, 0, dirty[tile], PaintTileGridTileBytes(grid, tile) / sizeof(uint32_t));
+        }
+    }
+    if ((repaint && PaintRasterizeStrokeRange(pool, &timeline->store, 0, end, grid, dirty) != 0) ||
+        (first < end && PaintRasterizeStrokeRange(pool, &timeline->store, first, end, grid, clean) != 0)) {
+        return -1;
+    }
+    
+    for (size_t n = first; n < end; n++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&timeline->store, n);
+        PaintStrokeBounds bounds        = PaintRasterStrokeReach(stroke, grid->scale);
+        size_t c0, r0, c1, r1;
+        if (stroke->erased || stroke->pointCount < 2 ||
+            !PaintTileGridRange(grid, bounds.minX, bounds.minY, bounds.maxX - bounds.minX, bounds.maxY - bounds.minY,
+                                &c0, &r0, &c1, &r1)) continue;
+        
+        for (size_t row = r0; row < r1; row++) {
+            for (size_t column = c0; column < c1; column++) {
+                timeline->changed[row * grid->columns + column] |= 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// Keep the tiles as the next keyframe at time. A tile which has not changed since the keyframe
+// before, or which comes out the same, shares its bytes:
+
+static void PaintTimelineDropKeyframe(PaintStrokeTimeline *timeline) {
+    
+    PaintTimelineKeyframe *keyframe = &timeline->keyframes[--timeline->keyframeCount];
+    for (size_t tile = 0; tile < PaintTileGridCount(&timeline->grid); tile++) {
+        if (!keyframe->owned[tile]) continue;
+        
+        timeline->keyframeBytes -= keyframe->packedBytes[tile];
+        free(keyframe->packed[tile]);
+    }
+    free(keyframe->packed);
+    free(keyframe->packedBytes);
+    free(keyframe->owned);
+}
+
+static int PaintTimelineSnapshot(PaintStrokeTimeline *timeline, double time, uint32_t *const *tiles) {
+    
+    if (PaintTimelineAddKeyframe(timeline) != 0) {
+        return -1;
+    }
+    const PaintTileGrid *grid           = &timeline->grid;
+    const PaintTimelineKeyframe *before = &timeline->keyframes[timeline->keyframeCount - 2];
+    PaintTimelineKeyframe *keyframe     = &timeline->keyframes[timeline->keyframeCount - 1];
+    keyframe->time    = time;
+    keyframe->strokes = PaintStrokeTimelineCommitted(timeline, time);
+    keyframe->erases  = PaintTimelineErasesUntil(timeline, time);
+    for (size_t tile = 0; tile < PaintTileGridCount(grid); tile++) {
+        keyframe->packed[tile]      = before->packed[tile];
+        keyframe->packedBytes[tile] = before->packedBytes[tile];
+        if (!timeline->changed[tile]) continue;
+        
+        size_t bytes = PaintTilePack(tiles[tile], PaintTileGridTileBytes(grid, tile) / sizeof(uint32_t), timeline->packBuffer);
+        if (bytes == before->packedBytes[tile] &&
+            (bytes == 0 || memcmp(timeline->packBuffer, before->packed[tile], bytes) == 0)) continue;
+        
+        uint8_t *packed = NULL;
+        if (bytes) {
+            if (!(packed = malloc(bytes))) {
+                PaintTimelineDropKeyframe(timeline);
+                return -1;
+            }
+            memcpy(packed, timeline->packBuffer, bytes);
+        }
+        keyframe->packed[tile]      = packed;
+        keyframe->packedBytes[tile] = bytes;
+        keyframe->owned[tile]       = 1;
+        timeline->keyframeBytes    += bytes;
+    }
+    return 0;
+}
+
+int PaintStrokeTimelineSeek(PaintStrokeTimeline *timeline, PaintRasterPool *pool, double time,
+                            uint32_t *const *tiles) {
+    
+    size_t target = PaintTimelineKeyframeFor(timeline, time);
+    size_t held   = SIZE_MAX;
+    
+    // Make the keyframes which are missing, each from the one before, up to the last one which
+    // is older than everything that can still be handed in:
+    while (target >= timeline->keyframeCount) {
+        size_t last = timeline->keyframeCount - 1;
+        double next = timeline->origin + timeline->keyframeCount * timeline->interval;
+        if (!(next < timeline->latest)) break;
+        
+        if (held != last && PaintTimelineUnpack(timeline, last, tiles) != 0) {
+            return -1;
+        }
+        if (PaintTimelineReplay(timeline, pool, last, next, tiles) != 0 ||
+            PaintTimelineSnapshot(timeline, next, tiles) != 0) {
+            return -1;
+        }
+        held = last + 1;
+    }
+    if (target >= timeline->keyframeCount) {
+        target = timeline->keyframeCount - 1;
+    }
+    if (held != target && PaintTimelineUnpack(timeline, target, tiles) != 0) {
+        return -1;
+    }
+    return PaintTimelineReplay(timeline, pool, target, time, tiles);
+}
+
+size_t PaintStrokeTimelineBytes(const PaintStrokeTimeline *timeline) {
+    
+    size_t tileCount = PaintTileGridCount(&timeline->grid);
+    return PaintStrokeStoreBytes(&timeline->store) + timeline->timesCapacity * sizeof(PaintTimedStroke) +
+           timeline->eraseCapacity * sizeof(PaintTimelineErase) + timeline->keyframeBytes +
+           timeline->keyframeCapacity * sizeof(PaintTimelineKeyframe) +
+           timeline->keyframeCount * tileCount * (sizeof(uint8_t *) + sizeof(size_t) + 1);
+}
@@ -0,0 +1,128 @@
+//
+//  PaintStrokeTimeline.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  All strokes of a session with the times they were drawn and erased, so the canvas can be
+//  shown as it was at any time. A stroke is on the canvas from the time it was committed until
+//  it is erased; an erase event keeps what the strokes it took had painted. The strokes keep
+//  the order they were committed in, so the ones committed until a time are found by a binary
+//  search.
+//
+//  Every interval seconds from the first stroke on a keyframe keeps the tiles of the canvas at
+//  that time, packed like the idle tiles of PaintTileStore; a tile nothing happened to since
+//  the keyframe before shares its bytes. Keyframes are made when a seek first needs them, each
+//  from the one before, so the session is painted once. A seek unpacks the nearest keyframe
+//  before the time and paints only the strokes committed since over it; the tiles under the
+//  strokes erased since are painted again from all strokes on the canvas (see paintbench
+//  timeline).
+//
+
+#ifndef PaintStrokeTimeline_h
+#define PaintStrokeTimeline_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintRasterizer.h"
+#include "PaintStrokeStore.h"
+#include "PaintTileGrid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PaintTimedStroke {
+    double start, end;                  // First and last touch, seconds; it is committed at end
+    double erasedAt;                    // INFINITY while it is not erased
+} PaintTimedStroke;
+
+typedef struct PaintTimelineErase {
+    double            time;
+    PaintStrokeBounds bounds;           // What the strokes erased had painted
+} PaintTimelineErase;
+
+typedef struct PaintTimelineKeyframe {
+    double    time;
+    size_t    strokes;                  // Committed until then
+    size_t    erases;                   // Erase events until then
+    uint8_t **packed;                   // By tile, NULL for a white one
+    size_t   *packedBytes;
+    uint8_t  *owned;                    // The bytes are this keyframe's, not shared with the one before
+} PaintTimelineKeyframe;
+
+typedef struct PaintStrokeTimeline {
+    PaintStrokeStore       store;       // All strokes, erased or not
+    PaintTimedStroke      *times;       // By stroke
+    size_t                 timesCapacity;
+    PaintTimelineErase    *erases;
+    size_t                 eraseCount;
+    size_t                 eraseCapacity;
+    PaintTileGrid          grid;
+    double                 interval;    // Seconds between keyframes
+    double                 origin;      // Start of the first stroke, NAN before
+    double                 latest;      // Newest time handed in; older times are taken as this
+    PaintTimelineKeyframe *keyframes;   // The first one is the white canvas before everything
+    size_t                 keyframeCount;
+    size_t                 keyframeCapacity;
+    size_t                 keyframeBytes;  // Packed pixels of all keyframes
+    uint32_t             **scratch;     // Two tile arrays and a mask of the tiles changed
+    uint8_t               *changed;
+    uint8_t               *packBuffer;
+} PaintStrokeTimeline;
+
+/**
+ *  An empty timeline whose canvas is width × height points in tiles of tileSize points, with
+ *  scale pixels per point, and a keyframe every interval seconds. Returns 0, or -1 if there is
+ *  no memory.
+ */
+int  PaintStrokeTimelineInit(PaintStrokeTimeline *timeline, double width, double height, double tileSize,
+                             double scale, double interval);
+void PaintStrokeTimelineFree(PaintStrokeTimeline *timeline);
+
+#pragma mark - Recording
+
+/**
+ *  Add a stroke as it is, drawn from start to end. Returns its index, or -1 if the timeline
+ *  cannot grow.
+ */
+long PaintStrokeTimelineAdd(PaintStrokeTimeline *timeline, const PaintStoredPoint *points, const float *widths,
+                            size_t count, PaintLineStyle style, double start, double end);
+
+/**
+ *  Erase count strokes by their index at time; strokes already erased stay as they were.
+ *  Returns 0, or -1 if the event cannot be kept.
+ */
+int  PaintStrokeTimelineErase(PaintStrokeTimeline *timeline, const uint32_t *indices, size_t count, double time);
+
+/**
+ *  Erase all strokes on the canvas at time. Returns 0 or -1.
+ */
+int  PaintStrokeTimelineClear(PaintStrokeTimeline *timeline, double time);
+
+#pragma mark - Seeking
+
+/**
+ *  The number of strokes committed until time, and whether stroke index is on the canvas then.
+ */
+size_t PaintStrokeTimelineCommitted(const PaintStrokeTimeline *timeline, double time);
+int    PaintStrokeTimelineVisible(const PaintStrokeTimeline *timeline, size_t index, double time);
+
+/**
+ *  Paint the canvas at time into tiles, one buffer for every tile of timeline->grid as for
+ *  PaintRasterizeStrokes(). Keyframes up to time which are missing are made first. The store
+ *  is left with the strokes erased until time marked. Returns 0, or -1 if there is no memory.
+ */
+int PaintStrokeTimelineSeek(PaintStrokeTimeline *timeline, PaintRasterPool *pool, double time,
+                            uint32_t *const *tiles);
+
+/**
+ *  Memory of the timeline: strokes, times, events and keyframes.
+ */
+size_t PaintStrokeTimelineBytes(const PaintStrokeTimeline *timeline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintStrokeTimeline_h */
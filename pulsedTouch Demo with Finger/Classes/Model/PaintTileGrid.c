@@ -0,0 +1,124 @@
+//
+//  PaintTileGrid.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintTileGrid.h"
+
+int PaintTileGridInit(PaintTileGrid *grid, double width, double height, double tileSize, double scale) {
+    
+    memset(grid, 0, sizeof(PaintTileGrid));
+    grid->width    = width;
+    grid->height   = height;
+    grid->tileSize = tileSize;
+    grid->scale    = scale;
+    grid->columns  = (size_t)ceil(width  / tileSize);
+    grid->rows     = (size_t)ceil(height / tileSize);
+    grid->dirty    = malloc(grid->columns * grid->rows + 1);
+    if (!grid->dirty) {
+        return -1;
+    }
+    PaintTileGridMarkAll(grid);
+    return 0;
+}
+
+void PaintTileGridFree(PaintTileGrid *grid) {
+    
+    free(grid->dirty);
+    grid->dirty = NULL;
+}
+
+size_t PaintTileGridCount(const PaintTileGrid *grid) {
+    
+    return grid->columns * grid->rows;
+}
+
+#pragma mark - Geometry
+
+void PaintTileGridTileRect(const PaintTileGrid *grid, size_t index, double *x, double *y, double *w, double *h) {
+    
+    *x = (index % grid->columns) * grid->tileSize;
+    *y = (index / grid->columns) * grid->tileSize;
+    *w = fmin(grid->tileSize, grid->width  - *x);
+    *h = fmin(grid->tileSize, grid->height - *y);
+}
+
+void PaintTileGridTilePixels(const PaintTileGrid *grid, size_t index, size_t *pixelsWide, size_t *pixelsHigh) {
+    
+    double x, y, w, h;
+    PaintTileGridTileRect(grid, index, &x, &y, &w, &h);
+    *pixelsWide = (size_t)ceil(w * grid->scale);
+    *pixelsHigh = (size_t)ceil(h * grid->scale);
+}
+
+size_t PaintTileGridTileBytes(const PaintTileGrid *grid, size_t index) {
+    
+    size_t pixelsWide, pixelsHigh;
+    PaintTileGridTilePixels(grid, index, &pixelsWide, &pixelsHigh);
+    return 4 * pixelsWide * pixelsHigh;
+}
+
+int PaintTileGridRange(const PaintTileGrid *grid, double x, double y, double w, double h,
+                       size_t *c0, size_t *r0, size_t *c1, size_t *r1) {
+    
+    // The negated comparisons also catch NaN and the null rect:
+    double x0 = fmax(x, 0.0), x1 = fmin(x + w, grid->width);
+    double y0 = fmax(y, 0.0), y1 = fmin(y + h, grid->height);
+    if (!(x1 > x0) || !(y1 > y0)) {
+        return 0;
+    }
+    *c0 = (size_t)floor(x0 / grid->tileSize);
+    *r0 = (size_t)floor(y0 / grid->tileSize);
+    *c1 = (size_t)ceil(x1 / grid->tileSize);
+    *r1 = (size_t)ceil(y1 / grid->tileSize);
+    return 1;
+}
+
+#pragma mark - Dirty tiles
+
+size_t PaintTileGridMarkRect(PaintTileGrid *grid, double x, double y, double w, double h) {
+    
+    size_t c0, r0, c1, r1;
+    if (!PaintTileGridRange(grid, x, y, w, h, &c0, &r0, &c1, &r1)) {
+        return 0;
+    }
+    for (size_t row = r0; row < r1; row++) {
+        for (size_t column = c0; column < c1; column++) {
+            uint8_t *flag     = &grid->dirty[row * grid->columns + column];
+            grid->dirtyCount += !*flag;
+            *flag             = 1;
+        }
+    }
+    return (r1 - r0) * (c1 - c0);
+}
+
+void PaintTileGridMarkAll(PaintTileGrid *grid) {
+    
+    memset(grid->dirty, 1, PaintTileGridCount(grid));
+    grid->dirtyCount = PaintTileGridCount(grid);
+}
+
+size_t PaintTileGridNextDirty(const PaintTileGrid *grid, size_t start) {
+    
+    size_t count = PaintTileGridCount(grid);
+    if (grid->dirtyCount == 0) {
+        return count;
+    }
+    const uint8_t *found = start < count ? memchr(grid->dirty + start, 1, count - start) : NULL;
+    return found ? (size_t)(found - grid->dirty) : count;
+}
+
+void PaintTileGridPresented(PaintTileGrid *grid, size_t index) {
+    
+    if (grid->dirty[index]) {
+        grid->dirty[index] = 0;
+        grid->dirtyCount--;
+    }
+    grid->tilesPresented++;
+    grid->bytesPresented += PaintTileGridTileBytes(grid, index);
+}
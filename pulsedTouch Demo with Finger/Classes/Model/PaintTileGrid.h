@@ -0,0 +1,79 @@
+//
+//  PaintTileGrid.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Bookkeeping for the tiled bitmap of PaintView: which tiles a rect touches, which tiles have
+//  changed since they were last presented, and how many bytes presenting them has copied.
+//  Plain C, so the numbers can be checked without a screen (see paintbench tiles).
+//
+
+#ifndef PaintTileGrid_h
+#define PaintTileGrid_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  A canvas of width x height points cut into square tiles of tileSize points. Tiles at the
+ *  right and bottom edge are cut to the canvas. Every pixel takes four bytes.
+ */
+typedef struct PaintTileGrid {
+    double    width, height;
+    double    tileSize;
+    double    scale;                // pixels per point
+    size_t    columns, rows;
+    uint8_t  *dirty;                // one flag per tile, row by row
+    size_t    dirtyCount;
+    uint64_t  tilesPresented;
+    uint64_t  bytesPresented;
+} PaintTileGrid;
+
+/**
+ *  Returns 0 on success and -1 if the flags cannot be allocated. All tiles start dirty.
+ */
+int  PaintTileGridInit(PaintTileGrid *grid, double width, double height, double tileSize, double scale);
+void PaintTileGridFree(PaintTileGrid *grid);
+
+size_t PaintTileGridCount(const PaintTileGrid *grid);
+
+/**
+ *  The rect of a tile in points, and the size of its bitmap in pixels and bytes.
+ */
+void   PaintTileGridTileRect(const PaintTileGrid *grid, size_t index, double *x, double *y, double *w, double *h);
+void   PaintTileGridTilePixels(const PaintTileGrid *grid, size_t index, size_t *pixelsWide, size_t *pixelsHigh);
+size_t PaintTileGridTileBytes(const PaintTileGrid *grid, size_t index);
+
+/**
+ *  The range of tiles a rect touches: columns c0 … c1-1 and rows r0 … r1-1. Returns 0 if the
+ *  rect misses the canvas.
+ */
+int PaintTileGridRange(const PaintTileGrid *grid, double x, double y, double w, double h,
+                       size_t *c0, size_t *r0, size_t *c1, size_t *r1);
+
+/**
+ *  Mark the tiles under a rect, or all tiles, as changed. Returns the number of tiles touched.
+ */
+size_t PaintTileGridMarkRect(PaintTileGrid *grid, double x, double y, double w, double h);
+void   PaintTileGridMarkAll(PaintTileGrid *grid);
+
+/**
+ *  The first dirty tile at or after index start, or PaintTileGridCount() if there is none.
+ */
+size_t PaintTileGridNextDirty(const PaintTileGrid *grid, size_t start);
+
+/**
+ *  The tile has been presented: clear its flag and count its bytes.
+ */
+void PaintTileGridPresented(PaintTileGrid *grid, size_t index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintTileGrid_h */
@@ -0,0 +1,328 @@
+//
+//  PaintTileStore.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "PaintTileStore.h"
+
+static inline size_t PaintTileStorePixelCount(const PaintTileStore *store, size_t index) {
+    
+    return PaintTileGridTileBytes(store->grid, index) / sizeof(uint32_t);
+}
+
+int PaintTileStoreInit(PaintTileStore *store, const PaintTileGrid *grid, size_t budget) {
+    
+    memset(store, 0, sizeof(PaintTileStore));
+    store->grid   = grid;
+    store->budget = budget;
+    store->tiles  = calloc(PaintTileGridCount(grid) + 1, sizeof(PaintTile));
+    return store->tiles ? 0 : -1;
+}
+
+// Free what a tile holds and put it in state. The pixels of a packing tile belong to the other
+// thread until it is done:
+
+static void PaintTileStoreDrop(PaintTileStore *store, size_t index, PaintTileState state) {
+    
+    PaintTile *tile = &store->tiles[index];
+    if (tile->pixels) {
+        store->liveBytes -= PaintTileGridTileBytes(store->grid, index);
+        if (tile->state != PaintTilePacking) {
+            free(tile->pixels);
+        }
+    }
+    if (tile->packed) {
+        store->packedBytes -= tile->packedBytes;
+        free(tile->packed);
+    }
+    tile->pixels      = NULL;
+    tile->packed      = NULL;
+    tile->packedBytes = 0;
+    tile->state       = state;
+}
+
+void PaintTileStoreFree(PaintTileStore *store) {
+    
+    for (size_t index = 0; store->tiles && index < PaintTileGridCount(store->grid); index++) {
+        if (store->tiles[index].state == PaintTilePacking) {
+            store->tiles[index].state = PaintTileLive;
+        }
+        PaintTileStoreDrop(store, index, PaintTileBlank);
+    }
+    free(store->tiles);
+    store->tiles = NULL;
+}
+
+size_t PaintTileStoreBytes(const PaintTileStore *store) {
+    
+    return store->liveBytes + store->packedBytes + PaintTileGridCount(store->grid) * sizeof(PaintTile);
+}
+
+size_t PaintTileStoreCount(const PaintTileStore *store, PaintTileState state) {
+    
+    size_t count = 0;
+    for (size_t index = 0; index < PaintTileGridCount(store->grid); index++) {
+        count += store->tiles[index].state == state;
+    }
+    return count;
+}
+
+#pragma mark - Painting
+
+uint32_t *PaintTileStoreWrite(PaintTileStore *store, size_t index, double now) {
+    
+    PaintTile *tile = &store->tiles[index];
+    size_t count    = PaintTileStorePixelCount(store, index);
+    if (tile->state != PaintTileLive) {
+        uint32_t *pixels = malloc(count * sizeof(uint32_t));
+        if (!pixels) {
+            return NULL;
+        }
+        switch (tile->state) {
+            case PaintTilePacking:
+                memcpy(pixels, tile->pixels, count * sizeof(uint32_t));
+                break;
+            case PaintTilePacked:
+                if (PaintTileUnpack(tile->packed, tile->packedBytes, pixels, count) != 0) {
+                    free(pixels);
+                    return NULL;
+                }
+                store->unpacks++;
+                break;
+            default:
+                PaintTileUnpack(NULL, 0, pixels, count);
+                break;
+        }
+        PaintTileStoreDrop(store, index, PaintTileLive);
+        tile->pixels      = pixels;
+        store->liveBytes += count * sizeof(uint32_t);
+    }
+    tile->touched = now;
+    tile->generation++;
+    return tile->pixels;
+}
+
+const uint32_t *PaintTileStorePixels(const PaintTileStore *store, size_t index) {
+    
+    return store->tiles[index].pixels;
+}
+
+int PaintTileStoreRead(const PaintTileStore *store, size_t index, uint32_t *pixels) {
+    
+    const PaintTile *tile = &store->tiles[index];
+    size_t count          = PaintTileStorePixelCount(store, index);
+    if (tile->pixels) {
+        memcpy(pixels, tile->pixels, count * sizeof(uint32_t));
+        return 0;
+    }
+    return tile->state == PaintTileEvicted ? -1 : PaintTileUnpack(tile->packed, tile->packedBytes, pixels, count);
+}
+
+void PaintTileStoreClear(PaintTileStore *store, size_t index) {
+    
+    PaintTileStoreDrop(store, index, PaintTileBlank);
+    store->tiles[index].generation++;
+}
+
+#pragma mark - Packing
+
+size_t PaintTileStoreIdle(const PaintTileStore *store, double now, double age, size_t *indices, size_t capacity) {
+    
+    size_t count = 0;
+    for (size_t index = 0; index < PaintTileGridCount(store->grid); index++) {
+        const PaintTile *tile = &store->tiles[index];
+        if (tile->state != PaintTileLive || tile->touched > now - age) continue;
+        
+        if (count < capacity) {
+            indices[count] = index;
+        }
+        count++;
+    }
+    return count;
+}
+
+const uint32_t *PaintTileStoreBeginPacking(PaintTileStore *store, size_t index, uint32_t *generation) {
+    
+    PaintTile *tile = &store->tiles[index];
+    if (tile->state != PaintTileLive) {
+        return NULL;
+    }
+    tile->state = PaintTilePacking;
+    *generation = tile->generation;
+    return tile->pixels;
+}
+
+void PaintTileStoreFinishPacking(PaintTileStore *store, size_t index, uint32_t generation, const uint32_t *pixels,
+                                 uint8_t *packed, size_t packedBytes) {
+    
+    PaintTile *tile = &store->tiles[index];
+    if (tile->state != PaintTilePacking || tile->generation != generation) {
+        
+        // Painted into or cleared meanwhile: the pixels it was packed from are no one's now:
+        free((uint32_t *)pixels);
+        free(packed);
+        return;
+    }
+    if (!packed) {
+        tile->state = PaintTileLive;
+        return;
+    }
+    store->liveBytes -= PaintTileGridTileBytes(store->grid, index);
+    free(tile->pixels);
+    tile->pixels = NULL;
+    if (packedBytes == 0) {
+        free(packed);
+        tile->state = PaintTileBlank;
+        return;
+    }
+    
+    // The buffer was sized for the worst case:
+    uint8_t *fitted     = realloc(packed, packedBytes);
+    tile->packed        = fitted ? fitted : packed;
+    tile->packedBytes   = packedBytes;
+    tile->state         = PaintTilePacked;
+    store->packedBytes += packedBytes;
+    store->packs++;
+}
+
+typedef struct PaintTileAge {
+    double touched;
+    size_t index;
+} PaintTileAge;
+
+static int PaintTileCompareAges(const void *a, const void *b) {
+    
+    const PaintTileAge *x = a, *y = b;
+    if (x->touched != y->touched) return x->touched < y->touched ? -1 : 1;
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+size_t PaintTileStoreTrim(PaintTileStore *store, size_t budget) {
+    
+    size_t tileCount = PaintTileGridCount(store->grid);
+    size_t evicted   = 0;
+    PaintTileAge *ages = malloc((tileCount + 1) * sizeof(PaintTileAge));
+    if (!ages) {
+        return 0;
+    }
+    static const PaintTileState order[2] = { PaintTilePacked, PaintTileLive };
+    for (int pass = 0; pass < 2 && store->liveBytes + store->packedBytes > budget; pass++) {
+        size_t count = 0;
+        for (size_t index = 0; index < tileCount; index++) {
+            if (store->tiles[index].state == order[pass]) {
+                ages[count++] = (PaintTileAge){ store->tiles[index].touched, index };
+            }
+        }
+        qsort(ages, count, sizeof(PaintTileAge), PaintTileCompareAges);
+        for (size_t n = 0; n < count && store->liveBytes + store->packedBytes > budget; n++) {
+            PaintTileStoreDrop(store, ages[n].index, PaintTileEvicted);
+            store->tiles[ages[n].index].generation++;
+            store->evictions++;
+            evicted++;
+        }
+    }
+    free(ages);
+    return evicted;
+}
+
+#pragma mark - Codec
+
+// A token is a varint: the low bit tells a run (0) from literal pixels (1), the rest is the
+// number of pixels minus one. A run is followed by its pixel, literals by all of theirs:
+
+static inline uint8_t *PaintTilePutToken(uint8_t *out, size_t count, unsigned literal) {
+    
+    uint64_t token = ((uint64_t)(count - 1) << 1) | literal;
+    while (token >= 0x80) {
+        *out++  = (uint8_t)(token | 0x80);
+        token >>= 7;
+    }
+    *out++ = (uint8_t)token;
+    return out;
+}
+
+size_t PaintTilePackedMaxBytes(size_t count) {
+    
+    // Literals throughout, in one token:
+    return count * sizeof(uint32_t) + 10;
+}
+
+size_t PaintTilePack(const uint32_t *pixels, size_t count, uint8_t *out) {
+    
+    size_t white = 0;
+    while (white < count && pixels[white] == PAINT_TILE_WHITE) {
+        white++;
+    }
+    if (white == count) {
+        return 0;
+    }
+    uint8_t *p = out;
+    size_t n   = 0;
+    while (n < count) {
+        size_t run = 1;
+        while (n + run < count && pixels[n + run] == pixels[n]) {
+            run++;
+        }
+        if (run >= 2) {
+            p = PaintTilePutToken(p, run, 0);
+            memcpy(p, &pixels[n], sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            n += run;
+            continue;
+        }
+        
+        // Literals up to the next two equal pixels:
+        size_t end = n + 1;
+        while (end < count && !(end + 1 < count && pixels[end + 1] == pixels[end])) {
+            end++;
+        }
+        p = PaintTilePutToken(p, end - n, 1);
+        memcpy(p, &pixels[n], (end - n) * sizeof(uint32_t));
+        p += (end - n) * sizeof(uint32_t);
+        n  = end;
+    }
+    return (size_t)(p - out);
+}
+
+int PaintTileUnpack(const uint8_t *packed, size_t length, uint32_t *pixels, size_t count) {
+    
+    if (length == 0) {
+        for (size_t n = 0; n < count; n++) {
+            pixels[n] = PAINT_TILE_WHITE;
+        }
+        return 0;
+    }
+    const uint8_t *p = packed, *end = packed + length;
+    size_t n = 0;
+    while (p < end) {
+        uint64_t token = 0;
+        unsigned shift = 0;
+        do {
+            if (p == end || shift > 63) return -1;
+            token |= (uint64_t)(*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        
+        uint64_t run = (token >> 1) + 1;
+        if (run > count - n) return -1;
+        if (token & 1) {
+            if ((size_t)(end - p) < run * sizeof(uint32_t)) return -1;
+            memcpy(&pixels[n], p, run * sizeof(uint32_t));
+            p += run * sizeof(uint32_t);
+        } else {
+            uint32_t pixel;
+            if ((size_t)(end - p) < sizeof(uint32_t)) return -1;
+            memcpy(&pixel, p, sizeof(uint32_t));
+            p += sizeof(uint32_t);
+            for (uint64_t k = 0; k < run; k++) {
+                pixels[n + k] = pixel;
+            }
+        }
+        n += (size_t)run;
+    }
+    return n == count ? 0 : -1;
+}
@@ -0,0 +1,166 @@
+//
+//  PaintTileStore.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Sparse backing store for the tiles of PaintView. A white tile costs nothing; a tile gets its
+//  pixels when something is painted into it. A tile which has not been painted into for a while
+//  is packed losslessly, on another thread, and a packed tile which turns out to be white again
+//  is dropped. Above its byte budget the store evicts the packed tiles first and then the tiles
+//  idle longest; an evicted tile is painted again from the strokes when it is needed, so no line
+//  is ever lost, only the time to paint it.
+//
+//  Packed pixels are runs: a varint token, then one pixel for a run of equal pixels or the
+//  pixels themselves. The paper and the inside of lines take a few bytes per row, the
+//  antialiased edges stay as they are. Plain C, so the bytes can be counted without a screen
+//  (see paintbench tilestore).
+//
+
+#ifndef PaintTileStore_h
+#define PaintTileStore_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintTileGrid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A white pixel, premultiplied alpha first like the bitmaps of PaintView:
+#define PAINT_TILE_WHITE 0xffffffffu
+
+typedef enum PaintTileState {
+    PaintTileBlank    = 0,              // White, no memory
+    PaintTileLive     = 1,              // Pixels
+    PaintTilePacking  = 2,              // Pixels, which another thread is packing
+    PaintTilePacked   = 3,              // Packed pixels
+    PaintTileEvicted  = 4,              // Nothing, has to be painted again from the strokes
+} PaintTileState;
+
+typedef struct PaintTile {
+    uint32_t *pixels;
+    uint8_t  *packed;
+    size_t    packedBytes;
+    double    touched;                  // When it was last painted into, seconds
+    uint32_t  generation;               // Counts the times it was painted into or cleared
+    uint8_t   state;
+} PaintTile;
+
+typedef struct PaintTileStore {
+    const PaintTileGrid *grid;
+    PaintTile           *tiles;
+    size_t               budget;        // Bytes of pixels and packed pixels
+    size_t               liveBytes;
+    size_t               packedBytes;
+    uint64_t             packs;
+    uint64_t             unpacks;
+    uint64_t             evictions;
+} PaintTileStore;
+
+/**
+ *  A store for the tiles of grid, which has to outlive it. All tiles start blank. Returns 0,
+ *  or -1 if there is no memory.
+ */
+int  PaintTileStoreInit(PaintTileStore *store, const PaintTileGrid *grid, size_t budget);
+
+/**
+ *  Frees all tiles. The other thread has to be done with the tiles which are packing.
+ */
+void PaintTileStoreFree(PaintTileStore *store);
+
+static inline PaintTileState PaintTileStoreState(const PaintTileStore *store, size_t index) {
+    return (PaintTileState)store->tiles[index].state;
+}
+
+/**
+ *  Memory of the store: pixels, packed pixels and bookkeeping.
+ */
+size_t PaintTileStoreBytes(const PaintTileStore *store);
+
+/**
+ *  How many tiles are in state.
+ */
+size_t PaintTileStoreCount(const PaintTileStore *store, PaintTileState state);
+
+#pragma mark - Painting
+
+/**
+ *  The pixels of a tile to paint into, PaintTileGridTilePixels() wide and high without padding.
+ *  A blank or evicted tile comes white, a packed one unpacked; for an evicted tile the caller
+ *  paints the strokes in again. The pixels of a tile which is packing are copied, the other
+ *  thread keeps reading the old ones. now is the time in seconds. Returns NULL if there is no
+ *  memory.
+ */
+uint32_t *PaintTileStoreWrite(PaintTileStore *store, size_t index, double now);
+
+/**
+ *  The pixels of a live or packing tile, NULL for all others. Nothing changes.
+ */
+const uint32_t *PaintTileStorePixels(const PaintTileStore *store, size_t index);
+
+/**
+ *  Copy what a tile shows into pixels. Returns 0, or -1 for an evicted tile.
+ */
+int PaintTileStoreRead(const PaintTileStore *store, size_t index, uint32_t *pixels);
+
+/**
+ *  The tile is white again and frees its memory.
+ */
+void PaintTileStoreClear(PaintTileStore *store, size_t index);
+
+#pragma mark - Packing
+
+/**
+ *  Live tiles not painted into since now - age, up to capacity of them into indices. Returns
+ *  how many there are.
+ */
+size_t PaintTileStoreIdle(const PaintTileStore *store, double now, double age, size_t *indices, size_t capacity);
+
+/**
+ *  Hand the pixels of a live tile to another thread for PaintTilePack(). They stay valid until
+ *  PaintTileStoreFinishPacking() is called for the tile with the generation from here. Returns
+ *  NULL if the tile is not live.
+ */
+const uint32_t *PaintTileStoreBeginPacking(PaintTileStore *store, size_t index, uint32_t *generation);
+
+/**
+ *  Take the packed pixels, which are freed with the tile from now on; 0 bytes means white.
+ *  pixels are the ones from PaintTileStoreBeginPacking(). If the tile was painted into or
+ *  cleared since, both are freed and the tile stays as it is. NULL packed means packing
+ *  failed, the tile is live again.
+ */
+void PaintTileStoreFinishPacking(PaintTileStore *store, size_t index, uint32_t generation, const uint32_t *pixels,
+                                 uint8_t *packed, size_t packedBytes);
+
+/**
+ *  Evict packed tiles, the oldest first, and then live ones, until the store takes at most
+ *  budget bytes of pixels. Tiles which are packing stay. Returns the number of tiles evicted.
+ */
+size_t PaintTileStoreTrim(PaintTileStore *store, size_t budget);
+
+#pragma mark - Codec
+
+/**
+ *  Upper bound of the packed size of count pixels.
+ */
+size_t PaintTilePackedMaxBytes(size_t count);
+
+/**
+ *  Pack count pixels into out, which has room for PaintTilePackedMaxBytes(). Returns the
+ *  number of bytes, 0 if all pixels are white.
+ */
+size_t PaintTilePack(const uint32_t *pixels, size_t count, uint8_t *out);
+
+/**
+ *  Unpack length bytes into count pixels; 0 bytes is white. Returns 0, or -1 if the bytes are
+ *  damaged or are not count pixels.
+ */
+int PaintTileUnpack(const uint8_t *packed, size_t length, uint32_t *pixels, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintTileStore_h */
@@ -0,0 +1,150 @@
+//
+//  PaintTouchColumns.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include "PaintTouchColumns.h"
+
+// The first chunk takes one block of touches, later chunks double up to the maximum:
+#define ARENA_FIRST_CHUNK  4096
+#define ARENA_MAX_CHUNK   65536
+
+struct PaintArenaChunk {
+    PaintArenaChunk *previous;
+    size_t           size;              // Usable bytes after the header
+    size_t           used;
+};
+
+#pragma mark - Arena
+
+void PaintArenaInit(PaintArena *arena) {
+    
+    memset(arena, 0, sizeof(PaintArena));
+}
+
+void *PaintArenaAlloc(PaintArena *arena, size_t bytes) {
+    
+    // Everything is handed out 16 byte aligned, like malloc does:
+    size_t header = (sizeof(PaintArenaChunk) + 15) & ~(size_t)15;
+    bytes         = (bytes + 15) & ~(size_t)15;
+    
+    PaintArenaChunk *chunk = arena->chunk;
+    if (!chunk || chunk->size - chunk->used < bytes) {
+        size_t size = chunk ? 2 * (chunk->size + header) : ARENA_FIRST_CHUNK;
+        size        = size > ARENA_MAX_CHUNK ? ARENA_MAX_CHUNK : size;
+        size        = size < bytes + header ? bytes + header : size;
+        chunk       = malloc(size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->previous       = arena->chunk;
+        chunk->size           = size - header;
+        chunk->used           = 0;
+        arena->chunk          = chunk;
+        arena->chunkCount++;
+        arena->bytesReserved += size;
+    }
+    void *memory  = (char *)chunk + header + chunk->used;
+    chunk->used  += bytes;
+    return memory;
+}
+
+void PaintArenaRelease(PaintArena *arena) {
+    
+    while (arena->chunk) {
+        PaintArenaChunk *previous = arena->chunk->previous;
+        free(arena->chunk);
+        arena->chunk = previous;
+    }
+    PaintArenaInit(arena);
+}
+
+#pragma mark - Columns
+
+void PaintTouchColumnsInit(PaintTouchColumns *columns) {
+    
+    memset(columns, 0, sizeof(PaintTouchColumns));
+}
+
+int PaintTouchColumnsAppend(PaintTouchColumns *columns, const PaintSplineControl *control, int classification) {
+    
+    size_t slot = columns->count % PAINT_TOUCH_BLOCK;
+    if (slot == 0) {
+        
+        // The block table is small, a grown copy leaves the old one behind in the arena:
+        if (columns->blockCount == columns->blockCapacity) {
+            size_t capacity         = columns->blockCapacity ? 2 * columns->blockCapacity : 8;
+            PaintTouchBlock **table = PaintArenaAlloc(&columns->arena, capacity * sizeof(PaintTouchBlock *));
+            if (!table) {
+                return -1;
+            }
+            if (columns->blockCount) {
+                memcpy(table, columns->blocks, columns->blockCount * sizeof(PaintTouchBlock *));
+            }
+            columns->blocks        = table;
+            columns->blockCapacity = capacity;
+        }
+        PaintTouchBlock *block = PaintArenaAlloc(&columns->arena, sizeof(PaintTouchBlock));
+        if (!block) {
+            return -1;
+        }
+        columns->blocks[columns->blockCount++] = block;
+    }
+    PaintTouchBlock *block      = columns->blocks[columns->count / PAINT_TOUCH_BLOCK];
+    block->x[slot]              = control->point.x;
+    block->y[slot]              = control->point.y;
+    block->vx[slot]             = control->velocity.x;
+    block->vy[slot]             = control->velocity.y;
+    block->t[slot]              = control->timestamp;
+    block->classification[slot] = (int8_t)classification;
+    columns->count++;
+    return 0;
+}
+
+PaintSplineControl PaintTouchColumnsControl(const PaintTouchColumns *columns, size_t index) {
+    
+    const PaintTouchBlock *block = columns->blocks[index / PAINT_TOUCH_BLOCK];
+    size_t slot                  = index % PAINT_TOUCH_BLOCK;
+    return (PaintSplineControl){ { block->x[slot],  block->y[slot]  },
+                                 { block->vx[slot], block->vy[slot] },
+                                 block->t[slot] };
+}
+
+int PaintTouchColumnsClassification(const PaintTouchColumns *columns, size_t index) {
+    
+    return columns->blocks[index / PAINT_TOUCH_BLOCK]->classification[index % PAINT_TOUCH_BLOCK];
+}
+
+size_t PaintTouchColumnsSplineControls(const PaintTouchColumns *columns, size_t first, PaintSplineControl *out) {
+    
+    size_t length = 0;
+    for (size_t index = first; index < columns->count; ) {
+        const PaintTouchBlock *block = columns->blocks[index / PAINT_TOUCH_BLOCK];
+        size_t slot = index % PAINT_TOUCH_BLOCK;
+        size_t end  = PAINT_TOUCH_BLOCK;
+        if (end - slot > columns->count - index) {
+            end = slot + columns->count - index;
+        }
+        for (; slot < end; slot++, index++) {
+            if (block->classification[slot] < 3) {
+                out[length].point.x    = block->x[slot];
+                out[length].point.y    = block->y[slot];
+                out[length].velocity.x = block->vx[slot];
+                out[length].velocity.y = block->vy[slot];
+                out[length].timestamp  = block->t[slot];
+                length++;
+            }
+        }
+    }
+    return length;
+}
+
+void PaintTouchColumnsRelease(PaintTouchColumns *columns) {
+    
+    PaintArenaRelease(&columns->arena);
+    PaintTouchColumnsInit(columns);
+}
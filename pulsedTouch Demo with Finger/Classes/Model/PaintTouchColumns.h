@@ -0,0 +1,90 @@
+//
+//  PaintTouchColumns.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  The touches of one line as a structure of arrays: one column each for x, y, vx, vy, the
+//  timestamp and the classification. The columns live in a per-line arena, which grows in
+//  chunks and is released in one shot when the line is committed or erased.
+//
+
+#ifndef PaintTouchColumns_h
+#define PaintTouchColumns_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintSplineKernel.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ *  Bump allocator over a list of chunks. Nothing is freed on its own, PaintArenaRelease()
+ *  frees all chunks at once. The counters tell what the arena has cost.
+ */
+typedef struct PaintArenaChunk PaintArenaChunk;
+
+typedef struct PaintArena {
+    PaintArenaChunk *chunk;             // The newest chunk, allocations come from here
+    size_t           chunkCount;
+    size_t           bytesReserved;     // Sum of all chunk sizes
+} PaintArena;
+
+void  PaintArenaInit(PaintArena *arena);
+void *PaintArenaAlloc(PaintArena *arena, size_t bytes);
+void  PaintArenaRelease(PaintArena *arena);
+
+/**
+ *  Touch columns. They are cut into blocks of PAINT_TOUCH_BLOCK touches, so appending never
+ *  moves what is already there. Touch n is at index n % PAINT_TOUCH_BLOCK of every column in
+ *  block n / PAINT_TOUCH_BLOCK.
+ */
+#define PAINT_TOUCH_BLOCK 64
+
+typedef struct PaintTouchBlock {
+    PaintFloat  x[PAINT_TOUCH_BLOCK], y[PAINT_TOUCH_BLOCK];
+    PaintFloat  vx[PAINT_TOUCH_BLOCK], vy[PAINT_TOUCH_BLOCK];
+    double      t[PAINT_TOUCH_BLOCK];
+    int8_t      classification[PAINT_TOUCH_BLOCK];
+} PaintTouchBlock;
+
+typedef struct PaintTouchColumns {
+    PaintArena        arena;
+    PaintTouchBlock **blocks;
+    size_t            blockCount;
+    size_t            blockCapacity;
+    size_t            count;
+} PaintTouchColumns;
+
+void PaintTouchColumnsInit(PaintTouchColumns *columns);
+
+/**
+ *  Append one touch. Returns 0, or -1 if the arena cannot grow.
+ */
+int  PaintTouchColumnsAppend(PaintTouchColumns *columns, const PaintSplineControl *control, int classification);
+
+/**
+ *  The control point of touch index for the spline, and its classification.
+ */
+PaintSplineControl PaintTouchColumnsControl(const PaintTouchColumns *columns, size_t index);
+int                PaintTouchColumnsClassification(const PaintTouchColumns *columns, size_t index);
+
+/**
+ *  Gather the control points of the touches from index first on the spline is made of,
+ *  skipping palm touches and extrapolated points (classification 3 and up). out needs room
+ *  for count - first controls. Returns the number written.
+ */
+size_t PaintTouchColumnsSplineControls(const PaintTouchColumns *columns, size_t first, PaintSplineControl *out);
+
+/**
+ *  Forget all touches and hand the memory back.
+ */
+void PaintTouchColumnsRelease(PaintTouchColumns *columns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintTouchColumns_h */
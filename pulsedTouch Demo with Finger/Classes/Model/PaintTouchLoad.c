@@ -0,0 +1,342 @@
+//
+//  PaintTouchLoad.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "PaintTouchLoad.h"
+
+typedef enum PaintTouchLoadKind {
+    PaintTouchLoadPen    = 0,
+    PaintTouchLoadFinger = 1,
+    PaintTouchLoadPalm   = 2,
+} PaintTouchLoadKind;
+
+typedef struct PaintTouchLoadLine {
+    uint32_t           lineID;
+    PaintTouchLoadKind kind;
+    int                mode;
+    size_t             length;          // Touches of the line
+    size_t             touched;         // Touches generated so far
+    size_t             increments;
+    double             x0, y0;
+    PaintTouchRecord  *pending;         // The increment being collected
+    size_t             pendingCount;
+    size_t             nextStart;       // Tick at which the slot takes its next line
+    int                active;
+} PaintTouchLoadLine;
+
+typedef struct PaintTouchLoadOutput {
+    PaintTouchRecord *records;
+    size_t            count;
+    size_t            capacity;
+    int               failed;
+} PaintTouchLoadOutput;
+
+PaintTouchLoad PaintTouchLoadDefault(void) {
+    
+    PaintTouchLoad load = {
+        .lines             = 1,
+        .concurrent        = 1,
+        .sampleRate        = 240.0,
+        .lineTouches       = 240,
+        .incrementTouches  = 4,
+        .palmTouches       = 6,
+        .extrapolatedShare = 0.1,
+        .seed              = 1,
+    };
+    return load;
+}
+
+// xorshift32, uniform in [0, 1):
+static double PaintTouchLoadRandom(uint32_t *state) {
+    
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x / 4294967296.0;
+}
+
+static void PaintTouchLoadAppend(PaintTouchLoadOutput *output, const PaintTouchRecord *records, size_t count) {
+    
+    if (output->failed) {
+        return;
+    }
+    if (output->count + count > output->capacity) {
+        size_t capacity = output->capacity ? 2 * output->capacity : 4096;
+        while (capacity < output->count + count) {
+            capacity *= 2;
+        }
+        PaintTouchRecord *grown = realloc(output->records, capacity * sizeof(PaintTouchRecord));
+        if (!grown) {
+            output->failed = 1;
+            return;
+        }
+        output->records  = grown;
+        output->capacity = capacity;
+    }
+    memcpy(output->records + output->count, records, count * sizeof(PaintTouchRecord));
+    output->count += count;
+}
+
+// Handwriting: small loops, drifting slowly back and forth, so even a very long line stays on
+// an iPad screen:
+static void PaintTouchLoadPoint(const PaintTouchLoadLine *line, double t, double *x, double *y) {
+    
+    *x = line->x0 + 300.0 * sin(0.13 * t) + 25.0 * cos(9.0 * t) * (1.0 + 0.3 * sin(1.3 * t));
+    *y = line->y0 +  40.0 * sin(0.05 * t) + 30.0 * sin(9.0 * t);
+}
+
+static PaintTouchRecord PaintTouchLoadTouch(const PaintTouchLoad *load, const PaintTouchLoadLine *line,
+                                            size_t index, double start) {
+    
+    double dt = 1.0 / load->sampleRate, t = index * dt;
+    double x, y, px, py;
+    PaintTouchLoadPoint(line, t, &x, &y);
+    PaintTouchLoadPoint(line, t - dt, &px, &py);
+    
+    PaintTouchRecord record = {
+        .timestamp      = start + t,
+        .x              = (float)x,
+        .y              = (float)y,
+        .vx             = index ? (float)((x - px) / dt) : 0.0f,
+        .vy             = index ? (float)((y - py) / dt) : 0.0f,
+        .lineID         = line->lineID,
+        .classification = line->kind == PaintTouchLoadFinger ? 2 : 1,
+        .phase          = 2,
+        .kind           = PaintTouchRecordTouch | (line->kind == PaintTouchLoadFinger ? PaintTouchRecordFromAnalyzer : 0),
+    };
+    return record;
+}
+
+static void PaintTouchLoadMessage(PaintTouchLoadOutput *output, const PaintTouchLoadLine *line,
+                                  PaintTouchRecordKind kind, double timestamp) {
+    
+    PaintTouchRecord record = {
+        .timestamp      = timestamp,
+        .lineID         = line->lineID,
+        .classification = (int8_t)line->mode,
+        .phase          = 2,
+        .kind           = kind | PaintTouchRecordEndOfGroup,
+    };
+    PaintTouchLoadAppend(output, &record, 1);
+}
+
+static void PaintTouchLoadStart(const PaintTouchLoad *load, PaintTouchLoadLine *line, uint32_t lineID, uint32_t *random) {
+    
+    static const int modes[3] = { 20, 10, 30 };
+    
+    double kind   = PaintTouchLoadRandom(random);
+    double spread = load->lengthSpread * (2.0 * PaintTouchLoadRandom(random) - 1.0);
+    line->lineID     = lineID;
+    line->kind       = kind < load->palmShare ? PaintTouchLoadPalm
+                     : (kind < load->palmShare + load->fingerShare ? PaintTouchLoadFinger : PaintTouchLoadPen);
+    line->mode       = line->kind == PaintTouchLoadFinger ? 9 : modes[lineID % 3];
+    line->length     = (size_t)fmax(1.0, round(load->lineTouches * (1.0 + spread)));
+    line->x0         = 350.0 + 324.0 * PaintTouchLoadRandom(random);
+    line->y0         = 100.0 + 568.0 * PaintTouchLoadRandom(random);
+    line->touched    = 0;
+    line->increments = 0;
+    line->active     = 1;
+    
+    // A palm is rejected with the increment after the one which opened it. The analyzer needs a
+    // first and a last increment for a finger:
+    if (line->kind == PaintTouchLoadPalm) {
+        line->length = load->palmTouches > load->incrementTouches ? load->palmTouches : load->incrementTouches + 1;
+    } else if (line->kind == PaintTouchLoadFinger && line->length < 2 * load->incrementTouches) {
+        line->length = 2 * load->incrementTouches;
+    }
+}
+
+// Hand over the touches collected for the line, like one call of the recognizer or analyzer:
+static void PaintTouchLoadFlush(const PaintTouchLoad *load, PaintTouchLoadLine *line, PaintTouchLoadOutput *output,
+                                double start, uint32_t *random) {
+    
+    int first = line->increments == 0, last = line->touched == line->length;
+    for (size_t n = 0; n < line->pendingCount; n++) {
+        line->pending[n].state = first ? 1 : (last ? 3 : 2);
+    }
+    if (last && line->kind == PaintTouchLoadPalm) {
+        line->pending[line->pendingCount - 1].classification = 3;
+    }
+    
+    // The recognizer adds a point ahead of the line now and then, the analyzer marks it as finger:
+    if (!last && PaintTouchLoadRandom(random) < load->extrapolatedShare) {
+        PaintTouchRecord ahead = PaintTouchLoadTouch(load, line, line->touched, start);
+        ahead.classification   = line->kind == PaintTouchLoadFinger ? 6 : (line->increments % 2 ? 5 : 4);
+        ahead.state            = line->pending[0].state;
+        line->pending[line->pendingCount++] = ahead;
+    }
+    line->pending[line->pendingCount - 1].kind |= PaintTouchRecordEndOfGroup;
+    PaintTouchLoadAppend(output, line->pending, line->pendingCount);
+    double now = line->pending[line->pendingCount - 1].timestamp;
+    line->pendingCount = 0;
+    line->increments++;
+    
+    // Pen lines learn their mode from the second increment on and are ended with it:
+    if (line->kind == PaintTouchLoadPen) {
+        if (line->increments == 2 || (last && line->increments < 2)) {
+            PaintTouchLoadMessage(output, line, PaintTouchRecordPenMode, now);
+        }
+        if (last) {
+            PaintTouchLoadMessage(output, line, PaintTouchRecordLineEnded, now);
+        }
+    }
+}
+
+PaintTouchRecord *PaintTouchLoadGenerate(const PaintTouchLoad *load, size_t *count) {
+    
+    *count = 0;
+    size_t concurrent = load->concurrent ? load->concurrent : 1;
+    size_t increment  = load->incrementTouches ? load->incrementTouches : 1;
+    if (load->lines == 0 || !(load->sampleRate > 0.0)) {
+        return NULL;
+    }
+    PaintTouchLoadLine *lines = calloc(concurrent, sizeof(PaintTouchLoadLine));
+    PaintTouchRecord *pending = calloc(concurrent * (increment + 1), sizeof(PaintTouchRecord));
+    PaintTouchLoadOutput output = { 0 };
+    if (!lines || !pending) {
+        free(lines);
+        free(pending);
+        return NULL;
+    }
+    
+    // The slots start one tick apart, so their increments do not all come at once:
+    uint32_t random = load->seed ? load->seed : 1;
+    for (size_t s = 0; s < concurrent; s++) {
+        lines[s].pending   = pending + s * (increment + 1);
+        lines[s].nextStart = s % increment;
+    }
+    PaintTouchLoad adjusted = *load;
+    adjusted.incrementTouches = increment;
+    
+    size_t started = 0, active = 0;
+    for (size_t tick = 0; (started < load->lines || active > 0) && !output.failed; tick++) {
+        for (size_t s = 0; s < concurrent; s++) {
+            PaintTouchLoadLine *line = &lines[s];
+            if (!line->active) {
+                if (started == load->lines || tick < line->nextStart) continue;
+                
+                PaintTouchLoadStart(&adjusted, line, (uint32_t)started++, &random);
+                line->nextStart = tick;
+                active++;
+            }
+            
+            // Every line starts at 1 s plus the tick it started at:
+            double start = 1.0 + line->nextStart / load->sampleRate;
+            line->pending[line->pendingCount++] = PaintTouchLoadTouch(&adjusted, line, line->touched++, start);
+            if (line->pendingCount == increment || line->touched == line->length) {
+                PaintTouchLoadFlush(&adjusted, line, &output, start, &random);
+            }
+            if (line->touched == line->length) {
+                line->active    = 0;
+                line->nextStart = tick + 1;
+                active--;
+            }
+        }
+    }
+    free(pending);
+    free(lines);
+    if (output.failed) {
+        free(output.records);
+        return NULL;
+    }
+    *count = output.count;
+    return output.records;
+}
+
+#pragma mark - Feeding the engine
+
+static PaintStrokeTouch PaintTouchLoadStrokeTouch(const PaintTouchRecord *record) {
+    
+    PaintStrokeTouch touch;
+    touch.control.point.x    = record->x;
+    touch.control.point.y    = record->y;
+    touch.control.velocity.x = record->vx;
+    touch.control.velocity.y = record->vy;
+    touch.control.timestamp  = record->timestamp;
+    touch.classification     = record->classification;
+    touch.state              = record->state;
+    return touch;
+}
+
+// Does the record continue the group of the one before? Recordings of version 1 have no group
+// marks, there a group is a run of touches of the same line:
+static int PaintTouchLoadSameGroup(const PaintTouchRecord *first, const PaintTouchRecord *previous,
+                                   const PaintTouchRecord *record) {
+    
+    if (previous->kind & PaintTouchRecordEndOfGroup) return 0;
+    if ((record->kind ^ first->kind) & ~PaintTouchRecordEndOfGroup) return 0;
+    return (first->kind & PaintTouchRecordKindMask) != PaintTouchRecordTouch || record->lineID == first->lineID;
+}
+
+// Feed the engine, or the pipeline if there is one:
+static size_t PaintTouchLoadFeedTo(PaintStrokeEngine *engine, PaintStrokePipeline *pipeline,
+                                   const PaintTouchRecord *records, size_t count) {
+    
+    PaintStrokeTouch *touches     = malloc((count ? count : 1) * sizeof(PaintStrokeTouch));
+    PaintStrokeModeChange *events = malloc((count ? count : 1) * sizeof(PaintStrokeModeChange));
+    size_t groups                 = 0;
+    if (!touches || !events) {
+        free(touches);
+        free(events);
+        return 0;
+    }
+    for (size_t n = 0; n < count; groups++) {
+        const PaintTouchRecord *first = &records[n];
+        size_t length = 0;
+        do {
+            touches[length] = PaintTouchLoadStrokeTouch(&records[n]);
+            events[length]  = (PaintStrokeModeChange){ records[n].lineID, records[n].classification };
+            length++;
+            n++;
+        } while (n < count && PaintTouchLoadSameGroup(first, &records[n - 1], &records[n]));
+        
+        PaintStrokeSource source = (first->kind & PaintTouchRecordFromAnalyzer) ? PaintStrokeFromAnalyzer
+                                                                                 : PaintStrokeFromRecognizer;
+        switch (first->kind & PaintTouchRecordKindMask) {
+            case PaintTouchRecordTouch:
+                if (pipeline) {
+                    PaintStrokePipelineIncrement(pipeline, first->lineID, touches, length, source);
+                } else {
+                    PaintStrokeEngineIncrement(engine, first->lineID, touches, length, source);
+                }
+                break;
+            
+            case PaintTouchRecordPenMode:
+                if (pipeline) {
+                    PaintStrokePipelineApplyPenModes(pipeline, events, length);
+                } else {
+                    PaintStrokeEngineApplyPenModes(engine, events, length);
+                }
+                break;
+            
+            case PaintTouchRecordLineEnded:
+                if (pipeline) {
+                    PaintStrokePipelineEndLines(pipeline, events, length);
+                } else {
+                    PaintStrokeEngineEndLines(engine, events, length);
+                }
+                break;
+        }
+    }
+    free(events);
+    free(touches);
+    return groups;
+}
+
+size_t PaintTouchLoadFeed(PaintStrokeEngine *engine, const PaintTouchRecord *records, size_t count) {
+    
+    return PaintTouchLoadFeedTo(engine, NULL, records, count);
+}
+
+size_t PaintTouchLoadFeedPipeline(PaintStrokePipeline *pipeline, const PaintTouchRecord *records, size_t count) {
+    
+    return PaintTouchLoadFeedTo(NULL, pipeline, records, count);
+}
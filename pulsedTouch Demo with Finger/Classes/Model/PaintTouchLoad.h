@@ -0,0 +1,73 @@
+//
+//  PaintTouchLoad.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Synthetic touch streams for putting the line handling under a known load. The generator
+//  writes what DetailViewController receives through SID_linesChangedClass: and
+//  handleTouchEnded: as touch records, in the format of the touch recorder: pen lines in all
+//  modes with their pen mode and line ended messages, finger lines from the analyzer, palm
+//  lines the recognizer rejects, and extrapolated points. PaintTouchLoadFeed() hands records
+//  to the stroke engine the way the controller does, so a generated stream and a recording
+//  run through the same code (see paintbench load and paintreplay).
+//
+
+#ifndef PaintTouchLoad_h
+#define PaintTouchLoad_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "PaintStrokeEngine.h"
+#include "PaintStrokePipeline.h"
+#include "PaintTouchRecorder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct PaintTouchLoad {
+    size_t   lines;                 // Lines in all
+    size_t   concurrent;            // Lines drawn at the same time
+    double   sampleRate;            // Touches per second of each line: 60, 120 or 240
+    size_t   lineTouches;           // Touches of a line, on average
+    double   lengthSpread;          // Lines are up to this share shorter or longer
+    size_t   incrementTouches;      // Touches handed over at once
+    double   fingerShare;           // Share of finger lines, from the analyzer
+    double   palmShare;             // Share of lines the recognizer rejects as palm
+    size_t   palmTouches;           // Touches of a palm line before it is rejected
+    double   extrapolatedShare;     // Share of increments which end with an extrapolated point
+    uint32_t seed;
+} PaintTouchLoad;
+
+/**
+ *  One pen line of 240 touches at a time at 240 Hz, in increments of 4 touches, and a few
+ *  extrapolated points.
+ */
+PaintTouchLoad PaintTouchLoadDefault(void);
+
+/**
+ *  Generate the stream. Returns the records, to be freed by the caller, and their number in
+ *  count; NULL if there is no memory. The same load and seed always give the same stream.
+ */
+PaintTouchRecord *PaintTouchLoadGenerate(const PaintTouchLoad *load, size_t *count);
+
+/**
+ *  Hand count records to the engine like DetailViewController: each increment goes to
+ *  PaintStrokeEngineIncrement(), each pen mode and line ended message to
+ *  PaintStrokeEngineApplyPenModes() and PaintStrokeEngineEndLines(). Returns the number of
+ *  groups fed, or 0 if there is no memory for them.
+ */
+size_t PaintTouchLoadFeed(PaintStrokeEngine *engine, const PaintTouchRecord *records, size_t count);
+
+/**
+ *  The same through the worker of the pipeline. The records are queued, not yet handled; see
+ *  PaintStrokePipelineFlush().
+ */
+size_t PaintTouchLoadFeedPipeline(PaintStrokePipeline *pipeline, const PaintTouchRecord *records, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintTouchLoad_h */
@@ -0,0 +1,172 @@
+//
+//  PaintTouchRecorder.c
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "PaintTouchRecorder.h"
+
+// How long the writer sleeps when the ring is empty:
+#define WRITER_IDLE_NS 5000000L
+
+struct PaintTouchRecorder {
+    PaintTouchRecord *ring;
+    size_t            mask;         // capacity - 1, the capacity is a power of two
+    size_t            head;         // next slot to fill, written by the producer only
+    size_t            tail;         // next slot to write out, written by the writer only
+    size_t            dropped;
+    int               stop;
+    int               failed;
+    FILE             *file;
+    pthread_t         writer;
+};
+
+#pragma mark - Writer thread
+
+// Write the records between tail and head. The range can wrap around the end of the ring:
+
+static size_t PaintTouchRecorderDrain(PaintTouchRecorder *recorder) {
+    
+    size_t head  = __atomic_load_n(&recorder->head, __ATOMIC_ACQUIRE);
+    size_t tail  = recorder->tail;
+    size_t count = head - tail;
+    
+    while (tail != head) {
+        size_t start = tail & recorder->mask;
+        size_t chunk = head - tail;
+        if (start + chunk > recorder->mask + 1) {
+            chunk = recorder->mask + 1 - start;
+        }
+        if (fwrite(recorder->ring + start, sizeof(PaintTouchRecord), chunk, recorder->file) != chunk) {
+            recorder->failed = 1;
+        }
+        tail += chunk;
+        __atomic_store_n(&recorder->tail, tail, __ATOMIC_RELEASE);
+    }
+    if (count > 0 && fflush(recorder->file) != 0) {
+        recorder->failed = 1;
+    }
+    return count;
+}
+
+static void *PaintTouchRecorderWriter(void *context) {
+    
+    PaintTouchRecorder *recorder = context;
+    struct timespec idle         = { 0, WRITER_IDLE_NS };
+    
+    for (;;) {
+        int stop = __atomic_load_n(&recorder->stop, __ATOMIC_ACQUIRE);
+        if (PaintTouchRecorderDrain(recorder) == 0) {
+            if (stop) break;
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+#pragma mark - Recording
+
+PaintTouchRecorder *PaintTouchRecorderOpen(const char *path, size_t capacity) {
+    
+    PaintTouchRecorder *recorder = calloc(1, sizeof(PaintTouchRecorder));
+    if (!recorder) {
+        return NULL;
+    }
+    size_t size = 64;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    recorder->mask = size - 1;
+    recorder->ring = malloc(size * sizeof(PaintTouchRecord));
+    recorder->file = fopen(path, "wb");
+    
+    PaintTouchRecordHeader header = { .version = PAINT_TOUCH_RECORD_VERSION, .recordSize = sizeof(PaintTouchRecord) };
+    memcpy(header.magic, PAINT_TOUCH_RECORD_MAGIC, sizeof(header.magic));
+    
+    int error = 0;
+    if (!recorder->ring || !recorder->file) {
+        error = recorder->ring ? errno : ENOMEM;
+    } else if (fwrite(&header, sizeof(header), 1, recorder->file) != 1) {
+        error = errno ? errno : EIO;
+    } else {
+        error = pthread_create(&recorder->writer, NULL, PaintTouchRecorderWriter, recorder);
+    }
+    if (error) {
+        if (recorder->file) fclose(recorder->file);
+        free(recorder->ring);
+        free(recorder);
+        errno = error;
+        return NULL;
+    }
+    return recorder;
+}
+
+size_t PaintTouchRecorderAppend(PaintTouchRecorder *recorder, const PaintTouchRecord *records, size_t count) {
+    
+    size_t head  = recorder->head;
+    size_t tail  = __atomic_load_n(&recorder->tail, __ATOMIC_ACQUIRE);
+    size_t space = recorder->mask + 1 - (head - tail);
+    size_t taken = count < space ? count : space;
+    
+    for (size_t n = 0; n < taken; n++) {
+        recorder->ring[(head + n) & recorder->mask] = records[n];
+    }
+    __atomic_store_n(&recorder->head, head + taken, __ATOMIC_RELEASE);
+    
+    if (taken < count) {
+        __atomic_fetch_add(&recorder->dropped, count - taken, __ATOMIC_RELAXED);
+    }
+    return taken;
+}
+
+size_t PaintTouchRecorderDropped(PaintTouchRecorder *recorder) {
+    
+    return __atomic_load_n(&recorder->dropped, __ATOMIC_RELAXED);
+}
+
+int PaintTouchRecorderClose(PaintTouchRecorder *recorder) {
+    
+    if (!recorder) {
+        return 0;
+    }
+    __atomic_store_n(&recorder->stop, 1, __ATOMIC_RELEASE);
+    pthread_join(recorder->writer, NULL);
+    
+    int result = recorder->failed ? -1 : 0;
+    if (fclose(recorder->file) != 0) {
+        result = -1;
+    }
+    free(recorder->ring);
+    free(recorder);
+    return result;
+}
+
+#pragma mark - Reading
+
+FILE *PaintTouchRecordOpen(const char *path) {
+    
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    PaintTouchRecordHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+        || memcmp(header.magic, PAINT_TOUCH_RECORD_MAGIC, sizeof(header.magic)) != 0
+        || header.version > PAINT_TOUCH_RECORD_VERSION
+        || header.recordSize != sizeof(PaintTouchRecord)) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+size_t PaintTouchRecordRead(FILE *file, PaintTouchRecord *records, size_t max) {
+    
+    return fread(records, sizeof(PaintTouchRecord), max, file);
+}
@@ -0,0 +1,117 @@
+//
+//  PaintTouchRecorder.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+//  Binary touch protocol. The drawing code appends fixed size records to a lock-free ring
+//  buffer, a background thread writes them to disk in chunks. Memory use stays constant no
+//  matter how long the recording runs, and the touch path does no formatting at all.
+//  Tools/touchlog2txt.c turns a recording back into the old text protocol.
+//
+
+#ifndef PaintTouchRecorder_h
+#define PaintTouchRecorder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PAINT_TOUCH_RECORD_MAGIC   "PTRC"
+#define PAINT_TOUCH_RECORD_VERSION 2
+
+/**
+ *  What a record describes, in the low four bits of kind. Pen mode and line ended records
+ *  carry the mode of the notification in classification. Version 1 only knew touches.
+ */
+typedef enum PaintTouchRecordKind {
+    PaintTouchRecordTouch     = 0,
+    PaintTouchRecordPenMode   = 1,
+    PaintTouchRecordLineEnded = 2,
+} PaintTouchRecordKind;
+
+/**
+ *  Flags in the high bits of kind. The last record of an increment or of a notification is
+ *  marked, so a replay can cut the stream exactly the way the app received it.
+ */
+enum {
+    PaintTouchRecordKindMask     = 0x0f,
+    PaintTouchRecordEndOfGroup   = 0x10,
+    PaintTouchRecordFromAnalyzer = 0x20,
+};
+
+/**
+ *  One touch or event as it is stored on disk, 32 bytes in host byte order (little endian on
+ *  every platform the app runs on). The phase is the state of the gesture recognizer at the
+ *  time of recording, which the old text protocol used to pick its wording.
+ */
+typedef struct PaintTouchRecord {
+    double   timestamp;
+    float    x, y;
+    float    vx, vy;
+    uint32_t lineID;
+    int8_t   classification;
+    int8_t   state;
+    int8_t   phase;
+    uint8_t  kind;
+} PaintTouchRecord;
+
+/**
+ *  The file starts with this header, followed by the records.
+ */
+typedef struct PaintTouchRecordHeader {
+    char     magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+} PaintTouchRecordHeader;
+
+typedef struct PaintTouchRecorder PaintTouchRecorder;
+
+/**
+ *  Create the file at path, write the header and start the writer thread. The ring buffer
+ *  takes capacity records, rounded up to a power of two. Returns NULL with errno set if the
+ *  file cannot be created.
+ */
+PaintTouchRecorder *PaintTouchRecorderOpen(const char *path, size_t capacity);
+
+/**
+ *  Append records to the ring buffer. Only one thread may append. Never blocks: if the writer
+ *  falls behind and the ring is full, the records which do not fit are dropped and counted.
+ *  Returns the number of records taken.
+ */
+size_t PaintTouchRecorderAppend(PaintTouchRecorder *recorder, const PaintTouchRecord *records, size_t count);
+
+/**
+ *  Records lost because the ring buffer was full.
+ */
+size_t PaintTouchRecorderDropped(PaintTouchRecorder *recorder);
+
+/**
+ *  Write everything still in the ring, stop the writer thread, close the file and free the
+ *  recorder. Returns 0 on success and -1 if a write failed.
+ */
+int PaintTouchRecorderClose(PaintTouchRecorder *recorder);
+
+#pragma mark - Reading
+
+/**
+ *  Open a recording and check its header. Returns NULL if the file is missing or no recording.
+ */
+FILE *PaintTouchRecordOpen(const char *path);
+
+/**
+ *  Read up to max records. Returns the number read, 0 at the end of the file.
+ */
+size_t PaintTouchRecordRead(FILE *file, PaintTouchRecord *records, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PaintTouchRecorder_h */
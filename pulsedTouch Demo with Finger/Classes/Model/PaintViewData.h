@@ -21,6 +21,14 @@
 @property (assign, nonatomic) CGFloat    minLineWidth;
 @property (assign, nonatomic) CGFloat    maxLineWidth;
 @property (assign, nonatomic) NSUInteger maxSplinePoints;
+@property (assign, nonatomic) CGFloat    splineTolerance;    // Max spline deviation in pixels, 0: by speed
+@property (assign, nonatomic) CGFloat    strokeTolerance;    // Max deviation of stored strokes in pixels
+@property (assign, nonatomic) NSUInteger predictor;          // Motion predictor of the line tail, see PaintPredictor.h; 0: off
+@property (assign, nonatomic) CGFloat    predictionLead;     // How far ahead of the newest touch it predicts, in ms
+@property (assign, nonatomic) NSUInteger tileBudget;         // Bytes the bitmap tiles may take, see PaintTileStore.h
+@property (assign, nonatomic) CGFloat    tileIdleTime;       // Seconds before a tile not painted into is packed
+@property (assign, nonatomic) CGFloat    keyframeInterval;   // Seconds between keyframes of the stroke timeline
+@property (assign, nonatomic) BOOL       diagnostics;        // Log the performance reports at each erase
 
 - (instancetype) init;
 
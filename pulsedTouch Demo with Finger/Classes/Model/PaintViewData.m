@@ -18,6 +18,14 @@
         _minLineWidth    =  0.5;
         _maxLineWidth    =  2.0;
         _maxSplinePoints =  5;
+        _splineTolerance =  0.5;
+        _strokeTolerance =  0.5;
+        _predictor       =  0;
+        _predictionLead  = 16.0;
+        _tileBudget      =  8 << 20;
+        _tileIdleTime    =  2.0;
+        _keyframeInterval = 30.0;
+        _diagnostics     =  NO;
         _rectDisplay     = YES;
         _touchAnalyzer   =  NO;
         _v8tRec          =   1;
@@ -8,6 +8,8 @@
 
 #import <Foundation/Foundation.h>
 #import "SID_PulsedTouchRecognizer/SID_Touch.h"
+#import "PaintSplineKernel.h"
+#import "PaintStrokeEngine.h"
 
 @interface PaintViewLine : NSObject
 /**
@@ -20,7 +22,6 @@
  */
 @property (assign, nonatomic) NSInteger  mode;               // Which pattern has been detected?
 @property (assign, nonatomic) NSUInteger length;             // How many points are there so far?
-@property (strong, nonatomic) NSMutableArray *touches;       // Constituents of the line.
 
 // These variables can be set with the control subview,
 @property (assign, nonatomic) CGFloat    width;
@@ -31,6 +32,11 @@
 - (instancetype) init;
 - (instancetype) initWithIncrement:(NSArray *)increment andLine:(PaintViewLine *)line;
 - (void) addIncrement:(NSArray *)increment;
+- (const PaintTouchColumns *) touchColumns; // Constituents of the line, as columns of numbers
+- (void) releaseTouches;                    // Hand the touch memory back in one go
 - (void) copyToLine:(PaintViewLine *)line;
+- (PaintSplineStream *) splineStream;       // Spline state of the line, fed by PaintSplines
+- (PaintLineStyle) style;                   // Mode, color, width, alpha and brightness for PaintStrokeEngine
+- (void) setStyle:(PaintLineStyle)style;
 
 @end
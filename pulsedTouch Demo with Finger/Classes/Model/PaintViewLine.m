@@ -8,19 +8,26 @@
 
 #import "PaintViewLine.h"
 
+@interface PaintViewLine () {
+    PaintSplineStream stream;
+    PaintTouchColumns touches;
+}
+@end
+
 @implementation PaintViewLine
 
 - (instancetype) init {
     
     self = [super init];
     if (self) {
-        self.touches = nil;
         _length      = 0;
         _mode        = 2;
         _width       = 5;
         _alphaValue  = 1.0;
         _bright      = 0.8;
         _color       = 1;
+        PaintSplineStreamInit(&stream);
+        PaintTouchColumnsInit(&touches);
     }
     return self;
 }
@@ -29,8 +36,9 @@
     
     self = [super init];
     if (self) {
-        self.touches = [[NSMutableArray alloc] initWithArray:increment];
-        _length      = [increment count];
+        PaintSplineStreamInit(&stream);
+        PaintTouchColumnsInit(&touches);
+        [self addIncrement:increment];
     }
     
     // If the supplied sample line exists, inherit its characteristics:
@@ -52,12 +60,30 @@
     return self;
 }
 
+// Only the numbers are copied, the touch objects and their strings are not retained:
+
 - (void) addIncrement:(NSArray *)increment {
     
-    [self.touches addObjectsFromArray:increment];
+    for (SID_Touch *touch in increment) {
+        PaintSplineControl control = { { touch.point.x,    touch.point.y    },
+                                       { touch.velocity.x, touch.velocity.y },
+                                       touch.timestamp };
+        PaintTouchColumnsAppend(&touches, &control, (int)touch.classification);
+    }
     self.length += [increment count];
 }
 
+- (const PaintTouchColumns *) touchColumns {
+    
+    return &touches;
+}
+
+- (void) releaseTouches {
+    
+    PaintTouchColumnsRelease(&touches);
+    self.length = 0;
+}
+
 // Copy all parameters over to another line, except for the actual touch points:
 
 - (void) copyToLine:(PaintViewLine *)line {
@@ -69,4 +95,35 @@
     line.color      = self.color;
 }
 
+- (PaintLineStyle) style {
+    
+    PaintLineStyle style = { .mode   = (int)_mode,
+                             .color  = (int)_color,
+                             .width  = _width,
+                             .alpha  = _alphaValue,
+                             .bright = _bright };
+    return style;
+}
+
+- (void) setStyle:(PaintLineStyle)style {
+    
+    _mode       = style.mode;
+    _color      = style.color;
+    _width      = style.width;
+    _alphaValue = style.alpha;
+    _bright     = style.bright;
+}
+
+- (PaintSplineStream *) splineStream {
+    
+    return &stream;
+}
+
+#pragma mark - Cleanup
+
+- (void) dealloc {
+    
+    PaintTouchColumnsRelease(&touches);
+}
+
 @end
@@ -0,0 +1,51 @@
+//
+//  PaintStrokeLayer.h
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#import <UIKit/UIKit.h>
+
+/**
+ *  Layer for a line which is still being drawn. The stable part of the line is split into
+ *  segments of at most segmentLength points, each in its own CAShapeLayer. Only the open
+ *  segment at the end gets a new path when points arrive, together with the speculative tail,
+ *  so an increment costs the same no matter how long the line is.
+ *
+ *  The segments are drawn opaque and the alpha of the stroke color becomes the opacity of this
+ *  layer. This way the overlap between two segments does not show in translucent lines.
+ *
+ *  A line whose width follows the speed comes with a width factor for each point. Its segments
+ *  are filled outlines from PaintStrokeOutline instead of stroked paths; the outline of the
+ *  open segment grows with the points, only the tail and the caps are new with every increment.
+ */
+@interface PaintStrokeLayer : CALayer
+
+@property (assign, nonatomic) CGColorRef strokeColor;
+@property (assign, nonatomic) CGFloat    lineWidth;
+@property (copy,   nonatomic) NSString   *lineCap;
+@property (copy,   nonatomic) NSString   *lineJoin;
+
+@property (readonly, nonatomic) NSUInteger pointCount;      // stable points so far
+@property (readonly, nonatomic) BOOL       variableWidth;   // points came with width factors
+@property (readonly, nonatomic) CGRect     strokeBounds;    // bounds of all points including the tail
+
++ (NSUInteger) segmentLength;
+
+/**
+ *  Append stable points and replace the tail. Returns the rect which changed, i.e. the new points
+ *  and the old and new tail.
+ */
+- (CGRect) appendPoints:(const CGPoint *)points count:(NSUInteger)count
+               withTail:(const CGPoint *)tail count:(NSUInteger)tailCount;
+
+/**
+ *  The same with a factor of lineWidth for each point and tail point. The first points decide
+ *  whether the line has a variable width.
+ */
+- (CGRect) appendPoints:(const CGPoint *)points widths:(const CGFloat *)widths count:(NSUInteger)count
+               withTail:(const CGPoint *)tail widths:(const CGFloat *)tailWidths count:(NSUInteger)tailCount;
+- (CGMutablePathRef) createPath CF_RETURNS_RETAINED;        // stable points plus tail
+
+@end
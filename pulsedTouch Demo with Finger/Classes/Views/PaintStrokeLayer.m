@@ -0,0 +1,344 @@
+//
+//  PaintStrokeLayer.m
+//  PulsedTouch Demo with Finger
+//
+//  Copyright (c) 2015 STABILO digital. All rights reserved.
+//
+
+#import "PaintStrokeLayer.h"
+#import "PaintStrokeOutline.h"
+
+// Points per segment. Two consecutive segments share one line piece, so the round join between
+// them is drawn by the later segment:
+#define SEGMENT_LENGTH 128
+
+// Maximum deviation of the round joins and caps of outlines, in pixels:
+#define OUTLINE_TOLERANCE 0.25
+
+@interface PaintStrokeLayer () {
+    CGPoint      *points;           // All stable points of the line
+    NSUInteger    capacity;
+    NSUInteger    openStart;        // Index of the first point of the open segment
+    CGPoint      *tail;             // Speculative points after the stable ones
+    NSUInteger    tailCount;
+    NSUInteger    tailCapacity;
+    CGRect        stableBounds;
+    CGRect        tailBounds;
+    CAShapeLayer *openSegment;
+    CGFloat      *widths;           // Width factors of the points and of the tail,
+    CGFloat      *tailWidths;       // for a variable width only
+    CGFloat      *radii;            // Scratch space for the outline
+    NSUInteger    radiusCapacity;
+    PaintStrokeOutline outline;     // Of the open segment, up to outlined
+    NSUInteger    outlined;
+}
+@end
+
+@implementation PaintStrokeLayer
+
+#pragma mark - Initialisation
+
++ (NSUInteger) segmentLength {
+    
+    return SEGMENT_LENGTH;
+}
+
+- (instancetype) init {
+    
+    self = [super init];
+    if (self) {
+        _lineWidth   = 1.0;
+        _lineCap     = kCALineCapRound;
+        _lineJoin    = kCALineJoinRound;
+        stableBounds = CGRectNull;
+        tailBounds   = CGRectNull;
+        PaintStrokeOutlineInit(&outline, OUTLINE_TOLERANCE / [[UIScreen mainScreen] scale]);
+        
+        // No implicit animations, the line has to follow the pen:
+        self.actions = @{ @"opacity" : [NSNull null], @"sublayers" : [NSNull null] };
+        openSegment  = [self newSegment];
+    }
+    return self;
+}
+
+- (CAShapeLayer *) newSegment {
+    
+    CAShapeLayer *segment = [CAShapeLayer layer];
+    segment.actions       = @{ @"path"        : [NSNull null],
+                               @"strokeColor" : [NSNull null],
+                               @"fillColor"   : [NSNull null],
+                               @"lineWidth"   : [NSNull null] };
+    segment.opaque        = NO;
+    segment.lineWidth     = self.lineWidth;
+    segment.lineCap       = self.lineCap;
+    segment.lineJoin      = self.lineJoin;
+    [self colorSegment:segment];
+    [self addSublayer:segment];
+    return segment;
+}
+
+// A stroked path gets the color on its line, an outline inside:
+
+- (void) colorSegment:(CAShapeLayer *)segment {
+    
+    CGColorRef opaque = self.strokeColor ? CGColorCreateCopyWithAlpha(self.strokeColor, 1.0) : NULL;
+    if (_variableWidth) {
+        segment.fillColor   = opaque;
+        segment.strokeColor = NULL;
+    } else {
+        segment.fillColor   = [UIColor clearColor].CGColor;
+        segment.strokeColor = opaque;
+    }
+    CGColorRelease(opaque);
+}
+
+#pragma mark - Style
+
+- (void) setStrokeColor:(CGColorRef)strokeColor {
+    
+    CGColorRetain(strokeColor);
+    CGColorRelease(_strokeColor);
+    _strokeColor = strokeColor;
+    
+    for (CAShapeLayer *segment in self.sublayers) {
+        [self colorSegment:segment];
+    }
+    self.opacity = CGColorGetAlpha(strokeColor);
+}
+
+// Outlines have the width and the caps in their shape, they are made again:
+
+- (void) setLineWidth:(CGFloat)lineWidth {
+    
+    BOOL changed = lineWidth != _lineWidth;
+    _lineWidth   = lineWidth;
+    for (CAShapeLayer *segment in self.sublayers) {
+        segment.lineWidth = lineWidth;
+    }
+    if (changed && _variableWidth) {
+        [self outlineAllSegments];
+    }
+}
+
+- (void) setLineCap:(NSString *)lineCap {
+    
+    BOOL changed = ![lineCap isEqualToString:_lineCap];
+    _lineCap     = [lineCap copy];
+    for (CAShapeLayer *segment in self.sublayers) {
+        segment.lineCap = lineCap;
+    }
+    if (changed && _variableWidth) {
+        [self outlineAllSegments];
+    }
+}
+
+- (void) setLineJoin:(NSString *)lineJoin {
+    
+    _lineJoin = [lineJoin copy];
+    for (CAShapeLayer *segment in self.sublayers) {
+        segment.lineJoin = lineJoin;
+    }
+}
+
+#pragma mark - Points
+
+static CGRect PaintBoundsOfPoints(const CGPoint *points, NSUInteger count) {
+    
+    if (count == 0) {
+        return CGRectNull;
+    }
+    CGFloat minX = points[0].x, maxX = points[0].x;
+    CGFloat minY = points[0].y, maxY = points[0].y;
+    for (NSUInteger n = 1; n < count; n++) {
+        minX = MIN(minX, points[n].x);
+        maxX = MAX(maxX, points[n].x);
+        minY = MIN(minY, points[n].y);
+        maxY = MAX(maxY, points[n].y);
+    }
+    return CGRectMake(minX, minY, maxX - minX, maxY - minY);
+}
+
+- (CGRect) strokeBounds {
+    
+    return CGRectUnion(stableBounds, tailBounds);
+}
+
+- (CGRect) appendPoints:(const CGPoint *)newPoints count:(NSUInteger)count
+               withTail:(const CGPoint *)newTail count:(NSUInteger)newTailCount {
+    
+    return [self appendPoints:newPoints widths:NULL count:count withTail:newTail widths:NULL count:newTailCount];
+}
+
+- (CGRect) appendPoints:(const CGPoint *)newPoints widths:(const CGFloat *)newWidths count:(NSUInteger)count
+               withTail:(const CGPoint *)newTail widths:(const CGFloat *)newTailWidths count:(NSUInteger)newTailCount {
+    
+    if (_pointCount == 0 && count > 0 && newWidths && !_variableWidth) {
+        _variableWidth = YES;
+        [self colorSegment:openSegment];
+    }
+    CGRect changed = tailBounds;
+    if (count > 0) {
+        if (_pointCount + count > capacity) {
+            capacity = MAX(2 * capacity, _pointCount + count);
+            points   = reallocf(points, capacity * sizeof(CGPoint));
+            if (_variableWidth) {
+                widths = reallocf(widths, capacity * sizeof(CGFloat));
+            }
+        }
+        memcpy(points + _pointCount, newPoints, count * sizeof(CGPoint));
+        if (_variableWidth) {
+            for (NSUInteger n = 0; n < count; n++) {
+                widths[_pointCount + n] = newWidths ? newWidths[n] : 1.0;
+            }
+        }
+        _pointCount += count;
+        CGRect added = PaintBoundsOfPoints(newPoints, count);
+        changed      = CGRectUnion(changed, added);
+        stableBounds = CGRectUnion(stableBounds, added);
+        
+        // Freeze full segments. They keep their path for good:
+        while (_pointCount - openStart > SEGMENT_LENGTH) {
+            CGMutablePathRef path = [self createSegmentPathFrom:openStart];
+            openSegment.path      = path;
+            CGPathRelease(path);
+            
+            openStart  += SEGMENT_LENGTH - 2;
+            openSegment = [self newSegment];
+            PaintStrokeOutlineReset(&outline);
+            outlined    = openStart;
+        }
+    }
+    
+    // The tail is speculative and gets replaced every time:
+    if (newTailCount > tailCapacity) {
+        tailCapacity = newTailCount;
+        tail         = reallocf(tail, tailCapacity * sizeof(CGPoint));
+        tailWidths   = reallocf(tailWidths, tailCapacity * sizeof(CGFloat));
+    }
+    memcpy(tail, newTail, newTailCount * sizeof(CGPoint));
+    for (NSUInteger n = 0; n < newTailCount && _variableWidth; n++) {
+        tailWidths[n] = newTailWidths ? newTailWidths[n] : 1.0;
+    }
+    tailCount  = newTailCount;
+    tailBounds = PaintBoundsOfPoints(tail, tailCount);
+    
+    [self updateOpenSegment];
+    return CGRectUnion(changed, tailBounds);
+}
+
+// Only the open segment gets a new path, at most SEGMENT_LENGTH points plus the tail. Its
+// outline only takes the points which are new:
+
+- (void) updateOpenSegment {
+    
+    if (_variableWidth) {
+        const CGFloat *stableRadii = [self radiiOf:widths + outlined count:_pointCount - outlined];
+        PaintStrokeOutlineAppend(&outline, (const PaintPoint *)points + outlined, stableRadii, _pointCount - outlined);
+        outlined = _pointCount;
+        
+        size_t count;
+        const PaintPoint *ring = PaintStrokeOutlineClose(&outline, (const PaintPoint *)tail,
+                                                         [self radiiOf:tailWidths count:_pointCount > 0 ? tailCount : 0],
+                                                         _pointCount > 0 ? tailCount : 0, [self buttCap], &count);
+        openSegment.path = [self pathOfRing:ring count:count];
+        return;
+    }
+    CGMutablePathRef path = CGPathCreateMutable();
+    CGPathAddLines(path, NULL, points + openStart, _pointCount - openStart);
+    for (NSUInteger n = 0; n < tailCount && _pointCount > 0; n++) {
+        CGPathAddLineToPoint(path, NULL, tail[n].x, tail[n].y);
+    }
+    openSegment.path = path;
+    CGPathRelease(path);
+}
+
+#pragma mark - Outlines
+
+- (BOOL) buttCap {
+    
+    return [_lineCap isEqualToString:kCALineCapButt];
+}
+
+// Half the line width at each of count width factors:
+
+- (const CGFloat *) radiiOf:(const CGFloat *)factors count:(NSUInteger)count {
+    
+    if (count > radiusCapacity) {
+        radiusCapacity = MAX(2 * radiusCapacity, count);
+        radii          = reallocf(radii, radiusCapacity * sizeof(CGFloat));
+    }
+    for (NSUInteger n = 0; n < count && radii; n++) {
+        radii[n] = 0.5 * _lineWidth * factors[n];
+    }
+    return radii;
+}
+
+- (CGPathRef) pathOfRing:(const PaintPoint *)ring count:(size_t)count {
+    
+    CGMutablePathRef path = CGPathCreateMutable();
+    if (ring) {
+        CGPathAddLines(path, NULL, (const CGPoint *)ring, count);
+        CGPathCloseSubpath(path);
+    }
+    return (CGPathRef)CFAutorelease(path);
+}
+
+// The path of the full segment from start on, stroked or outlined:
+
+- (CGMutablePathRef) createSegmentPathFrom:(NSUInteger)start {
+    
+    if (!_variableWidth) {
+        CGMutablePathRef path = CGPathCreateMutable();
+        CGPathAddLines(path, NULL, points + start, SEGMENT_LENGTH);
+        return path;
+    }
+    size_t count;
+    const PaintPoint *ring = PaintStrokeOutlineOfPoints(&outline, (const PaintPoint *)points + start,
+                                                        [self radiiOf:widths + start count:SEGMENT_LENGTH],
+                                                        SEGMENT_LENGTH, [self buttCap], &count);
+    return CGPathCreateMutableCopy([self pathOfRing:ring count:count]);
+}
+
+// After a change of the width or the caps, every segment gets its outline again:
+
+- (void) outlineAllSegments {
+    
+    NSArray *segments = self.sublayers;
+    NSUInteger start  = 0;
+    for (CAShapeLayer *segment in segments) {
+        if (segment == openSegment) break;
+        
+        CGMutablePathRef path = [self createSegmentPathFrom:start];
+        segment.path          = path;
+        CGPathRelease(path);
+        start += SEGMENT_LENGTH - 2;
+    }
+    PaintStrokeOutlineReset(&outline);
+    outlined = openStart;
+    [self updateOpenSegment];
+}
+
+- (CGMutablePathRef) createPath {
+    
+    CGMutablePathRef path = CGPathCreateMutable();
+    CGPathAddLines(path, NULL, points, _pointCount);
+    for (NSUInteger n = 0; n < tailCount && _pointCount > 0; n++) {
+        CGPathAddLineToPoint(path, NULL, tail[n].x, tail[n].y);
+    }
+    return path;
+}
+
+#pragma mark - Cleanup
+
+- (void) dealloc {
+    
+    free(points);
+    free(tail);
+    free(widths);
+    free(tailWidths);
+    free(radii);
+    PaintStrokeOutlineFree(&outline);
+    CGColorRelease(_strokeColor);
+}
+
+@end
@@ -7,20 +7,59 @@
 //
 
 #import <UIKit/UIKit.h>
-#import "PaintSplines.h"
 #import "PaintViewData.h"
 #import "PaintViewLine.h"
+#import "PaintStrokeFile.h"
+#import "PaintStrokeStore.h"
+#import "PaintStrokeTimeline.h"
 
 @interface PaintView : UIView
 
 @property (strong, nonatomic) NSMutableDictionary *linesDict;
 @property (strong, nonatomic) PaintViewData *pvData;
-@property (strong, nonatomic) PaintSplines *splinefunc;
 @property (assign, nonatomic) CGRect clipRect;
 
 - (instancetype) initWithFrame:(CGRect)frame andData:(PaintViewData *)data;
 - (void)     clearScreen;
 - (UIColor *)lineColorFor:(PaintViewLine *)line;
-- (void)     addPath:(CGPathRef)path with:(PaintViewLine *)line;
 - (void)     drawGreenRect:(CGRect)enclosingRect andRedRect:(CGRect)palmRect;
+
+// Committed lines are kept as simplified vectors, the bitmap is painted from them:
+- (void)     commitLine:(const PaintStrokeLine *)line;
+- (void)     commitLines:(const PaintStrokeLine *const *)lines count:(size_t)count;
+- (void)     redrawStrokes;
+- (void)     redrawStrokesInRect:(CGRect)rect;
+- (NSUInteger) eraseStrokesInRect:(CGRect)rect;
+- (const PaintStrokeStore *) strokeStore;
+
+// Committed lines are painted into the tiles on a queue of their own; each call of commitLines
+// which adds strokes is a commit with a number. presentCommits shows the tiles of the ones
+// which are done and returns the number of the newest among them; finishCommits waits for all:
+- (unsigned long long) commitsQueued;
+- (unsigned long long) presentCommits;
+- (void)     finishCommits;
+
+// All strokes since the view was made with the times they were drawn and erased. The canvas
+// at a time goes into tiles of the timeline's grid, at one pixel per point:
+- (const PaintStrokeTimeline *) strokeTimeline;
+- (BOOL)     paintTimelineAt:(CFTimeInterval)time intoTiles:(uint32_t *const *)tiles;
+
+// A review shows the canvas at a time of the timeline over the bitmap until it is ended; the
+// bitmap and the strokes stay as they are:
+- (BOOL)     reviewTimelineAt:(CFTimeInterval)time;
+- (void)     endTimelineReview;
+
+// A saved drawing is mapped and painted where it is visible first, the rest follows in the
+// background. Lines committed meanwhile and strokeStore wait until all of it is in:
+- (BOOL)     openDrawing:(NSString *)path;
+
+// What presenting the changed tiles of the bitmap has cost so far:
+- (unsigned long long) tilesPresented;
+- (unsigned long long) bytesPresented;
+
+// The tiles keep to pvData.tileBudget; on a memory warning they give up all they can. After the
+// view has changed its size they are made again and painted from the strokes:
+- (void)     shrinkTiles;
+- (void)     resizeTiles;
+- (NSString *) tileReport;
 @end
@@ -8,19 +8,100 @@
 //  Version 1.3   Sept 18, 2015
 //
 
+#import <QuartzCore/QuartzCore.h>
 #import "PaintView.h"
+#import "PaintRasterizer.h"
+#import "PaintStrokeOutline.h"
+#import "PaintTileGrid.h"
+#import "PaintTileStore.h"
+
+// Edge length of the bitmap tiles in points:
+#define TILE_SIZE 128.0
+
+// Cell size in points and bucket count of the index of committed strokes:
+#define INDEX_CELL     64.0f
+#define INDEX_BUCKETS  1024
+
+// Strokes of an opened drawing decoded in one go, and chunks decoded ahead of the main thread:
+#define DRAWING_CHUNK  256
+#define DRAWING_AHEAD    2
+
+// Points of a stroke whose width changes converted for its outline in one go:
+#define OUTLINE_CHUNK  256
+
+// Committed strokes on their way through the commit queue: a copy of them, and the pixels of
+// the tiles they reach, which the queue paints them into. done is set on the queue when it is
+// through:
+
+typedef struct PaintViewCommit {
+    unsigned long long number;
+    PaintStrokeStore   strokes;
+    PaintStrokeBounds  reach;           // What they can paint
+    PaintTileGrid      grid;
+    uint32_t         **tiles;           // By tile, NULL for the ones they do not reach
+    int                done;            // 1, or -1 if the rasterizer had no memory
+} PaintViewCommit;
 
 @interface PaintView () {
-    CALayer      *greenLayer,     // Layer for drawing the enclosingRect
+    CALayer       *greenLayer,     // Layer for drawing the enclosingRect
     *redLayer;
-    CGContextRef  lineContext;
+    PaintTileGrid  grid;           // The bitmap of confirmed lines is split into tiles,
+    PaintTileStore tileStore;      // which have pixels only where something is painted,
+    CGContextRef  *tileContexts;   // a context on those pixels
+    CALayer       *tileLayer;      // and their own layer in here
+    dispatch_queue_t packQueue;    // Packs the tiles which are idle
+    BOOL           packScheduled;
+    uint32_t       tilesGeneration;    // Packed tiles of tiles made before are thrown away
+    dispatch_queue_t commitQueue;  // Paints committed strokes into their tiles
+    PaintViewCommit **commits;     // On the queue or done, oldest first
+    size_t         commitCount;
+    size_t         commitCapacity;
+    unsigned long long *tileCommits;    // By tile, the newest commit which paints into it, 0 if none
+    unsigned long long commitsQueued;
+    unsigned long long commitsPainted;
+    size_t         paintedStrokes; // Strokes of the store in the bitmap, evicted tiles get them again
+    PaintStrokeStore strokes;      // The committed lines, the bitmap is painted from them
+    PaintStrokeIndex strokeIndex;  // Where they are, by their index in the store
+    PaintRasterPool *rasterPool;   // Threads for painting all tiles at once, made when first needed
+    PaintStrokeReader *drawing;    // An opened drawing, until all its strokes are in the store
+    size_t         drawingNext;    // Its first stroke which is not in the store yet
+    CGRect         drawingDone;    // The tiles which have all its strokes already
+    uint32_t       drawingGeneration;  // Chunks decoded for an earlier drawing are thrown away
+    int           *drawingCancelled;   // Stops the decoder
+    dispatch_queue_t     drawingQueue; // Decodes the strokes in the background
+    dispatch_semaphore_t drawingAhead; // Chunks the decoder may be ahead
+    CFTimeInterval drawingStart;
+    PaintStrokeOutline outline;    // Of strokes whose width changes, they are filled
+    PaintStrokeTimeline timeline;  // Every stroke of the session, erased ones too, and when
+    CALayer       *reviewLayer;    // Shows the canvas at a time of the timeline over the bitmap
+    BOOL           timelineRecording;
+    size_t         timelineBase;   // Its index of the first stroke in the store
 }
-@property (assign, nonatomic) CGAffineTransform flipTransform;
 
 @end
 
 @implementation PaintView
 
+static int PaintViewCompareIndices(const void *a, const void *b) {
+    
+    uint32_t left = *(const uint32_t *)a, right = *(const uint32_t *)b;
+    return (left > right) - (left < right);
+}
+
+// An image on pixels in the layout of the tiles:
+
+static CGImageRef PaintViewCreateImage(CFDataRef data, size_t pixelsWide, size_t pixelsHigh) {
+    
+    CGDataProviderRef provider = CGDataProviderCreateWithCFData(data);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef image           = CGImageCreate(pixelsWide, pixelsHigh, 8, 32, 4 * pixelsWide, colorSpace,
+                                               kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host,
+                                               provider, NULL, false, kCGRenderingIntentDefault);
+    CGColorSpaceRelease(colorSpace);
+    CGDataProviderRelease(provider);
+    return image;
+}
+
 #pragma mark - Initialisation
 
 - (instancetype)initWithFrame:(CGRect)frame andData:(PaintViewData *)data {
@@ -34,19 +115,15 @@
     self.multipleTouchEnabled   = YES;
     self.exclusiveTouch         =  NO;
     self.layer.backgroundColor  = [UIColor whiteColor].CGColor;
-    self.splinefunc             = [[PaintSplines alloc] initWithData:data];
-    self.flipTransform          = CGAffineTransformIdentity;
+    PaintStrokeStoreInit(&strokes);
+    PaintStrokeIndexInit(&strokeIndex, INDEX_CELL, INDEX_BUCKETS);
+    PaintStrokeOutlineInit(&outline, 0.25 / [self contentScaleFactor]);
     
-    // Fill the basic context with a white bitmap:
-    float scale = [self contentScaleFactor];
-    UIGraphicsBeginImageContextWithOptions(frame.size, NO, scale);
-    lineContext = UIGraphicsGetCurrentContext();
-    [self fillWhite:lineContext];
-    
-    // Invert the coordinate system:
-    CGContextTranslateCTM(lineContext, 0.0, self.bounds.size.height);
-    CGContextScaleCTM(lineContext, 1.0, -1.0);
-    CGContextSetLineCap(lineContext, kCGLineCapRound);
+    // Fill the tiles of the bitmap with white:
+    [self createTilesWithScale:[self contentScaleFactor]];
+    [self fillWhite];
+    timelineRecording = PaintStrokeTimelineInit(&timeline, self.bounds.size.width, self.bounds.size.height, TILE_SIZE,
+                                                1.0, self.pvData.keyframeInterval) == 0;
     
     // Define the context for drawing the enclosingRect:
     greenLayer = [self layerWithColor:[UIColor greenColor].CGColor];
@@ -56,6 +133,155 @@
     return self;
 }
 
+// Cut the bitmap into tiles. Each tile has a layer, which shows the tile, and while it has
+// pixels a bitmap context on them in the coordinates of the view. A white tile has neither
+// pixels nor an image, its layer is white:
+
+- (void) createTilesWithScale:(CGFloat)scale {
+    
+    PaintTileGridInit(&grid, self.bounds.size.width, self.bounds.size.height, TILE_SIZE, scale);
+    PaintTileStoreInit(&tileStore, &grid, self.pvData.tileBudget);
+    tileContexts = calloc(PaintTileGridCount(&grid), sizeof(CGContextRef));
+    tileCommits  = calloc(PaintTileGridCount(&grid), sizeof(unsigned long long));
+    tileLayer    = [CALayer layer];
+    tileLayer.frame = self.bounds;
+    [self.layer insertSublayer:tileLayer atIndex:0];
+    if (!packQueue) {
+        packQueue = dispatch_queue_create("PaintView tiles", DISPATCH_QUEUE_SERIAL);
+    }
+    
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        double x, y, w, h;
+        PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+        
+        CALayer *layer        = [CALayer layer];
+        layer.frame           = CGRectMake(x, y, w, h);
+        layer.actions         = @{ @"contents" : [NSNull null] };
+        layer.opaque          = YES;
+        layer.backgroundColor = [UIColor whiteColor].CGColor;
+        [tileLayer addSublayer:layer];
+    }
+}
+
+// The tiles go with their layers. A tile being packed keeps its pixels until the packing queue
+// is done with them, the packed pixels which come back after that are not for these tiles:
+
+- (void) destroyTiles {
+    
+    [self dropCommits];
+    dispatch_sync(packQueue, ^{});
+    tilesGeneration++;
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        CGContextRelease(tileContexts[index]);
+    }
+    free(tileContexts);
+    tileContexts = NULL;
+    free(tileCommits);
+    tileCommits  = NULL;
+    PaintTileStoreFree(&tileStore);
+    PaintTileGridFree(&grid);
+    [tileLayer removeFromSuperlayer];
+    tileLayer = nil;
+}
+
+// The bitmap follows the size of the view and the scale of its screen: the tiles are made again
+// and the rasterizer paints the strokes into them. Nothing happens if neither has changed.
+
+- (void) resizeTiles {
+    
+    CGFloat scale = [self contentScaleFactor];
+    if (grid.width == self.bounds.size.width && grid.height == self.bounds.size.height && grid.scale == scale) {
+        return;
+    }
+    [self finishDrawing];
+    [self destroyTiles];
+    [self createTilesWithScale:scale];
+    PaintStrokeOutlineFree(&outline);
+    PaintStrokeOutlineInit(&outline, 0.25 / scale);
+    [self redrawStrokes];
+}
+
+// A screen with another scale, e.g. an external display, needs tiles with other pixels:
+
+- (void) traitCollectionDidChange:(UITraitCollection *)previousTraitCollection {
+    
+    [super traitCollectionDidChange:previousTraitCollection];
+    CGFloat scale = self.traitCollection.displayScale;
+    if (scale > 0.0 && scale != previousTraitCollection.displayScale) {
+        self.contentScaleFactor = scale;
+        [self resizeTiles];
+    }
+}
+
+// The context to paint into a tile. The tile gets its pixels first, an evicted tile gets the
+// strokes which were in it again. NULL if there is no memory:
+
+- (CGContextRef) contextForTile:(size_t)index {
+    
+    BOOL evicted     = PaintTileStoreState(&tileStore, index) == PaintTileEvicted;
+    uint32_t *pixels = PaintTileStoreWrite(&tileStore, index, CACurrentMediaTime());
+    if (!pixels) {
+        return NULL;
+    }
+    if (!tileContexts[index] || CGBitmapContextGetData(tileContexts[index]) != pixels) {
+        double x, y, w, h;
+        size_t pixelsWide, pixelsHigh;
+        PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+        PaintTileGridTilePixels(&grid, index, &pixelsWide, &pixelsHigh);
+        
+        CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+        CGContextRef context       = CGBitmapContextCreate(pixels, pixelsWide, pixelsHigh, 8, 4 * pixelsWide, colorSpace,
+                                                           kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+        CGColorSpaceRelease(colorSpace);
+        
+        // Invert the coordinate system and move the tile to its place:
+        CGContextTranslateCTM(context, 0.0, pixelsHigh);
+        CGContextScaleCTM(context, grid.scale, -grid.scale);
+        CGContextTranslateCTM(context, -x, -y);
+        CGContextSetLineCap(context, kCGLineCapRound);
+        CGContextRelease(tileContexts[index]);
+        tileContexts[index] = context;
+    }
+    if (evicted) {
+        [self restoreTile:index];
+    }
+    [self schedulePacking];
+    return tileContexts[index];
+}
+
+// Paint the strokes which were in an evicted tile again, in the order they were committed. A
+// stroke which is being painted right now is not there yet:
+
+- (void) restoreTile:(size_t)index {
+    
+    double x, y, w, h;
+    PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+    PaintStrokeBounds bounds = { x, y, x + w, y + h };
+    size_t count             = PaintStrokeIndexQuery(&strokeIndex, bounds, NULL, 0);
+    uint32_t *indices        = malloc(MAX(count, 1) * sizeof(uint32_t));
+    if (!indices) {
+        return;
+    }
+    PaintStrokeIndexQuery(&strokeIndex, bounds, indices, count);
+    qsort(indices, count, sizeof(uint32_t), PaintViewCompareIndices);
+    for (size_t n = 0; n < count && indices[n] < paintedStrokes; n++) {
+        [self paintStroke:indices[n] clippedTo:CGRectMake(x, y, w, h)];
+    }
+    free(indices);
+}
+
+// Contexts on pixels which a tile has given up go as well:
+
+- (void) releaseStaleContexts {
+    
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        if (tileContexts[index] && CGBitmapContextGetData(tileContexts[index]) != PaintTileStorePixels(&tileStore, index)) {
+            CGContextRelease(tileContexts[index]);
+            tileContexts[index] = NULL;
+        }
+    }
+}
+
 // Initialize one of the Rect layers:
 
 - (CALayer *)layerWithColor:(CGColorRef)color {
@@ -72,92 +298,910 @@
 
 #pragma mark - UI methods
 
-// Clear the lineContext. Called from the ViewController when the appropriate button is pressed.
+// Clear the bitmap and forget the strokes. Called from the ViewController when the appropriate
+// button is pressed.
 
 - (void) clearScreen {
     
-    for (CAShapeLayer *layer in [self.layer.sublayers copy]) {
-        [layer removeFromSuperlayer];
+    [self endTimelineReview];
+    [self closeDrawing];
+    [self dropCommits];
+    if (timelineRecording) {
+        timelineRecording = PaintStrokeTimelineClear(&timeline, CACurrentMediaTime()) == 0;
+        timelineBase      = timeline.store.count;
+    }
+    PaintStrokeStoreClear(&strokes);
+    PaintStrokeIndexClear(&strokeIndex);
+    paintedStrokes = 0;
+    for (CALayer *layer in [self.layer.sublayers copy]) {
+        if (layer != tileLayer) {
+            [layer removeFromSuperlayer];
+        }
     }
-    [self fillWhite:lineContext];
+    [self fillWhite];
     
     // Re-establish the two Rect layers:
     greenLayer = [self layerWithColor:[UIColor greenColor].CGColor];
     redLayer   = [self layerWithColor:[UIColor redColor].CGColor];
 }
 
-// Fills the context with white color and forces a redraw.
+// Makes all tiles white, which frees their memory, and forces them to be presented again.
 
-- (void) fillWhite:(CGContextRef)context {
+- (void) fillWhite {
     
-    CGContextSetRGBFillColor(context, 1.0, 1.0, 1.0, 1.0);
-    CGContextFillRect(context, self.bounds);
-    [self setNeedsDisplay];
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        PaintTileStoreClear(&tileStore, index);
+    }
+    [self releaseStaleContexts];
+    PaintTileGridMarkAll(&grid);
+    [self setNeedsLayout];
+}
+
+// The same for the tiles under rect, and only inside rect; a tile inside rect is cleared:
+
+- (void) fillWhiteInRect:(CGRect)rect {
+    
+    size_t c0, r0, c1, r1;
+    if (!PaintTileGridRange(&grid, rect.origin.x, rect.origin.y, rect.size.width, rect.size.height, &c0, &r0, &c1, &r1)) {
+        return;
+    }
+    for (size_t row = r0; row < r1; row++) {
+        for (size_t column = c0; column < c1; column++) {
+            size_t index = row * grid.columns + column;
+            double x, y, w, h;
+            PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+            if (CGRectContainsRect(rect, CGRectMake(x, y, w, h))) {
+                PaintTileStoreClear(&tileStore, index);
+                continue;
+            }
+            CGContextRef context = [self contextForTile:index];
+            if (!context) continue;
+            
+            CGContextSetRGBFillColor(context, 1.0, 1.0, 1.0, 1.0);
+            CGContextFillRect(context, rect);
+        }
+    }
+    [self releaseStaleContexts];
+    PaintTileGridMarkRect(&grid, rect.origin.x, rect.origin.y, rect.size.width, rect.size.height);
+    [self setNeedsLayout];
 }
 
 #pragma mark - Line Drawing
 
-// This method repaints the paths in the bitmap at the base of the displayed picture.
+// A line goes into the bitmap: it is simplified into the stroke store and painted from there.
+// An empty line has no tail either.
+
+- (void) commitLine:(const PaintStrokeLine *)line {
+    
+    [self commitLines:&line count:1];
+}
+
+// Several lines go in one after the other, but the tiles are painted in one pass: each tile
+// under any of them gets all its strokes, in order, and the whole area is marked once. The
+// painting is done on the commit queue (see Committing); Core Graphics paints them right here
+// only if that cannot be.
+
+- (void) commitLines:(const PaintStrokeLine *const *)lines count:(size_t)count {
+    
+    // A new line goes over all strokes of an opened drawing:
+    [self finishDrawing];
+    CGFloat tolerance = self.pvData.strokeTolerance / [self contentScaleFactor];
+    size_t first      = strokes.count;
+    for (size_t n = 0; n < count; n++) {
+        const PaintStrokeLine *line = lines[n];
+        long index = PaintStrokeStoreAddWidths(&strokes, line->points, line->widths, line->pointCount, line->tail,
+                                               line->tailWidths, line->pointCount ? line->tailCount : 0, line->style, tolerance);
+        if (index >= 0) {
+            [self indexStroke:(size_t)index];
+            
+            // The line was drawn from its first touch to its last. A mirror line of the pipeline
+            // keeps only the last one, the time of the first comes with the line:
+            double start = CACurrentMediaTime(), end = start;
+            if (line->touches.count) {
+                start = line->firstTimestamp;
+                end   = PaintTouchColumnsControl(&line->touches, line->touches.count - 1).timestamp;
+            }
+            [self recordStroke:(size_t)index from:start to:end];
+        }
+    }
+    if (strokes.count > first && ![self queueCommitFrom:first to:strokes.count]) {
+        [self finishCommits];
+        if (strokes.count - first == 1) {
+            [self paintStroke:first clippedTo:CGRectInfinite];
+        } else {
+            [self paintStrokesFrom:first to:strokes.count];
+        }
+        commitsPainted = ++commitsQueued;
+    }
+    paintedStrokes = strokes.count;
+}
+
+// A stroke of the store goes into the index of the committed strokes, with its widest line:
+
+- (void) indexStroke:(size_t)index {
+    
+    const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&strokes, index);
+    PaintStrokeIndexInsert(&strokeIndex, (uint32_t)index,
+                           PaintStrokeBoundsInset(stroke->bounds, -stroke->width * stroke->widest));
+}
+
+// Paint one stroke of the store into the bitmap, but nothing outside clip:
+
+- (void) paintStroke:(size_t)index clippedTo:(CGRect)clip {
+    
+    const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&strokes, index);
+    if (stroke->erased) {
+        return;
+    }
+    [self paintPoints:PaintStrokeStorePoints(&strokes, stroke) widths:PaintStrokeStoreWidths(&strokes, stroke)
+                count:stroke->pointCount style:PaintStrokeStoreStyle(stroke) clippedTo:clip];
+}
+
+- (void) paintPoints:(const PaintStoredPoint *)points widths:(const float *)widths count:(size_t)count
+               style:(PaintLineStyle)style clippedTo:(CGRect)clip {
+    
+    CGMutablePathRef path = [self createPathOfPoints:points widths:widths count:count style:style];
+    if (!path) {
+        return;
+    }
+    PaintViewLine *line = [[PaintViewLine alloc] init];
+    [line setStyle:style];
+    [self addPath:path with:line filled:widths != NULL clippedTo:clip];
+    CGPathRelease(path);
+}
+
+// The path of a stroke: its points to be stroked with the line width, or, if the width changes
+// along it, its outline to be filled. NULL for a stroke without points.
+
+- (CGMutablePathRef) createPathOfPoints:(const PaintStoredPoint *)points widths:(const float *)widths count:(size_t)count
+                                  style:(PaintLineStyle)style {
+    
+    if (count == 0) {
+        return NULL;
+    }
+    CGMutablePathRef path = CGPathCreateMutable();
+    if (!widths) {
+        CGPathMoveToPoint(path, NULL, points[0].x, points[0].y);
+        for (size_t n = 1; n < count; n++) {
+            CGPathAddLineToPoint(path, NULL, points[n].x, points[n].y);
+        }
+        return path;
+    }
+    PaintPoint centers[OUTLINE_CHUNK];
+    PaintFloat radii[OUTLINE_CHUNK];
+    PaintStrokeOutlineReset(&outline);
+    for (size_t start = 0; start < count; start += OUTLINE_CHUNK) {
+        size_t chunk = MIN(count - start, OUTLINE_CHUNK);
+        for (size_t n = 0; n < chunk; n++) {
+            centers[n] = (PaintPoint){ points[start + n].x, points[start + n].y };
+            radii[n]   = 0.25 * style.width * widths[start + n];
+        }
+        PaintStrokeOutlineAppend(&outline, centers, radii, chunk);
+    }
+    size_t ringCount;
+    const PaintPoint *ring = PaintStrokeOutlineClose(&outline, NULL, NULL, 0, style.mode == 3, &ringCount);
+    if (ring) {
+        CGPathAddLines(path, NULL, (const CGPoint *)ring, ringCount);
+        CGPathCloseSubpath(path);
+    }
+    return path;
+}
+
+// Paint the strokes first … end-1 of the store tile by tile, each tile only with the strokes
+// which reach into it:
+
+- (void) paintStrokesFrom:(size_t)first to:(size_t)end {
+    
+    [self paintStrokesFrom:first to:end skippingTilesIn:CGRectNull];
+}
+
+// The same, but tiles inside skip are left as they are:
+
+- (void) paintStrokesFrom:(size_t)first to:(size_t)end skippingTilesIn:(CGRect)skip {
+    
+    size_t count              = end - first;
+    CGMutablePathRef *paths   = calloc(count, sizeof(CGMutablePathRef));
+    CGRect *bounds            = malloc(count * sizeof(CGRect));
+    BOOL *filled              = malloc(count * sizeof(BOOL));
+    NSMutableArray *styles    = [NSMutableArray arrayWithCapacity:count];
+    CGRect area               = CGRectNull;
+    for (size_t n = 0; n < count; n++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&strokes, first + n);
+        const PaintStoredPoint  *points = PaintStrokeStorePoints(&strokes, stroke);
+        PaintViewLine *style            = [[PaintViewLine alloc] init];
+        [styles addObject:style];
+        if (stroke->pointCount == 0 || stroke->erased) continue;
+        
+        const float *widths = PaintStrokeStoreWidths(&strokes, stroke);
+        paths[n]            = [self createPathOfPoints:points widths:widths count:stroke->pointCount
+                                                 style:PaintStrokeStoreStyle(stroke)];
+        filled[n]           = widths != NULL;
+        [style setStyle:PaintStrokeStoreStyle(stroke)];
+        bounds[n] = CGRectInset(CGPathGetBoundingBox(paths[n]), -style.width, -style.width);
+        area      = CGRectUnion(area, bounds[n]);
+    }
+    
+    size_t c0, r0, c1, r1;
+    if (!CGRectIsNull(area) && PaintTileGridRange(&grid, area.origin.x, area.origin.y, area.size.width, area.size.height,
+                                                  &c0, &r0, &c1, &r1)) {
+        for (size_t row = r0; row < r1; row++) {
+            for (size_t column = c0; column < c1; column++) {
+                size_t index         = row * grid.columns + column;
+                double x, y, w, h;
+                PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+                CGRect tile          = CGRectMake(x, y, w, h);
+                if (CGRectContainsRect(skip, tile)) continue;
+                
+                CGContextRef context = [self contextForTile:index];
+                if (!context) continue;
+                
+                for (size_t n = 0; n < count; n++) {
+                    if (!paths[n] || !CGRectIntersectsRect(bounds[n], tile)) continue;
+                    
+                    PaintViewLine *style = styles[n];
+                    CGContextAddPath(context, paths[n]);
+                    if (filled[n]) {
+                        CGContextSetFillColorWithColor(context, [[self lineColorFor:style] CGColor]);
+                        CGContextFillPath(context);
+                        continue;
+                    }
+                    CGContextSetStrokeColorWithColor(context, [[self lineColorFor:style] CGColor]);
+                    CGContextSetLineWidth(context, 0.5 * style.width);
+                    CGContextSetLineJoin(context, kCGLineJoinRound);
+                    CGContextSetLineCap(context, style.mode == 3 ? kCGLineCapButt : kCGLineCapRound);
+                    CGContextStrokePath(context);
+                }
+                PaintTileGridMarkRect(&grid, x, y, w, h);
+            }
+        }
+        [self setNeedsLayout];
+    }
+    for (size_t n = 0; n < count; n++) {
+        if (paths[n]) CGPathRelease(paths[n]);
+    }
+    free(paths);
+    free(bounds);
+    free(filled);
+}
+
+// Throw the bitmap away and paint it again from the stroke store. The rasterizer paints right
+// into the pixels of the tiles, on all cores, but only of the tiles which a stroke reaches; the
+// others are white and need none. Core Graphics is the fallback:
+
+- (void) redrawStrokes {
+    
+    [self finishDrawing];
+    [self dropCommits];
+    if (!rasterPool) {
+        rasterPool = PaintRasterPoolCreate(0);
+    }
+    size_t count = PaintTileGridCount(&grid);
+    uint32_t *tiles[count];
+    double now   = CACurrentMediaTime();
+    for (size_t index = 0; index < count; index++) {
+        double x, y, w, h;
+        PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+        PaintStrokeBounds bounds = { x, y, x + w, y + h };
+        tiles[index] = NULL;
+        if (PaintStrokeIndexQuery(&strokeIndex, bounds, NULL, 0)) {
+            tiles[index] = PaintTileStoreWrite(&tileStore, index, now);
+        } else {
+            PaintTileStoreClear(&tileStore, index);
+        }
+    }
+    [self releaseStaleContexts];
+    paintedStrokes = strokes.count;
+    if (rasterPool && PaintRasterizeStrokes(rasterPool, &strokes, &grid, tiles) == 0) {
+        PaintTileGridMarkAll(&grid);
+        [self schedulePacking];
+        [self setNeedsLayout];
+        return;
+    }
+    [self fillWhite];
+    for (size_t index = 0; index < strokes.count; index++) {
+        [self paintStroke:index clippedTo:CGRectInfinite];
+    }
+}
+
+// Paint the bitmap again inside rect only. The index tells which strokes reach into the rect,
+// they are painted in the order they were committed:
+
+- (void) redrawStrokesInRect:(CGRect)rect {
+    
+    [self finishDrawing];
+    [self finishCommits];
+    rect = CGRectIntersection(rect, self.bounds);
+    if (CGRectIsEmpty(rect)) {
+        return;
+    }
+    [self fillWhiteInRect:rect];
+    
+    PaintStrokeBounds bounds = { CGRectGetMinX(rect), CGRectGetMinY(rect), CGRectGetMaxX(rect), CGRectGetMaxY(rect) };
+    size_t count             = PaintStrokeIndexQuery(&strokeIndex, bounds, NULL, 0);
+    uint32_t *indices        = malloc(MAX(count, 1) * sizeof(uint32_t));
+    if (!indices) {
+        return;
+    }
+    PaintStrokeIndexQuery(&strokeIndex, bounds, indices, count);
+    qsort(indices, count, sizeof(uint32_t), PaintViewCompareIndices);
+    for (size_t n = 0; n < count; n++) {
+        [self paintStroke:indices[n] clippedTo:rect];
+    }
+    free(indices);
+}
+
+// Erase every committed stroke which reaches into rect, and paint the area they covered again:
+
+- (NSUInteger) eraseStrokesInRect:(CGRect)rect {
+    
+    [self finishDrawing];
+    PaintStrokeBounds bounds = { CGRectGetMinX(rect), CGRectGetMinY(rect), CGRectGetMaxX(rect), CGRectGetMaxY(rect) };
+    size_t count             = PaintStrokeIndexQuery(&strokeIndex, bounds, NULL, 0);
+    uint32_t *indices        = malloc(MAX(count, 1) * sizeof(uint32_t));
+    if (!indices) {
+        return 0;
+    }
+    PaintStrokeIndexQuery(&strokeIndex, bounds, indices, count);
+    
+    PaintStrokeBounds dirty = PaintStrokeBoundsEmpty;
+    for (size_t n = 0; n < count; n++) {
+        dirty = PaintStrokeBoundsUnion(dirty, PaintStrokeIndexBounds(&strokeIndex, indices[n]));
+        PaintStrokeIndexRemove(&strokeIndex, indices[n]);
+        PaintStrokeStoreErase(&strokes, indices[n]);
+        indices[n] += (uint32_t)timelineBase;
+    }
+    if (timelineRecording && count > 0) {
+        timelineRecording = PaintStrokeTimelineErase(&timeline, indices, count, CACurrentMediaTime()) == 0;
+    }
+    free(indices);
+    if (count > 0) {
+        [self redrawStrokesInRect:CGRectMake(dirty.minX, dirty.minY, dirty.maxX - dirty.minX, dirty.maxY - dirty.minY)];
+    }
+    return count;
+}
+
+- (const PaintStrokeStore *) strokeStore {
+    
+    [self finishDrawing];
+    return &strokes;
+}
+
+#pragma mark - Committing
+
+// Strokes first … end-1 of the store go to the commit queue, which paints them right into the
+// pixels of the tiles they reach, over what an earlier commit paints there. Here those tiles
+// only get their pixels; until the commit is presented they are not packed, evicted or shown,
+// and nothing else paints into them. Returns NO if there is no memory or no rasterizer.
+
+- (BOOL) queueCommitFrom:(size_t)first to:(size_t)end {
+    
+    if (!rasterPool) {
+        rasterPool = PaintRasterPoolCreate(0);
+    }
+    if (!commitQueue) {
+        commitQueue = dispatch_queue_create("PaintView commits", DISPATCH_QUEUE_SERIAL);
+    }
+    if (commitCount == commitCapacity) {
+        size_t capacity         = MAX(2 * commitCapacity, 16);
+        PaintViewCommit **grown = realloc(commits, capacity * sizeof(PaintViewCommit *));
+        if (!grown) {
+            return NO;
+        }
+        commits        = grown;
+        commitCapacity = capacity;
+    }
+    size_t count            = PaintTileGridCount(&grid);
+    PaintViewCommit *commit = calloc(1, sizeof(PaintViewCommit));
+    if (!rasterPool || !commit || !(commit->tiles = calloc(count, sizeof(uint32_t *)))) {
+        free(commit);
+        return NO;
+    }
+    PaintStrokeStoreInit(&commit->strokes);
+    commit->reach = PaintStrokeBoundsEmpty;
+    BOOL ready    = YES;
+    for (size_t index = first; index < end && ready; index++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&strokes, index);
+        ready = PaintStrokeStoreAppendWidths(&commit->strokes, PaintStrokeStorePoints(&strokes, stroke),
+                                             PaintStrokeStoreWidths(&strokes, stroke), stroke->pointCount,
+                                             PaintStrokeStoreStyle(stroke)) >= 0;
+        if (stroke->pointCount > 0) {
+            commit->reach = PaintStrokeBoundsUnion(commit->reach, PaintRasterStrokeReach(stroke, grid.scale));
+        }
+    }
+    
+    // An evicted tile is painted again first, from the strokes before these:
+    size_t c0, r0, c1, r1;
+    double now = CACurrentMediaTime();
+    if (ready && !PaintStrokeBoundsIsEmpty(commit->reach)
+        && PaintTileGridRange(&grid, commit->reach.minX, commit->reach.minY, commit->reach.maxX - commit->reach.minX,
+                              commit->reach.maxY - commit->reach.minY, &c0, &r0, &c1, &r1)) {
+        for (size_t row = r0; row < r1 && ready; row++) {
+            for (size_t column = c0; column < c1 && ready; column++) {
+                size_t index = row * grid.columns + column;
+                if (PaintTileStoreState(&tileStore, index) == PaintTileEvicted) {
+                    [self contextForTile:index];
+                }
+                commit->tiles[index] = PaintTileStoreWrite(&tileStore, index, now);
+                ready                = commit->tiles[index] != NULL;
+            }
+        }
+        [self releaseStaleContexts];
+    }
+    if (!ready) {
+        PaintStrokeStoreFree(&commit->strokes);
+        free(commit->tiles);
+        free(commit);
+        return NO;
+    }
+    commit->number = ++commitsQueued;
+    commit->grid   = grid;
+    for (size_t index = 0; index < count; index++) {
+        if (commit->tiles[index]) tileCommits[index] = commit->number;
+    }
+    commits[commitCount++] = commit;
+    
+    PaintRasterPool *pool = rasterPool;
+    dispatch_async(commitQueue, ^{
+        int painted = PaintRasterizeStrokeRange(pool, &commit->strokes, 0, commit->strokes.count, &commit->grid,
+                                                commit->tiles);
+        __atomic_store_n(&commit->done, painted == 0 ? 1 : -1, __ATOMIC_RELEASE);
+    });
+    return YES;
+}
+
+- (unsigned long long) commitsQueued {
+    
+    return commitsQueued;
+}
+
+// The commits the queue is through with are presented, in the order they were queued; their
+// tiles are free again once the newest commit on them is. Where the rasterizer had no memory
+// the strokes are painted again. Returns the number of the newest commit presented.
+
+- (unsigned long long) presentCommits {
+    
+    size_t presented = 0;
+    CGRect failed    = CGRectNull;
+    while (presented < commitCount && __atomic_load_n(&commits[presented]->done, __ATOMIC_ACQUIRE)) {
+        PaintViewCommit *commit = commits[presented++];
+        for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+            if (!commit->tiles[index]) continue;
+            
+            double x, y, w, h;
+            PaintTileGridTileRect(&grid, index, &x, &y, &w, &h);
+            PaintTileGridMarkRect(&grid, x, y, w, h);
+            if (tileCommits[index] == commit->number) {
+                tileCommits[index] = 0;
+            }
+        }
+        if (commit->done < 0) {
+            failed = CGRectUnion(failed, CGRectMake(commit->reach.minX, commit->reach.minY,
+                                                    commit->reach.maxX - commit->reach.minX,
+                                                    commit->reach.maxY - commit->reach.minY));
+        }
+        commitsPainted = commit->number;
+        PaintStrokeStoreFree(&commit->strokes);
+        free(commit->tiles);
+        free(commit);
+    }
+    if (presented > 0) {
+        commitCount -= presented;
+        memmove(commits, commits + presented, commitCount * sizeof(PaintViewCommit *));
+        [self schedulePacking];
+        [self setNeedsLayout];
+    }
+    if (!CGRectIsNull(failed)) {
+        [self redrawStrokesInRect:failed];
+    }
+    return commitsPainted;
+}
+
+// Wait for the commit queue and present all it has painted. Needed before the tiles are painted
+// into here:
+
+- (void) finishCommits {
+    
+    if (commitCount == 0) {
+        return;
+    }
+    dispatch_sync(commitQueue, ^{});
+    [self presentCommits];
+}
+
+// The same, but nothing is presented; the tiles are painted from the strokes or cleared next:
+
+- (void) dropCommits {
+    
+    if (commitCount == 0) {
+        return;
+    }
+    dispatch_sync(commitQueue, ^{});
+    for (size_t n = 0; n < commitCount; n++) {
+        PaintStrokeStoreFree(&commits[n]->strokes);
+        free(commits[n]->tiles);
+        free(commits[n]);
+    }
+    memset(tileCommits, 0, PaintTileGridCount(&grid) * sizeof(unsigned long long));
+    commitCount    = 0;
+    commitsPainted = commitsQueued;
+}
+
+#pragma mark - Timeline
+
+// A stroke of the store goes into the timeline as well, at the index it has there. If the
+// timeline cannot take it, it stops recording rather than get the indices wrong:
+
+- (void) recordStroke:(size_t)index from:(double)start to:(double)end {
+    
+    if (!timelineRecording) {
+        return;
+    }
+    const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&strokes, index);
+    long recorded = PaintStrokeTimelineAdd(&timeline, PaintStrokeStorePoints(&strokes, stroke),
+                                           PaintStrokeStoreWidths(&strokes, stroke), stroke->pointCount,
+                                           PaintStrokeStoreStyle(stroke), start, end);
+    if (recorded < 0 || (size_t)recorded != timelineBase + index) {
+        NSLog(@"Stroke timeline stopped at %lu strokes", (unsigned long)timeline.store.count);
+        timelineRecording = NO;
+    }
+}
+
+- (const PaintStrokeTimeline *) strokeTimeline {
+    
+    [self finishDrawing];
+    return &timeline;
+}
+
+// Seeking makes the keyframes up to time first, the first seek far into a session takes longer:
+
+- (BOOL) paintTimelineAt:(CFTimeInterval)time intoTiles:(uint32_t *const *)tiles {
+    
+    [self finishDrawing];
+    [self finishCommits];
+    if (!rasterPool) {
+        rasterPool = PaintRasterPoolCreate(0);
+    }
+    return rasterPool && PaintStrokeTimelineSeek(&timeline, rasterPool, time, tiles) == 0;
+}
+
+// Every seek paints all tiles of the timeline into images of their own, which go into the
+// layers of the review; it lies over the bitmap and under the layers of the live lines:
+
+- (BOOL) reviewTimelineAt:(CFTimeInterval)time {
+    
+    size_t count = PaintTileGridCount(&timeline.grid);
+    if (count == 0) {
+        return NO;
+    }
+    CFMutableDataRef data[count];
+    uint32_t *tiles[count];
+    BOOL ready = YES;
+    for (size_t index = 0; index < count; index++) {
+        size_t bytes = PaintTileGridTileBytes(&timeline.grid, index);
+        data[index]  = CFDataCreateMutable(NULL, bytes);
+        tiles[index] = NULL;
+        if (data[index]) {
+            CFDataSetLength(data[index], bytes);
+            tiles[index] = (uint32_t *)CFDataGetMutableBytePtr(data[index]);
+        }
+        ready = ready && tiles[index];
+    }
+    ready = ready && [self paintTimelineAt:time intoTiles:tiles];
+    if (ready && !reviewLayer) {
+        reviewLayer       = [CALayer layer];
+        reviewLayer.frame = CGRectMake(0.0, 0.0, timeline.grid.width, timeline.grid.height);
+        [self.layer insertSublayer:reviewLayer above:tileLayer];
+        for (size_t index = 0; index < count; index++) {
+            double x, y, w, h;
+            PaintTileGridTileRect(&timeline.grid, index, &x, &y, &w, &h);
+            
+            CALayer *layer = [CALayer layer];
+            layer.frame    = CGRectMake(x, y, w, h);
+            layer.actions  = @{ @"contents" : [NSNull null] };
+            layer.opaque   = YES;
+            [reviewLayer addSublayer:layer];
+        }
+    }
+    for (size_t index = 0; index < count; index++) {
+        if (ready) {
+            size_t pixelsWide, pixelsHigh;
+            PaintTileGridTilePixels(&timeline.grid, index, &pixelsWide, &pixelsHigh);
+            CGImageRef image = PaintViewCreateImage(data[index], pixelsWide, pixelsHigh);
+            [reviewLayer.sublayers[index] setContents:(__bridge id)image];
+            CGImageRelease(image);
+        }
+        if (data[index]) CFRelease(data[index]);
+    }
+    return ready;
+}
+
+- (void) endTimelineReview {
+    
+    [reviewLayer removeFromSuperlayer];
+    reviewLayer = nil;
+}
+
+#pragma mark - Opening Drawings
 
-- (void) addPath:(CGPathRef)path with:(PaintViewLine *)line {
+// The strokes of a drawing which reach into the visible part of the view are painted right
+// away, into the whole tiles under it; those tiles are complete then and the first frame can
+// show them. A serial queue decodes all strokes in chunks meanwhile, the main thread puts each
+// chunk into the store and paints it into the other tiles. The chunks come in the order of the
+// file, so every tile gets its strokes in the order they were drawn.
+
+- (BOOL) openDrawing:(NSString *)path {
     
-    // Prepare drawing into the layer before it is copied to the bitmap:
-    UIGraphicsPushContext(lineContext);
-    UIColor *color = [self lineColorFor:line];
-    CGContextSetStrokeColorWithColor(lineContext, [color CGColor]);
-    CGContextSetLineWidth(lineContext, 0.5 * line.width);
-    CGContextSetLineJoin(lineContext, kCGLineJoinRound);
-    CGContextSetLineCap(lineContext, kCGLineCapRound);
-    if (line.mode == 3) {
-        CGContextSetLineCap(lineContext, kCGLineCapButt);
+    [self clearScreen];
+    drawing = PaintStrokeReaderOpen([path fileSystemRepresentation]);
+    if (!drawing) {
+        return NO;
+    }
+    drawingStart = CACurrentMediaTime();
+    drawingNext  = 0;
+    drawingDone  = [self visibleTiles];
+    
+    size_t count = 0;
+    if (!CGRectIsNull(drawingDone)) {
+        PaintStrokeBounds bounds = { CGRectGetMinX(drawingDone), CGRectGetMinY(drawingDone),
+                                     CGRectGetMaxX(drawingDone), CGRectGetMaxY(drawingDone) };
+        count                    = PaintStrokeReaderQuery(drawing, bounds, NULL, 0);
+        uint32_t *indices        = malloc(MAX(count, 1) * sizeof(uint32_t));
+        PaintStrokeReaderQuery(drawing, bounds, indices, count);
+        PaintStoredPoint *points = NULL;
+        float *widths            = NULL;
+        size_t capacity          = 0;
+        for (size_t n = 0; n < count; n++) {
+            size_t pointCount = PaintStrokeReaderPointCount(drawing, indices[n]);
+            if (pointCount > capacity) {
+                free(points);
+                free(widths);
+                capacity = pointCount;
+                points   = malloc(capacity * sizeof(PaintStoredPoint));
+                widths   = malloc(capacity * sizeof(float));
+            }
+            PaintStrokeData data = { .points = points, .widths = widths };
+            if (points && widths && PaintStrokeReaderRead(drawing, indices[n], &data, capacity) > 0) {
+                [self paintPoints:points widths:data.widths count:data.count style:data.style clippedTo:drawingDone];
+            }
+        }
+        free(points);
+        free(widths);
+        free(indices);
+    }
+    NSLog(@"Drawing %@: %lu strokes, %lu in view painted in %.1f ms", [path lastPathComponent],
+          (unsigned long)PaintStrokeReaderCount(drawing), (unsigned long)count, 1e3 * (CACurrentMediaTime() - drawingStart));
+    
+    if (PaintStrokeReaderCount(drawing) == 0) {
+        [self closeDrawing];
     } else {
-        CGContextSetLineCap(lineContext, kCGLineCapRound);
+        [self decodeDrawing];
     }
-    CGContextAddPath(lineContext, path);
+    return YES;
+}
+
+// The tiles under the part of the view which is inside its window:
+
+- (CGRect) visibleTiles {
     
-    // Now paint the path into the current context:
-    CGContextStrokePath(lineContext);
-    UIGraphicsPopContext();
+    CGRect visible = self.bounds;
+    if (self.window) {
+        visible = CGRectIntersection(visible, [self convertRect:self.window.bounds fromView:nil]);
+    }
+    size_t c0, r0, c1, r1;
+    if (!PaintTileGridRange(&grid, visible.origin.x, visible.origin.y, visible.size.width, visible.size.height,
+                            &c0, &r0, &c1, &r1)) {
+        return CGRectNull;
+    }
+    CGRect tiles = CGRectMake(c0 * grid.tileSize, r0 * grid.tileSize, (c1 - c0) * grid.tileSize, (r1 - r0) * grid.tileSize);
+    return CGRectIntersection(tiles, self.bounds);
 }
 
-// Set line color to one of five preset values:
+// Strokes first … end-1 of a drawing in a store of their own. A damaged stroke stays in it
+// without points, so the strokes keep their places:
 
-- (UIColor *)lineColorFor:(PaintViewLine *)line {
+static PaintStrokeStore *PaintViewDrawingChunk(const PaintStrokeReader *reader, size_t first, size_t end) {
     
-    switch (line.color) {
-        case  9: {
-            return [UIColor colorWithRed:0.000*line.bright
-                                   green:0.800*line.bright
-                                    blue:0.300*line.bright
-                                   alpha:line.alphaValue];
+    PaintStrokeStore *chunk  = malloc(sizeof(PaintStrokeStore));
+    PaintStoredPoint *points = NULL;
+    float *widths            = NULL;
+    size_t capacity          = 0;
+    if (!chunk) {
+        return NULL;
+    }
+    PaintStrokeStoreInit(chunk);
+    for (size_t index = first; index < end; index++) {
+        size_t pointCount = PaintStrokeReaderPointCount(reader, index);
+        if (pointCount > capacity) {
+            free(points);
+            free(widths);
+            capacity = pointCount;
+            points   = malloc(capacity * sizeof(PaintStoredPoint));
+            widths   = malloc(capacity * sizeof(float));
         }
-        case  3: {
-            return [UIColor colorWithRed:1.000*line.bright
-                                   green:1.000*line.bright
-                                    blue:0.000*line.bright
-                                   alpha:0.33];
+        PaintStrokeData data = { .style = PaintLineStyleDefault(), .points = points, .widths = widths };
+        if (!points || !widths || PaintStrokeReaderRead(reader, index, &data, capacity) < 0) {
+            data.count  = 0;
+            data.widths = NULL;
         }
-        case  2: {
-            return [UIColor colorWithRed:1.000*line.bright
-                                   green:0.166*line.bright
-                                    blue:0.000*line.bright
-                                   alpha:line.alphaValue];
+        PaintStrokeStoreAppendWidths(chunk, points, data.widths, data.count, data.style);
+    }
+    free(points);
+    free(widths);
+    return chunk;
+}
+
+// Start the decoder at drawingNext. It holds no reference to the view; its chunks are handed to
+// the main thread, which lets it go on:
+
+- (void) decodeDrawing {
+    
+    if (!drawingQueue) {
+        drawingQueue = dispatch_queue_create("PaintView drawing", DISPATCH_QUEUE_SERIAL);
+    }
+    const PaintStrokeReader *reader = drawing;
+    size_t first                    = drawingNext;
+    size_t count                    = PaintStrokeReaderCount(drawing);
+    uint32_t generation             = drawingGeneration;
+    int *cancelled                  = calloc(1, sizeof(int));
+    dispatch_semaphore_t ahead      = dispatch_semaphore_create(DRAWING_AHEAD);
+    drawingCancelled                = cancelled;
+    drawingAhead                    = ahead;
+    
+    __weak PaintView *weakSelf = self;
+    dispatch_async(drawingQueue, ^{
+        for (size_t start = first; start < count; start += DRAWING_CHUNK) {
+            dispatch_semaphore_wait(ahead, DISPATCH_TIME_FOREVER);
+            if (__atomic_load_n(cancelled, __ATOMIC_ACQUIRE)) break;
+            
+            PaintStrokeStore *chunk = PaintViewDrawingChunk(reader, start, MIN(start + DRAWING_CHUNK, count));
+            if (!chunk) break;
+            
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [weakSelf addDrawingChunk:chunk generation:generation];
+                PaintStrokeStoreFree(chunk);
+                free(chunk);
+                dispatch_semaphore_signal(ahead);
+            });
         }
-        case  1: {
-            return [UIColor colorWithRed:0.000*line.bright
-                                   green:0.300*line.bright
-                                    blue:0.800*line.bright
-                                   alpha:line.alphaValue];
+    });
+}
+
+// The next strokes of the drawing go into the store and into the tiles which are not complete:
+
+- (void) addDrawingChunk:(const PaintStrokeStore *)chunk generation:(uint32_t)generation {
+    
+    if (!drawing || generation != drawingGeneration) {
+        return;
+    }
+    size_t first = strokes.count;
+    for (size_t n = 0; n < chunk->count; n++) {
+        const PaintStoredStroke *stroke = PaintStrokeStoreStroke(chunk, n);
+        long index = PaintStrokeStoreAppendWidths(&strokes, PaintStrokeStorePoints(chunk, stroke),
+                                                  PaintStrokeStoreWidths(chunk, stroke), stroke->pointCount,
+                                                  PaintStrokeStoreStyle(stroke));
+        if (index >= 0) {
+            [self indexStroke:(size_t)index];
+            [self recordStroke:(size_t)index from:drawingStart to:CACurrentMediaTime()];
         }
-        default: {
-            return [UIColor colorWithRed:1.000*line.bright
-                                   green:1.000*line.bright
-                                    blue:1.000*line.bright
-                                   alpha:1.0];
+    }
+    [self paintStrokesFrom:first to:strokes.count skippingTilesIn:drawingDone];
+    paintedStrokes = strokes.count;
+    drawingNext   += chunk->count;
+    if (drawingNext >= PaintStrokeReaderCount(drawing)) {
+        NSLog(@"Drawing complete: %lu strokes, %lu points in %.1f ms", (unsigned long)strokes.count,
+              (unsigned long)strokes.pointCount, 1e3 * (CACurrentMediaTime() - drawingStart));
+        [self closeDrawing];
+    }
+}
+
+// Stop the decoder and wait until it has stopped; chunks it has handed over are thrown away:
+
+- (void) stopDecodingDrawing {
+    
+    if (!drawingCancelled) {
+        return;
+    }
+    drawingGeneration++;
+    __atomic_store_n(drawingCancelled, 1, __ATOMIC_RELEASE);
+    dispatch_semaphore_signal(drawingAhead);
+    dispatch_sync(drawingQueue, ^{});
+    free(drawingCancelled);
+    drawingCancelled = NULL;
+    drawingAhead     = nil;
+}
+
+// Put the rest of the drawing into the store and the bitmap right now:
+
+- (void) finishDrawing {
+    
+    if (!drawing) {
+        return;
+    }
+    [self stopDecodingDrawing];
+    while (drawing) {
+        size_t end              = MIN(drawingNext + DRAWING_CHUNK, PaintStrokeReaderCount(drawing));
+        PaintStrokeStore *chunk = PaintViewDrawingChunk(drawing, drawingNext, end);
+        if (!chunk) {
+            [self closeDrawing];
+            break;
         }
+        [self addDrawingChunk:chunk generation:drawingGeneration];
+        PaintStrokeStoreFree(chunk);
+        free(chunk);
     }
 }
 
+// Forget the drawing, whatever of it is not in the store yet:
+
+- (void) closeDrawing {
+    
+    [self stopDecodingDrawing];
+    PaintStrokeReaderClose(drawing);
+    drawing = NULL;
+}
+
+// This method paints a path into the tiles of the bitmap at the base of the displayed picture.
+// With a finite clip, nothing outside of it changes. A filled path is the outline of a line
+// whose width changes, it is filled with the color of the line instead of stroked.
+
+- (void) addPath:(CGPathRef)path with:(PaintViewLine *)line filled:(BOOL)filled clippedTo:(CGRect)clip {
+    
+    // Only the tiles under the path (plus the line width) get painted:
+    CGRect bounds = CGRectInset(CGPathGetBoundingBox(path), -line.width, -line.width);
+    BOOL clipped  = !CGRectIsInfinite(clip);
+    if (clipped) {
+        bounds = CGRectIntersection(bounds, clip);
+    }
+    size_t c0, r0, c1, r1;
+    if (!PaintTileGridRange(&grid, bounds.origin.x, bounds.origin.y, bounds.size.width, bounds.size.height,
+                            &c0, &r0, &c1, &r1)) {
+        return;
+    }
+    CGColorRef color = [[self lineColorFor:line] CGColor];
+    for (size_t row = r0; row < r1; row++) {
+        for (size_t column = c0; column < c1; column++) {
+            CGContextRef context = [self contextForTile:row * grid.columns + column];
+            if (!context) continue;
+            
+            CGContextSetStrokeColorWithColor(context, color);
+            CGContextSetFillColorWithColor(context, color);
+            CGContextSetLineWidth(context, 0.5 * line.width);
+            CGContextSetLineJoin(context, kCGLineJoinRound);
+            if (line.mode == 3) {
+                CGContextSetLineCap(context, kCGLineCapButt);
+            } else {
+                CGContextSetLineCap(context, kCGLineCapRound);
+            }
+            CGContextAddPath(context, path);
+            
+            // Now paint the path into the tile:
+            if (clipped) {
+                CGContextSaveGState(context);
+                CGContextClipToRect(context, clip);
+            }
+            if (filled) {
+                CGContextFillPath(context);
+            } else {
+                CGContextStrokePath(context);
+            }
+            if (clipped) {
+                CGContextRestoreGState(context);
+            }
+        }
+    }
+    PaintTileGridMarkRect(&grid, bounds.origin.x, bounds.origin.y, bounds.size.width, bounds.size.height);
+    [self setNeedsLayout];
+}
+
+// Set line color to one of five preset values. The rasterizer has the table:
+
+- (UIColor *)lineColorFor:(PaintViewLine *)line {
+    
+    double rgba[4];
+    PaintRasterStyleColor([line style], rgba);
+    return [UIColor colorWithRed:rgba[0] green:rgba[1] blue:rgba[2] alpha:rgba[3]];
+}
+
 #pragma mark - Rect Drawing
 
 // Paint the red and green rectangles in their layers:
@@ -171,26 +1215,182 @@
     [redLayer setFrame:palmRect];
 }
 
-// Redraw the screen. Called by the OS when provoked by setNeedsDisplay.
+#pragma mark - Presentation
 
-- (void) drawRect:(CGRect)rect {
+// Called by the OS when provoked by setNeedsLayout. Only the tiles which changed since the last
+// time get a new image, but not while the commit queue paints into them; they stay dirty. There
+// is no drawRect:, so the view has no full size backing store.
+
+- (void) layoutSubviews {
     
-    CGContextRef context = UIGraphicsGetCurrentContext();
+    [super layoutSubviews];
+    [self presentDirtyTiles];
+}
+
+- (void) presentDirtyTiles {
     
-    // Paint the bitmap, which includes the confirmed lines:
-    if (lineContext) {
-        CGImageRef cacheImage = CGBitmapContextCreateImage(lineContext);
-        CGContextDrawImage(context, CGRectApplyAffineTransform(self.bounds, self.flipTransform), cacheImage);
-        CGImageRelease(cacheImage);
+    NSArray *layers = tileLayer.sublayers;
+    size_t count    = PaintTileGridCount(&grid);
+    for (size_t index = PaintTileGridNextDirty(&grid, 0); index < count; index = PaintTileGridNextDirty(&grid, index + 1)) {
+        if (tileCommits[index]) continue;
+        
+        CGImageRef image = [self createImageOfTile:index];
+        [layers[index] setContents:(__bridge id)image];
+        CGImageRelease(image);
+        PaintTileGridPresented(&grid, index);
     }
     
     // Reset the clipRects:
     self.clipRect = CGRectNull;
 }
 
+// A copy of what a tile shows, NULL for a white one. A packed tile is unpacked for it and stays
+// packed, an evicted one is painted again:
+
+- (CGImageRef) createImageOfTile:(size_t)index {
+    
+    if (PaintTileStoreState(&tileStore, index) == PaintTileBlank) {
+        return NULL;
+    }
+    if (PaintTileStoreState(&tileStore, index) == PaintTileEvicted && ![self contextForTile:index]) {
+        return NULL;
+    }
+    size_t pixelsWide, pixelsHigh;
+    PaintTileGridTilePixels(&grid, index, &pixelsWide, &pixelsHigh);
+    size_t bytes          = PaintTileGridTileBytes(&grid, index);
+    CFMutableDataRef data = CFDataCreateMutable(NULL, bytes);
+    CFDataSetLength(data, bytes);
+    if (PaintTileStoreRead(&tileStore, index, (uint32_t *)CFDataGetMutableBytePtr(data)) != 0) {
+        CFRelease(data);
+        return NULL;
+    }
+    CGImageRef image = PaintViewCreateImage(data, pixelsWide, pixelsHigh);
+    CFRelease(data);
+    return image;
+}
+
+- (unsigned long long) tilesPresented {
+    
+    return grid.tilesPresented;
+}
+
+- (unsigned long long) bytesPresented {
+    
+    return grid.bytesPresented;
+}
+
+#pragma mark - Tile Memory
+
+// Tiles which have not been painted into for tileIdleTime are packed on a queue of their own.
+// One check is waiting at a time:
+
+- (void) schedulePacking {
+    
+    if (packScheduled) {
+        return;
+    }
+    packScheduled              = YES;
+    __weak PaintView *weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.pvData.tileIdleTime * NSEC_PER_SEC)),
+                   dispatch_get_main_queue(), ^{
+        [weakSelf packIdleTiles];
+    });
+}
+
+// The view stays until the tiles it handed out are back, so their pixels are never lost:
+
+- (void) packIdleTiles {
+    
+    packScheduled   = NO;
+    size_t count    = PaintTileGridCount(&grid);
+    size_t *indices = malloc(count * sizeof(size_t));
+    size_t idle     = indices ? PaintTileStoreIdle(&tileStore, CACurrentMediaTime(), self.pvData.tileIdleTime,
+                                                   indices, count) : 0;
+    if (PaintTileStoreCount(&tileStore, PaintTileLive) > idle) {
+        [self schedulePacking];
+    }
+    for (size_t n = 0; n < idle; n++) {
+        size_t index = indices[n];
+        if (tileCommits[index]) continue;
+        
+        uint32_t generation;
+        const uint32_t *pixels = PaintTileStoreBeginPacking(&tileStore, index, &generation);
+        size_t pixelCount      = PaintTileGridTileBytes(&grid, index) / sizeof(uint32_t);
+        uint32_t tiles         = tilesGeneration;
+        dispatch_async(packQueue, ^{
+            uint8_t *packed = malloc(PaintTilePackedMaxBytes(pixelCount));
+            size_t bytes    = packed ? PaintTilePack(pixels, pixelCount, packed) : 0;
+            dispatch_async(dispatch_get_main_queue(), ^{
+                [self finishPackingTile:index of:tiles generation:generation pixels:pixels packed:packed bytes:bytes];
+            });
+        });
+    }
+    free(indices);
+}
+
+// A packed tile is back and the store keeps to its budget. While a drawing is being opened its
+// tiles have strokes which are not in the store yet, and while the commit queue paints into
+// tiles they must keep their pixels; nothing is evicted then. A tile of tiles which are gone is
+// thrown away:
+
+- (void) finishPackingTile:(size_t)index of:(uint32_t)tiles generation:(uint32_t)generation
+                    pixels:(const uint32_t *)pixels packed:(uint8_t *)packed bytes:(size_t)bytes {
+    
+    if (tiles != tilesGeneration) {
+        free(packed);
+        return;
+    }
+    PaintTileStoreFinishPacking(&tileStore, index, generation, pixels, packed, bytes);
+    if (!drawing && commitCount == 0) {
+        PaintTileStoreTrim(&tileStore, self.pvData.tileBudget);
+    }
+    [self releaseStaleContexts];
+}
+
+// On a memory warning every tile which is not being packed gives up its memory. The layers go
+// on showing their images; an evicted tile is painted from the strokes when a line reaches it.
+
+- (void) shrinkTiles {
+    
+    if (drawing) {
+        return;
+    }
+    [self finishCommits];
+    size_t bytes   = PaintTileStoreBytes(&tileStore);
+    size_t evicted = PaintTileStoreTrim(&tileStore, 0);
+    [self releaseStaleContexts];
+    NSLog(@"Bitmap tiles: %lu evicted, %.1f MB freed", (unsigned long)evicted,
+          (bytes - PaintTileStoreBytes(&tileStore)) / 1e6);
+}
+
+- (NSString *) tileReport {
+    
+    size_t full = 0;
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        full += PaintTileGridTileBytes(&grid, index);
+    }
+    return [NSString stringWithFormat:@"Bitmap tiles: %lu white, %lu with pixels, %lu packed, %lu evicted; "
+            "%.1f MB of %.1f MB, %llu packed, %llu unpacked, %llu evicted so far",
+            (unsigned long)PaintTileStoreCount(&tileStore, PaintTileBlank),
+            (unsigned long)(PaintTileStoreCount(&tileStore, PaintTileLive) + PaintTileStoreCount(&tileStore, PaintTilePacking)),
+            (unsigned long)PaintTileStoreCount(&tileStore, PaintTilePacked),
+            (unsigned long)PaintTileStoreCount(&tileStore, PaintTileEvicted),
+            PaintTileStoreBytes(&tileStore) / 1e6, full / 1e6,
+            tileStore.packs, tileStore.unpacks, tileStore.evictions];
+}
+
 #pragma mark - Cleanup
 
 - (void) dealloc {
+    
+    [self closeDrawing];
+    [self destroyTiles];
+    PaintStrokeStoreFree(&strokes);
+    PaintStrokeIndexFree(&strokeIndex);
+    PaintStrokeOutlineFree(&outline);
+    PaintStrokeTimelineFree(&timeline);
+    PaintRasterPoolDestroy(rasterPool);
+    free(commits);
 }
 
 @end
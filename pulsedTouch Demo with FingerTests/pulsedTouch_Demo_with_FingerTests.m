@@ -8,6 +8,24 @@
 
 #import <UIKit/UIKit.h>
 #import <XCTest/XCTest.h>
+#import "PaintSplines.h"
+#import "PaintLatency.h"
+#import "PaintPredictor.h"
+#import "PaintRasterizer.h"
+#import "PaintSplineKernel.h"
+#import "PaintStrokeEngine.h"
+#import "PaintStrokeFile.h"
+#import "PaintStrokeIndex.h"
+#import "PaintStrokeOutline.h"
+#import "PaintStrokePipeline.h"
+#import "PaintStrokeLayer.h"
+#import "PaintStrokeStore.h"
+#import "PaintStrokeTimeline.h"
+#import "PaintTileGrid.h"
+#import "PaintTileStore.h"
+#import "PaintTouchLoad.h"
+#import "PaintTouchRecorder.h"
+#import "PaintView.h"
 
 @interface pulsedTouch_Demo_with_FingerTests : XCTestCase
 
@@ -30,11 +48,1058 @@
     XCTAssert(YES, @"Pass");
 }
 
-- (void)testPerformanceExample {
-    // This is an example of a performance test case.
+// A short pen line sampled at 240 Hz:
+
+- (NSArray *)touchesForTestLine:(NSUInteger)count {
+    
+    NSMutableArray *touches = [[NSMutableArray alloc] initWithCapacity:count];
+    for (NSUInteger n = 0; n < count; n++) {
+        SID_Touch *touch     = [[SID_Touch alloc] init];
+        touch.timestamp      = n / 240.0;
+        touch.point          = CGPointMake(100.0 + 3.0 * n, 200.0 + 40.0 * sin(0.2 * n));
+        touch.velocity       = CGPointMake(720.0, 1900.0 * cos(0.2 * n));
+        touch.classification = 1;
+        [touches addObject:touch];
+    }
+    return touches;
+}
+
+- (void)testSplineKernelFollowsTheBasisFunctions {
+    
+    PaintPoint p[4] = { { 0, 0 }, { 10, 5 }, { 20, -5 }, { 30, 0 } };
+    PaintSplineSegment segment;
+    PaintSplineSegmentMake(&segment, p[0], p[1], p[2], p[3]);
+    PaintPoint points[16];
+    for (size_t interpol = 0; interpol < 16; interpol++) {
+        size_t count = PaintSplineSegmentEvaluate(&segment, interpol + 0.5, interpol, points);
+        XCTAssertEqual(count, interpol > 1 ? interpol - 1 : 0);
+        for (size_t i = 0; i < count; i++) {
+            double t    = (i + 1) / (interpol + 0.5), s = 1.0 - t;
+            double b[4] = { s * s * s / 6.0, (3 * t * t * t - 6 * t * t + 4) / 6.0,
+                            (-3 * t * t * t + 3 * t * t + 3 * t + 1) / 6.0, t * t * t / 6.0 };
+            XCTAssertEqualWithAccuracy(points[i].x, b[0] * p[0].x + b[1] * p[1].x + b[2] * p[2].x + b[3] * p[3].x, 1e-9);
+            XCTAssertEqualWithAccuracy(points[i].y, b[0] * p[0].y + b[1] * p[1].y + b[2] * p[2].y + b[3] * p[3].y, 1e-9);
+        }
+    }
+}
+
+- (void)testSegmentStepsKeepDeviationWithinTolerance {
+    
+    // A straight segment needs no inner points, however fast it was drawn:
+    PaintSplineSegment segment;
+    PaintSplineSegmentMake(&segment, (PaintPoint){ 0, 0 }, (PaintPoint){ 10, 0 }, (PaintPoint){ 20, 0 }, (PaintPoint){ 30, 0 });
+    XCTAssertEqual(PaintSplineSegmentSteps(&segment, 0.25, 16), (size_t)1);
+    
+    // A tight curve gets just enough steps to stay within the tolerance:
+    PaintSplineSegmentMake(&segment, (PaintPoint){ 0, 0 }, (PaintPoint){ 10, 10 }, (PaintPoint){ 20, -10 }, (PaintPoint){ 30, 0 });
+    size_t steps = PaintSplineSegmentSteps(&segment, 0.25, 16);
+    XCTAssertTrue(steps > 1 && steps < 16);
+    double deviation = 0.0;
+    for (size_t i = 0; i < steps; i++) {
+        double t0 = (double)i / steps, t1 = (double)(i + 1) / steps;
+        double x0 = ((segment.c0x * t0 + segment.c1x) * t0 + segment.c2x) * t0 + segment.c3x;
+        double y0 = ((segment.c0y * t0 + segment.c1y) * t0 + segment.c2y) * t0 + segment.c3y;
+        double x1 = ((segment.c0x * t1 + segment.c1x) * t1 + segment.c2x) * t1 + segment.c3x;
+        double y1 = ((segment.c0y * t1 + segment.c1y) * t1 + segment.c2y) * t1 + segment.c3y;
+        for (size_t k = 1; k < 32; k++) {
+            double t = t0 + (t1 - t0) * k / 32.0;
+            double x = ((segment.c0x * t + segment.c1x) * t + segment.c2x) * t + segment.c3x;
+            double y = ((segment.c0y * t + segment.c1y) * t + segment.c2y) * t + segment.c3y;
+            double d = fabs((x1 - x0) * (y - y0) - (y1 - y0) * (x - x0)) / hypot(x1 - x0, y1 - y0);
+            deviation = fmax(deviation, d);
+        }
+    }
+    XCTAssertTrue(deviation <= 0.25);
+}
+
+- (void)testFlatSplineIncrementMatchesBoxedVariant {
+    
+    PaintSplines *splines = [[PaintSplines alloc] initWithData:[[PaintViewData alloc] init]];
+    NSArray *touches      = [self touchesForTestLine:40];
+    NSArray *lineIncr     = [touches subarrayWithRange:NSMakeRange(30, 10)];
+    
+    NSMutableArray *boxed = [splines splineIncrement:lineIncr forLine:touches];
+    CGPoint flat[[splines maxPointsForIncrement:[lineIncr count]]];
+    NSUInteger count      = [splines splineIncrement:lineIncr forLine:touches toPoints:flat];
+    XCTAssertEqual(count, [boxed count]);
+    for (NSUInteger n = 0; n < count; n++) {
+        XCTAssertTrue(CGPointEqualToPoint(flat[n], [boxed[n] CGPointValue]));
+    }
+}
+
+- (void)testSplineStreamIsIndependentOfIncrementSize {
+    
+    PaintSplines *splines = [[PaintSplines alloc] initWithData:[[PaintViewData alloc] init]];
+    NSArray *touches      = [self touchesForTestLine:60];
+    
+    PaintViewLine *whole  = [[PaintViewLine alloc] init];
+    CGPoint expected[[splines maxPointsForIncrement:[touches count]]];
+    NSUInteger length     = [splines splineIncrement:touches ofLine:whole toPoints:expected];
+    XCTAssertTrue(CGPointEqualToPoint(expected[0], [touches[0] point]));
+    
+    // Each increment starts with the point where the previous one stopped:
+    PaintViewLine *pieces = [[PaintViewLine alloc] init];
+    CGPoint points[[splines maxPointsForIncrement:7]];
+    NSUInteger index      = 0;
+    for (NSUInteger n = 0; n < [touches count]; n += 7) {
+        NSArray *lineIncr = [touches subarrayWithRange:NSMakeRange(n, MIN(7, [touches count] - n))];
+        NSUInteger count  = [splines splineIncrement:lineIncr ofLine:pieces toPoints:points];
+        for (NSUInteger i = (n > 0) ? 1 : 0; i < count; i++) {
+            XCTAssertTrue(index < length);
+            XCTAssertTrue(CGPointEqualToPoint(points[i], expected[index++]));
+        }
+    }
+    XCTAssertEqual(index, length);
+}
+
+- (void)testLineKeepsTouchesInColumns {
+    
+    NSArray *touches    = [self touchesForTestLine:1000];
+    PaintViewLine *line = [[PaintViewLine alloc] init];
+    for (NSUInteger n = 0; n < [touches count]; n += 8) {
+        [line addIncrement:[touches subarrayWithRange:NSMakeRange(n, MIN(8, [touches count] - n))]];
+    }
+    
+    const PaintTouchColumns *columns = [line touchColumns];
+    XCTAssertEqual(columns->count, (size_t)1000);
+    for (NSUInteger n = 0; n < [touches count]; n++) {
+        PaintSplineControl control = PaintTouchColumnsControl(columns, n);
+        XCTAssertTrue(CGPointEqualToPoint(CGPointMake(control.point.x, control.point.y), [touches[n] point]));
+        XCTAssertEqual(control.timestamp, [touches[n] timestamp]);
+        XCTAssertEqual(PaintTouchColumnsClassification(columns, n), 1);
+    }
+    
+    // A handful of chunks for the whole line, all of them gone in one go:
+    XCTAssertTrue(columns->arena.chunkCount <= 8);
+    [line releaseTouches];
+    XCTAssertEqual(columns->count, (size_t)0);
+    XCTAssertEqual(columns->arena.chunkCount, (size_t)0);
+}
+
+- (void)testStrokeLayerKeepsAllPointsAcrossSegments {
+    
+    PaintStrokeLayer *layer = [PaintStrokeLayer layer];
+    NSUInteger total        = 3 * [PaintStrokeLayer segmentLength] + 17;
+    CGPoint points[total];
+    for (NSUInteger n = 0; n < total; n++) {
+        points[n] = CGPointMake(n, 0.5 * n);
+    }
+    
+    // Feed in uneven increments, the tail gets replaced each time:
+    CGPoint tail[2] = { CGPointMake(-1.0, -1.0), CGPointMake(-2.0, -2.0) };
+    for (NSUInteger n = 0; n < total; n += 5) {
+        [layer appendPoints:points + n count:MIN(5, total - n) withTail:tail count:2];
+    }
+    [layer appendPoints:NULL count:0 withTail:NULL count:0];
+    XCTAssertEqual(layer.pointCount, total);
+    XCTAssertEqual([layer.sublayers count], (total - 3) / ([PaintStrokeLayer segmentLength] - 2) + 1);
+    XCTAssertTrue(CGRectEqualToRect(layer.strokeBounds, CGRectMake(0.0, 0.0, total - 1, 0.5 * (total - 1))));
+    
+    CGMutablePathRef path = [layer createPath];
+    XCTAssertTrue(CGPointEqualToPoint(CGPathGetCurrentPoint(path), points[total - 1]));
+    CGPathRelease(path);
+}
+
+- (void)testTouchRecorderWritesRecordsInOrder {
+    
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"test.ptrc"];
+    PaintTouchRecorder *recorder = PaintTouchRecorderOpen([path fileSystemRepresentation], 64);
+    XCTAssertTrue(recorder != NULL);
+    
+    PaintTouchRecord records[100];
+    for (NSUInteger n = 0; n < 100; n++) {
+        records[n] = (PaintTouchRecord){ .timestamp = n / 240.0, .x = n, .y = 2 * n, .lineID = (uint32_t)(n / 10),
+                                         .classification = 1, .state = (n % 10) ? 2 : 1, .phase = 2 };
+    }
+    
+    // Retry when the ring is full, the writer thread catches up:
+    for (NSUInteger n = 0; n < 100; ) {
+        n += PaintTouchRecorderAppend(recorder, records + n, MIN(7, 100 - n));
+    }
+    XCTAssertEqual(PaintTouchRecorderClose(recorder), 0);
+    
+    FILE *file = PaintTouchRecordOpen([path fileSystemRepresentation]);
+    XCTAssertTrue(file != NULL);
+    PaintTouchRecord check[101];
+    XCTAssertEqual(PaintTouchRecordRead(file, check, 101), (size_t)100);
+    XCTAssertEqual(memcmp(check, records, sizeof(records)), 0);
+    fclose(file);
+}
+
+- (void)testTileGridCountsBytesOfTouchedTilesOnly {
+    
+    PaintTileGrid grid;
+    XCTAssertEqual(PaintTileGridInit(&grid, 1024.0, 768.0, 128.0, 2.0), 0);
+    XCTAssertEqual(PaintTileGridCount(&grid), (size_t)48);
+    for (size_t index = 0; index < PaintTileGridCount(&grid); index++) {
+        PaintTileGridPresented(&grid, index);
+    }
+    XCTAssertEqual(grid.bytesPresented, (uint64_t)(4 * 2048 * 1536));
+    XCTAssertEqual(PaintTileGridNextDirty(&grid, 0), PaintTileGridCount(&grid));
+    
+    // A short stroke inside one tile, one across a vertical edge and one across a corner:
+    XCTAssertEqual(PaintTileGridMarkRect(&grid,  10.0,  10.0, 20.0, 20.0), (size_t)1);
+    XCTAssertEqual(PaintTileGridMarkRect(&grid, 120.0,  10.0, 20.0, 20.0), (size_t)2);
+    XCTAssertEqual(PaintTileGridMarkRect(&grid, 250.0, 250.0, 20.0, 20.0), (size_t)4);
+    XCTAssertEqual(PaintTileGridMarkRect(&grid, 2000.0, 10.0, 20.0, 20.0), (size_t)0);
+    XCTAssertEqual(grid.dirtyCount, (size_t)6);
+    
+    grid.bytesPresented = 0;
+    for (size_t index = PaintTileGridNextDirty(&grid, 0); index < PaintTileGridCount(&grid);
+         index = PaintTileGridNextDirty(&grid, index + 1)) {
+        PaintTileGridPresented(&grid, index);
+    }
+    XCTAssertEqual(grid.bytesPresented, (uint64_t)(6 * 4 * 256 * 256));
+    XCTAssertEqual(grid.dirtyCount, (size_t)0);
+    PaintTileGridFree(&grid);
+}
+
+- (void)testLineTableKeepsFindingLinesAcrossRemovals {
+    
+    PaintLineTable table;
+    XCTAssertEqual(PaintLineTableInit(&table, 4), 0);
+    static int values[1000];
+    for (uint32_t lineID = 0; lineID < 1000; lineID++) {
+        PaintLineTableInsert(&table, lineID)->value = &values[lineID];
+    }
+    for (uint32_t lineID = 0; lineID < 1000; lineID += 2) {
+        PaintLineTableRemove(&table, PaintLineTableFind(&table, lineID));
+    }
+    XCTAssertEqual(table.count, (size_t)500);
+    for (uint32_t lineID = 0; lineID < 1000; lineID++) {
+        PaintLineTableEntry *entry = PaintLineTableFind(&table, lineID);
+        if (lineID % 2) {
+            XCTAssertTrue(entry != NULL && entry->value == &values[lineID]);
+        } else {
+            XCTAssertTrue(entry == NULL);
+        }
+    }
+    PaintLineTableFree(&table);
+}
+
+- (void)testStrokeStoreKeepsSimplifiedLineWithinTolerance {
+    
+    // Half a circle of radius 100 with 2000 points, plus a straight tail:
+    PaintPoint points[2000], tail[10];
+    for (size_t n = 0; n < 2000; n++) {
+        points[n] = (PaintPoint){ 200.0 + 100.0 * cos(M_PI * n / 1999), 200.0 + 100.0 * sin(M_PI * n / 1999) };
+    }
+    for (size_t n = 0; n < 10; n++) {
+        tail[n] = (PaintPoint){ 100.0, 200.0 - 10.0 * (n + 1) };
+    }
+    PaintLineStyle style = { .mode = 20, .color = 2, .width = 7.0, .alpha = 0.5, .bright = 0.8 };
+    PaintStrokeStore store;
+    PaintStrokeStoreInit(&store);
+    XCTAssertEqual(PaintStrokeStoreAdd(&store, points, 2000, tail, 10, style, 0.25), 0L);
+    
+    const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&store, 0);
+    const PaintStoredPoint  *kept   = PaintStrokeStorePoints(&store, stroke);
+    XCTAssertEqual(stroke->pointsIn, (uint32_t)2010);
+    XCTAssertLessThan(stroke->pointCount, (uint32_t)100);
+    XCTAssertEqual(kept[0].x, 300.0f);
+    XCTAssertEqual(kept[stroke->pointCount - 1].y, 100.0f);
+    XCTAssertEqual(PaintStrokeStoreStyle(stroke).mode, 20);
+    XCTAssertEqual(PaintStrokeStoreStyle(stroke).width, 7.0);
+    XCTAssertEqual(PaintStrokeStoreBytes(&store), PaintStrokeStoreStrokeBytes(stroke));
+    
+    // No point of the circle is farther than the tolerance from the kept polygon:
+    for (size_t n = 0; n < 2000; n++) {
+        double nearest = 1e30;
+        for (uint32_t segment = 0; segment + 1 < stroke->pointCount; segment++) {
+            double ax = kept[segment].x, ay = kept[segment].y;
+            double dx = kept[segment + 1].x - ax, dy = kept[segment + 1].y - ay;
+            double t  = fmax(0.0, fmin(1.0, ((points[n].x - ax) * dx + (points[n].y - ay) * dy) / (dx * dx + dy * dy)));
+            nearest   = fmin(nearest, hypot(points[n].x - ax - t * dx, points[n].y - ay - t * dy));
+        }
+        XCTAssertLessThan(nearest, 0.25 + 1e-3);
+    }
+    PaintStrokeStoreFree(&store);
+}
+
+- (void)testStrokeIndexAnswersRectQueriesLikeAScan {
+    
+    // A 100 x 100 grid of 8 pt strokes, 10 pt apart. Stroke 0 grows across the canvas:
+    PaintStrokeIndex index;
+    XCTAssertEqual(PaintStrokeIndexInit(&index, 64.0f, 64), 0);
+    for (uint32_t item = 0; item < 10000; item++) {
+        float x = 10.0f * (item % 100), y = 10.0f * (item / 100);
+        XCTAssertEqual(PaintStrokeIndexInsert(&index, item, (PaintStrokeBounds){ x, y, x + 8.0f, y + 8.0f }), 0);
+    }
+    PaintStrokeIndexInsert(&index, 0, (PaintStrokeBounds){ 500.0f, 500.0f, 505.0f, 505.0f });
+    for (uint32_t item = 1; item < 10000; item += 2) {
+        PaintStrokeIndexRemove(&index, item);
+    }
+    XCTAssertEqual(index.count, (size_t)5000);
+    
+    uint32_t found[10000];
+    size_t count = PaintStrokeIndexQuery(&index, (PaintStrokeBounds){ 495.0f, 495.0f, 515.0f, 515.0f }, found, 10000);
+    BOOL grown   = NO;
+    for (size_t n = 0; n < count; n++) {
+        XCTAssertEqual(found[n] % 2, (uint32_t)0);
+        grown |= found[n] == 0;
+    }
+    
+    // Of the strokes at x, y = 490 … 510 only the even ones 4950, 5050 and 5150 are left, plus stroke 0:
+    XCTAssertTrue(grown);
+    XCTAssertEqual(count, (size_t)4);
+    XCTAssertEqual(PaintStrokeIndexQuery(&index, (PaintStrokeBounds){ 2000.0f, 2000.0f, 2100.0f, 2100.0f }, found, 10000), (size_t)0);
+    PaintStrokeIndexFree(&index);
+}
+
+- (void)testRasterizerPaintsStoredStrokeIntoTiles {
+    
+    // A red 8 pt stroke across a 256 x 256 pt canvas at y = 100, painted at scale 2 into 64 pt tiles:
+    PaintStrokeStore store;
+    PaintStrokeStoreInit(&store);
+    PaintPoint line[]    = { { 20.0, 100.0 }, { 120.0, 101.0 }, { 230.0, 100.0 } };
+    PaintLineStyle style = PaintLineStyleDefault();
+    style.mode  = 20;
+    style.color = 2;
+    style.width = 8.0;
+    PaintStrokeStoreAdd(&store, line, 3, NULL, 0, style, 0.25);
+    PaintTileGrid grid;
+    PaintTileGridInit(&grid, 256.0, 256.0, 64.0, 2.0);
+    XCTAssertEqual(PaintTileGridCount(&grid), (size_t)16);
+    
+    uint32_t *one[16], *four[16];
+    for (size_t index = 0; index < 16; index++) {
+        one[index]  = malloc(128 * 128 * sizeof(uint32_t));
+        four[index] = malloc(128 * 128 * sizeof(uint32_t));
+    }
+    PaintRasterPool *single = PaintRasterPoolCreate(1);
+    PaintRasterPool *pool   = PaintRasterPoolCreate(4);
+    XCTAssertEqual(PaintRasterizeStrokes(single, &store, &grid, one), 0);
+    XCTAssertEqual(PaintRasterizeStrokes(pool, &store, &grid, four), 0);
+    
+    // On the stroke it is the color of lineColorFor:, 10 pt beyond its end and far off it is white:
+    XCTAssertEqual(one[5][72 * 128 + 72], (uint32_t)0xffcc2200);
+    XCTAssertEqual(one[7][72 * 128 + 96], (uint32_t)0xffffffff);
+    XCTAssertEqual(one[0][20 * 128 + 20], (uint32_t)0xffffffff);
+    for (size_t index = 0; index < 16; index++) {
+        XCTAssertEqual(memcmp(one[index], four[index], 128 * 128 * sizeof(uint32_t)), 0);
+        free(one[index]);
+        free(four[index]);
+    }
+    PaintRasterPoolDestroy(single);
+    PaintRasterPoolDestroy(pool);
+    PaintTileGridFree(&grid);
+    PaintStrokeStoreFree(&store);
+}
+
+- (void)testLatencyPercentilesAreGoodToOneBucket {
+    
+    // 0.1 … 100 ms in steps of 0.1 ms, and a touch from the future which is not counted:
+    PaintLatency *latency = PaintLatencyCreate();
+    for (int n = 1; n <= 1000; n++) {
+        PaintLatencyRecord(latency, PaintLatencyLayered, n * 1e-4);
+    }
+    PaintLatencyRecord(latency, PaintLatencyLayered, -0.001);
+    XCTAssertEqual(PaintLatencyCount(latency, PaintLatencyLayered), (uint64_t)1000);
+    XCTAssertEqual(latency->negative, (uint64_t)1);
+    XCTAssertEqual(PaintLatencyCount(latency, PaintLatencyDelivered), (uint64_t)0);
+    
+    // A bucket is 1/64 of its power of two wide:
+    XCTAssertEqualWithAccuracy(PaintLatencyPercentile(latency, PaintLatencyLayered, 50.0), 0.050, 0.050 / 64);
+    XCTAssertEqualWithAccuracy(PaintLatencyPercentile(latency, PaintLatencyLayered, 99.0), 0.099, 0.099 / 64);
+    XCTAssertEqualWithAccuracy(PaintLatencyPercentile(latency, PaintLatencyLayered, 99.9), 0.0999, 0.0999 / 64);
+    XCTAssertEqualWithAccuracy(PaintLatencyPercentile(latency, PaintLatencyLayered, 100.0), 0.100, 1e-6);
+    XCTAssertEqualWithAccuracy(PaintLatencyMean(latency, PaintLatencyLayered), 0.05005, 1e-6);
+    
+    char *text   = NULL;
+    size_t size  = 0;
+    FILE *file   = open_memstream(&text, &size);
+    XCTAssertEqual(PaintLatencyWrite(latency, file), 0);
+    fclose(file);
+    XCTAssertTrue(strstr(text, "# layered") != NULL);
+    XCTAssertTrue(strstr(text, "Total count    =         1000") != NULL);
+    free(text);
+    
+    PaintLatencyReset(latency);
+    XCTAssertEqual(PaintLatencyCount(latency, PaintLatencyLayered), (uint64_t)0);
+    XCTAssertEqual(PaintLatencyPercentile(latency, PaintLatencyLayered, 50.0), 0.0);
+    PaintLatencyDestroy(latency);
+}
+
+// Counts what the stroke engine reports:
+
+typedef struct PaintTestStrokes {
+    size_t opened, committed, removed, committedPoints;
+} PaintTestStrokes;
+
+static void PaintTestOpened(void *context, const PaintStrokeLine *line) {
+    ((PaintTestStrokes *)context)->opened++;
+}
+
+static void PaintTestCommitted(void *context, const PaintStrokeLine *line) {
+    ((PaintTestStrokes *)context)->committed++;
+    ((PaintTestStrokes *)context)->committedPoints = line->pointCount;
+}
+
+static void PaintTestRemoved(void *context, const PaintStrokeLine *line) {
+    ((PaintTestStrokes *)context)->removed++;
+}
+
+- (void)testTouchLoadEndsEveryGeneratedLine {
+    
+    // 30 pen lines one after the other, at 120 Hz in increments of 4 touches:
+    PaintTouchLoad load = PaintTouchLoadDefault();
+    load.lines          = 30;
+    load.sampleRate     = 120.0;
+    load.lineTouches    = 100;
+    size_t count;
+    PaintTouchRecord *records = PaintTouchLoadGenerate(&load, &count);
+    XCTAssertTrue(records != NULL);
+    
+    PaintTestStrokes strokes       = { 0 };
+    PaintStrokeCallbacks callbacks = { .context = &strokes, .lineOpened = PaintTestOpened,
+                                       .lineCommitted = PaintTestCommitted, .lineRemoved = PaintTestRemoved };
+    PaintStrokeEngine *engine      = PaintStrokeEngineCreate(5, &callbacks);
+    PaintTouchLoadFeed(engine, records, count);
+    PaintStrokeStatistics statistics = PaintStrokeEngineGetStatistics(engine);
+    XCTAssertEqual(statistics.touches + 2 * 30, count);
+    XCTAssertEqual(strokes.opened, (size_t)30);
+    XCTAssertEqual(strokes.committed, (size_t)30);
+    XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)0);
+    PaintStrokeEngineDestroy(engine);
+    free(records);
+    
+    // Palm lines only: the recognizer rejects every one of them:
+    load.palmShare  = 1.0;
+    load.concurrent = 5;
+    records         = PaintTouchLoadGenerate(&load, &count);
+    strokes         = (PaintTestStrokes){ 0 };
+    engine          = PaintStrokeEngineCreate(5, &callbacks);
+    PaintTouchLoadFeed(engine, records, count);
+    XCTAssertEqual(strokes.opened, (size_t)30);
+    XCTAssertEqual(strokes.removed, (size_t)30);
+    XCTAssertEqual(strokes.committed, (size_t)0);
+    PaintStrokeEngineDestroy(engine);
+    free(records);
+}
+
+- (void)testPenModeOnlyLooksAtLinesWithAnotherMode {
+    
+    PaintTestStrokes strokes       = { 0 };
+    PaintStrokeCallbacks callbacks = { .context = &strokes, .lineOpened = PaintTestOpened,
+                                       .lineCommitted = PaintTestCommitted, .lineRemoved = PaintTestRemoved };
+    PaintStrokeEngine *engine      = PaintStrokeEngineCreate(5, &callbacks);
+    PaintStrokeTouch touches[4];
+    for (NSUInteger n = 0; n < 4; n++) {
+        touches[n] = (PaintStrokeTouch){ { { 10.0 * n, 20.0 }, { 1.0, 0.0 }, 0.01 * n }, 1, 2 };
+    }
+    
+    // 40 undecided pen lines. The first one to be confirmed decides all others:
+    for (uint32_t lineID = 1; lineID <= 40; lineID++) {
+        PaintStrokeEngineIncrement(engine, lineID, touches, 4, PaintStrokeFromRecognizer);
+    }
+    PaintStrokeModeChange change = { 1, 10 };
+    PaintStrokeEngineApplyPenModes(engine, &change, 1);
+    XCTAssertEqual(strokes.committed, (size_t)39);
+    XCTAssertEqual(PaintStrokeEngineGetStatistics(engine).modeChecks, (size_t)39);
+    
+    // New lines start with that mode. Confirming them one by one does not look at the others:
+    for (uint32_t lineID = 100; lineID < 140; lineID++) {
+        PaintStrokeEngineIncrement(engine, lineID, touches, 4, PaintStrokeFromRecognizer);
+    }
+    for (uint32_t lineID = 100; lineID < 140; lineID++) {
+        change = (PaintStrokeModeChange){ lineID, 10 };
+        PaintStrokeEngineApplyPenModes(engine, &change, 1);
+    }
+    XCTAssertEqual(PaintStrokeEngineGetStatistics(engine).modeChecks, (size_t)39);
+    XCTAssertEqual(strokes.committed, (size_t)39);
+    XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)41);
+    
+    // Another mode decides them again, in the order they were opened:
+    change = (PaintStrokeModeChange){ 100, 30 };
+    PaintStrokeEngineApplyPenModes(engine, &change, 1);
+    XCTAssertEqual(PaintStrokeEngineGetStatistics(engine).modeChecks, (size_t)79);
+    XCTAssertEqual(strokes.committed, (size_t)79);
+    XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)1);
+    XCTAssertEqual(PaintStrokeEngineLineAtIndex(engine, 0)->lineID, (uint32_t)100);
+    PaintStrokeEngineDestroy(engine);
+}
+
+- (void)testPipelineEndsLinesLikeTheEngine {
+    
+    // Pen and palm lines, four at a time:
+    PaintTouchLoad load = PaintTouchLoadDefault();
+    load.lines          = 40;
+    load.concurrent     = 4;
+    load.palmShare      = 0.25;
+    size_t count;
+    PaintTouchRecord *records = PaintTouchLoadGenerate(&load, &count);
+    XCTAssertTrue(records != NULL);
+    
+    PaintTestStrokes direct        = { 0 };
+    PaintStrokeCallbacks callbacks = { .context = &direct, .lineOpened = PaintTestOpened,
+                                       .lineCommitted = PaintTestCommitted, .lineRemoved = PaintTestRemoved };
+    PaintStrokeEngine *engine      = PaintStrokeEngineCreate(5, &callbacks);
+    PaintTouchLoadFeed(engine, records, count);
+    PaintStrokeEngineDestroy(engine);
+    
+    // The worker gets the same events in the same order, the callbacks come with the drain:
+    PaintTestStrokes piped          = { 0 };
+    callbacks.context               = &piped;
+    PaintStrokePipeline *pipeline   = PaintStrokePipelineCreate(5, &callbacks, NULL, NULL);
+    XCTAssertTrue(pipeline != NULL);
+    PaintTouchLoadFeedPipeline(pipeline, records, count);
+    PaintStrokePipelineFlush(pipeline);
+    XCTAssertTrue(PaintStrokePipelineIdle(pipeline));
+    XCTAssertEqual(piped.opened, direct.opened);
+    XCTAssertEqual(piped.committed, direct.committed);
+    XCTAssertEqual(piped.removed, direct.removed);
+    XCTAssertEqual(piped.committedPoints, direct.committedPoints);
+    XCTAssertEqual(PaintStrokePipelineLineCount(pipeline), (size_t)0);
+    PaintStrokePipelineDestroy(pipeline);
+    free(records);
+}
+
+- (void)testPipelineTakesIncrementsLargerThanItsQueue {
+    
+    // A finger line which ends with an increment of 40000 touches, more than the touch queue holds:
+    const size_t count        = 40000;
+    PaintStrokeTouch *touches = calloc(count + 1, sizeof(PaintStrokeTouch));
+    for (size_t n = 0; n <= count; n++) {
+        touches[n].control = (PaintSplineControl){ { 100.0 + 200.0 * sin(n * 0.001), 100.0 + n * 0.02 }, { 0.0, 0.0 }, n / 240.0 };
+        touches[n].classification = 2;
+        touches[n].state          = n == 0 ? 1 : 3;
+    }
+    
+    PaintTestStrokes direct        = { 0 };
+    PaintStrokeCallbacks callbacks = { .context = &direct, .lineCommitted = PaintTestCommitted };
+    PaintStrokeEngine *engine      = PaintStrokeEngineCreate(5, &callbacks);
+    PaintStrokeEngineIncrement(engine, 1, touches, 1, PaintStrokeFromAnalyzer);
+    PaintStrokeEngineIncrement(engine, 1, touches + 1, count, PaintStrokeFromAnalyzer);
+    PaintStrokeEngineDestroy(engine);
+    
+    // It goes through in pieces, and the line ends with the last one:
+    PaintTestStrokes piped        = { 0 };
+    callbacks.context             = &piped;
+    PaintStrokePipeline *pipeline = PaintStrokePipelineCreate(5, &callbacks, NULL, NULL);
+    PaintStrokePipelineIncrement(pipeline, 1, touches, 1, PaintStrokeFromAnalyzer);
+    PaintStrokePipelineIncrement(pipeline, 1, touches + 1, count, PaintStrokeFromAnalyzer);
+    PaintStrokePipelineFlush(pipeline);
+    XCTAssertEqual(direct.committed, (size_t)1);
+    XCTAssertEqual(piped.committed, (size_t)1);
+    XCTAssertEqual(piped.committedPoints, direct.committedPoints);
+    XCTAssertEqual(PaintStrokePipelineLineCount(pipeline), (size_t)0);
+    PaintStrokePipelineDestroy(pipeline);
+    free(touches);
+}
+
+- (void)testPredictorsFollowTheirMotionModels {
+    
+    // x at constant speed, y at constant acceleration, sampled at 240 Hz:
+    PaintSplineControl controls[40];
+    for (NSUInteger n = 0; n < 40; n++) {
+        double t    = n / 240.0;
+        controls[n] = (PaintSplineControl){ { 100.0 + 300.0 * t, 200.0 + 800.0 * t * t }, { 0.0, 0.0 }, t };
+    }
+    double t = 39 / 240.0 + 0.016;
+    PaintPoint predicted[PaintPredictorKinds];
+    for (int kind = 0; kind < PaintPredictorKinds; kind++) {
+        PaintPredictorConfig config = PaintPredictorConfigDefault(kind, 0.016);
+        PaintPredictor predictor;
+        PaintPredictorInit(&predictor, &config);
+        XCTAssertFalse(PaintPredictorPredict(&predictor, 0.016, &predicted[kind]));
+        for (NSUInteger n = 0; n < 40; n++) {
+            PaintPredictorUpdate(&predictor, &controls[n]);
+        }
+        XCTAssertTrue(PaintPredictorPredict(&predictor, 0.016, &predicted[kind]));
+    }
+    XCTAssertEqualWithAccuracy(predicted[PaintPredictorOff].x, controls[39].point.x, 1e-9);
+    XCTAssertEqualWithAccuracy(predicted[PaintPredictorConstantVelocity].x, 100.0 + 300.0 * t, 1e-3);
+    XCTAssertEqualWithAccuracy(predicted[PaintPredictorConstantAcceleration].x, 100.0 + 300.0 * t, 1e-3);
+    XCTAssertEqualWithAccuracy(predicted[PaintPredictorConstantAcceleration].y, 200.0 + 800.0 * t * t, 1e-3);
+    XCTAssertEqualWithAccuracy(predicted[PaintPredictorKalman].x, 100.0 + 300.0 * t, 0.5);
+    
+    // The engine ends the tail of every increment where the predictor expects the pen:
+    PaintStrokeEngine *engine = PaintStrokeEngineCreate(5, NULL);
+    PaintStrokeEngineSetPredictor(engine, PaintPredictorConfigDefault(PaintPredictorConstantVelocity, 0.016));
+    PaintStrokeTouch touches[40];
+    for (NSUInteger n = 0; n < 40; n++) {
+        touches[n] = (PaintStrokeTouch){ controls[n], 1, 2 };
+    }
+    PaintStrokeEngineIncrement(engine, 1, touches, 20, PaintStrokeFromRecognizer);
+    PaintStrokeEngineIncrement(engine, 1, touches + 20, 20, PaintStrokeFromRecognizer);
+    const PaintStrokeLine *line = PaintStrokeEngineLineAtIndex(engine, 0);
+    XCTAssertTrue(line->tailCount > 1 && line->tailCount <= 6);
+    XCTAssertEqualWithAccuracy(line->tail[line->tailCount - 1].x, predicted[PaintPredictorConstantVelocity].x, 1e-3);
+    PaintStrokeEngineDestroy(engine);
+}
+
+static void PaintTestCommittedEnd(void *context, const PaintStrokeLine *line) {
+    *(PaintPoint *)context = line->tailCount ? line->tail[line->tailCount - 1] : line->points[line->pointCount - 1];
+}
+
+- (void)testCommittedLineEndsAtItsLastTouch {
+    
+    // A finger line at 600 points/s, sampled at 240 Hz. The predictor leads it by 9.6 points:
+    PaintStrokeTouch touches[40];
+    for (NSUInteger n = 0; n < 40; n++) {
+        double t   = n / 240.0;
+        touches[n] = (PaintStrokeTouch){ { { 100.0 + 600.0 * t, 200.0 }, { 600.0, 0.0 }, t }, 2, n == 0 ? 1 : (n == 39 ? 3 : 2) };
+    }
+    PaintPoint last = touches[39].control.point;
+    for (int kind = PaintPredictorConstantVelocity; kind < PaintPredictorKinds; kind++) {
+        PaintPoint end                 = { 0.0, 0.0 };
+        PaintStrokeCallbacks callbacks = { .context = &end, .lineCommitted = PaintTestCommittedEnd };
+        PaintStrokeEngine *engine      = PaintStrokeEngineCreate(5, &callbacks);
+        PaintStrokeEngineSetPredictor(engine, PaintPredictorConfigDefault(kind, 0.016));
+        PaintStrokeEngineIncrement(engine, 1, touches, 1, PaintStrokeFromAnalyzer);
+        PaintStrokeEngineIncrement(engine, 1, touches + 1, 30, PaintStrokeFromAnalyzer);
+        PaintStrokeEngineIncrement(engine, 1, touches + 31, 8, PaintStrokeFromAnalyzer);
+        const PaintStrokeLine *line = PaintStrokeEngineLineAtIndex(engine, 0);
+        XCTAssertGreaterThan(line->tail[line->tailCount - 1].x, touches[38].control.point.x + 5.0);
+        
+        // Lifting the finger commits the line without the lead:
+        PaintStrokeEngineIncrement(engine, 1, touches + 39, 1, PaintStrokeFromAnalyzer);
+        XCTAssertEqualWithAccuracy(end.x, last.x, 1.0);
+        XCTAssertEqualWithAccuracy(end.y, last.y, 1.0);
+        
+        // So does a pen mode found for another line:
+        end = (PaintPoint){ 0.0, 0.0 };
+        for (NSUInteger n = 0; n < 40; n++) {
+            touches[n].classification = 1;
+        }
+        PaintStrokeEngineIncrement(engine, 5, touches, 40, PaintStrokeFromRecognizer);
+        PaintStrokeEngineIncrement(engine, 6, touches, 4, PaintStrokeFromRecognizer);
+        PaintStrokeModeChange change = { 6, 10 };
+        PaintStrokeEngineApplyPenModes(engine, &change, 1);
+        XCTAssertEqualWithAccuracy(end.x, last.x, 1.0);
+        XCTAssertEqualWithAccuracy(end.y, last.y, 1.0);
+        for (NSUInteger n = 0; n < 40; n++) {
+            touches[n].classification = 2;
+        }
+        PaintStrokeEngineDestroy(engine);
+    }
+}
+
+- (void)testStrokeFileReadsBackEveryStrokeOnItsOwn {
+    
+    // Three strokes of a curve sampled at 240 Hz, the middle one without time:
+    PaintStoredPoint points[3][50];
+    double timestamps[3][50];
+    for (NSUInteger line = 0; line < 3; line++) {
+        for (NSUInteger n = 0; n < 50; n++) {
+            points[line][n]     = (PaintStoredPoint){ 100.0f * line + 0.37f * n * n / 10.0f, 500.0f - 3.1f * n };
+            timestamps[line][n] = line + n / 240.0;
+        }
+    }
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"test.pstk"];
+    PaintStrokeWriter *writer = PaintStrokeWriterCreate([path fileSystemRepresentation], PAINT_STROKE_FILE_GRID);
+    XCTAssertTrue(writer != NULL);
+    for (NSUInteger line = 0; line < 3; line++) {
+        PaintStrokeData data = { PaintLineStyleDefault(), points[line], line == 1 ? NULL : timestamps[line], 50, NULL };
+        data.style.color     = (int)line;
+        XCTAssertEqual(PaintStrokeWriterAppend(writer, &data), 0);
+    }
+    XCTAssertLessThan(PaintStrokeWriterBytes(writer), (uint64_t)(3 * 50 * 4));
+    XCTAssertEqual(PaintStrokeWriterClose(writer), 0);
+    
+    PaintStrokeReader *reader = PaintStrokeReaderOpen([path fileSystemRepresentation]);
+    XCTAssertTrue(reader != NULL);
+    XCTAssertEqual(PaintStrokeReaderCount(reader), (size_t)3);
+    PaintStoredPoint readPoints[50];
+    double readTimestamps[50];
+    for (NSUInteger line = 3; line-- > 0; ) {
+        PaintStrokeData data = { .points = readPoints, .timestamps = readTimestamps };
+        XCTAssertEqual(PaintStrokeReaderPointCount(reader, line), (size_t)50);
+        XCTAssertEqual(PaintStrokeReaderRead(reader, line, &data, 50), 50L);
+        XCTAssertEqual(data.style.color, (int)line);
+        XCTAssertEqual(data.timestamps == NULL, line == 1);
+        for (NSUInteger n = 0; n < 50; n++) {
+            XCTAssertEqualWithAccuracy(readPoints[n].x, points[line][n].x, 0.5 / PAINT_STROKE_FILE_GRID);
+            XCTAssertEqualWithAccuracy(readPoints[n].y, points[line][n].y, 0.5 / PAINT_STROKE_FILE_GRID);
+            if (data.timestamps) XCTAssertEqualWithAccuracy(readTimestamps[n], timestamps[line][n], 1e-6);
+        }
+    }
+    
+    // Too little room is an error, not an overrun:
+    PaintStrokeData data = { .points = readPoints, .timestamps = readTimestamps };
+    XCTAssertEqual(PaintStrokeReaderRead(reader, 0, &data, 49), -1L);
+    PaintStrokeReaderClose(reader);
+}
+
+- (void)testStrokeFileFindsStrokesInARectBeforeDecoding {
+    
+    // A row of short strokes, one every 100 points, each 2 points wide:
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"rect.pstk"];
+    PaintStrokeWriter *writer = PaintStrokeWriterCreate([path fileSystemRepresentation], PAINT_STROKE_FILE_GRID);
+    for (NSUInteger n = 0; n < 20; n++) {
+        PaintStoredPoint points[2] = { { 100.0f * n + 10.0f, 50.0f }, { 100.0f * n + 40.0f, 60.0f } };
+        PaintStrokeData data       = { PaintLineStyleDefault(), points, NULL, n == 7 ? 0 : 2, NULL };
+        data.style.width           = 2.0;
+        XCTAssertEqual(PaintStrokeWriterAppend(writer, &data), 0);
+    }
+    XCTAssertEqual(PaintStrokeWriterClose(writer), 0);
+    
+    PaintStrokeReader *reader = PaintStrokeReaderOpen([path fileSystemRepresentation]);
+    XCTAssertTrue(reader != NULL);
+    PaintStrokeBounds bounds = PaintStrokeReaderBounds(reader, 3);
+    XCTAssertEqualWithAccuracy(bounds.minX, 308.0f, 1.0 / PAINT_STROKE_FILE_GRID);
+    XCTAssertEqualWithAccuracy(bounds.maxY,  62.0f, 1.0 / PAINT_STROKE_FILE_GRID);
+    XCTAssertTrue(PaintStrokeBoundsIsEmpty(PaintStrokeReaderBounds(reader, 7)));
+    
+    // The strokes from 250 to 950 points, without the empty one, in the order of the file:
+    uint32_t indices[20];
+    PaintStrokeBounds rect = { 250.0f, 0.0f, 950.0f, 100.0f };
+    XCTAssertEqual(PaintStrokeReaderQuery(reader, rect, NULL, 0), (size_t)6);
+    XCTAssertEqual(PaintStrokeReaderQuery(reader, rect, indices, 20), (size_t)6);
+    uint32_t expected[6] = { 3, 4, 5, 6, 8, 9 };
+    XCTAssertEqual(memcmp(indices, expected, sizeof(expected)), 0);
+    PaintStrokeReaderClose(reader);
+}
+
+- (void)testStrokeEngineCommitsPenLineLikeTheSplineStream {
+    
+    PaintViewData *data       = [[PaintViewData alloc] init];
+    PaintSplines *splines     = [[PaintSplines alloc] initWithData:data];
+    NSArray *touches          = [self touchesForTestLine:40];
+    PaintViewLine *line       = [[PaintViewLine alloc] init];
+    CGPoint expected[[splines maxPointsForIncrement:[touches count]]];
+    NSUInteger length         = [splines splineIncrement:touches ofLine:line toPoints:expected];
+    
+    PaintTestStrokes strokes      = { 0 };
+    PaintStrokeCallbacks callbacks = { .context = &strokes, .lineOpened = PaintTestOpened,
+                                       .lineCommitted = PaintTestCommitted, .lineRemoved = PaintTestRemoved };
+    PaintStrokeEngine *engine = PaintStrokeEngineCreate(data.maxSplinePoints, &callbacks);
+    PaintStrokeEngineSetTolerance(engine, [splines tolerance]);
+    
+    // Feed the pen line in increments of five touches, then confirm and end it:
+    for (NSUInteger n = 0; n < [touches count]; n += 5) {
+        PaintStrokeTouch increment[5];
+        for (NSUInteger i = 0; i < 5; i++) {
+            SID_Touch *touch = touches[n + i];
+            increment[i]     = (PaintStrokeTouch){ { { touch.point.x, touch.point.y },
+                                                     { touch.velocity.x, touch.velocity.y }, touch.timestamp }, 1, 2 };
+        }
+        PaintStrokeEngineIncrement(engine, 7, increment, 5, PaintStrokeFromRecognizer);
+    }
+    XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)1);
+    XCTAssertEqual(PaintStrokeEngineLineAtIndex(engine, 0)->pointCount, (size_t)length);
+    uint32_t slot = PaintStrokeEngineLineAtIndex(engine, 0)->slot;
+    XCTAssertTrue(PaintStrokeEngineLineInSlot(engine, slot) == PaintStrokeEngineLineAtIndex(engine, 0));
+    
+    PaintStrokeModeChange change = { 7, 10 };
+    PaintStrokeEngineApplyPenModes(engine, &change, 1);
+    XCTAssertEqual(PaintStrokeEngineLineAtIndex(engine, 0)->style.color, 1);
+    PaintStrokeEngineEndLines(engine, &change, 1);
+    
+    XCTAssertEqual(strokes.opened, (size_t)1);
+    XCTAssertEqual(strokes.committed, (size_t)1);
+    XCTAssertEqual(strokes.removed, (size_t)0);
+    XCTAssertEqual(strokes.committedPoints, (size_t)length);
+    XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)0);
+    XCTAssertTrue(PaintStrokeEngineLineInSlot(engine, slot) == NULL);
+    PaintStrokeEngineDestroy(engine);
+}
+
+- (void)testStrokeOutlineGrowsIntoTheOutlineOfTheWholeLine {
+    
+    // A wave which gets thin where it is steep, like a quick pen:
+    PaintPoint points[200];
+    PaintFloat radii[200];
+    PaintStrokeWidthRange range = PaintStrokeWidthRangeDefault(0.5, 2.0);
+    for (NSUInteger n = 0; n < 200; n++) {
+        points[n] = (PaintPoint){ 100.0 + 2.0 * n, 300.0 + 40.0 * sin(n / 10.0) };
+        radii[n]  = 2.0 * PaintStrokeWidthForSpeed(&range, 240.0 * hypot(2.0, 4.0 * cos(n / 10.0)));
+    }
+    XCTAssertEqual(PaintStrokeWidthForSpeed(&range, 10.0), 2.0);
+    XCTAssertEqual(PaintStrokeWidthForSpeed(&range, 2000.0), 0.5);
+    
+    PaintStrokeOutline whole, grown;
+    PaintStrokeOutlineInit(&whole, 0.1);
+    PaintStrokeOutlineInit(&grown, 0.1);
+    size_t wholeCount, grownCount;
+    const PaintPoint *ring = PaintStrokeOutlineOfPoints(&whole, points, radii, 200, 0, &wholeCount);
+    XCTAssertTrue(ring != NULL);
+    
+    // In increments of seven points, closed over the next ones as a tail every time:
+    const PaintPoint *closed = NULL;
+    for (NSUInteger first = 0; first < 200; first += 7) {
+        size_t count = MIN(7, 200 - first);
+        XCTAssertEqual(PaintStrokeOutlineAppend(&grown, points + first, radii + first, count), 0);
+        size_t tail  = MIN(5, 200 - first - count);
+        closed       = PaintStrokeOutlineClose(&grown, points + first + count, radii + first + count, tail, 0, &grownCount);
+        XCTAssertTrue(closed != NULL);
+    }
+    XCTAssertEqual(grownCount, wholeCount);
+    XCTAssertEqual(memcmp(closed, ring, wholeCount * sizeof(PaintPoint)), 0);
+    
+    // No point of the ring is outside the line by more than the tolerance:
+    for (size_t k = 0; k < wholeCount; k++) {
+        double edge = INFINITY;
+        for (NSUInteger n = 0; n < 200; n++) {
+            edge = MIN(edge, hypot(ring[k].x - points[n].x, ring[k].y - points[n].y) - radii[n]);
+        }
+        XCTAssertLessThan(edge, 0.1);
+    }
+    
+    // A single point is a dot, or nothing with butt caps:
+    XCTAssertTrue(PaintStrokeOutlineOfPoints(&grown, points, radii, 1, 0, &grownCount) != NULL);
+    XCTAssertTrue(PaintStrokeOutlineOfPoints(&grown, points, radii, 1, 1, &grownCount) == NULL);
+    PaintStrokeOutlineFree(&whole);
+    PaintStrokeOutlineFree(&grown);
+}
+
+- (void)testTileStorePacksIdleTilesAndEvictsThemFirst {
+    
+    PaintTileGrid grid;
+    PaintTileStore store;
+    XCTAssertEqual(PaintTileGridInit(&grid, 512.0, 256.0, 128.0, 1.0), 0);
+    XCTAssertEqual(PaintTileStoreInit(&store, &grid, 0), 0);
+    size_t count     = 128 * 128;
+    size_t tileBytes = count * sizeof(uint32_t);
+    XCTAssertEqual(PaintTileStoreCount(&store, PaintTileBlank), (size_t)8);
+    
+    // A line through tile 1, tile 2 painted into later, tile 3 painted and cleared:
+    uint32_t *pixels = PaintTileStoreWrite(&store, 1, 1.0);
+    XCTAssertEqual(pixels[0], (uint32_t)PAINT_TILE_WHITE);
+    for (size_t n = 0; n < 128; n++) {
+        pixels[n * 129] = 0xff000000u + (uint32_t)n;
+    }
+    PaintTileStoreWrite(&store, 2, 5.0)[7] = 0xff102030u;
+    PaintTileStoreWrite(&store, 3, 1.0);
+    PaintTileStoreClear(&store, 3);
+    XCTAssertEqual(store.liveBytes, (size_t)(2 * tileBytes));
+    
+    // Only tile 1 is idle at 6; its pixels are packed once more than the line takes:
+    size_t idle[8];
+    XCTAssertEqual(PaintTileStoreIdle(&store, 6.0, 2.0, idle, 8), (size_t)1);
+    XCTAssertEqual(idle[0], (size_t)1);
+    uint32_t generation;
+    const uint32_t *live = PaintTileStoreBeginPacking(&store, 1, &generation);
+    uint8_t *packed      = malloc(PaintTilePackedMaxBytes(count));
+    size_t bytes         = PaintTilePack(live, count, packed);
+    XCTAssertGreaterThan(bytes, (size_t)(128 * sizeof(uint32_t)));
+    XCTAssertLessThan(bytes, tileBytes / 20);
+    uint32_t *unpacked = malloc(tileBytes);
+    XCTAssertEqual(PaintTileUnpack(packed, bytes, unpacked, count), 0);
+    XCTAssertEqual(memcmp(unpacked, live, tileBytes), 0);
+    XCTAssertEqual(PaintTileUnpack(packed, bytes - 1, unpacked, count), -1);
+    PaintTileStoreFinishPacking(&store, 1, generation, live, packed, bytes);
+    XCTAssertEqual(PaintTileStoreState(&store, 1), PaintTilePacked);
+    XCTAssertEqual(store.liveBytes, tileBytes);
+    XCTAssertEqual(PaintTileStoreRead(&store, 1, unpacked), 0);
+    XCTAssertEqual(unpacked[129], (uint32_t)0xff000001u);
+    
+    // Painting into a tile while it is packing makes the packed pixels worthless:
+    live   = PaintTileStoreBeginPacking(&store, 2, &generation);
+    packed = malloc(PaintTilePackedMaxBytes(count));
+    bytes  = PaintTilePack(live, count, packed);
+    PaintTileStoreWrite(&store, 2, 7.0)[8] = 0xff102030u;
+    PaintTileStoreFinishPacking(&store, 2, generation, live, packed, bytes);
+    XCTAssertEqual(PaintTileStoreState(&store, 2), PaintTileLive);
+    XCTAssertEqual(PaintTileStorePixels(&store, 2)[7], (uint32_t)0xff102030u);
+    
+    // Over the budget the packed tile goes first, then the live one:
+    XCTAssertEqual(PaintTileStoreTrim(&store, tileBytes), (size_t)1);
+    XCTAssertEqual(PaintTileStoreState(&store, 1), PaintTileEvicted);
+    XCTAssertEqual(PaintTileStoreRead(&store, 1, unpacked), -1);
+    XCTAssertEqual(PaintTileStoreTrim(&store, 0), (size_t)1);
+    XCTAssertEqual(PaintTileStoreCount(&store, PaintTileEvicted), (size_t)2);
+    XCTAssertEqual(store.liveBytes + store.packedBytes, (size_t)0);
+    
+    // An evicted tile comes back white, to be painted again:
+    XCTAssertEqual(PaintTileStoreWrite(&store, 1, 8.0)[129], (uint32_t)PAINT_TILE_WHITE);
+    free(unpacked);
+    PaintTileStoreFree(&store);
+    PaintTileGridFree(&grid);
+}
+
+- (void)testTimelineSeekPaintsTheStrokesOnTheCanvasThen {
+    
+    // Strokes a second apart on a 256 x 256 pt canvas with a keyframe every 4 s, every fifth
+    // erased with the one before it, then everything cleared at 30 s:
+    PaintStrokeTimeline timeline;
+    XCTAssertEqual(PaintStrokeTimelineInit(&timeline, 256.0, 256.0, 64.0, 1.0, 4.0), 0);
+    PaintStoredPoint points[8];
+    for (size_t n = 0; n < 40; n++) {
+        for (size_t k = 0; k < 8; k++) {
+            points[k] = (PaintStoredPoint){ 20.0f + 25.0f * k, 10.0f + 6.0f * n + 4.0f * (k % 2) };
+        }
+        PaintLineStyle style = PaintLineStyleDefault();
+        style.width = n % 3 ? 6.0 : 20.0;
+        style.alpha = n % 3 ? 1.0 : 0.33;
+        XCTAssertEqual(PaintStrokeTimelineAdd(&timeline, points, NULL, 8, style, n + 0.2, n + 0.8), (long)n);
+        if (n % 5 == 4) {
+            uint32_t erased[2] = { (uint32_t)n - 1, (uint32_t)n };
+            XCTAssertEqual(PaintStrokeTimelineErase(&timeline, erased, 2, n + 0.9), 0);
+        }
+        if (n == 29) {
+            XCTAssertEqual(PaintStrokeTimelineClear(&timeline, n + 0.95), 0);
+        }
+    }
+    XCTAssertEqual(PaintStrokeTimelineCommitted(&timeline, 10.5), (size_t)10);
+    XCTAssertFalse(PaintStrokeTimelineVisible(&timeline, 8, 10.5));
+    XCTAssertTrue(PaintStrokeTimelineVisible(&timeline, 7, 10.5));
+    XCTAssertFalse(PaintStrokeTimelineVisible(&timeline, 7, 30.0));
+    
+    // Seeking back and forth gives the pixels of the strokes on the canvas then, painted on
+    // their own:
+    PaintRasterPool *pool = PaintRasterPoolCreate(2);
+    uint32_t *seek[16], *repaint[16];
+    for (size_t index = 0; index < 16; index++) {
+        seek[index]    = malloc(64 * 64 * sizeof(uint32_t));
+        repaint[index] = malloc(64 * 64 * sizeof(uint32_t));
+    }
+    double times[] = { 39.0, 0.5, 10.5, 14.85, 14.95, 29.92, 29.97, 33.0, 22.0, 3.9 };
+    for (size_t t = 0; t < sizeof(times) / sizeof(times[0]); t++) {
+        PaintStrokeStore visible;
+        PaintStrokeStoreInit(&visible);
+        for (size_t index = 0; index < PaintStrokeTimelineCommitted(&timeline, times[t]); index++) {
+            if (!PaintStrokeTimelineVisible(&timeline, index, times[t])) continue;
+            
+            const PaintStoredStroke *stroke = PaintStrokeStoreStroke(&timeline.store, index);
+            PaintStrokeStoreAppend(&visible, PaintStrokeStorePoints(&timeline.store, stroke), stroke->pointCount,
+                                   PaintStrokeStoreStyle(stroke));
+        }
+        XCTAssertEqual(PaintStrokeTimelineSeek(&timeline, pool, times[t], seek), 0);
+        XCTAssertEqual(PaintRasterizeStrokes(pool, &visible, &timeline.grid, repaint), 0);
+        for (size_t index = 0; index < 16; index++) {
+            XCTAssertEqual(memcmp(seek[index], repaint[index], 64 * 64 * sizeof(uint32_t)), 0, @"at %g s", times[t]);
+        }
+        PaintStrokeStoreFree(&visible);
+    }
+    
+    // Keyframes were made up to the last one before the newest event, and share the tiles
+    // nothing happened to:
+    XCTAssertEqual(timeline.keyframeCount, (size_t)10);
+    XCTAssertLessThan(timeline.keyframeBytes, (size_t)(9 * 16 * 64 * 64 * sizeof(uint32_t) / 10));
+    for (size_t index = 0; index < 16; index++) {
+        free(seek[index]);
+        free(repaint[index]);
+    }
+    PaintRasterPoolDestroy(pool);
+    PaintStrokeTimelineFree(&timeline);
+}
+
+static void PaintTestCommitToView(void *context, const PaintStrokeLine *const *lines, size_t count) {
+    [(__bridge PaintView *)context commitLines:lines count:count];
+}
+
+- (void)testPipelineRecordsWhenEachStrokeWasDrawn {
+    
+    // Five pen lines of 100 touches at 120 Hz, one after the other, through the worker into a view:
+    PaintTouchLoad load    = PaintTouchLoadDefault();
+    load.lines             = 5;
+    load.sampleRate        = 120.0;
+    load.lineTouches       = 100;
+    load.extrapolatedShare = 0.0;
+    size_t count;
+    PaintTouchRecord *records = PaintTouchLoadGenerate(&load, &count);
+    XCTAssertTrue(records != NULL);
+    PaintView *view = [[PaintView alloc] initWithFrame:CGRectMake(0.0, 0.0, 1024.0, 768.0)
+                                               andData:[[PaintViewData alloc] init]];
+    PaintStrokeCallbacks callbacks = { .context = (__bridge void *)view, .linesCommitted = PaintTestCommitToView };
+    PaintStrokePipeline *pipeline  = PaintStrokePipelineCreate(5, &callbacks, NULL, NULL);
+    XCTAssertTrue(pipeline != NULL);
+    PaintTouchLoadFeedPipeline(pipeline, records, count);
+    PaintStrokePipelineFlush(pipeline);
+    
+    // Each stroke lasts from the first touch of its line to the last one:
+    double first[5], last[5];
+    uint32_t lineIDs[5];
+    size_t lines = 0;
+    for (size_t n = 0; n < count; n++) {
+        if ((records[n].kind & PaintTouchRecordKindMask) != PaintTouchRecordTouch) continue;
+        
+        size_t line = 0;
+        while (line < lines && lineIDs[line] != records[n].lineID) line++;
+        if (line == lines) {
+            lineIDs[lines] = records[n].lineID;
+            first[lines++] = records[n].timestamp;
+        }
+        last[line] = records[n].timestamp;
+    }
+    const PaintStrokeTimeline *timeline = [view strokeTimeline];
+    XCTAssertEqual(lines, (size_t)5);
+    XCTAssertEqual(timeline->store.count, (size_t)5);
+    for (size_t stroke = 0; stroke < timeline->store.count; stroke++) {
+        XCTAssertEqualWithAccuracy(timeline->times[stroke].start, first[stroke], 1e-9);
+        XCTAssertEqualWithAccuracy(timeline->times[stroke].end, last[stroke], 1e-9);
+        XCTAssertGreaterThan(timeline->times[stroke].end - timeline->times[stroke].start, 0.8);
+    }
+    XCTAssertEqualWithAccuracy(timeline->origin, first[0], 1e-9);
+    PaintStrokePipelineDestroy(pipeline);
+    free(records);
+}
+
+#pragma mark - Performance
+
+// The performance tests run on Handwriting.ptrc, the same recording paintbench suite measures
+// on the Mac and on Linux; Xcode keeps their baselines.
+
+- (NSData *)handwritingRecords {
+    
+    NSString *path = [[NSBundle bundleForClass:[self class]] pathForResource:@"Handwriting" ofType:@"ptrc"];
+    FILE *file     = path ? PaintTouchRecordOpen([path fileSystemRepresentation]) : NULL;
+    XCTAssertTrue(file != NULL);
+    NSMutableData *records = [[NSMutableData alloc] init];
+    PaintTouchRecord buffer[256];
+    for (size_t read; file && (read = PaintTouchRecordRead(file, buffer, 256)) > 0; ) {
+        [records appendBytes:buffer length:read * sizeof(PaintTouchRecord)];
+    }
+    if (file) {
+        fclose(file);
+    }
+    return records;
+}
+
+// The recording through the stroke engine as the app runs it: increments into the spline
+// streams of the lines, pen modes and line ends, like paintbench suite:
+
+- (void)testPerformanceStrokeEngineIncrements {
+    
+    PaintViewData *data = [[PaintViewData alloc] init];
+    NSData *records     = [self handwritingRecords];
+    [self measureBlock:^{
+        PaintStrokeEngine *engine = PaintStrokeEngineCreate(data.maxSplinePoints, NULL);
+        PaintStrokeEngineSetTolerance(engine, 0.25);
+        PaintTouchLoadFeed(engine, [records bytes], [records length] / sizeof(PaintTouchRecord));
+        XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)0);
+        XCTAssertTrue(PaintStrokeEngineGetStatistics(engine).points > 0);
+        PaintStrokeEngineDestroy(engine);
+    }];
+}
+
+- (void)testPerformanceStrokeLayerExtendsLongLine {
+    
+    // 20000 points, about a minute of writing without lifting the pen:
+    NSUInteger total = 20000;
+    CGPoint *points  = malloc(total * sizeof(CGPoint));
+    for (NSUInteger n = 0; n < total; n++) {
+        points[n] = CGPointMake(100.0 + 0.05 * n + 20.0 * cos(0.3 * n), 300.0 + 40.0 * sin(0.2 * n));
+    }
+    [self measureBlock:^{
+        CGPoint tail[2]         = { CGPointMake(-1.0, -1.0), CGPointMake(-2.0, -2.0) };
+        PaintStrokeLayer *layer = [PaintStrokeLayer layer];
+        for (NSUInteger n = 0; n < total; n += 4) {
+            [layer appendPoints:points + n count:MIN(4, total - n) withTail:tail count:2];
+        }
+        XCTAssertEqual(layer.pointCount, total);
+    }];
+    free(points);
+}
+
+- (void)testPerformanceCommitLinesIntoBitmap {
+    
+    PaintViewData *data = [[PaintViewData alloc] init];
+    PaintView *view     = [[PaintView alloc] initWithFrame:CGRectMake(0.0, 0.0, 1024.0, 768.0) andData:data];
+    NSData *records     = [self handwritingRecords];
+    PaintStrokeCallbacks callbacks = { .context = (__bridge void *)view, .linesCommitted = PaintTestCommitToView };
     [self measureBlock:^{
-        // Put the code you want to measure the time of here.
+        [view clearScreen];
+        PaintStrokeEngine *engine = PaintStrokeEngineCreate(data.maxSplinePoints, &callbacks);
+        PaintTouchLoadFeed(engine, [records bytes], [records length] / sizeof(PaintTouchRecord));
+        XCTAssertEqual(PaintStrokeEngineLineCount(engine), (size_t)0);
+        PaintStrokeEngineDestroy(engine);
+        
+        // The lines are painted on the commit queue of the view, wait for them:
+        [view finishCommits];
     }];
+    XCTAssertTrue([view strokeStore]->count > 0);
 }
 
 @end